@@ -0,0 +1,108 @@
+"""Splits command round trips into stages using device timestamps.
+
+Every `CommandResponse` carries device (trace clock) timestamps, which divide
+a round trip into:
+  - queue: command received by the UART ISR until taken off the command
+    queue. Includes decoding and the wait behind earlier commands.
+  - handler: command handler until the response is queued.
+  - response: response queued until handed to the UART, i.e. the wait
+    behind other outgoing traffic.
+  - link: the rest of the end-to-end time, i.e. both UART transfers and
+    host-side overhead. Host and device clocks are not synchronized, so the
+    two directions cannot be told apart.
+"""
+
+from collections import deque
+from dataclasses import astuple, dataclass, fields
+
+STAGES = ("end_to_end", "link", "queue", "handler", "response")
+
+
+@dataclass
+class CommandLatency:
+    # All in seconds. Field order matches `STAGES`.
+    end_to_end: float
+    link: float
+    queue: float
+    handler: float
+    response: float
+
+
+def _elapsed(start: int, end: int, clock_hz: int) -> float:
+    # The trace clock is a wrapping 32-bit counter.
+    return ((end - start) & 0xFFFFFFFF) / clock_hz
+
+
+def from_response(
+    end_to_end: float,
+    received_at: int,
+    dispatched_at: int,
+    completed_at: int,
+    sent_at: int,
+    clock_hz: int,
+) -> CommandLatency | None:
+    """Returns the stages of one round trip, or None without a device clock.
+
+    Args:
+        end_to_end: Time (s) from sending the command to receiving the
+            response, measured on the host.
+        received_at, dispatched_at, completed_at, sent_at, clock_hz: Fields of
+            the `CommandResponse`.
+    """
+    if clock_hz == 0:
+        return None
+
+    queue = _elapsed(received_at, dispatched_at, clock_hz)
+    handler = _elapsed(dispatched_at, completed_at, clock_hz)
+    response = _elapsed(completed_at, sent_at, clock_hz)
+    return CommandLatency(
+        end_to_end=end_to_end,
+        link=max(0.0, end_to_end - (queue + handler + response)),
+        queue=queue,
+        handler=handler,
+        response=response,
+    )
+
+
+def percentile(values: list[float], p: float) -> float:
+    """Nearest-rank percentile of already sorted `values`."""
+    if not values:
+        raise ValueError("No values")
+
+    rank = max(1, -(-len(values) * p // 100))  # ceil(n * p / 100)
+    return values[int(rank) - 1]
+
+
+class LatencyStats:
+    """Aggregates the most recent round trips."""
+
+    samples: deque[CommandLatency]
+
+    def __init__(self, max_samples: int = 1000):
+        self.samples = deque(maxlen=max_samples)
+
+    def add(self, latency: CommandLatency) -> None:
+        self.samples.append(latency)
+
+    def clear(self) -> None:
+        self.samples.clear()
+
+    def summary(
+        self,
+        percentiles: tuple[float, ...] = (50, 90, 99),
+    ) -> list[tuple]:
+        """Returns (stage, p..., max) rows in milliseconds."""
+        if not self.samples:
+            return []
+
+        columns = zip(*(astuple(sample) for sample in self.samples))
+        rows = []
+        for field, values in zip(fields(CommandLatency), columns):
+            values = sorted(values)
+            rows.append((
+                field.name,
+                *(percentile(values, p) * 1e3 for p in percentiles),
+                values[-1] * 1e3,
+            ))
+
+        return rows
@@ -0,0 +1,164 @@
+"""Measures command latency while the device floods the log stream.
+
+Sends pings one at a time, first on an idle link and then while the device
+emits a flood of INFO logs, and reports per-stage latency percentiles (see
+`deloop_mk0.latency`) for both runs.
+
+Also times applying a scene of parameter values as one command per value
+and as a single batch.
+
+Example usage:
+```sh
+python -m deloop_mk0.load_test --commands 200 --flood 5000
+```
+"""
+
+import argparse
+import statistics
+import threading
+import time
+
+from deloop_mk0.uart_stream import Mk0Stream, add_uart_args, open_uart_stream
+from tabulate import tabulate
+
+HEADERS = ["Stage", "p50", "p90", "p99", "Max"]
+
+
+def run_pings(stream: Mk0Stream, count: int, timeout: float) -> int:
+    """Sends `count` pings, each after the previous response.
+
+    Returns:
+        The number of pings that timed out.
+    """
+    timeouts = 0
+    for _ in range(count):
+        done = threading.Event()
+        stream.ping(lambda resp: done.set())
+        if not done.wait(timeout):
+            timeouts += 1
+
+    return timeouts
+
+
+def run_scene(
+    stream: Mk0Stream,
+    scene: list[tuple[str, float]],
+    batched: bool,
+    timeout: float,
+) -> float | None:
+    """Applies every value in `scene`.
+
+    Without batching, each value waits for the previous response, since the
+    device only queues a few commands.
+
+    Returns:
+        The time (s) until the last response, or None on timeout.
+    """
+    start = time.perf_counter()
+    commands = [scene] if batched else [[value] for value in scene]
+    for values in commands:
+        done = threading.Event()
+        stream.set_params(values, lambda resp: done.set())
+        if not done.wait(timeout):
+            return None
+
+    return time.perf_counter() - start
+
+
+def report_scenes(stream: Mk0Stream, args: argparse.Namespace) -> None:
+    # Repeated values of one parameter load the command path just like
+    # distinct parameters would.
+    scene = [(args.scene_param, (i % 2) * 0.5 + 0.25)
+             for i in range(args.scene_size)]
+
+    rows = []
+    for title, batched in (("Individual", False), ("Batched", True)):
+        times = []
+        for _ in range(args.scenes):
+            elapsed = run_scene(stream, scene, batched, args.timeout)
+            if elapsed is not None:
+                times.append(elapsed * 1e3)
+
+        if times:
+            rows.append((title, statistics.median(times), max(times),
+                         args.scenes - len(times)))
+        else:
+            rows.append((title, None, None, args.scenes))
+
+    print(f"\nScene of {args.scene_size} values ({args.scenes} runs)")
+    print(tabulate(rows, headers=["Mode", "Median (ms)", "Max (ms)",
+                                  "Timeouts"], floatfmt=".2f"))
+
+
+def report(title: str, stream: Mk0Stream, timeouts: int) -> None:
+    print(f"\n{title} ({len(stream.latency.samples)} commands, "
+          f"{timeouts} timed out)")
+    print(tabulate(stream.latency.summary(), headers=HEADERS, floatfmt=".2f"))
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    add_uart_args(parser)
+    parser.add_argument(
+        "--commands",
+        type=int,
+        default=200,
+        help="Pings sent per run.",
+    )
+    parser.add_argument(
+        "--flood",
+        type=int,
+        default=5000,
+        help="Logs emitted by the device during the loaded run.",
+    )
+    parser.add_argument(
+        "--flood_interval_ms",
+        type=int,
+        default=1,
+        help="Time between flooded logs on the device.",
+    )
+    parser.add_argument(
+        "--scenes",
+        type=int,
+        default=20,
+        help="Scenes applied per mode (0 skips the scene benchmark).",
+    )
+    parser.add_argument(
+        "--scene_size",
+        type=int,
+        default=20,
+        help=f"Values per scene (at most {Mk0Stream.MAX_PARAM_UPDATES}).",
+    )
+    parser.add_argument(
+        "--scene_param",
+        type=str,
+        default="sine.level",
+        help="Parameter set by the scene benchmark.",
+    )
+    parser.add_argument(
+        "--timeout",
+        type=float,
+        default=1.0,
+        help="Time (s) to wait for each response.",
+    )
+    args = parser.parse_args()
+
+    with open_uart_stream(args) as stream:
+        stream.configure_logging(min_level="INFO")
+
+        stream.latency.clear()
+        timeouts = run_pings(stream, args.commands, args.timeout)
+        report("Idle", stream, timeouts)
+
+        stream.latency.clear()
+        stream.flood_logs(args.flood, args.flood_interval_ms)
+        timeouts = run_pings(stream, args.commands, args.timeout)
+        stream.flood_logs(0)
+        report("Log flood", stream, timeouts)
+
+        if args.scenes > 0:
+            report_scenes(stream, args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,113 @@
+"""Decodes compact log batches sent by Mk0 devices.
+
+NOTE: This must match `src/log_encoding.hpp`.
+"""
+
+import struct
+from dataclasses import dataclass, field
+
+# Matches `deloop::LogLevel`.
+LOG_LEVELS = ("INFO", "WARNING", "ERROR")
+
+ARG_U32 = 1
+ARG_I32 = 2
+ARG_F32 = 3
+
+
+@dataclass
+class LogBatchRecord:
+    level: str
+    site_id: int
+    timestamp: int
+    args: list[int | float] = field(default_factory=list)
+    suppressed: int = 0
+
+
+def site_id(hash: int) -> int:
+    """Folds a 64-bit format string hash into a 32-bit log site ID."""
+    return (hash ^ (hash >> 32)) & 0xFFFFFFFF
+
+
+def _read_varint(data: bytes, pos: int) -> tuple[int, int]:
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(data):
+            raise ValueError("Truncated varint")
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if byte & 0x80 == 0:
+            return value, pos
+
+
+def _unzigzag(value: int) -> int:
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode_log_batch(data: bytes) -> list[LogBatchRecord]:
+    """Decodes every record in a log batch.
+
+    Raises:
+        ValueError: If the batch is truncated or malformed.
+    """
+    records = []
+    if len(data) == 0:
+        return records
+
+    timestamp, pos = _read_varint(data, 0)
+    while pos < len(data):
+        header = data[pos]
+        pos += 1
+        level_index = header & 0x03
+        num_args = (header >> 2) & 0x07
+        has_suppressed = (header >> 5) & 0x01
+        if level_index >= len(LOG_LEVELS) or num_args > 4:
+            raise ValueError(f"Invalid record header: {header:#04x}")
+
+        if pos + 4 > len(data):
+            raise ValueError("Truncated site ID")
+        (record_site_id,) = struct.unpack_from("<I", data, pos)
+        pos += 4
+
+        delta, pos = _read_varint(data, pos)
+        timestamp = (timestamp + _unzigzag(delta)) & 0xFFFFFFFF
+
+        arg_types = 0
+        if num_args > 0:
+            if pos >= len(data):
+                raise ValueError("Truncated arg types")
+            arg_types = data[pos]
+            pos += 1
+
+        args = []
+        for i in range(num_args):
+            arg_type = (arg_types >> (2 * i)) & 0x03
+            if arg_type == ARG_U32:
+                value, pos = _read_varint(data, pos)
+            elif arg_type == ARG_I32:
+                value, pos = _read_varint(data, pos)
+                value = _unzigzag(value)
+            elif arg_type == ARG_F32:
+                if pos + 4 > len(data):
+                    raise ValueError("Truncated float arg")
+                (value,) = struct.unpack_from("<f", data, pos)
+                pos += 4
+            else:
+                raise ValueError(f"Invalid arg type: {arg_type}")
+            args.append(value)
+
+        suppressed = 0
+        if has_suppressed:
+            suppressed, pos = _read_varint(data, pos)
+
+        records.append(LogBatchRecord(
+            level=LOG_LEVELS[level_index],
+            site_id=record_site_id,
+            timestamp=timestamp,
+            args=args,
+            suppressed=suppressed,
+        ))
+
+    return records
@@ -0,0 +1,110 @@
+"""Tracks device metrics reported by telemetry snapshots.
+
+Metric names, types and histogram units come from the log table (entries with
+`"kind": "metric"`), so only IDs and values are sent by the device.
+
+NOTE: Must match `src/metrics.hpp`.
+"""
+
+from dataclasses import dataclass, field
+
+from deloop_mk0.log_encoding import site_id
+
+COUNTER = "counter"
+GAUGE = "gauge"
+HISTOGRAM = "histogram"
+
+# Matches `deloop::Histogram::kNumBuckets`.
+NUM_HISTOGRAM_BUCKETS = 8
+
+
+def bucket_labels(unit_shift: int) -> list[str]:
+    """Returns the range of each histogram bucket, e.g. "[16, 32)"."""
+    unit = 1 << unit_shift
+    labels = [f"[0, {unit})"]
+    for i in range(1, NUM_HISTOGRAM_BUCKETS - 1):
+        labels.append(f"[{unit << (i - 1)}, {unit << i})")
+    labels.append(f"[{unit << (NUM_HISTOGRAM_BUCKETS - 2)}, inf)")
+    return labels
+
+
+@dataclass
+class Metric:
+    name: str
+    type: str
+    unit_shift: int = 0
+    value: int = 0
+    buckets: list[int] = field(
+        default_factory=lambda: [0] * NUM_HISTOGRAM_BUCKETS)
+    tick: int = 0  # Device time (ms) of the latest update.
+
+    def format(self) -> str:
+        if self.type == GAUGE and self.name.endswith("_cb"):
+            return f"{self.value / 10:.1f} dB"
+        if self.type != HISTOGRAM:
+            return str(self.value)
+
+        return ", ".join(
+            f"{label}: {count}"
+            for label, count in zip(bucket_labels(self.unit_shift),
+                                    self.buckets)
+            if count > 0
+        )
+
+
+class MetricStore:
+    """Latest value of every metric seen in snapshots."""
+
+    metrics: dict[int, Metric]
+    sites: dict[int, dict]
+
+    def __init__(self, log_table: dict[str, dict] | None = None):
+        self.metrics = {}
+        self.load_log_table(log_table or {})
+
+    def load_log_table(self, log_table: dict[str, dict]) -> None:
+        self.sites = {
+            site_id(int(hash)): entry
+            for hash, entry in log_table.items()
+            if entry.get("kind") == "metric"
+        }
+
+    def update(
+        self,
+        id: int,
+        type: str,
+        value: int,
+        bucket: int = 0,
+        tick: int = 0,
+    ) -> Metric:
+        """Applies one value from a snapshot.
+
+        Raises:
+            ValueError: If the histogram bucket is out of range.
+        """
+        metric = self.metrics.get(id)
+        if metric is None:
+            site = self.sites.get(id, {})
+            metric = Metric(
+                name=site.get("msg", f"unknown_{id:08x}"),
+                type=type,
+                unit_shift=site.get("unit_shift", 0),
+            )
+            self.metrics[id] = metric
+
+        if type == HISTOGRAM:
+            if not 0 <= bucket < NUM_HISTOGRAM_BUCKETS:
+                raise ValueError(f"Bad histogram bucket: {bucket}")
+            metric.buckets[bucket] = value
+        else:
+            metric.value = value
+
+        metric.tick = tick
+        return metric
+
+    def rows(self) -> list[tuple[str, str, str]]:
+        """Returns (name, type, value) for every metric, sorted by name."""
+        return sorted(
+            (metric.name, metric.type, metric.format())
+            for metric in self.metrics.values()
+        )
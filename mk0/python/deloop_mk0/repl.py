@@ -9,8 +9,9 @@ from queue import Queue
 
 import cmd2
 import pyinotify
-from deloop_mk0.uart_stream import (LOG_TABLE_FILE, Mk0Stream, add_uart_args,
-                                    open_uart_stream)
+from tabulate import tabulate
+from deloop_mk0.uart_stream import (LOG_TABLE_FILE, SAMPLE_RATE, Mk0Stream,
+                                    add_uart_args, open_uart_stream)
 from deloop_mk0.utils import ColoredFormatter
 
 logger = logging.getLogger()  # Root logger
@@ -119,6 +120,188 @@ class Mk0Cmd(cmd2.Cmd):
         except ValueError:
             print("Error: Volume must be a number between 0.0 and 1.0")
 
+    def do_set_log_level(self, arg) -> None:
+        """
+        Set the lowest log level reported by the device.
+
+        Usage: set_log_level WARNING  # One of INFO, WARNING, ERROR
+        """
+        level = arg.strip().upper()
+        if level not in ("INFO", "WARNING", "ERROR"):
+            print("Error: Level must be one of INFO, WARNING, ERROR")
+            return
+
+        self._stream.configure_logging(min_level=level)
+
+    def do_set_log_modules(self, arg) -> None:
+        """
+        Set which device modules report logs.
+
+        Usage: set_log_modules 0x1f  # Bit N enables module N
+        """
+        try:
+            self._stream.configure_logging(module_mask=int(arg, 0))
+
+        except ValueError:
+            print("Error: Mask must be an integer (e.g. 0x1f)")
+
+    def do_start_trace(self, arg) -> None:
+        """
+        Start capturing trace events from the device.
+
+        Usage: start_trace capture.bin
+
+        Convert the capture with:
+            python -m deloop_mk0.trace capture.bin --output trace.json
+        """
+        path = arg.strip()
+        if not path:
+            print("Error: A capture file is required")
+            return
+
+        self._stream.start_trace_capture(path)
+
+    def do_stop_trace(self, _) -> None:
+        """Stop capturing trace events from the device."""
+
+        self._stream.stop_trace_capture()
+
+    def do_metrics(self, _) -> None:
+        """Show the latest device metrics."""
+
+        print(tabulate(self._stream.metrics.rows(),
+                       headers=["Metric", "Type", "Value"]))
+
+    def do_set_metrics_period(self, arg) -> None:
+        """
+        Set how often the device sends metric snapshots.
+
+        Usage: set_metrics_period 500  # Milliseconds, or 0 to disable
+        """
+        try:
+            self._stream.configure_metrics(int(arg))
+
+        except ValueError:
+            print("Error: Period must be an integer number of milliseconds")
+
+    def do_set_param(self, arg) -> None:
+        """
+        Set a device parameter.
+
+        Usage: set_param sine.level 0.5
+        """
+        try:
+            name, value = arg.split()
+            self._stream.set_params({name: float(value)})
+
+        except ValueError:
+            print("Error: Usage is set_param <name> <value>")
+        except KeyError as e:
+            print(f"Error: {e}")
+
+    def do_get_param(self, arg) -> None:
+        """
+        Show the value of device parameters.
+
+        Usage: get_param sine.level [more names...]
+        """
+
+        def show(values):
+            if values is not None:
+                for name, value in values.items():
+                    print(f"{name} = {value:g}")
+
+        try:
+            self._stream.get_params(arg.split(), show)
+
+        except KeyError as e:
+            print(f"Error: {e}")
+
+    def do_params(self, _) -> None:
+        """List the parameters the device firmware declares."""
+
+        for name in sorted(self._stream.param_ids):
+            print(name)
+
+    def do_loop(self, arg) -> None:
+        """
+        Trigger a looper action on a track.
+
+        Usage: loop <track> record|play|overdub|pause|clear|undo|redo
+                    [none|beat|bar|loop|last_beat|last_bar [sync_track]]
+                    [pcm16|pcm12|adpcm4]
+
+        The format sets how a recording is stored, pcm16 by default.
+        last_beat and last_bar start a recording in the past, from the
+        firmware's input capture, and store it as adpcm4. The capture
+        holds about 136 ms, so trigger them just after the boundary.
+        """
+        try:
+            args = arg.split()
+            formats = [a for a in args if a in ("pcm16", "pcm12", "adpcm4")]
+            args = [a for a in args if a not in formats]
+            if not 2 <= len(args) <= 4 or len(formats) > 1:
+                raise ValueError
+            quantize = args[2] if len(args) > 2 else "none"
+            sync_track = int(args[3]) if len(args) > 3 else 0
+            fmt = formats[0] if formats else "pcm16"
+            self._stream.looper(int(args[0]), args[1], quantize, sync_track,
+                                fmt)
+
+        except ValueError:
+            print("Error: Usage is loop <track> <action> [quantize "
+                  "[sync_track]] [format]")
+
+    def do_tracks(self, _) -> None:
+        """Show the state, length (frames) and format of every track."""
+
+        def show(tracks):
+            if tracks is not None:
+                print(tabulate([(i, *track) for i, track in enumerate(tracks)],
+                               headers=["Track", "State", "Length",
+                                        "Format"]))
+
+        self._stream.get_looper_status(show)
+
+    def do_measure_loopback(self, _) -> None:
+        """
+        Measure audio latency and frequency response through a cable from
+        the output back to the input (see `loopback`).
+        """
+
+        self._stream.measure_loopback()
+
+    def do_loopback(self, _) -> None:
+        """Show the result of the last loopback measurement."""
+
+        def show(state, result):
+            if state is None:
+                return
+            print(f"State: {state}")
+            if state != "done":
+                return
+            ms = result.latency_frames / SAMPLE_RATE * 1e3
+            print(f"Latency: {result.latency_frames} frames ({ms:.2f} ms), "
+                  f"spread {result.spread_frames}, "
+                  f"{result.block_frames} frame blocks")
+            print(f"Impulse peak: {result.peak_db:.1f} dBFS")
+            print(tabulate(zip(result.band_hz, result.response_db),
+                           headers=["Hz", "dB"], floatfmt=".1f"))
+
+        self._stream.get_loopback_result(show)
+
+    def do_latency(self, _) -> None:
+        """Show command round-trip latency percentiles (ms) by stage."""
+
+        print(tabulate(self._stream.latency.summary(),
+                       headers=["Stage", "p50", "p90", "p99", "Max"],
+                       floatfmt=".2f"))
+
+    def do_ping(self, _) -> None:
+        """Send a command that does nothing (see `latency`)."""
+
+        self._stream.ping()
+
     def do_reset(self, _) -> None:
         """Reset the device (performs a soft reset)."""
 
@@ -0,0 +1,215 @@
+"""Decodes trace captures from Mk0 devices and converts them to Chrome traces.
+
+A capture is a sequence of trace batches, each prefixed by its length (one
+byte), as written by `Mk0Stream.start_trace_capture`.
+
+Example usage:
+```sh
+python -m deloop_mk0.trace capture.bin --output trace.json
+```
+
+Open the result in chrome://tracing or https://ui.perfetto.dev.
+
+NOTE: The batch format must match `TraceBatchEncoder` in `src/trace.hpp`.
+"""
+
+import argparse
+import importlib.resources
+import json
+import struct
+from dataclasses import dataclass
+from typing import BinaryIO
+
+from deloop_mk0.log_encoding import site_id
+
+LOG_TABLE_FILE = importlib.resources.files("deloop_mk0") / "log_table.json"
+
+# Matches `deloop::TraceEventType`.
+BEGIN = 0
+END = 1
+INSTANT = 2
+COUNTER = 3
+
+# Matches `deloop::TraceTrack`.
+TRACKS = ("Audio DMA", "Audio", "UART Stream", "Command Handler")
+
+
+@dataclass
+class TraceEvent:
+    type: int
+    track: int
+    id: int
+    timestamp: int  # Raw 32-bit trace clock cycles.
+    value: int = 0
+
+
+@dataclass
+class TraceBatch:
+    frequency: int  # Trace clock frequency (Hz).
+    events: list[TraceEvent]
+
+
+def _read_varint(data: bytes, pos: int) -> tuple[int, int]:
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(data):
+            raise ValueError("Truncated varint")
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if byte & 0x80 == 0:
+            return value, pos
+
+
+def _unzigzag(value: int) -> int:
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode_trace_batch(data: bytes) -> TraceBatch:
+    """Decodes one trace batch.
+
+    Raises:
+        ValueError: If the batch is truncated or malformed.
+    """
+    frequency, pos = _read_varint(data, 0)
+    timestamp, pos = _read_varint(data, pos)
+
+    events = []
+    while pos < len(data):
+        header = data[pos]
+        pos += 1
+        event_type = header & 0x03
+        track = (header >> 2) & 0x0F
+
+        if pos + 4 > len(data):
+            raise ValueError("Truncated event ID")
+        (event_id,) = struct.unpack_from("<I", data, pos)
+        pos += 4
+
+        delta, pos = _read_varint(data, pos)
+        timestamp = (timestamp + _unzigzag(delta)) & 0xFFFFFFFF
+
+        value = 0
+        if event_type == COUNTER:
+            value, pos = _read_varint(data, pos)
+            value = _unzigzag(value)
+
+        events.append(TraceEvent(
+            type=event_type,
+            track=track,
+            id=event_id,
+            timestamp=timestamp,
+            value=value,
+        ))
+
+    return TraceBatch(frequency=frequency, events=events)
+
+
+def read_capture(file: BinaryIO) -> list[TraceBatch]:
+    """Reads every length-prefixed batch in a capture file."""
+    batches = []
+    while True:
+        length = file.read(1)
+        if len(length) == 0:
+            return batches
+
+        data = file.read(length[0])
+        if len(data) != length[0]:
+            raise ValueError("Truncated capture")
+        batches.append(decode_trace_batch(data))
+
+
+def to_chrome_trace(
+    batches: list[TraceBatch],
+    log_table: dict[str, dict],
+) -> dict:
+    """Converts decoded batches to the Chrome trace event format.
+
+    The 32-bit cycle counter wraps about every 24 s at 180 MHz, so timestamps
+    are unwrapped assuming consecutive events are less than half a wrap
+    apart.
+    """
+    names = {site_id(int(hash)): entry["msg"]
+             for hash, entry in log_table.items()}
+
+    trace_events = [
+        {
+            "name": "thread_name",
+            "ph": "M",
+            "pid": 0,
+            "tid": i,
+            "args": {"name": name},
+        }
+        for i, name in enumerate(TRACKS)
+    ]
+
+    cycles = 0
+    last_timestamp = None
+    for batch in batches:
+        for event in batch.events:
+            if last_timestamp is not None:
+                cycles += (event.timestamp - last_timestamp) & 0xFFFFFFFF
+                # Events are queued in time order, so a large forward step is
+                # really a small step back across a batch boundary.
+                if (event.timestamp - last_timestamp) & 0x80000000:
+                    cycles -= 1 << 32
+            last_timestamp = event.timestamp
+
+            name = names.get(event.id, f"unknown_{event.id:08x}")
+            trace_event = {
+                "name": name,
+                "pid": 0,
+                "tid": event.track,
+                "ts": cycles * 1e6 / batch.frequency if batch.frequency else 0,
+            }
+
+            if event.type == BEGIN:
+                trace_event["ph"] = "B"
+            elif event.type == END:
+                trace_event["ph"] = "E"
+            elif event.type == INSTANT:
+                trace_event["ph"] = "i"
+                trace_event["s"] = "t"
+            else:
+                trace_event["ph"] = "C"
+                trace_event["args"] = {name: event.value}
+
+            trace_events.append(trace_event)
+
+    return {"traceEvents": trace_events, "displayTimeUnit": "ns"}
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", type=str, help="Trace capture file.")
+    parser.add_argument(
+        "--output",
+        type=str,
+        required=True,
+        help="Path to write the Chrome trace (JSON format).",
+    )
+    parser.add_argument(
+        "--log_table",
+        type=str,
+        default=None,
+        help="Log table with trace event names (defaults to the bundled one).",
+    )
+    args = parser.parse_args()
+
+    with open(args.log_table or LOG_TABLE_FILE, "r") as file:
+        log_table = json.load(file)
+
+    with open(args.capture, "rb") as file:
+        batches = read_capture(file)
+
+    with open(args.output, "w") as file:
+        json.dump(to_chrome_trace(batches, log_table), file)
+
+    print(f"Wrote {sum(len(b.events) for b in batches)} events "
+          f"to {args.output}")
+
+
+if __name__ == "__main__":
+    main()
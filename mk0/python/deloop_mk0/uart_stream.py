@@ -5,10 +5,14 @@ import importlib
 import json
 import logging
 import struct
+import time
 from contextlib import contextmanager
-from typing import Final, Generator
+from typing import BinaryIO, Final, Generator
 
 import serial
+from deloop_mk0.latency import LatencyStats, from_response
+from deloop_mk0.log_encoding import LogBatchRecord, decode_log_batch, site_id
+from deloop_mk0.metrics import COUNTER, GAUGE, HISTOGRAM, MetricStore
 from serial.threaded import Protocol, ReaderThread
 from serial.tools import list_ports
 from tabulate import tabulate
@@ -16,6 +20,7 @@ from tabulate import tabulate
 try:
     import command_pb2
     import log_pb2
+    import metrics_pb2
     import stream_pb2
 except ImportError as e:
     print(e)
@@ -24,32 +29,56 @@ except ImportError as e:
 
 LOG_TABLE_FILE = importlib.resources.files("deloop_mk0") / "log_table.json"
 
+# Frames per second of the device's audio (`audio_scheduler::kSampleRate`).
+SAMPLE_RATE: Final = 48000
+
 logger = logging.getLogger(__name__)
 
 
 class Mk0Stream(Protocol):
 
     MAGIC_BYTE: Final[int] = 0xEB
+    LOG_BATCH_MAGIC_BYTE: Final[int] = 0xEC
+    TRACE_BATCH_MAGIC_BYTE: Final[int] = 0xED
+
+    # Match the max_count options in `proto/command.options`.
+    MAX_BATCH_REQUESTS: Final[int] = 8
+    MAX_PARAM_UPDATES: Final[int] = 24
 
     transport: ReaderThread
     log_table: dict[str, str]
+    log_sites: dict[int, dict]
+    param_ids: dict[str, int]
 
     start_byte_received: bool
+    frame_type: int | None
     data_remaining: int | None
     buffer: bytearray
 
     last_cmd_id: int
     outstanding_cmds: dict[int, callable]
+    cmd_send_times: dict[int, float]
+    batch_cmd: command_pb2.Command | None
+    latency: LatencyStats
+
+    trace_capture: BinaryIO | None
+    metrics: MetricStore
 
     def __init__(self):
         self.transport = None
 
+        self.metrics = MetricStore()
         self.load_log_table()
         self.start_byte_received = False
+        self.frame_type = None
         self.data_remaining = None
         self.buffer = bytearray()
         self.last_cmd_id = 0
         self.outstanding_cmds = {}
+        self.cmd_send_times = {}
+        self.batch_cmd = None
+        self.latency = LatencyStats()
+        self.trace_capture = None
 
     def load_log_table(self) -> None:
         try:
@@ -59,6 +88,18 @@ class Mk0Stream(Protocol):
             logger.warning(f"Log table file not found: {LOG_TABLE_FILE}")
             self.log_table = {}
 
+        # Log batches identify call sites by a fold of the hash.
+        self.log_sites = {
+            site_id(int(hash)): entry
+            for hash, entry in self.log_table.items()
+        }
+        self.param_ids = {
+            entry["msg"]: site_id(int(hash))
+            for hash, entry in self.log_table.items()
+            if entry.get("kind") == "param"
+        }
+        self.metrics.load_log_table(self.log_table)
+
     def connection_made(self, transport: ReaderThread) -> None:
         logger.info("Connected to device.")
         self.transport = transport
@@ -70,12 +111,17 @@ class Mk0Stream(Protocol):
         super().connection_lost(exc)
 
     def data_received(self, data: bytes) -> None:
-        # First, read until our magic byte is found.
+        # First, read until one of our magic bytes is found.
         if not self.start_byte_received:
             while len(data) > 0:
                 start, data = data[0], data[1:]
-                if start == self.MAGIC_BYTE:
+                if start in (
+                    self.MAGIC_BYTE,
+                    self.LOG_BATCH_MAGIC_BYTE,
+                    self.TRACE_BATCH_MAGIC_BYTE,
+                ):
                     self.start_byte_received = True
+                    self.frame_type = start
                     break
 
             if len(data) == 0 or not self.start_byte_received:
@@ -96,8 +142,14 @@ class Mk0Stream(Protocol):
 
         # Once packet has been fully read, clear start flag.
         if self.data_remaining == 0:
-            self.handle_packet(bytes(self.buffer))
+            if self.frame_type == self.LOG_BATCH_MAGIC_BYTE:
+                self.handle_log_batch(bytes(self.buffer))
+            elif self.frame_type == self.TRACE_BATCH_MAGIC_BYTE:
+                self.handle_trace_batch(bytes(self.buffer))
+            else:
+                self.handle_packet(bytes(self.buffer))
             self.start_byte_received = False
+            self.frame_type = None
             self.data_remaining = None
             self.buffer.clear()
 
@@ -129,8 +181,53 @@ class Mk0Stream(Protocol):
 
         args = self.parse_log_args(log.args)
         logger.log(logging.getLevelName(level), entry["msg"], *args)
+        if log.suppressed > 0:
+            logger.log(
+                logging.getLevelName(level),
+                f"({log.suppressed} similar message(s) suppressed)",
+            )
+
+    def handle_batched_log(self, record: LogBatchRecord) -> None:
+        entry = self.log_sites.get(record.site_id)
+        if entry is None:
+            logger.warning(f"Unknown log site: {record.site_id:#010x}")
+            return
+
+        level = logging.getLevelName(record.level)
+        logger.log(level, entry["msg"], *record.args)
+        if record.suppressed > 0:
+            logger.log(
+                level,
+                f"({record.suppressed} similar message(s) suppressed)",
+            )
+
+    def handle_log_batch(self, batch: bytes) -> None:
+        try:
+            for record in decode_log_batch(batch):
+                self.handle_batched_log(record)
+
+        except Exception as e:
+            logger.exception(f"Error: {e}")
+
+    def handle_trace_batch(self, batch: bytes) -> None:
+        # Batches are stored as-is; see `deloop_mk0.trace` for decoding.
+        if self.trace_capture is not None:
+            self.trace_capture.write(bytes([len(batch)]) + batch)
 
     def handle_command_response(self, cmd: command_pb2.Command) -> None:
+        send_time = self.cmd_send_times.pop(cmd.cmd_id, None)
+        if send_time is not None:
+            sample = from_response(
+                time.perf_counter() - send_time,
+                cmd.received_at,
+                cmd.dispatched_at,
+                cmd.completed_at,
+                cmd.sent_at,
+                cmd.clock_hz,
+            )
+            if sample is not None:
+                self.latency.add(sample)
+
         if cmd.cmd_id in self.outstanding_cmds:
             callback = self.outstanding_cmds.pop(cmd.cmd_id)
             if callback:
@@ -139,6 +236,24 @@ class Mk0Stream(Protocol):
         else:
             logger.warning(f"Unknown command ID: {cmd.cmd_id}")
 
+    def handle_drop_report(self, report: stream_pb2.DropReport) -> None:
+        lane = stream_pb2.StreamPriority.Name(report.priority)
+        logger.warning(f"Device dropped {report.count} message(s) ({lane}).")
+
+    def handle_metrics(self, snapshot: metrics_pb2.MetricsSnapshot) -> None:
+        for value in snapshot.values:
+            field = value.WhichOneof("value")
+            if field == "counter":
+                self.metrics.update(value.id, COUNTER, value.counter,
+                                    tick=snapshot.tick)
+            elif field == "gauge":
+                self.metrics.update(value.id, GAUGE, value.gauge,
+                                    tick=snapshot.tick)
+            elif field == "bucket_count":
+                self.metrics.update(value.id, HISTOGRAM,
+                                    value.bucket_count, value.bucket,
+                                    tick=snapshot.tick)
+
     def handle_packet(self, packet: bytes) -> None:
         try:
             stream = stream_pb2.StreamPacket()
@@ -147,6 +262,10 @@ class Mk0Stream(Protocol):
                 self.handle_log(stream.log)
             elif stream.HasField("cmd_response"):
                 self.handle_command_response(stream.cmd_response)
+            elif stream.HasField("dropped"):
+                self.handle_drop_report(stream.dropped)
+            elif stream.HasField("metrics"):
+                self.handle_metrics(stream.metrics)
 
         except Exception as e:
             logger.exception(f"Error: {e}")
@@ -163,16 +282,22 @@ class Mk0Stream(Protocol):
         Returns:
             bool: True if command was sent successfully, False otherwise
         """
+        # Batched requests are sent when the batch ends.
+        if cmd is self.batch_cmd:
+            return True
+
         cmd_bytes = cmd.SerializeToString()
 
         try:
             payload = struct.pack("<BB", self.MAGIC_BYTE, len(cmd_bytes))
             payload += cmd_bytes
 
+            self.cmd_send_times[cmd.cmd_id] = time.perf_counter()
             bytes_written = self.transport.write(payload)
             if bytes_written != len(payload):
                 logger.error("Failed to write command to device.")
-                del self.outstanding_cmds[cmd.cmd_id]
+                self.outstanding_cmds.pop(cmd.cmd_id, None)
+                self.cmd_send_times.pop(cmd.cmd_id, None)
                 return False
 
             if success_msg:
@@ -181,7 +306,8 @@ class Mk0Stream(Protocol):
 
         except Exception as e:
             logger.exception(f"Error writing to device: {e}")
-            del self.outstanding_cmds[cmd.cmd_id]
+            self.outstanding_cmds.pop(cmd.cmd_id, None)
+            self.cmd_send_times.pop(cmd.cmd_id, None)
             return False
 
     def _create_command(self, callback=None):
@@ -194,6 +320,9 @@ class Mk0Stream(Protocol):
         Returns:
             command_pb2.Command: New command object with ID assigned
         """
+        if self.batch_cmd is not None:
+            return self.batch_cmd
+
         cmd = command_pb2.Command()
         cmd.cmd_id = self.last_cmd_id + 1
         self.last_cmd_id = cmd.cmd_id
@@ -203,6 +332,38 @@ class Mk0Stream(Protocol):
 
         return cmd
 
+    @contextmanager
+    def batch(self, callback=None) -> Generator[None, None, None]:
+        """Sends the commands issued inside the block as a single batch.
+
+        The device checks every request before applying any of them and
+        replies once; `failed_request` in the response identifies the request
+        that failed. Callbacks of the individual commands are not called.
+
+        Args:
+            callback: Function to call when the batch response is received
+        """
+        if self.batch_cmd is not None:
+            raise RuntimeError("Batches cannot be nested.")
+
+        cmd = self._create_command(callback)
+        self.batch_cmd = cmd
+        try:
+            yield
+        except BaseException:
+            self.outstanding_cmds.pop(cmd.cmd_id, None)
+            raise
+        finally:
+            self.batch_cmd = None
+
+        if len(cmd.requests) > self.MAX_BATCH_REQUESTS:
+            logger.error(f"Batch of {len(cmd.requests)} requests is too "
+                         f"large (max {self.MAX_BATCH_REQUESTS}).")
+            self.outstanding_cmds.pop(cmd.cmd_id, None)
+            return
+
+        self._send_command(cmd)
+
     def configure_recording(self, enable: bool | None = None) -> None:
         """Configure audio recording on the device.
 
@@ -218,9 +379,10 @@ class Mk0Stream(Protocol):
                 logger.error(f"Failed to configure recording: {resp.status}")
 
         cmd = self._create_command(cmd_cb)
+        request = cmd.requests.add()
 
         if enable is not None:
-            cmd.configure_recording.enable = enable
+            request.configure_recording.enable = enable
 
         self._send_command(cmd)
 
@@ -244,12 +406,13 @@ class Mk0Stream(Protocol):
                 logger.error(f"Failed to configure playback: {resp.status}")
 
         cmd = self._create_command(cmd_cb)
+        request = cmd.requests.add()
 
         if enable is not None:
-            cmd.configure_playback.enable = enable
+            request.configure_playback.enable = enable
 
         if volume is not None:
-            cmd.configure_playback.volume = max(0.0, min(1.0, volume))
+            request.configure_playback.volume = max(0.0, min(1.0, volume))
 
         self._send_command(cmd)
 
@@ -263,6 +426,273 @@ class Mk0Stream(Protocol):
         # We use configure_playback with just the volume parameter
         self.configure_playback(volume=volume)
 
+    def configure_logging(
+        self,
+        min_level: str | None = None,
+        module_mask: int | None = None,
+    ) -> None:
+        """
+        Configure runtime log filtering on the device.
+
+        Args:
+            min_level: Name of the lowest `LogLevel` to report (optional)
+            module_mask: Bit N enables logs from module N (optional)
+        """
+
+        def cmd_cb(resp):
+            if resp.status == command_pb2.CommandStatus.SUCCESS:
+                logger.info("Logging configured successfully.")
+            else:
+                logger.error(f"Failed to configure logging: {resp.status}")
+
+        cmd = self._create_command(cmd_cb)
+        request = cmd.requests.add()
+
+        if min_level is not None:
+            request.configure_logging.min_level = log_pb2.LogLevel.Value(
+                min_level)
+
+        if module_mask is not None:
+            request.configure_logging.module_mask = module_mask
+
+        self._send_command(cmd)
+
+    def configure_trace(self, enable: bool) -> None:
+        """Enable or disable event tracing on the device."""
+
+        def cmd_cb(resp):
+            if resp.status == command_pb2.CommandStatus.SUCCESS:
+                logger.info("Tracing configured successfully.")
+            else:
+                logger.error(f"Failed to configure tracing: {resp.status}")
+
+        cmd = self._create_command(cmd_cb)
+        request = cmd.requests.add()
+        request.configure_trace.enable = enable
+        self._send_command(cmd)
+
+    def start_trace_capture(self, path: str) -> None:
+        """Enable tracing and record trace batches to `path`."""
+        self.stop_trace_capture()
+        self.trace_capture = open(path, "wb")
+        self.configure_trace(enable=True)
+
+    def stop_trace_capture(self) -> None:
+        """Disable tracing and close the capture file, if any."""
+        if self.trace_capture is None:
+            return
+
+        self.configure_trace(enable=False)
+        self.trace_capture.close()
+        self.trace_capture = None
+
+    def configure_metrics(self, period_ms: int) -> None:
+        """Set the metrics snapshot period (0 disables snapshots)."""
+
+        def cmd_cb(resp):
+            if resp.status == command_pb2.CommandStatus.SUCCESS:
+                logger.info("Metrics configured successfully.")
+            else:
+                logger.error(f"Failed to configure metrics: {resp.status}")
+
+        cmd = self._create_command(cmd_cb)
+        request = cmd.requests.add()
+        request.configure_metrics.period_ms = period_ms
+        self._send_command(cmd)
+
+    def ping(self, callback=None) -> None:
+        """Send a command that does nothing, to measure the round trip.
+
+        Args:
+            callback: Called with the response (optional)
+        """
+        cmd = self._create_command(callback)
+        request = cmd.requests.add()
+        request.ping.SetInParent()
+        self._send_command(cmd)
+
+    def flood_logs(self, count: int, interval_ms: int = 1) -> None:
+        """Make the device emit `count` INFO logs, one every `interval_ms`.
+
+        A count of 0 stops a running flood.
+        """
+
+        def cmd_cb(resp):
+            if resp.status != command_pb2.CommandStatus.SUCCESS:
+                logger.error(f"Failed to start log flood: {resp.status}")
+
+        cmd = self._create_command(cmd_cb)
+        request = cmd.requests.add()
+        request.flood_logs.count = count
+        request.flood_logs.interval_ms = interval_ms
+        self._send_command(cmd)
+
+    def set_params(
+        self,
+        values: dict[str, float] | list[tuple[str, float]],
+        callback=None,
+    ) -> None:
+        """Set device parameters by name.
+
+        All values reach the audio task together, at a block boundary. The
+        device rejects the whole command if any value is out of range.
+
+        Args:
+            values: New value of each parameter
+            callback: Called with the response (optional)
+        """
+        items = values.items() if isinstance(values, dict) else values
+
+        def cmd_cb(resp):
+            if resp.status != command_pb2.CommandStatus.SUCCESS:
+                logger.error(f"Failed to set parameters: {resp.status}")
+
+        cmd = self._create_command(callback or cmd_cb)
+        request = cmd.requests.add()
+        for name, value in items:
+            if name not in self.param_ids:
+                raise KeyError(f"Unknown parameter: {name}")
+            request.set_params.ids.append(self.param_ids[name])
+            request.set_params.values.append(value)
+
+        if len(request.set_params.ids) > self.MAX_PARAM_UPDATES:
+            raise ValueError(f"At most {self.MAX_PARAM_UPDATES} parameters "
+                             f"can be set at once.")
+
+        self._send_command(cmd)
+
+    def get_params(self, names: list[str], callback) -> None:
+        """Read device parameters by name.
+
+        Args:
+            names: Parameters to read
+            callback: Called with a dict of parameter values, or None if
+                the device failed to read them
+        """
+        for name in names:
+            if name not in self.param_ids:
+                raise KeyError(f"Unknown parameter: {name}")
+
+        def cmd_cb(resp):
+            if resp.status != command_pb2.CommandStatus.SUCCESS:
+                logger.error(f"Failed to get parameters: {resp.status}")
+                callback(None)
+                return
+            callback(dict(zip(names, resp.param_values)))
+
+        cmd = self._create_command(cmd_cb)
+        request = cmd.requests.add()
+        request.get_params.ids.extend(self.param_ids[name] for name in names)
+        self._send_command(cmd)
+
+    def looper(
+        self,
+        track: int,
+        action: str,
+        quantize: str = "none",
+        sync_track: int = 0,
+        fmt: str = "pcm16",
+        callback=None,
+    ) -> None:
+        """Trigger a looper action.
+
+        Args:
+            track: Track index
+            action: One of record, play, overdub, pause, clear, undo or
+                redo
+            quantize: When the action applies: none, beat, bar, or loop to
+                wait for `sync_track` to wrap to its start. Recordings can
+                also start in the past with last_beat or last_bar, which
+                fail if the boundary is older than the input capture
+            sync_track: Track followed by loop quantization
+            fmt: Storage of a recorded loop: pcm16, pcm12 or adpcm4
+            callback: Called with the response (optional)
+        """
+
+        def cmd_cb(resp):
+            if resp.status != command_pb2.CommandStatus.SUCCESS:
+                logger.error(f"Failed to {action} track {track}: "
+                             f"{resp.status}")
+
+        cmd = self._create_command(callback or cmd_cb)
+        request = cmd.requests.add()
+        request.looper.track = track
+        request.looper.action = command_pb2.LooperAction.Value(
+            f"LOOPER_{action.upper()}")
+        request.looper.quantize = command_pb2.LooperQuantize.Value(
+            f"QUANTIZE_{quantize.upper()}")
+        request.looper.sync_track = sync_track
+        request.looper.format = command_pb2.LoopFormat.Value(
+            f"FORMAT_{fmt.upper()}")
+        self._send_command(cmd)
+
+    def get_looper_status(self, callback) -> None:
+        """Read the state of every looper track.
+
+        Args:
+            callback: Called with a list of (state, length in frames,
+                format) per track, or None if the device failed to respond
+        """
+
+        def cmd_cb(resp):
+            if resp.status != command_pb2.CommandStatus.SUCCESS:
+                logger.error(f"Failed to get looper status: {resp.status}")
+                callback(None)
+                return
+            callback([(command_pb2.LooperState.Name(track.state)
+                       .removeprefix("TRACK_").lower(), track.length,
+                       command_pb2.LoopFormat.Name(track.format)
+                       .removeprefix("FORMAT_").lower())
+                      for track in resp.tracks])
+
+        cmd = self._create_command(cmd_cb)
+        request = cmd.requests.add()
+        request.get_looper_status.SetInParent()
+        self._send_command(cmd)
+
+    def measure_loopback(self, callback=None) -> None:
+        """Start measuring output to input latency and frequency response.
+
+        Needs a cable from the output back to the input. The output is
+        replaced by test signals for about 2.5 s; read the result with
+        `get_loopback_result`.
+
+        Args:
+            callback: Called with the response (optional)
+        """
+
+        def cmd_cb(resp):
+            if resp.status != command_pb2.CommandStatus.SUCCESS:
+                logger.error(f"Failed to start loopback measurement: "
+                             f"{resp.status}")
+
+        cmd = self._create_command(callback or cmd_cb)
+        request = cmd.requests.add()
+        request.measure_loopback.SetInParent()
+        self._send_command(cmd)
+
+    def get_loopback_result(self, callback) -> None:
+        """Read the result of the last loopback measurement.
+
+        Args:
+            callback: Called with the state (idle, running, done or
+                no_signal) and the `LoopbackResult`, or with None twice if
+                the device failed to respond
+        """
+
+        def cmd_cb(resp):
+            if resp.status != command_pb2.CommandStatus.SUCCESS:
+                logger.error(f"Failed to get loopback result: {resp.status}")
+                callback(None, None)
+                return
+            callback(command_pb2.LoopbackState.Name(resp.loopback.state)
+                     .removeprefix("LOOPBACK_").lower(), resp.loopback)
+
+        cmd = self._create_command(cmd_cb)
+        request = cmd.requests.add()
+        request.get_loopback_result.SetInParent()
+        self._send_command(cmd)
+
     def reset_device(self) -> None:
         """Send a reset command to the device."""
 
@@ -273,7 +703,8 @@ class Mk0Stream(Protocol):
                 logger.error(f"Failed to reset device: {resp.status}")
 
         cmd = self._create_command(cmd_cb)
-        cmd.reset.SetInParent()  # Initialize the reset message
+        request = cmd.requests.add()
+        request.reset.SetInParent()  # Initialize the reset message
 
         self._send_command(
             cmd,
@@ -13,10 +13,11 @@ setup(
         "pyinotify",
     ],
     package_data={"deloop_mk0": ["**/*.json"]},
-    py_modules=["log_pb2", "stream_pb2", "command_pb2"],
+    py_modules=["log_pb2", "stream_pb2", "command_pb2", "metrics_pb2"],
     entry_points={
         "console_scripts": [
             "deloop_mk0_repl = deloop_mk0.repl:main",
+            "deloop_mk0_load_test = deloop_mk0.load_test:main",
         ],
     },
 )
@@ -1,26 +1,62 @@
 #!/usr/bin/env python3
-"""Parses logging calls into a table of unique identifiers.
+"""Extracts logging call sites from a firmware ELF into a table.
 
 Example usage:
 ```sh
-create_log_table.py --output table.json --macro DELOOP_LOG src1.c src2.c ...
+create_log_table.py --output table.json --elf deloop_mk0.elf
 ```
 
-This script expects the logging macro to follow a specific format:
-```c
-#define <MACRO>(MSG, ...)
-```
-
-You can pass multiple macro names.
+Every logging macro emits a descriptor into the `.deloop_log_sites*`
+sections (see `LogSite` in `src/logging.hpp`), so the table covers exactly the
+log calls that were compiled in. Trace event names (see `src/trace.hpp`),
+metrics (see `src/metrics.hpp`) and parameters (see `src/params.hpp`) are
+emitted the same way and are included with `"kind": "trace"`,
+`"kind": "metric"` and `"kind": "param"`.
 
 """
 
 import argparse
 import json
-import os
-import re
+import struct
+from dataclasses import dataclass
+
+LOG_SITE_SECTION = ".deloop_log_sites"
+LOG_SITE_MAGIC = 0x5173106D
+TRACE_SITE_MAGIC = 0x7ACE5173
+METRIC_SITE_MAGIC = 0x3E791C5A
+PARAM_SITE_MAGIC = 0x9A7A3E7E
+
+# NOTE: Must match `deloop::LogSite` in `src/logging.hpp`.
+LOG_SITE_HEADER = "IIQBBBB"
+
+# Matches `deloop::LogLevel`.
+LOG_LEVELS = ("INFO", "WARNING", "ERROR")
+
+# Matches `deloop::LogArg::Type`.
+ARG_TYPES = {1: "u32", 2: "i32", 3: "f32"}
+
+SITE_KINDS = {
+    LOG_SITE_MAGIC: "log",
+    TRACE_SITE_MAGIC: "trace",
+    PARAM_SITE_MAGIC: "param",
+}
 
-MACRO_PATTERN = r'({MACROS})\s*\(\s*(".*?(?<!\\)")'
+# Matches `deloop::MetricType`.
+METRIC_TYPES = ("counter", "gauge", "histogram")
+
+
+@dataclass
+class LogSite:
+    hash: int
+    level: str
+    module: int
+    arg_types: list[str]
+    msg: str
+    file: str
+    line: int
+    kind: str = "log"
+    metric_type: str | None = None
+    unit_shift: int = 0
 
 
 def fnv1a_64(s: str) -> int:
@@ -34,50 +70,153 @@ def fnv1a_64(s: str) -> int:
     return hash & 0xFFFFFFFFFFFFFFFF
 
 
-def main(args: argparse.Namespace) -> None:
-    if not args.macro:
-        print("No macros provided.")
-        return
+def read_sections(elf: bytes, prefix: str) -> list[tuple[bytes, str]]:
+    """Returns the contents and byte order of sections named `prefix*`."""
+    if elf[:4] != b"\x7fELF":
+        raise ValueError("Not an ELF file")
+
+    is_64 = elf[4] == 2
+    endian = "<" if elf[5] == 1 else ">"
+    if is_64:
+        shoff, = struct.unpack_from(endian + "Q", elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(
+            endian + "HHH", elf, 0x3A)
+        header_fmt = endian + "IIQQQQIIQQ"
+    else:
+        shoff, = struct.unpack_from(endian + "I", elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(
+            endian + "HHH", elf, 0x2E)
+        header_fmt = endian + "IIIIIIIIII"
+
+    headers = [
+        struct.unpack_from(header_fmt, elf, shoff + i * shentsize)
+        for i in range(shnum)
+    ]
+    strtab_offset = headers[shstrndx][4]
+
+    sections = []
+    for name_offset, type_, _, _, offset, size, *_ in headers:
+        end = elf.index(b"\0", strtab_offset + name_offset)
+        name = elf[strtab_offset + name_offset:end].decode("utf-8")
+        # SHT_NOBITS sections have no contents in the file.
+        if name.startswith(prefix) and type_ != 8:
+            sections.append((elf[offset:offset + size], endian))
+
+    return sections
+
+
+def _read_string(data: bytes, pos: int) -> tuple[str, int]:
+    end = data.index(b"\0", pos)
+    return data[pos:end].decode("utf-8"), end + 1
+
+
+def parse_log_sites(data: bytes, endian: str) -> list[LogSite]:
+    """Parses the descriptors packed into one log site section."""
+    sites = []
+    header_size = struct.calcsize(endian + LOG_SITE_HEADER)
+    pos = 0
+    while pos < len(data):
+        # Skip alignment padding between descriptors.
+        if data[pos] == 0:
+            pos += 1
+            continue
 
-    elif not args.source_files:
-        print("No source files provided.")
-        return
+        (magic, line, hash, level, module, num_args,
+         arg_types) = struct.unpack_from(endian + LOG_SITE_HEADER, data, pos)
+        if magic not in (LOG_SITE_MAGIC, TRACE_SITE_MAGIC, METRIC_SITE_MAGIC,
+                         PARAM_SITE_MAGIC):
+            raise ValueError(f"Bad log site magic at offset {pos}")
+
+        msg, pos = _read_string(data, pos + header_size)
+        file, pos = _read_string(data, pos)
+        if fnv1a_64(msg) != hash:
+            raise ValueError(f"Hash mismatch for log site {file}:{line}")
+
+        # Metric sites reuse the level and arg type fields for the metric
+        # type and histogram unit.
+        if magic == METRIC_SITE_MAGIC:
+            sites.append(LogSite(
+                hash=hash,
+                level="INFO",
+                module=module,
+                arg_types=[],
+                msg=msg,
+                file=file,
+                line=line,
+                kind="metric",
+                metric_type=METRIC_TYPES[level],
+                unit_shift=arg_types,
+            ))
+            continue
 
-    macro_re = re.compile(
-        MACRO_PATTERN.format(MACROS="|".join(args.macro)),
-        re.VERBOSE | re.DOTALL,
-    )
+        sites.append(LogSite(
+            hash=hash,
+            level=LOG_LEVELS[level],
+            module=module,
+            arg_types=[
+                ARG_TYPES[(arg_types >> (2 * i)) & 0x03]
+                for i in range(num_args)
+            ],
+            msg=msg,
+            file=file,
+            line=line,
+            kind=SITE_KINDS[magic],
+        ))
 
+    return sites
+
+
+def extract_log_sites(elf: bytes) -> list[LogSite]:
+    sites = []
+    for data, endian in read_sections(elf, LOG_SITE_SECTION):
+        sites.extend(parse_log_sites(data, endian))
+
+    return sites
+
+
+def main(args: argparse.Namespace) -> None:
     log_table = {}
     if args.latest:
         with open(args.latest, "r") as latest_file:
             log_table.update(json.load(latest_file))
 
-    for source_file in args.source_files:
-        if not os.path.isfile(source_file):
-            print(f"File not found: {source_file}")
+    with open(args.elf, "rb") as elf_file:
+        sites = extract_log_sites(elf_file.read())
+
+    for site in sites:
+        key = str(site.hash)
+        if key in log_table and log_table[key]["msg"] != site.msg:
+            print("COLLISION DETECTED!")
+            print(f"Previous: {log_table[key]['msg']}")
+            print(f"New: {site.msg}")
             continue
 
-        with open(source_file, "r") as file:
-            content = file.read()
-            matches = macro_re.findall(content)
-            for (_, match) in matches:
-                msg = match.strip('"')
-                key = str(fnv1a_64(msg))
-                if key in log_table:
-                    if log_table[key]["msg"] == msg:
-                        log_table[key]["latest_version"] = args.source_version
-                        continue
-
-                    print("COLLISION DETECTED!")
-                    print(f"Previous: {log_table[key]['msg']}")
-                    print(f"New: {msg}")
-                    continue
-
-                log_table[key] = {
-                    "msg": msg,
-                    "latest_version": args.source_version,
-                }
+        if site.kind in ("trace", "param"):
+            log_table[key] = {
+                "msg": site.msg,
+                "kind": site.kind,
+                "location": f"{site.file}:{site.line}",
+                "latest_version": args.source_version,
+            }
+            continue
+        elif site.kind == "metric":
+            log_table[key] = {
+                "msg": site.msg,
+                "kind": site.kind,
+                "type": site.metric_type,
+                "unit_shift": site.unit_shift,
+                "location": f"{site.file}:{site.line}",
+                "latest_version": args.source_version,
+            }
+            continue
+
+        log_table[key] = {
+            "msg": site.msg,
+            "level": site.level,
+            "args": site.arg_types,
+            "location": f"{site.file}:{site.line}",
+            "latest_version": args.source_version,
+        }
 
     with open(args.output, "w") as output_file:
         json.dump(log_table, output_file, indent=2)
@@ -101,15 +240,10 @@ if __name__ == "__main__":
         help="Path to a previous log table (for backwards compatibility).",
     )
     arg_parser.add_argument(
-        "--macro",
+        "--elf",
         type=str,
-        nargs="+",
-        help="List of logging macros to parse.",
-    )
-    arg_parser.add_argument(
-        "--source_files",
-        nargs="+",
-        help="List of source files to parse for logging calls.",
+        required=True,
+        help="Firmware ELF to extract logging calls from.",
     )
     arg_parser.add_argument(
         "--source_version",
@@ -0,0 +1,69 @@
+#include "audio/biquad.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+using namespace deloop;
+
+const int64_t kMaxSample = 0x7FFFFF;
+
+// Adds the 64-bit product of `a` and `b` to `sum`.
+static inline int64_t mac(int64_t sum, int32_t a, int32_t b) {
+#if defined(__ARM_FEATURE_DSP)
+  uint32_t lo = static_cast<uint32_t>(sum);
+  uint32_t hi = static_cast<uint32_t>(static_cast<uint64_t>(sum) >> 32);
+  __asm("smlal %0, %1, %2, %3" : "+r"(lo), "+r"(hi) : "r"(a), "r"(b));
+  return static_cast<int64_t>(static_cast<uint64_t>(hi) << 32 | lo);
+#else
+  return sum + static_cast<int64_t>(a) * b;
+#endif
+}
+
+void BiquadCascade::configure(const BiquadCoeffs *sections,
+                              size_t num_sections) {
+  num_sections = std::min(num_sections, kMaxSections);
+  for (size_t s = num_sections_; s < num_sections; s++) {
+    for (size_t c = 0; c < kChannels; c++) {
+      history_[s * kChannels + c] = {};
+    }
+  }
+  std::copy(sections, sections + num_sections, coeffs_.begin());
+  num_sections_ = num_sections;
+}
+
+void BiquadCascade::reset(void) { history_.fill({}); }
+
+void BiquadCascade::process(uint32_t num_frames, int32_t *frames) {
+  for (size_t s = 0; s < num_sections_; s++) {
+    const BiquadCoeffs k = coeffs_[s];
+    const uint64_t mask = (uint64_t{1} << k.bits) - 1;
+    for (size_t c = 0; c < kChannels; c++) {
+      History &h = history_[s * kChannels + c];
+      int32_t x1 = h.x1;
+      int32_t x2 = h.x2;
+      int32_t y1 = h.y1;
+      int32_t y2 = h.y2;
+      int64_t error = h.error;
+      int32_t *samples = &frames[c];
+      for (uint32_t i = 0; i < num_frames; i++) {
+        int32_t x = samples[i * kChannels];
+        int64_t sum = mac(error, k.b0, x);
+        sum = mac(sum, k.b1, x1);
+        sum = mac(sum, k.b2, x2);
+        sum = mac(sum, k.a1, y1);
+        sum = mac(sum, k.a2, y2);
+        error = static_cast<int64_t>(static_cast<uint64_t>(sum) & mask);
+        int32_t y =
+            static_cast<int32_t>(std::clamp(sum >> k.bits, -kMaxSample,
+                                            kMaxSample));
+        samples[i * kChannels] = y;
+        x2 = x1;
+        x1 = x;
+        y2 = y1;
+        y1 = y;
+      }
+      h = {x1, x2, y1, y2, static_cast<uint32_t>(error)};
+    }
+  }
+}
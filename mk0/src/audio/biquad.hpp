@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+
+#include "util/const_math.hpp"
+
+namespace deloop {
+
+// Coefficients of one second order section, normalised so a0 is 1 and with
+// the feedback terms negated, so every term is a multiply-accumulate:
+//
+//   y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] + a1 y[n-1] + a2 y[n-2]
+//
+// All five are scaled by 2^`bits`, the most (up to `biquad::kMaxBits`) that
+// fits the largest in 32 bits. Poles close to 1, as in low cutoffs, keep all
+// 30 bits; boosts give some up for range.
+struct BiquadCoeffs {
+  int32_t b0;
+  int32_t b1;
+  int32_t b2;
+  int32_t a1;
+  int32_t a2;
+  int32_t bits;
+};
+
+// Designs from the Audio EQ Cookbook. Frequencies are in Hz, gains in dB.
+// All are constexpr, so fixed filters are designed at compile time, and
+// cheap enough to redesign at run time when a param changes.
+namespace biquad {
+
+constexpr int kMaxBits = 30;
+
+constexpr BiquadCoeffs Quantize(double b0, double b1, double b2, double a0,
+                                double a1, double a2) {
+  const double terms[5] = {b0 / a0, b1 / a0, b2 / a0, -a1 / a0, -a2 / a0};
+  double largest = 0.0;
+  for (double term : terms) {
+    largest = std::max(largest, term < 0.0 ? -term : term);
+  }
+  int bits = kMaxBits;
+  double scale = static_cast<double>(1 << kMaxBits);
+  while (bits > 0 && largest * scale >= 2147483647.0) {
+    bits--;
+    scale /= 2.0;
+  }
+
+  int32_t q[5] = {};
+  for (size_t i = 0; i < 5; i++) {
+    double scaled = terms[i] * scale + (terms[i] < 0.0 ? -0.5 : 0.5);
+    q[i] = static_cast<int32_t>(
+        std::clamp(scaled, -2147483647.0, 2147483647.0));
+  }
+  return {q[0], q[1], q[2], q[3], q[4], bits};
+}
+
+// Moves `b1` of a quantized section so its gain at DC is exactly `gain`.
+// Rounding each coefficient on its own leaves a low cutoff's DC gain off by
+// parts in a thousand, since its terms nearly cancel, so a high pass would
+// pass an offset.
+constexpr BiquadCoeffs WithDcGain(BiquadCoeffs section, double gain) {
+  int64_t unity = (int64_t{1} << section.bits) - section.a1 - section.a2;
+  double scaled = gain * static_cast<double>(unity);
+  int64_t sum = static_cast<int64_t>(scaled + (scaled < 0.0 ? -0.5 : 0.5));
+  int64_t b1 = sum - section.b0 - section.b2;
+  section.b1 = static_cast<int32_t>(
+      std::clamp<int64_t>(b1, -INT32_MAX, INT32_MAX));
+  return section;
+}
+
+// Angular frequency of `hz`, with its sine and cosine, and the bandwidth
+// term for a resonance of `q`.
+struct Angle {
+  double sin;
+  double cos;
+  double alpha;
+};
+
+constexpr Angle AngleOf(double hz, double q, double sample_rate) {
+  double w = 2.0 * std::numbers::pi * hz / sample_rate;
+  return {ConstSin(w), ConstCos(w), ConstSin(w) / (2.0 * q)};
+}
+
+// Square root of the linear gain of `db`, as the shelves and peak take it.
+constexpr double AmplitudeOf(double db) {
+  return ConstExp(db * std::numbers::ln10 / 40.0);
+}
+
+constexpr BiquadCoeffs LowPass(double hz, double q, double sample_rate) {
+  Angle w = AngleOf(hz, q, sample_rate);
+  return WithDcGain(Quantize((1.0 - w.cos) / 2.0, 1.0 - w.cos,
+                             (1.0 - w.cos) / 2.0, 1.0 + w.alpha,
+                             -2.0 * w.cos, 1.0 - w.alpha),
+                    1.0);
+}
+
+constexpr BiquadCoeffs HighPass(double hz, double q, double sample_rate) {
+  Angle w = AngleOf(hz, q, sample_rate);
+  return WithDcGain(Quantize((1.0 + w.cos) / 2.0, -(1.0 + w.cos),
+                             (1.0 + w.cos) / 2.0, 1.0 + w.alpha,
+                             -2.0 * w.cos, 1.0 - w.alpha),
+                    0.0);
+}
+
+constexpr BiquadCoeffs Peak(double hz, double q, double db,
+                            double sample_rate) {
+  Angle w = AngleOf(hz, q, sample_rate);
+  double a = AmplitudeOf(db);
+  return WithDcGain(Quantize(1.0 + w.alpha * a, -2.0 * w.cos,
+                             1.0 - w.alpha * a, 1.0 + w.alpha / a,
+                             -2.0 * w.cos, 1.0 - w.alpha / a),
+                    1.0);
+}
+
+constexpr BiquadCoeffs LowShelf(double hz, double q, double db,
+                                double sample_rate) {
+  Angle w = AngleOf(hz, q, sample_rate);
+  double a = AmplitudeOf(db);
+  double k = 2.0 * ConstSqrt(a) * w.alpha;
+  return WithDcGain(Quantize(a * ((a + 1.0) - (a - 1.0) * w.cos + k),
+                             2.0 * a * ((a - 1.0) - (a + 1.0) * w.cos),
+                             a * ((a + 1.0) - (a - 1.0) * w.cos - k),
+                             (a + 1.0) + (a - 1.0) * w.cos + k,
+                             -2.0 * ((a - 1.0) + (a + 1.0) * w.cos),
+                             (a + 1.0) + (a - 1.0) * w.cos - k),
+                    a * a);
+}
+
+constexpr BiquadCoeffs HighShelf(double hz, double q, double db,
+                                 double sample_rate) {
+  Angle w = AngleOf(hz, q, sample_rate);
+  double a = AmplitudeOf(db);
+  double k = 2.0 * ConstSqrt(a) * w.alpha;
+  return WithDcGain(Quantize(a * ((a + 1.0) + (a - 1.0) * w.cos + k),
+                             -2.0 * a * ((a - 1.0) + (a + 1.0) * w.cos),
+                             a * ((a + 1.0) + (a - 1.0) * w.cos - k),
+                             (a + 1.0) - (a - 1.0) * w.cos + k,
+                             2.0 * ((a - 1.0) - (a + 1.0) * w.cos),
+                             (a + 1.0) - (a - 1.0) * w.cos - k),
+                    1.0);
+}
+
+} // namespace biquad
+
+// Cascade of up to `kMaxSections` biquads filtering interleaved stereo
+// 24-bit frames in place, in Direct Form I.
+//
+// Each section runs over the whole block one channel at a time, with its
+// coefficients and that channel's history in registers. Products are summed
+// in 64 bits (SMLAL on the Cortex-M4, the same integer arithmetic elsewhere,
+// so the host gives identical results). What the shift back to 24 bits
+// drops is added to the next frame's sum, first order error feedback, so
+// low cutoffs with poles close to 1 neither offset DC nor hum in limit
+// cycles. Every section saturates its output to 24 bits.
+//
+// Only one task may use a cascade.
+class BiquadCascade {
+public:
+  static constexpr size_t kMaxSections = 8;
+  static constexpr size_t kChannels = 2;
+
+  // Sets the sections to filter through, at most `kMaxSections`. Sections
+  // keep their history, so coefficients can change between blocks without
+  // a jump; sections added start from silence. No sections pass frames
+  // through untouched.
+  void configure(const BiquadCoeffs *sections, size_t num_sections);
+
+  // Clears the history of every section.
+  void reset(void);
+
+  size_t sections(void) const { return num_sections_; }
+
+  // Filters `num_frames` interleaved frames of `frames` in place.
+  void process(uint32_t num_frames, int32_t *frames);
+
+private:
+  struct History {
+    int32_t x1;
+    int32_t x2;
+    int32_t y1;
+    int32_t y2;
+    uint32_t error; // Bits dropped from the last output.
+  };
+
+  std::array<BiquadCoeffs, kMaxSections> coeffs_ = {};
+  std::array<History, kMaxSections * kChannels> history_ = {};
+  size_t num_sections_ = 0;
+};
+
+} // namespace deloop
@@ -0,0 +1,128 @@
+#include "audio/clock.hpp"
+
+#include <cstdint>
+
+#include "audio/scheduler.hpp"
+#include "errors.hpp"
+#include "params.hpp"
+#include "util/seqlock.hpp"
+
+using namespace deloop;
+
+DELOOP_PARAM(bpm, "clock.bpm", 120.0f, 20.0f, 300.0f);
+DELOOP_PARAM(beats_per_bar, "clock.beats_per_bar", 4.0f, 1.0f, 16.0f);
+
+static struct {
+  bool started;
+  float bpm;
+  // Only touched by the audio task.
+  audio_clock::Position position;
+  // Copy of `position` for other tasks.
+  SeqLock<audio_clock::Position> shared;
+} state_ = {0};
+
+static uint32_t subFramesPerBeat(float beats_per_minute);
+static void updateTempo(uint64_t now);
+
+Error audio_clock::process(uint32_t num_frames, int32_t *tx, int32_t *rx) {
+  (void)num_frames;
+  (void)tx;
+  (void)rx;
+
+  Position &pos = state_.position;
+  uint64_t now = audio_scheduler::getCallbackFrame();
+  if (!state_.started) {
+    // The first beat starts on the first block the clock sees.
+    state_.bpm = bpm.value();
+    pos.sub_frames_per_beat = subFramesPerBeat(state_.bpm);
+    pos.beat_frame = now;
+    pos.next_beat = now * kSubFrames + pos.sub_frames_per_beat;
+    state_.started = true;
+  }
+
+  updateTempo(now);
+  pos.frame = now;
+  pos.beats_per_bar = static_cast<uint32_t>(beats_per_bar.value() + 0.5f);
+
+  // At most one beat per block at any tempo in range, but a late start or a
+  // skipped block must not leave the clock behind.
+  while (pos.next_beat / kSubFrames <= now) {
+    pos.beat_frame = pos.next_beat / kSubFrames;
+    pos.next_beat += pos.sub_frames_per_beat;
+    pos.beat++;
+    if (++pos.beat_in_bar >= pos.beats_per_bar) {
+      pos.beat_in_bar = 0;
+      pos.bar++;
+    }
+  }
+
+  state_.shared.store(pos);
+  return Error::kOk;
+}
+
+const audio_clock::Position &audio_clock::position(void) {
+  return state_.position;
+}
+
+audio_clock::Position audio_clock::getPosition(void) {
+  return state_.shared.load();
+}
+
+uint64_t audio_clock::nextBeatFrame(const Position &pos, uint64_t frame) {
+  if (frame <= pos.beat_frame) {
+    return pos.beat_frame;
+  }
+
+  uint64_t target = frame * kSubFrames;
+  uint64_t beat = pos.next_beat;
+  if (beat < target) {
+    uint64_t beats = (target - beat + pos.sub_frames_per_beat - 1) /
+                     pos.sub_frames_per_beat;
+    beat += beats * pos.sub_frames_per_beat;
+  }
+  return beat / kSubFrames;
+}
+
+uint64_t audio_clock::nextBarFrame(const Position &pos, uint64_t frame) {
+  if (pos.beat_in_bar == 0 && frame <= pos.beat_frame) {
+    return pos.beat_frame;
+  }
+
+  // The next downbeat, then whole bars after it.
+  uint64_t beats_left =
+      pos.beats_per_bar > pos.beat_in_bar
+          ? pos.beats_per_bar - pos.beat_in_bar - 1
+          : 0;
+  uint64_t bar = pos.next_beat + beats_left * pos.sub_frames_per_beat;
+  uint64_t target = frame * kSubFrames;
+  if (bar < target) {
+    uint64_t bar_length =
+        static_cast<uint64_t>(pos.beats_per_bar) * pos.sub_frames_per_beat;
+    bar += (target - bar + bar_length - 1) / bar_length * bar_length;
+  }
+  return bar / kSubFrames;
+}
+
+static uint32_t subFramesPerBeat(float beats_per_minute) {
+  return static_cast<uint32_t>(audio_scheduler::kSampleRate * 60.0f *
+                               audio_clock::kSubFrames / beats_per_minute);
+}
+
+// Applies a tempo change, keeping the phase of the current beat.
+static void updateTempo(uint64_t now) {
+  float value = bpm.value();
+  if (value == state_.bpm) {
+    return;
+  }
+
+  audio_clock::Position &pos = state_.position;
+  uint32_t sub_frames_per_beat = subFramesPerBeat(value);
+  uint64_t now_sub = now * audio_clock::kSubFrames;
+  if (pos.next_beat > now_sub) {
+    uint64_t remaining = pos.next_beat - now_sub;
+    pos.next_beat = now_sub + remaining * sub_frames_per_beat /
+                                  pos.sub_frames_per_beat;
+  }
+  pos.sub_frames_per_beat = sub_frames_per_beat;
+  state_.bpm = value;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+
+#include "errors.hpp"
+
+namespace deloop {
+namespace audio_clock {
+
+// Musical timebase derived from the scheduler's frame time (see
+// `audio_scheduler::getFrameTime`). Tempo and meter are the `clock.bpm` and
+// `clock.beats_per_bar` parameters.
+//
+// `process` must be the first scheduler callback. It advances the position
+// once per block, so every later callback reads it for free with
+// `position()`. Beat frames are kept in 1/256 frame units, so tempos that
+// are not a whole number of frames per beat do not drift.
+
+// Sub-frame units per frame of `Position::next_beat`.
+constexpr uint32_t kSubFrames = 256;
+
+struct Position {
+  uint64_t frame;      // First frame of the block.
+  uint64_t beat;       // Beats since the clock started, 0 for the first.
+  uint64_t bar;        // Bars since the clock started, 0 for the first.
+  uint64_t beat_frame; // Frame the current beat started on.
+  uint64_t next_beat;  // Start of the next beat, in sub-frames.
+  uint32_t beat_in_bar;
+  uint32_t beats_per_bar;
+  uint32_t sub_frames_per_beat;
+};
+
+// Advances the position to the block. Register before any callback that uses
+// the clock.
+Error process(uint32_t num_frames, int32_t *tx, int32_t *rx);
+
+// Position at the start of the current block. Only valid in the audio task.
+const Position &position(void);
+
+// Position at the start of the last block. Safe to call from any task.
+Position getPosition(void);
+
+// Start frame of the first beat or bar at or after `frame`, assuming the
+// tempo and meter of `pos` hold. `frame` should not precede `pos.frame`.
+uint64_t nextBeatFrame(const Position &pos, uint64_t frame);
+uint64_t nextBarFrame(const Position &pos, uint64_t frame);
+
+// Returns true if a beat starts within the `num_frames` frames of the block,
+// setting `offset` to its first frame.
+inline bool beatInBlock(const Position &pos, uint32_t num_frames,
+                        uint32_t &offset) {
+  if (pos.beat_frame == pos.frame) {
+    offset = 0;
+    return true;
+  }
+
+  uint64_t next = pos.next_beat / kSubFrames;
+  if (next < pos.frame + num_frames) {
+    offset = static_cast<uint32_t>(next - pos.frame);
+    return true;
+  }
+  return false;
+}
+
+// Place in the bar of the beat `beatInBlock` found at `offset`: the current
+// beat if it starts the block, otherwise the next, wrapped the way `process`
+// wraps it, so a meter lowered below the current beat makes it a downbeat.
+inline uint32_t beatInBar(const Position &pos, uint32_t offset) {
+  if (offset == 0 && pos.beat_frame == pos.frame) {
+    return pos.beat_in_bar;
+  }
+  uint32_t next = pos.beat_in_bar + 1;
+  return next >= pos.beats_per_bar ? 0 : next;
+}
+
+} // namespace audio_clock
+} // namespace deloop
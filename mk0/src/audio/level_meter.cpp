@@ -0,0 +1,54 @@
+#include "audio/level_meter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+using namespace deloop;
+
+// A little below a 24-bit LSB, so silence floors at -144 dBFS.
+const float kMinLevel = 0.5f;
+const int32_t kMinCb = -1440;
+
+void LevelMeter::measure(uint32_t num_frames, const int32_t *frames) {
+  uint32_t clips = 0;
+  for (size_t c = 0; c < kChannels; c++) {
+    int32_t peak = peak_[c];
+    uint64_t squares = 0;
+    for (uint32_t i = 0; i < num_frames; i++) {
+      int32_t sample = frames[i * kChannels + c];
+      int32_t level = std::abs(sample);
+      peak = std::max(peak, level);
+      int32_t shifted = sample >> kSquareShift;
+      squares += static_cast<uint64_t>(static_cast<int64_t>(shifted) * shifted);
+      clips += level >= kFullScale ? 1 : 0;
+    }
+    peak_[c] = peak;
+    squares_[c] += squares;
+  }
+  clips_ += clips;
+  frames_ += num_frames;
+}
+
+LevelMeter::Levels LevelMeter::take(void) {
+  Levels levels = {frames_, peak_, {}, clips_};
+  for (size_t c = 0; c < kChannels; c++) {
+    if (frames_ > 0) {
+      float mean = static_cast<float>(squares_[c]) /
+                   static_cast<float>(frames_);
+      levels.rms[c] = std::sqrt(mean) * (1 << kSquareShift);
+    }
+  }
+  frames_ = 0;
+  peak_ = {};
+  squares_ = {};
+  clips_ = 0;
+  return levels;
+}
+
+int32_t deloop::LevelCb(float level) {
+  float db = 20.0f * std::log10(std::max(level, kMinLevel) /
+                                static_cast<float>(LevelMeter::kFullScale));
+  return std::max(static_cast<int32_t>(std::lround(db * 10.0f)), kMinCb);
+}
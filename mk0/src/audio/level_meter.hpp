@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace deloop {
+
+// Peak, RMS and clip count of interleaved stereo 24-bit frames, gathered a
+// block at a time in one pass and read out once per window.
+//
+// Squares are summed in 64 bits after dropping the bottom `kSquareShift`
+// bits of each sample, so a window of full scale frames can run for over
+// 5 s without overflowing.
+//
+// Only one task may use a meter.
+class LevelMeter {
+public:
+  static constexpr size_t kChannels = 2;
+  static constexpr int32_t kFullScale = 0x7FFFFF;
+  static constexpr int kSquareShift = 2;
+  static constexpr uint32_t kMaxWindowFrames = 1u << 18;
+
+  // Levels are linear, in 24-bit sample units.
+  struct Levels {
+    uint32_t frames;
+    std::array<int32_t, kChannels> peak;
+    std::array<float, kChannels> rms;
+    uint32_t clips; // Samples at full scale, on either channel.
+  };
+
+  // Adds `num_frames` frames of `frames` to the window.
+  void measure(uint32_t num_frames, const int32_t *frames);
+
+  // Frames in the window so far.
+  uint32_t frames(void) const { return frames_; }
+
+  // Levels over the window, then starts a new one.
+  Levels take(void);
+
+private:
+  uint32_t frames_ = 0;
+  std::array<int32_t, kChannels> peak_ = {};
+  std::array<uint64_t, kChannels> squares_ = {};
+  uint32_t clips_ = 0;
+};
+
+// Level relative to full scale, in centibels (tenths of a dB), down to
+// -1440 (-144 dBFS) for silence.
+int32_t LevelCb(float level);
+
+} // namespace deloop
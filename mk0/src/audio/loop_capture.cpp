@@ -0,0 +1,90 @@
+#include "audio/loop_capture.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "audio/loop_codec.hpp"
+
+using namespace deloop;
+
+void LoopCapture::process(uint64_t frame, uint32_t num_frames,
+                          const int32_t *rx) {
+  if (pool_ == nullptr) {
+    return;
+  } else if (pool_->tail() != ring_ || frame != frame_) {
+    restart(frame);
+  }
+  frame_ = frame + num_frames;
+  if (ring_blocks_ < 2) {
+    return;
+  }
+
+  const uint32_t block_words = static_cast<uint32_t>(LoopBlockWords(format_));
+  for (uint32_t done = 0; done < num_frames;) {
+    uint32_t n = std::min(num_frames - done,
+                          static_cast<uint32_t>(kLoopBlockFrames) - fill_);
+    const int32_t *in = &rx[done * kLoopBlockChannels];
+    int16_t *out = &cache_[fill_ * kLoopBlockChannels];
+    for (size_t i = 0; i < n * kLoopBlockChannels; i++) {
+      out[i] = static_cast<int16_t>(in[i] >> kLoopStorageShift);
+    }
+    done += n;
+    fill_ += n;
+
+    if (fill_ == kLoopBlockFrames) {
+      EncodeLoopBlock(format_, cache_, &ring_[write_block_ * block_words],
+                      codec_state_);
+      write_block_ = (write_block_ + 1) % ring_blocks_;
+      held_ = std::min(held_ + 1, ring_blocks_ - 1);
+      fill_ = 0;
+    }
+  }
+}
+
+bool LoopCapture::take(uint64_t start, LoopHistory &history) {
+  if (pool_ == nullptr || ring_blocks_ < 2 || pool_->tail() != ring_ ||
+      start < oldest() || start > frame_) {
+    return false;
+  }
+
+  // The region records on in the track it is handed to.
+  LoopPool::Region region = pool_->allocate(true);
+  if (region == LoopPool::kNoRegion) {
+    return false;
+  }
+  // The region starts at the tail, over the ring.
+  pool_->grow(region, ring_blocks_ *
+                          static_cast<uint32_t>(LoopBlockWords(format_)));
+
+  // Blocks back from the one being captured to the one holding `start`.
+  uint64_t partial_start = frame_ - fill_;
+  uint32_t back = start >= partial_start
+                      ? 0
+                      : static_cast<uint32_t>(
+                            (partial_start - start + kLoopBlockFrames - 1) /
+                            kLoopBlockFrames);
+  uint64_t first_start = partial_start - back * kLoopBlockFrames;
+
+  history.region = region;
+  history.format = format_;
+  history.wrap_blocks = ring_blocks_;
+  history.first_block = (write_block_ + ring_blocks_ - back) % ring_blocks_;
+  history.skip = static_cast<uint32_t>(start - first_start);
+  history.frames = static_cast<uint32_t>(frame_ - start);
+  std::copy(std::begin(cache_), std::end(cache_), history.partial);
+  history.state = codec_state_;
+
+  ring_ = nullptr;
+  return true;
+}
+
+void LoopCapture::restart(uint64_t frame) {
+  ring_ = pool_->tail();
+  ring_blocks_ = std::min(pool_->tailWords(), max_words_) /
+                 static_cast<uint32_t>(LoopBlockWords(format_));
+  write_block_ = 0;
+  held_ = 0;
+  frame_ = frame;
+  fill_ = 0;
+  codec_state_ = {};
+}
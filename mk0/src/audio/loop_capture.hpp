@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "audio/loop_codec.hpp"
+#include "audio/loop_pool.hpp"
+
+namespace deloop {
+
+// Recent input handed from a `LoopCapture` to a `LoopTrack`, which records on
+// from it. The coded blocks stay where they were captured: `region` holds
+// `wrap_blocks` blocks in ring order, starting with block `first_block`.
+struct LoopHistory {
+  LoopPool::Region region;
+  LoopFormat format;
+  uint32_t wrap_blocks;
+  uint32_t first_block;
+  uint32_t skip;   // Frames of the first block before the start.
+  uint32_t frames; // Frames from the start to now.
+  // The block being captured, decoded, and the codec state it starts from.
+  int16_t partial[kLoopBlockSamples];
+  LoopCodecState state;
+};
+
+// Always-on capture of the input into a ring of coded blocks, so recordings
+// can start in the past.
+//
+// The ring lives in the free words at the tail of a `LoopPool`, where the
+// next region will be allocated, and takes no memory of its own. Handing
+// history to a track allocates that region over the ring, so nothing is
+// copied. Anything that moves the tail (a region growing, a region freed or
+// compaction finishing a move) discards the history and capture starts over
+// at the new tail. In particular, nothing is captured while a track records
+// its first pass.
+//
+// Only the audio task may use a capture.
+class LoopCapture {
+public:
+  LoopCapture() = default;
+  // Captures in `format`, in at most `max_words` words of the pool tail.
+  LoopCapture(LoopPool &pool, LoopFormat format, uint32_t max_words)
+      : pool_(&pool), format_(format), max_words_(max_words) {}
+
+  // Captures `num_frames` interleaved frames of `rx`, the first at frame time
+  // `frame`. Call after anything that changes the pool in the same block.
+  void process(uint64_t frame, uint32_t num_frames, const int32_t *rx);
+
+  // Oldest frame held, or the next frame to be captured if none is.
+  uint64_t oldest(void) const {
+    return frame_ - fill_ - held_ * kLoopBlockFrames;
+  }
+  LoopFormat format(void) const { return format_; }
+
+  // Hands the frames from `start` on to `history` and starts capture over.
+  // Returns false, changing nothing, if `start` is not held.
+  bool take(uint64_t start, LoopHistory &history);
+
+private:
+  void restart(uint64_t frame);
+
+  LoopPool *pool_ = nullptr;
+  LoopFormat format_ = LoopFormat::kPcm16;
+  uint32_t max_words_ = 0;
+
+  uint32_t *ring_ = nullptr;
+  uint32_t ring_blocks_ = 0;
+  uint32_t write_block_ = 0; // Where the block being captured goes.
+  // Complete blocks held, one less than the ring so the block being
+  // captured never overwrites one of them.
+  uint32_t held_ = 0;
+  uint64_t frame_ = 0; // Next frame to capture.
+
+  int16_t cache_[kLoopBlockSamples] = {};
+  uint32_t fill_ = 0; // Frames in `cache_`.
+  LoopCodecState codec_state_ = {};
+};
+
+} // namespace deloop
@@ -0,0 +1,170 @@
+#include "audio/loop_codec.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+using namespace deloop;
+
+static_assert(LoopBlockWords(LoopFormat::kPcm16) <= kMaxLoopBlockWords);
+static_assert(LoopBlockWords(LoopFormat::kPcm12) <= kMaxLoopBlockWords);
+static_assert(LoopBlockWords(LoopFormat::kAdpcm4) <= kMaxLoopBlockWords);
+
+// Samples per channel in a block.
+const size_t kChannelSamples = kLoopBlockFrames;
+
+// IMA-ADPCM step sizes and step index adjustments.
+const int16_t kStepSizes[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+    19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+    337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+    876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+    5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+const int8_t kIndexAdjust[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+const int kMaxStepIndex = 88;
+
+static void encodePcm12(const int16_t *samples, uint32_t *words) {
+  // Bits are appended low first, so every 8 samples fill 3 words.
+  uint64_t bits = 0;
+  int num_bits = 0;
+  for (size_t i = 0; i < kLoopBlockSamples; i++) {
+    bits |= static_cast<uint64_t>(static_cast<uint16_t>(samples[i]) >> 4)
+            << num_bits;
+    num_bits += 12;
+    if (num_bits >= 32) {
+      *words++ = static_cast<uint32_t>(bits);
+      bits >>= 32;
+      num_bits -= 32;
+    }
+  }
+}
+
+static void decodePcm12(const uint32_t *words, int16_t *samples) {
+  uint64_t bits = 0;
+  int num_bits = 0;
+  for (size_t i = 0; i < kLoopBlockSamples; i++) {
+    if (num_bits < 12) {
+      bits |= static_cast<uint64_t>(*words++) << num_bits;
+      num_bits += 32;
+    }
+    samples[i] = static_cast<int16_t>((bits & 0xFFF) << 4);
+    bits >>= 12;
+    num_bits -= 12;
+  }
+}
+
+// Adds the step selected by `nibble` to `predictor`, as both the encoder and
+// decoder must.
+static inline int32_t adpcmStep(int32_t predictor, int &index,
+                                uint32_t nibble) {
+  int32_t step = kStepSizes[index];
+  int32_t delta = step >> 3;
+  if (nibble & 4) {
+    delta += step;
+  }
+  if (nibble & 2) {
+    delta += step >> 1;
+  }
+  if (nibble & 1) {
+    delta += step >> 2;
+  }
+  predictor += (nibble & 8) ? -delta : delta;
+  index = std::clamp(index + kIndexAdjust[nibble & 7], 0, kMaxStepIndex);
+  return std::clamp<int32_t>(predictor, INT16_MIN, INT16_MAX);
+}
+
+static void encodeAdpcm(const int16_t *samples, uint32_t *words,
+                        LoopCodecState &state) {
+  uint32_t *data = &words[kLoopBlockChannels];
+  for (size_t c = 0; c < kLoopBlockChannels; c++) {
+    // Each channel starts from its first sample, stored in the header.
+    int32_t predictor = samples[c];
+    int index = state.step_index[c];
+    words[c] = static_cast<uint16_t>(predictor) |
+               static_cast<uint32_t>(index) << 16;
+
+    for (size_t i = 0; i < kChannelSamples; i++) {
+      int32_t diff = samples[i * kLoopBlockChannels + c] - predictor;
+      uint32_t nibble = 0;
+      if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+      }
+
+      int32_t step = kStepSizes[index];
+      if (diff >= step) {
+        nibble |= 4;
+        diff -= step;
+      }
+      if (diff >= step >> 1) {
+        nibble |= 2;
+        diff -= step >> 1;
+      }
+      if (diff >= step >> 2) {
+        nibble |= 1;
+      }
+
+      predictor = adpcmStep(predictor, index, nibble);
+      if (i % 8 == 0) {
+        data[i / 8] = 0;
+      }
+      data[i / 8] |= nibble << (4 * (i % 8));
+    }
+    state.step_index[c] = static_cast<uint8_t>(index);
+    data += kChannelSamples / 8;
+  }
+}
+
+static void decodeAdpcm(const uint32_t *words, int16_t *samples,
+                        LoopCodecState &state) {
+  const uint32_t *data = &words[kLoopBlockChannels];
+  for (size_t c = 0; c < kLoopBlockChannels; c++) {
+    int32_t predictor = static_cast<int16_t>(words[c] & 0xFFFF);
+    int index = std::min<int>((words[c] >> 16) & 0xFF, kMaxStepIndex);
+    state.step_index[c] = static_cast<uint8_t>(index);
+
+    for (size_t i = 0; i < kChannelSamples; i += 8) {
+      uint32_t nibbles = data[i / 8];
+      for (size_t j = 0; j < 8; j++, nibbles >>= 4) {
+        predictor = adpcmStep(predictor, index, nibbles & 0xF);
+        samples[(i + j) * kLoopBlockChannels + c] =
+            static_cast<int16_t>(predictor);
+      }
+    }
+    data += kChannelSamples / 8;
+  }
+}
+
+void deloop::EncodeLoopBlock(LoopFormat format, const int16_t *samples,
+                             uint32_t *words, LoopCodecState &state) {
+  switch (format) {
+  case LoopFormat::kPcm16:
+    std::memcpy(words, samples, kLoopBlockSamples * sizeof(int16_t));
+    break;
+  case LoopFormat::kPcm12:
+    encodePcm12(samples, words);
+    break;
+  case LoopFormat::kAdpcm4:
+    encodeAdpcm(samples, words, state);
+    break;
+  }
+}
+
+void deloop::DecodeLoopBlock(LoopFormat format, const uint32_t *words,
+                             int16_t *samples, LoopCodecState &state) {
+  switch (format) {
+  case LoopFormat::kPcm16:
+    std::memcpy(samples, words, kLoopBlockSamples * sizeof(int16_t));
+    break;
+  case LoopFormat::kPcm12:
+    decodePcm12(words, samples);
+    break;
+  case LoopFormat::kAdpcm4:
+    decodeAdpcm(words, samples, state);
+    break;
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace deloop {
+
+// Storage formats for loop audio. Loops are coded in independent blocks of
+// `kLoopBlockFrames` interleaved stereo frames, so playback can start at any
+// block and an overdub re-codes only the blocks it touches.
+//
+// Samples enter and leave the codecs as the top 16 of the 24 sample bits.
+enum class LoopFormat : uint8_t {
+  kPcm16,  // Lossless at 16 bits, 32 words per block.
+  kPcm12,  // Top 12 bits, packed, 24 words per block.
+  kAdpcm4, // IMA-ADPCM, 4 bits per sample, 10 words per block.
+};
+
+constexpr size_t kLoopBlockFrames = 32;
+constexpr size_t kLoopBlockChannels = 2;
+constexpr size_t kLoopBlockSamples = kLoopBlockFrames * kLoopBlockChannels;
+
+// Largest block of any format, in 32-bit words.
+constexpr size_t kMaxLoopBlockWords = 32;
+
+// Shift from a 24-bit sample to the 16 bits the codecs take, and back.
+constexpr int kLoopStorageShift = 8;
+
+constexpr size_t LoopBlockWords(LoopFormat format) {
+  switch (format) {
+  case LoopFormat::kPcm16:
+    return kLoopBlockSamples / 2;
+  case LoopFormat::kPcm12:
+    return kLoopBlockSamples * 12 / 32;
+  case LoopFormat::kAdpcm4:
+    // A header word per channel, then 8 samples per word.
+    return kLoopBlockChannels + kLoopBlockSamples / 8;
+  }
+  return kMaxLoopBlockWords;
+}
+
+// Encoder state carried from one block to the next. ADPCM blocks start from
+// the step size the previous block ended on, which avoids re-learning the
+// signal level at every block.
+struct LoopCodecState {
+  uint8_t step_index[kLoopBlockChannels];
+};
+
+// Codes `kLoopBlockSamples` samples into `LoopBlockWords(format)` words,
+// starting from `state` and leaving the state the block ended on.
+void EncodeLoopBlock(LoopFormat format, const int16_t *samples,
+                     uint32_t *words, LoopCodecState &state);
+
+// Decodes a block, setting `state` to the state it was encoded from, so
+// re-encoding it after an overdub starts the same way.
+void DecodeLoopBlock(LoopFormat format, const uint32_t *words,
+                     int16_t *samples, LoopCodecState &state);
+
+} // namespace deloop
@@ -0,0 +1,111 @@
+#include "audio/loop_pool.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+using namespace deloop;
+
+LoopPool::LoopPool(std::span<uint32_t> memory)
+    : memory_(memory.data()),
+      capacity_(static_cast<uint32_t>(memory.size())) {}
+
+LoopPool::Region LoopPool::allocate(bool open) {
+  for (size_t i = 0; i < kMaxRegions; i++) {
+    Slot &slot = regions_[i];
+    if (slot.used) {
+      continue;
+    }
+
+    uint32_t base = num_regions_ > 0 ? end(num_regions_ - 1) : 0;
+    slot = {true, base, 0, base, 0, open};
+    order_[num_regions_++] = static_cast<Region>(i);
+    return static_cast<Region>(i);
+  }
+  return kNoRegion;
+}
+
+void LoopPool::free(Region region) {
+  regions_[region].used = false;
+  Region *last = order_.data() + num_regions_;
+  std::remove(order_.data(), last, region);
+  num_regions_--;
+}
+
+bool LoopPool::grow(Region region, uint32_t words) {
+  if (num_regions_ == 0 || order_[num_regions_ - 1] != region ||
+      words > capacity_ - end(num_regions_ - 1)) {
+    return false;
+  }
+
+  regions_[region].size += words;
+  return true;
+}
+
+uint32_t *LoopPool::words(Region region, uint32_t index,
+                          uint32_t &contiguous) {
+  const Slot &slot = regions_[region];
+  if (index < slot.moved) {
+    contiguous = slot.moved - index;
+    return &memory_[slot.target + index];
+  }
+
+  contiguous = slot.size - index;
+  return &memory_[slot.base + index];
+}
+
+uint32_t LoopPool::compact(uint32_t max_words) {
+  uint32_t done = 0;
+  while (done < max_words) {
+    // The first region that is part way through a move or has a gap before
+    // it. Every region before it is already packed.
+    uint32_t packed_end = 0;
+    size_t i = 0;
+    for (; i < num_regions_; i++) {
+      const Slot &slot = regions_[order_[i]];
+      if (slot.moved > 0 || slot.base > packed_end) {
+        break;
+      }
+      packed_end = slot.base + slot.size;
+    }
+    if (i == num_regions_) {
+      break;
+    }
+
+    // Words move in ascending order to a lower address, so a chunk never
+    // overwrites words of the region that have yet to move.
+    Slot &slot = regions_[order_[i]];
+    if (slot.moved == 0) {
+      slot.target = packed_end;
+    }
+    uint32_t n = std::min(max_words - done, slot.size - slot.moved);
+    std::memmove(&memory_[slot.target + slot.moved],
+                 &memory_[slot.base + slot.moved], n * sizeof(uint32_t));
+    slot.moved += n;
+    done += n;
+
+    if (slot.moved == slot.size) {
+      slot.base = slot.target;
+      slot.moved = 0;
+    }
+  }
+  return done;
+}
+
+uint32_t LoopPool::freeWords(void) const {
+  uint32_t used = 0;
+  for (size_t i = 0; i < num_regions_; i++) {
+    used += regions_[order_[i]].size;
+  }
+  return capacity_ - used;
+}
+
+uint32_t LoopPool::tailWords(void) const {
+  return capacity_ - (num_regions_ > 0 ? end(num_regions_ - 1) : 0);
+}
+
+uint32_t LoopPool::end(size_t i) const {
+  const Slot &slot = regions_[order_[i]];
+  return slot.base + slot.size;
+}
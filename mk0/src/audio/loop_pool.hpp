@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace deloop {
+
+// Variable-length regions of loop memory, carved from one buffer of 32-bit
+// words. What a word holds is up to the region's owner; loop tracks store
+// coded blocks of audio (see `loop_codec.hpp`).
+//
+// Regions are kept contiguous and in address order. A new region starts
+// after every other one, so the last region can grow into the free space at
+// the end of the pool as it records. Freeing a region leaves a gap, which
+// `compact` closes a few words at a time by sliding the regions after it
+// down. A region stays readable and writable while it moves: words already
+// moved are at their new address and the rest at the old one, so callers
+// must look words up with `words` rather than keep pointers across calls.
+//
+// Only the audio task may use a pool.
+class LoopPool {
+public:
+  using Region = uint8_t;
+
+  static constexpr size_t kMaxRegions = 12;
+  static constexpr Region kNoRegion = 0xFF;
+
+  LoopPool() = default;
+  explicit LoopPool(std::span<uint32_t> memory);
+
+  // Returns an empty region at the end of the pool, or `kNoRegion` if every
+  // region is in use. An `open` region is one its owner means to keep
+  // growing, like a recording, until it calls `seal`.
+  Region allocate(bool open = false);
+  void free(Region region);
+  void seal(Region region) { regions_[region].open = false; }
+
+  // Extends `region` by `words` words, or returns false and leaves it as is
+  // if there is not room. Only the last region can grow.
+  bool grow(Region region, uint32_t words);
+
+  uint32_t size(Region region) const { return regions_[region].size; }
+
+  // Returns word `index` of `region` and sets `contiguous` to the number of
+  // words stored after it, itself included, before the next lookup is
+  // needed.
+  uint32_t *words(Region region, uint32_t index, uint32_t &contiguous);
+
+  // Moves at most `max_words` words towards the start of the pool and
+  // returns how many were moved, 0 once there are no gaps left.
+  uint32_t compact(uint32_t max_words);
+
+  uint32_t capacity(void) const { return capacity_; }
+  // Words not in any region.
+  uint32_t freeWords(void) const;
+  // Free words after the last region, which it can grow into.
+  uint32_t tailWords(void) const;
+  // Whether the last region is open, so allocating now would cut it short.
+  bool tailOpen(void) const {
+    return num_regions_ > 0 && regions_[order_[num_regions_ - 1]].open;
+  }
+  // First free word after the last region, where the next region allocated
+  // will start. Free words may be used as scratch until then.
+  uint32_t *tail(void) {
+    return &memory_[num_regions_ > 0 ? end(num_regions_ - 1) : 0];
+  }
+
+private:
+  struct Slot {
+    bool used;
+    uint32_t base;   // Address of word 0, for words not yet moved.
+    uint32_t size;   // Words.
+    uint32_t target; // Address of word 0 once moved.
+    uint32_t moved;  // Words already at `target`.
+    bool open;
+  };
+
+  // End of the words stored at the old address of the `i`th region.
+  uint32_t end(size_t i) const;
+
+  uint32_t *memory_ = nullptr;
+  uint32_t capacity_ = 0;
+  std::array<Slot, kMaxRegions> regions_ = {};
+  // Regions in use, in address order.
+  std::array<Region, kMaxRegions> order_ = {};
+  size_t num_regions_ = 0;
+};
+
+} // namespace deloop
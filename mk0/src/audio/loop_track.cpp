@@ -0,0 +1,402 @@
+#include "audio/loop_track.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "audio/loop_codec.hpp"
+
+using namespace deloop;
+
+// Marks the first journal entry of a layer.
+const uint32_t kLayerStart = 1u << 31;
+
+// Kernels over `n` decoded samples that do not cross a block. Each touches
+// every sample once, playing, decaying and recording in the same pass.
+
+static void recordSamples(int16_t *loop, const int32_t *rx, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    loop[i] = static_cast<int16_t>(rx[i] >> kLoopStorageShift);
+  }
+}
+
+// Returns true if any sample of the loop changed.
+static bool overdubSamples(int16_t *loop, int16_t *out, const int32_t *rx,
+                           size_t n, int32_t feedback) {
+  int32_t changed = 0;
+  for (size_t i = 0; i < n; i++) {
+    int32_t sample = loop[i];
+    out[i] = static_cast<int16_t>(sample);
+    int32_t dubbed = std::clamp<int32_t>(
+        ((sample * feedback) >> 15) + (rx[i] >> kLoopStorageShift), INT16_MIN,
+        INT16_MAX);
+    changed |= dubbed ^ sample;
+    loop[i] = static_cast<int16_t>(dubbed);
+  }
+  return changed != 0;
+}
+
+// Copy `n` words between a buffer and a region, which may be part way
+// through a move.
+
+static void readWords(LoopPool &pool, LoopPool::Region region,
+                      uint32_t first, uint32_t *words, uint32_t n) {
+  for (uint32_t i = 0; i < n;) {
+    uint32_t contiguous = 0;
+    const uint32_t *src = pool.words(region, first + i, contiguous);
+    uint32_t run = std::min(contiguous, n - i);
+    std::copy(src, src + run, &words[i]);
+    i += run;
+  }
+}
+
+static void writeWords(LoopPool &pool, LoopPool::Region region,
+                       uint32_t first, const uint32_t *words, uint32_t n) {
+  for (uint32_t i = 0; i < n;) {
+    uint32_t contiguous = 0;
+    uint32_t *dst = pool.words(region, first + i, contiguous);
+    uint32_t run = std::min(contiguous, n - i);
+    std::copy(&words[i], &words[i + run], dst);
+    i += run;
+  }
+}
+
+void LoopTrack::apply(Action action, LoopFormat format) {
+  resampling_ = false;
+  switch (action) {
+  case Action::kRecord:
+    clear();
+    region_ = pool_ != nullptr ? pool_->allocate(true) : LoopPool::kNoRegion;
+    if (region_ != LoopPool::kNoRegion) {
+      state_ = State::kRecording;
+      format_ = format;
+    }
+    return;
+  case Action::kClear:
+    clear();
+    return;
+  case Action::kUndo:
+  case Action::kRedo: {
+    bool undo = action == Action::kUndo;
+    if (swapping() ||
+        (undo ? journal_top_ == 0 : journal_top_ == journal_end_)) {
+      return;
+    } else if (state_ == State::kOverdubbing) {
+      flush();
+      state_ = State::kPlaying;
+    }
+    swap_step_ = undo ? -1 : 1;
+    return;
+  }
+  case Action::kPlay:
+  case Action::kOverdub:
+  case Action::kPause:
+    break;
+  }
+
+  if (state_ == State::kIdle) {
+    return;
+  } else if (state_ == State::kRecording) {
+    close();
+    if (state_ == State::kIdle) {
+      return;
+    }
+  } else if (state_ == State::kPaused) {
+    head_ = 0;
+  }
+
+  flush();
+  new_layer_ = action == Action::kOverdub;
+  journal_lost_ = false;
+  resume_overdub_ = action == Action::kOverdub && swapping();
+  state_ = action == Action::kPlay || resume_overdub_ ? State::kPlaying
+           : action == Action::kOverdub               ? State::kOverdubbing
+                                                      : State::kPaused;
+}
+
+void LoopTrack::setSpeed(uint32_t step, Interpolation quality) {
+  step_ = std::min(step, Resampler::kMaxStep);
+  quality_ = quality;
+}
+
+void LoopTrack::adopt(const LoopHistory &history) {
+  clear();
+  region_ = history.region;
+  format_ = history.format;
+  state_ = State::kRecording;
+  head_ = history.frames;
+  skip_ = history.skip;
+  wrap_blocks_ = history.wrap_blocks;
+  first_block_ = history.first_block;
+  std::copy(std::begin(history.partial), std::end(history.partial), cache_);
+  codec_state_ = history.state;
+}
+
+bool LoopTrack::process(uint32_t num_frames, int16_t *out, const int32_t *rx,
+                        int32_t feedback) {
+  for (uint32_t i = 0; i < kSwapsPerProcess && swapping(); i++) {
+    swapEntry();
+  }
+
+  // Each pass runs up to the end of the block, the loop or the codec block
+  // under the head.
+  bool audible = false;
+  uint32_t done = 0;
+  while (done < num_frames) {
+    size_t offset = done * kNumChannels;
+    uint32_t stored = head_ + skip_;
+    uint32_t block = static_cast<uint32_t>(stored / kLoopBlockFrames);
+    uint32_t frame = static_cast<uint32_t>(stored % kLoopBlockFrames);
+    uint32_t n = std::min(num_frames - done,
+                          static_cast<uint32_t>(kLoopBlockFrames) - frame);
+    int16_t *loop = &cache_[frame * kNumChannels];
+    switch (state_) {
+    case State::kIdle:
+    case State::kPaused:
+      if (audible) {
+        std::fill(&out[offset], &out[num_frames * kNumChannels], 0);
+      }
+      return audible;
+    case State::kRecording: {
+      uint32_t block_words = static_cast<uint32_t>(LoopBlockWords(format_));
+      if (pool_->size(region_) < blockWord(block) + block_words &&
+          !pool_->grow(region_, block_words)) {
+        close();
+        state_ = length_ > 0 ? State::kPlaying : State::kIdle;
+        continue;
+      }
+      recordSamples(loop, &rx[offset], n * kNumChannels);
+      std::fill(&out[offset], &out[offset + n * kNumChannels], 0);
+      head_ += n;
+      if (frame + n == kLoopBlockFrames) {
+        store(block, codec_state_);
+      }
+    } break;
+    case State::kPlaying:
+      if (step_ != Resampler::kUnitStep) {
+        playResampled(num_frames - done, &out[offset]);
+        return true;
+      }
+      resampling_ = false;
+      load(block);
+      n = std::min(n, length_ - head_);
+      std::copy(loop, loop + n * kNumChannels, &out[offset]);
+      audible = true;
+      head_ = (head_ + n == length_) ? 0 : head_ + n;
+      break;
+    case State::kOverdubbing:
+      load(block);
+      n = std::min(n, length_ - head_);
+      if (overdubSamples(loop, &out[offset], &rx[offset], n * kNumChannels,
+                         feedback) &&
+          !dirty_) {
+        journal(block);
+        dirty_ = true;
+      }
+      audible = true;
+      head_ = (head_ + n == length_) ? 0 : head_ + n;
+      if (head_ == 0) {
+        // Each pass is a layer of its own.
+        flush();
+        new_layer_ = true;
+        journal_lost_ = false;
+      }
+      break;
+    }
+    done += n;
+  }
+  return audible;
+}
+
+void LoopTrack::playResampled(uint32_t num_frames, int16_t *out) {
+  if (!resampling_) {
+    // Start with the frames around the head, so the speed can change
+    // without a jump.
+    resampler_.reset();
+    uint32_t behind = static_cast<uint32_t>(Resampler::kCentre) % length_;
+    read_ = (head_ + length_ - behind) % length_;
+    for (size_t i = 0; i < Resampler::kTaps; i++) {
+      resampler_.push(frame(read_));
+      read_ = read_ + 1 == length_ ? 0 : read_ + 1;
+    }
+    resampling_ = true;
+  }
+
+  for (uint32_t i = 0; i < num_frames; i++) {
+    int32_t interpolated[kNumChannels];
+    resampler_.interpolate(quality_, interpolated);
+    for (size_t c = 0; c < kNumChannels; c++) {
+      out[i * kNumChannels + c] = static_cast<int16_t>(std::clamp<int32_t>(
+          interpolated[c] >> kLoopStorageShift, INT16_MIN, INT16_MAX));
+    }
+    for (uint32_t n = resampler_.advance(step_); n > 0; n--) {
+      head_ = head_ + 1 == length_ ? 0 : head_ + 1;
+      resampler_.push(frame(read_));
+      read_ = read_ + 1 == length_ ? 0 : read_ + 1;
+    }
+  }
+}
+
+const int16_t *LoopTrack::frame(uint32_t index) {
+  uint32_t stored = index + skip_;
+  load(static_cast<uint32_t>(stored / kLoopBlockFrames));
+  return &cache_[stored % kLoopBlockFrames * kNumChannels];
+}
+
+void LoopTrack::close() {
+  // A partly recorded block already has its words; code it padded with
+  // silence.
+  uint32_t stored = head_ + skip_;
+  uint32_t frame = static_cast<uint32_t>(stored % kLoopBlockFrames);
+  if (frame > 0) {
+    std::fill(&cache_[frame * kNumChannels], std::end(cache_), 0);
+    store(static_cast<uint32_t>(stored / kLoopBlockFrames), codec_state_);
+  }
+
+  length_ = head_;
+  head_ = 0;
+  cache_block_ = kNoBlock;
+  dirty_ = false;
+  pool_->seal(region_);
+  if (length_ == 0) {
+    clear();
+  }
+}
+
+void LoopTrack::clear() {
+  if (region_ != LoopPool::kNoRegion) {
+    pool_->free(region_);
+    region_ = LoopPool::kNoRegion;
+  }
+  dropJournal();
+  resume_overdub_ = false;
+  state_ = State::kIdle;
+  length_ = 0;
+  head_ = 0;
+  skip_ = 0;
+  wrap_blocks_ = 0;
+  first_block_ = 0;
+  cache_block_ = kNoBlock;
+  dirty_ = false;
+  codec_state_ = {};
+  resampling_ = false;
+}
+
+void LoopTrack::load(uint32_t block) {
+  if (block == cache_block_) {
+    return;
+  }
+  flush();
+
+  uint32_t words[kMaxLoopBlockWords];
+  readWords(*pool_, region_, blockWord(block), words,
+            static_cast<uint32_t>(LoopBlockWords(format_)));
+  DecodeLoopBlock(format_, words, cache_, codec_state_);
+  cache_block_ = block;
+}
+
+void LoopTrack::flush() {
+  if (dirty_) {
+    // Re-code from the state the block was first coded from, keeping its
+    // step size continuous with the block before.
+    LoopCodecState state = codec_state_;
+    store(cache_block_, state);
+    dirty_ = false;
+  }
+}
+
+void LoopTrack::store(uint32_t block, LoopCodecState &state) {
+  uint32_t words[kMaxLoopBlockWords];
+  EncodeLoopBlock(format_, cache_, words, state);
+  writeWords(*pool_, region_, blockWord(block), words,
+             static_cast<uint32_t>(LoopBlockWords(format_)));
+}
+
+uint32_t LoopTrack::blockWord(uint32_t block) const {
+  if (block < wrap_blocks_) {
+    block = (first_block_ + block) % wrap_blocks_;
+  }
+  return block * static_cast<uint32_t>(LoopBlockWords(format_));
+}
+
+void LoopTrack::journal(uint32_t block) {
+  if (journal_lost_) {
+    return;
+  } else if (journal_ == LoopPool::kNoRegion) {
+    // A journal after another track's recording would stop it growing, so
+    // this pass goes without undo instead.
+    journal_ = pool_->tailOpen() ? LoopPool::kNoRegion : pool_->allocate();
+  }
+
+  uint32_t block_words = static_cast<uint32_t>(LoopBlockWords(format_));
+  uint32_t entry_words = block_words + 1;
+  uint32_t first = journal_top_ * entry_words;
+  if (journal_ == LoopPool::kNoRegion ||
+      (pool_->size(journal_) < first + entry_words &&
+       !pool_->grow(journal_, entry_words))) {
+    // Older layers cannot be undone past changes that were not saved.
+    dropJournal();
+    journal_lost_ = true;
+    return;
+  }
+
+  uint32_t entry[1 + kMaxLoopBlockWords];
+  entry[0] = block | (new_layer_ ? kLayerStart : 0);
+  readWords(*pool_, region_, blockWord(block), &entry[1], block_words);
+  writeWords(*pool_, journal_, first, entry, entry_words);
+  new_layer_ = false;
+  // A new layer replaces any that were undone.
+  journal_end_ = ++journal_top_;
+}
+
+void LoopTrack::dropJournal() {
+  if (journal_ != LoopPool::kNoRegion) {
+    pool_->free(journal_);
+    journal_ = LoopPool::kNoRegion;
+  }
+  journal_top_ = 0;
+  journal_end_ = 0;
+  swap_step_ = 0;
+}
+
+void LoopTrack::swapEntry() {
+  uint32_t block_words = static_cast<uint32_t>(LoopBlockWords(format_));
+  uint32_t entry_words = block_words + 1;
+  uint32_t index = swap_step_ < 0 ? journal_top_ - 1 : journal_top_;
+
+  uint32_t saved[1 + kMaxLoopBlockWords];
+  uint32_t current[kMaxLoopBlockWords];
+  readWords(*pool_, journal_, index * entry_words, saved, entry_words);
+  uint32_t block = saved[0] & ~kLayerStart;
+  readWords(*pool_, region_, blockWord(block), current, block_words);
+  writeWords(*pool_, region_, blockWord(block), &saved[1], block_words);
+  writeWords(*pool_, journal_, index * entry_words + 1, current,
+             block_words);
+  if (block == cache_block_) {
+    cache_block_ = kNoBlock;
+  }
+
+  // An undo runs back to the first entry of the layer, a redo up to the
+  // first entry of the next.
+  bool done = false;
+  if (swap_step_ < 0) {
+    journal_top_--;
+    done = (saved[0] & kLayerStart) != 0;
+  } else {
+    journal_top_++;
+    uint32_t next = 0;
+    if (journal_top_ < journal_end_) {
+      readWords(*pool_, journal_, journal_top_ * entry_words, &next, 1);
+    }
+    done = journal_top_ == journal_end_ || (next & kLayerStart) != 0;
+  }
+
+  if (done) {
+    swap_step_ = 0;
+    if (resume_overdub_) {
+      resume_overdub_ = false;
+      new_layer_ = true;
+      state_ = State::kOverdubbing;
+    }
+  }
+}
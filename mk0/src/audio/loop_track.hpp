@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "audio/loop_capture.hpp"
+#include "audio/loop_codec.hpp"
+#include "audio/loop_pool.hpp"
+#include "audio/resampler.hpp"
+
+namespace deloop {
+
+// One loop of interleaved stereo audio in a region of a `LoopPool`,
+// recorded from scheduler blocks and played as 16-bit frames for a `Mixer`.
+// The loop is stored as blocks coded in the `LoopFormat` chosen when
+// recording starts, and the block under the head is kept decoded so each is
+// coded once per pass. The region grows a block at a time as the first pass
+// records, so a loop takes only the memory it needs.
+//
+// Overdubs can be undone. Each overdub pass is a layer: before a pass first
+// changes a block, the block's coded words are copied to a journal region
+// of the same pool. Undo swaps a layer's saved words with the loop's,
+// leaving the overdubbed words in the journal for redo, and is spread over
+// several calls to `process` so it fits in the audio deadline. If the
+// journal cannot grow, or would be allocated while another track records its
+// first pass, the undo history is dropped.
+//
+// Playback can run at any speed through a `Resampler`, fed frame by frame
+// from the decoded block under the read position. Recording and
+// overdubbing always run at normal speed.
+//
+// Transitions are applied with `apply` between blocks or, through scheduler
+// events, between any two frames. Only the audio task may use a track.
+class LoopTrack {
+public:
+  enum class State : uint8_t {
+    kIdle,        // Empty.
+    kRecording,   // Writing the first pass; the loop has no length yet.
+    kPlaying,     // Mixing the loop into the output.
+    kOverdubbing, // Playing while mixing the input into the loop.
+    kPaused,      // Holding a loop, restarting from its start on resume.
+  };
+
+  enum class Action : uint8_t {
+    kRecord,  // Start a new loop, discarding any current one.
+    kPlay,    // Close a recording, stop overdubbing or resume.
+    kOverdub, // Close a recording or start overdubbing.
+    kPause,   // Close a recording or stop.
+    kClear,   // Discard the loop.
+    kUndo,    // Stop overdubbing and remove the last overdub pass.
+    kRedo,    // Stop overdubbing and restore the last pass undone.
+  };
+
+  static constexpr size_t kNumChannels = kLoopBlockChannels;
+
+  // Overdub feedback of 1, keeping the existing loop as is.
+  static constexpr int32_t kUnityFeedback = 1 << 15;
+
+  // Blocks an undo or redo restores per call to `process`.
+  static constexpr uint32_t kSwapsPerProcess = 8;
+
+  LoopTrack() = default;
+  explicit LoopTrack(LoopPool &pool) : pool_(&pool) {}
+
+  // `format` is the storage format of the loop started by `Action::kRecord`.
+  void apply(Action action, LoopFormat format = LoopFormat::kPcm16);
+
+  // Sets the playback speed, in input frames per output frame (see
+  // `Resampler`), and how frames are interpolated when it is not
+  // `Resampler::kUnitStep`. Steps over `Resampler::kMaxStep` are clamped.
+  void setSpeed(uint32_t step, Interpolation quality);
+
+  // Starts a new loop from captured history, as `Action::kRecord` would have
+  // at its start, and carries on recording.
+  void adopt(const LoopHistory &history);
+
+  // Records `rx` and plays the loop into `out`, `num_frames` interleaved
+  // 24-bit and 16-bit frames respectively. Overdubbing scales the loop by
+  // `feedback` (Q15, at most `kUnityFeedback`) before adding the input. A
+  // recording that runs out of pool memory closes and plays from the start.
+  //
+  // Returns false, possibly leaving `out` as it was, if nothing was played;
+  // otherwise frames not played are silent.
+  bool process(uint32_t num_frames, int16_t *out, const int32_t *rx,
+               int32_t feedback);
+
+  State state() const { return state_; }
+  LoopFormat format() const { return format_; }
+  uint32_t length() const { return length_; } // Frames, 0 until closed.
+  uint32_t head() const { return head_; }     // Next frame read or written.
+  uint32_t speed() const { return step_; }
+
+  // True while an undo or redo is still being applied. Overdubbing waits
+  // for it to finish.
+  bool swapping() const { return swap_step_ != 0; }
+  // Pool words held for undo and redo.
+  uint32_t journalWords() const {
+    return journal_ != LoopPool::kNoRegion ? pool_->size(journal_) : 0;
+  }
+
+private:
+  static constexpr uint32_t kNoBlock = UINT32_MAX;
+
+  // Ends the first pass, keeping what was recorded as the loop.
+  void close();
+  void clear();
+
+  // Decodes block `block` into the cache, first storing the cached block if
+  // it was overdubbed.
+  void load(uint32_t block);
+  // Codes the cache back into its block if it was overdubbed.
+  void flush();
+  // Codes the cache into block `block` starting from `state`. A block may
+  // straddle a region move, so its words are looked up one run at a time.
+  void store(uint32_t block, LoopCodecState &state);
+
+  // Plays `num_frames` frames through the resampler, starting it from the
+  // head if it was not already running.
+  void playResampled(uint32_t num_frames, int16_t *out);
+  // Frame `index` of the loop, decoded.
+  const int16_t *frame(uint32_t index);
+
+  // Index in the region of the first word of block `block`.
+  uint32_t blockWord(uint32_t block) const;
+
+  // Saves the coded words of block `block` to the journal as the next entry
+  // of the current layer.
+  void journal(uint32_t block);
+  void dropJournal();
+  // Swaps the next journal entry of an undo or redo with the loop.
+  void swapEntry();
+
+  LoopPool *pool_ = nullptr;
+  LoopPool::Region region_ = LoopPool::kNoRegion;
+  LoopFormat format_ = LoopFormat::kPcm16;
+  State state_ = State::kIdle;
+  uint32_t length_ = 0;
+  uint32_t head_ = 0;
+
+  // Layout of a loop adopted from history: the loop starts `skip_` frames
+  // into block `first_block_` of a ring of `wrap_blocks_` blocks, and blocks
+  // past the ring follow it in order. 0 blocks for a loop recorded from its
+  // start.
+  uint32_t skip_ = 0;
+  uint32_t wrap_blocks_ = 0;
+  uint32_t first_block_ = 0;
+
+  // Undo journal: entries of a header word, the block index with
+  // `kLayerStart` set on the first entry of a layer, then the block's coded
+  // words. Entries before `journal_top_` can be undone, and those from it to
+  // `journal_end_` redone.
+  LoopPool::Region journal_ = LoopPool::kNoRegion;
+  uint32_t journal_top_ = 0;
+  uint32_t journal_end_ = 0;
+  bool new_layer_ = false;
+  bool journal_lost_ = false; // Until the next layer.
+  // Undo (-1) or redo (1) in progress, and overdubbing once it is done.
+  int8_t swap_step_ = 0;
+  bool resume_overdub_ = false;
+
+  // Varispeed playback. While `resampling_`, the head is the frame at the
+  // centre of the resampler's history and `read_` the next frame to push.
+  Resampler resampler_;
+  uint32_t step_ = Resampler::kUnitStep;
+  Interpolation quality_ = Interpolation::kLinear;
+  bool resampling_ = false;
+  uint32_t read_ = 0;
+
+  // The block under the head, decoded, and the codec state it starts from.
+  int16_t cache_[kLoopBlockSamples] = {};
+  uint32_t cache_block_ = kNoBlock;
+  bool dirty_ = false;
+  LoopCodecState codec_state_ = {};
+};
+
+} // namespace deloop
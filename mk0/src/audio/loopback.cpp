@@ -0,0 +1,232 @@
+#include "audio/loopback.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <numbers>
+
+#include "audio/oscillator.hpp"
+#include "audio/scheduler.hpp"
+#include "errors.hpp"
+#include "util/seqlock.hpp"
+
+using namespace deloop;
+
+const float kFullScale = 0x7FFFFF;
+const size_t kNumChannels = audio_scheduler::kNumChannels;
+
+// Tones fade in while the last window's worth of the previous band clears,
+// and the last fades out, so none of them click.
+const uint32_t kFadeFrames = static_cast<uint32_t>(
+    OscillatorBank::kGlideMs * audio_scheduler::kSampleRate / 1000.0f);
+const uint32_t kSettleFrames = loopback::kWindowFrames + kFadeFrames;
+
+enum class Step : uint8_t {
+  kImpulse, // One impulse, then its window.
+  kSettle,  // A band's tone, until it comes back steady.
+  kTone,    // A band's tone, measured.
+  kFadeOut,
+};
+
+static struct {
+  bool running;
+  Step step;
+  uint32_t index; // Of the impulse or band.
+  uint32_t frame; // Into the step.
+
+  // The loudest input of the current impulse's window, the weakest of those
+  // so far, and the earliest and latest frames they were on.
+  int32_t peak;
+  uint32_t peak_frame;
+  int32_t weakest;
+  uint32_t earliest;
+  uint32_t latest;
+
+  // Goertzel filter of each input channel at the current band.
+  float coeff;
+  float s1[kNumChannels];
+  float s2[kNumChannels];
+
+  loopback::Result result;
+} state_ = {0};
+
+static SeqLock<loopback::Result> result_;
+static OscillatorBank bank_(audio_scheduler::kSampleRate);
+
+static void applyStart(uint32_t arg);
+static uint32_t stepFrames(void);
+static void nextStep(void);
+static void listenImpulse(uint32_t num_frames, const int32_t *rx);
+static void listenTone(uint32_t num_frames, const int32_t *rx);
+static void startBand(uint32_t band);
+
+Error loopback::start(void) {
+  return audio_scheduler::postEvent(
+      {audio_scheduler::getFrameTime(), applyStart, 0});
+}
+
+Error loopback::process(uint32_t num_frames, int32_t *tx, int32_t *rx) {
+  if (num_frames == 0 || tx == nullptr || rx == nullptr) {
+    return Error::kInvalidArgument;
+  } else if (!state_.running) {
+    return Error::kOk;
+  }
+
+  // Events split blocks, so the largest part seen is the block.
+  state_.result.block_frames =
+      std::max(state_.result.block_frames, num_frames);
+  std::fill(tx, tx + num_frames * kNumChannels, 0);
+  for (uint32_t done = 0; done < num_frames && state_.running;) {
+    uint32_t n = std::min(num_frames - done, stepFrames() - state_.frame);
+    int32_t *out = &tx[done * kNumChannels];
+    const int32_t *in = &rx[done * kNumChannels];
+    switch (state_.step) {
+    case Step::kImpulse:
+      if (state_.frame == 0) {
+        std::fill(out, out + kNumChannels,
+                  static_cast<int32_t>(loopback::kImpulseLevel * kFullScale));
+      }
+      listenImpulse(n, in);
+      break;
+    case Step::kSettle:
+    case Step::kFadeOut:
+      bank_.render(n, out);
+      break;
+    case Step::kTone:
+      bank_.render(n, out);
+      listenTone(n, in);
+      break;
+    }
+
+    done += n;
+    state_.frame += n;
+    if (state_.frame == stepFrames()) {
+      nextStep();
+    }
+  }
+
+  result_.store(state_.result);
+  return Error::kOk;
+}
+
+loopback::Result loopback::getResult(void) { return result_.load(); }
+
+static void applyStart(uint32_t arg) {
+  (void)arg;
+  state_.running = true;
+  state_.step = Step::kImpulse;
+  state_.index = 0;
+  state_.frame = 0;
+  state_.peak = 0;
+  state_.weakest = INT32_MAX;
+  state_.earliest = UINT32_MAX;
+  state_.latest = 0;
+  state_.result = {loopback::State::kRunning, 0, 0, 0, 0.0f, {}};
+}
+
+static uint32_t stepFrames(void) {
+  switch (state_.step) {
+  case Step::kImpulse:
+    return loopback::kWindowFrames;
+  case Step::kSettle:
+    return kSettleFrames;
+  case Step::kTone:
+    return loopback::kToneFrames;
+  case Step::kFadeOut:
+    break;
+  }
+  return kFadeFrames;
+}
+
+static void nextStep(void) {
+  loopback::Result &result = state_.result;
+  state_.frame = 0;
+  switch (state_.step) {
+  case Step::kImpulse: {
+    state_.earliest = std::min(state_.earliest, state_.peak_frame);
+    state_.latest = std::max(state_.latest, state_.peak_frame);
+    state_.weakest = std::min(state_.weakest, state_.peak);
+    state_.peak = 0;
+    if (++state_.index < loopback::kImpulses) {
+      return;
+    }
+
+    result.latency_frames = state_.earliest;
+    result.spread_frames = state_.latest - state_.earliest;
+    float weakest = static_cast<float>(state_.weakest);
+    result.peak_db = 20.0f * std::log10(std::max(weakest, 1.0f) / kFullScale);
+    if (weakest < loopback::kMinPeak * kFullScale) {
+      result.state = loopback::State::kNoSignal;
+      state_.running = false;
+      return;
+    }
+    startBand(0);
+  } break;
+  case Step::kSettle:
+    state_.step = Step::kTone;
+    break;
+  case Step::kTone: {
+    // A Goertzel filter over N frames of whole cycles of a sine of
+    // amplitude A ends with a power of (N * A / 2)^2.
+    float power = 0.0f;
+    for (size_t c = 0; c < kNumChannels; c++) {
+      float s1 = state_.s1[c];
+      float s2 = state_.s2[c];
+      power = std::max(power, s1 * s1 + s2 * s2 - state_.coeff * s1 * s2);
+    }
+    float amplitude = 2.0f * std::sqrt(power) / loopback::kToneFrames;
+    result.response_db[state_.index] =
+        20.0f * std::log10(std::max(amplitude, 1.0f) /
+                           (loopback::kToneLevel * kFullScale));
+    if (++state_.index < loopback::kNumBands) {
+      startBand(state_.index);
+      return;
+    }
+    bank_.play(0, loopback::kBandHz.back(), 0.0f);
+    state_.step = Step::kFadeOut;
+  } break;
+  case Step::kFadeOut:
+    result.state = loopback::State::kDone;
+    state_.running = false;
+    break;
+  }
+}
+
+static void listenImpulse(uint32_t num_frames, const int32_t *rx) {
+  for (uint32_t i = 0; i < num_frames; i++) {
+    for (size_t c = 0; c < kNumChannels; c++) {
+      int32_t level = std::abs(rx[i * kNumChannels + c]);
+      if (level > state_.peak) {
+        state_.peak = level;
+        state_.peak_frame = state_.frame + i;
+      }
+    }
+  }
+}
+
+static void listenTone(uint32_t num_frames, const int32_t *rx) {
+  const float coeff = state_.coeff;
+  for (size_t c = 0; c < kNumChannels; c++) {
+    float s1 = state_.s1[c];
+    float s2 = state_.s2[c];
+    for (uint32_t i = 0; i < num_frames; i++) {
+      float s = static_cast<float>(rx[i * kNumChannels + c]) + coeff * s1 - s2;
+      s2 = s1;
+      s1 = s;
+    }
+    state_.s1[c] = s1;
+    state_.s2[c] = s2;
+  }
+}
+
+static void startBand(uint32_t band) {
+  float hz = loopback::kBandHz[band];
+  bank_.play(0, hz, loopback::kToneLevel);
+  state_.step = Step::kSettle;
+  state_.index = band;
+  state_.coeff = 2.0f * std::cos(2.0f * std::numbers::pi_v<float> * hz /
+                                 audio_scheduler::kSampleRate);
+  std::fill(std::begin(state_.s1), std::end(state_.s1), 0.0f);
+  std::fill(std::begin(state_.s2), std::end(state_.s2), 0.0f);
+}
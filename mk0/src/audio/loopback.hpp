@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "errors.hpp"
+
+namespace deloop {
+namespace loopback {
+
+// Measures the whole chain from output to input (codec, SAI, DMA buffers and
+// any processing between) with a cable from the output back to the input.
+//
+// A measurement plays `kImpulses` impulses, a window apart, and takes the
+// round trip latency from where each one peaks on the input. Then it plays a
+// tone per band, steps of a log sweep, and measures what comes back with a
+// Goertzel filter over whole cycles. Both use whichever input channel hears
+// more. Nothing is buffered, so it costs a few hundred bytes of RAM, and
+// takes about 2.5 s.
+constexpr uint32_t kImpulses = 4;
+constexpr uint32_t kWindowFrames = 4096; // 85 ms, the longest it can find.
+constexpr float kImpulseLevel = 0.5f;
+
+// Tones are measured over 100 ms, so every band is a whole number of cycles,
+// after a window and the tone's fade in.
+constexpr size_t kNumBands = 10;
+constexpr std::array<float, kNumBands> kBandHz = {
+    30.0f, 60.0f, 120.0f, 250.0f, 500.0f, 1000.0f, 2000.0f, 4000.0f,
+    8000.0f, 16000.0f};
+constexpr uint32_t kToneFrames = 4800;
+constexpr float kToneLevel = 0.25f; // -12 dBFS.
+
+// Impulses that come back quieter than this (-60 dBFS) count as no signal.
+constexpr float kMinPeak = 0.001f;
+
+enum class State : uint8_t {
+  kIdle,     // Never measured.
+  kRunning,
+  kDone,
+  kNoSignal, // No impulse came back, so there are no results.
+};
+
+struct Result {
+  State state;
+  uint32_t block_frames;   // Frames per block while measuring.
+  uint32_t latency_frames; // From an impulse out to its peak in.
+  uint32_t spread_frames;  // Between the earliest and latest impulse.
+  float peak_db;           // Of the quietest impulse back, in dBFS.
+  std::array<float, kNumBands> response_db; // Gain at each of `kBandHz`.
+};
+
+// Starts a measurement at the next block, through a scheduler event,
+// restarting one in progress. Must be called from the task that posts
+// scheduler events.
+Error start(void);
+
+// Scheduler callback that, while measuring, replaces the output with the
+// test signal. Leaves the output untouched otherwise. Register last, so
+// nothing is mixed over the test signal.
+Error process(uint32_t num_frames, int32_t *tx, int32_t *rx);
+
+// Result of the last measurement, or of the one running so far. Safe to
+// call from any task.
+Result getResult(void);
+
+} // namespace loopback
+} // namespace deloop
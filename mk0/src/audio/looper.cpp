@@ -0,0 +1,302 @@
+#include "audio/looper.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iterator>
+
+#include "audio/biquad.hpp"
+#include "audio/clock.hpp"
+#include "audio/loop_capture.hpp"
+#include "audio/loop_codec.hpp"
+#include "audio/loop_pool.hpp"
+#include "audio/loop_track.hpp"
+#include "audio/mixer.hpp"
+#include "audio/resampler.hpp"
+#include "audio/scheduler.hpp"
+#include "errors.hpp"
+#include "metrics.hpp"
+#include "params.hpp"
+#include "util/seqlock.hpp"
+
+using namespace deloop;
+
+// How much of the loop each overdub pass keeps.
+DELOOP_PARAM(feedback, "looper.feedback", 1.0f, 0.0f, 1.0f);
+
+// Playback speed of each track, 1 for as recorded.
+DELOOP_PARAM(speed0, "looper.track0.speed", 1.0f, 0.25f, 4.0f);
+DELOOP_PARAM(speed1, "looper.track1.speed", 1.0f, 0.25f, 4.0f);
+DELOOP_PARAM(speed2, "looper.track2.speed", 1.0f, 0.25f, 4.0f);
+DELOOP_PARAM(speed3, "looper.track3.speed", 1.0f, 0.25f, 4.0f);
+
+// Interpolation used away from speed 1: 0 linear, 1 cubic, 2 polyphase.
+DELOOP_PARAM(quality0, "looper.track0.quality", 1.0f, 0.0f, 2.0f);
+DELOOP_PARAM(quality1, "looper.track1.quality", 1.0f, 0.0f, 2.0f);
+DELOOP_PARAM(quality2, "looper.track2.quality", 1.0f, 0.0f, 2.0f);
+DELOOP_PARAM(quality3, "looper.track3.quality", 1.0f, 0.0f, 2.0f);
+
+// Mix level of each track: gain 0 to 2, pan -1 (left) to 1 (right).
+DELOOP_PARAM(gain0, "looper.track0.gain", 1.0f, 0.0f, 2.0f);
+DELOOP_PARAM(gain1, "looper.track1.gain", 1.0f, 0.0f, 2.0f);
+DELOOP_PARAM(gain2, "looper.track2.gain", 1.0f, 0.0f, 2.0f);
+DELOOP_PARAM(gain3, "looper.track3.gain", 1.0f, 0.0f, 2.0f);
+DELOOP_PARAM(pan0, "looper.track0.pan", 0.0f, -1.0f, 1.0f);
+DELOOP_PARAM(pan1, "looper.track1.pan", 0.0f, -1.0f, 1.0f);
+DELOOP_PARAM(pan2, "looper.track2.pan", 0.0f, -1.0f, 1.0f);
+DELOOP_PARAM(pan3, "looper.track3.pan", 0.0f, -1.0f, 1.0f);
+
+// Level the input is monitored at, off by default.
+DELOOP_PARAM(input_gain, "looper.input.gain", 0.0f, 0.0f, 2.0f);
+DELOOP_PARAM(input_pan, "looper.input.pan", 0.0f, -1.0f, 1.0f);
+
+// Conditioning of the input before anything records or monitors it: a high
+// pass cutoff in Hz (0 off), and bass and treble shelves in dB (0 off).
+DELOOP_PARAM(input_highpass, "looper.input.highpass", 0.0f, 0.0f, 300.0f);
+DELOOP_PARAM(input_bass, "looper.input.bass", 0.0f, -12.0f, 12.0f);
+DELOOP_PARAM(input_treble, "looper.input.treble", 0.0f, -12.0f, 12.0f);
+
+static Param *const speeds[] = {&speed0, &speed1, &speed2, &speed3};
+static Param *const qualities[] = {&quality0, &quality1, &quality2,
+                                   &quality3};
+static Param *const gains[] = {&gain0, &gain1, &gain2, &gain3};
+static Param *const pans[] = {&pan0, &pan1, &pan2, &pan3};
+static_assert(std::size(speeds) == looper::kMaxTracks &&
+              std::size(qualities) == looper::kMaxTracks &&
+              std::size(gains) == looper::kMaxTracks &&
+              std::size(pans) == looper::kMaxTracks);
+
+DELOOP_METRIC_GAUGE(free_words, "looper.free_words");
+// Free words a new recording cannot use until compaction closes the gaps.
+DELOOP_METRIC_GAUGE(gap_words, "looper.gap_words");
+// Frames of input a recording can currently start back from.
+DELOOP_METRIC_GAUGE(history_frames, "looper.history_frames");
+
+static struct {
+  bool initialized;
+  LoopPool pool;
+  LoopCapture capture;
+  std::array<LoopTrack, looper::kMaxTracks> tracks;
+  std::array<SeqLock<looper::TrackStatus>, looper::kMaxTracks> status;
+  SeqLock<uint64_t> oldest; // Oldest frame captured, as of the last block.
+} state_ = {0};
+
+static uint32_t memory_[looper::kPoolWords];
+
+// Tracks, then the input, are rendered as 16-bit frames and mixed into the
+// output `kMixFrames` at a time.
+const uint32_t kMixFrames = 32;
+const size_t kInputSource = looper::kMaxTracks;
+const size_t kNumSources = looper::kMaxTracks + 1;
+static_assert(kNumSources <= Mixer::kMaxSources);
+static int16_t sources_[kNumSources][kMixFrames * Mixer::kChannels];
+static Mixer mixer_(audio_scheduler::kSampleRate);
+
+// Butterworth high pass, and shelves turning over at these frequencies.
+const double kFilterQ = 0.7071;
+const double kBassHz = 200.0;
+const double kTrebleHz = 4000.0;
+static BiquadCascade input_filter_;
+static std::array<float, 3> input_settings_;
+
+static void updateInputFilter(void);
+static void applyAction(uint32_t arg);
+static void applyRecordFrom(uint32_t arg);
+
+Error looper::init(void) {
+  if (state_.initialized) {
+    return Error::kAlreadyInitialized;
+  }
+
+  state_.pool = LoopPool(memory_);
+  state_.capture = LoopCapture(state_.pool, kCaptureFormat, kCaptureWords);
+  for (LoopTrack &track : state_.tracks) {
+    track = LoopTrack(state_.pool);
+  }
+  state_.initialized = true;
+  return Error::kOk;
+}
+
+Error looper::process(uint32_t num_frames, int32_t *tx, int32_t *rx) {
+  if (!state_.initialized) {
+    return Error::kNotInitialized;
+  } else if (num_frames == 0 || tx == nullptr || rx == nullptr) {
+    return Error::kInvalidArgument;
+  }
+
+  int32_t feedback_q15 =
+      static_cast<int32_t>(feedback.value() * LoopTrack::kUnityFeedback);
+  uint64_t start = audio_scheduler::getCallbackFrame();
+  uint64_t end = start + num_frames;
+  for (size_t i = 0; i < kMaxTracks; i++) {
+    state_.tracks[i].setSpeed(
+        static_cast<uint32_t>(speeds[i]->value() * Resampler::kUnitStep),
+        static_cast<Interpolation>(qualities[i]->value() + 0.5f));
+    mixer_.setLevel(i, gains[i]->value(), pans[i]->value());
+  }
+  mixer_.setLevel(kInputSource, input_gain.value(), input_pan.value());
+  updateInputFilter();
+  input_filter_.process(num_frames, rx);
+
+  for (uint32_t done = 0; done < num_frames;) {
+    uint32_t n = std::min(num_frames - done, kMixFrames);
+    size_t offset = done * Mixer::kChannels;
+    const int16_t *sources[kNumSources];
+    for (size_t i = 0; i < kMaxTracks; i++) {
+      bool audible = state_.tracks[i].process(n, sources_[i], &rx[offset],
+                                              feedback_q15);
+      sources[i] = audible ? sources_[i] : nullptr;
+    }
+    sources[kInputSource] = nullptr;
+    if (!mixer_.silent(kInputSource)) {
+      for (size_t s = 0; s < n * Mixer::kChannels; s++) {
+        sources_[kInputSource][s] =
+            static_cast<int16_t>(rx[offset + s] >> kLoopStorageShift);
+      }
+      sources[kInputSource] = sources_[kInputSource];
+    }
+    mixer_.mix(n, sources, kNumSources, &tx[offset]);
+    done += n;
+  }
+
+  for (size_t i = 0; i < kMaxTracks; i++) {
+    const LoopTrack &track = state_.tracks[i];
+    state_.status[i].store({track.state(), track.format(), track.length(),
+                            end - track.head()});
+  }
+
+  // Tracks look words up on every pass, so regions can move between calls.
+  state_.pool.compact(num_frames * kCompactionRate);
+  free_words.set(static_cast<int32_t>(state_.pool.freeWords()));
+  gap_words.set(static_cast<int32_t>(state_.pool.freeWords() -
+                                     state_.pool.tailWords()));
+
+  // Last, so the capture sees where the pool tail ended up.
+  state_.capture.process(start, num_frames, rx);
+  state_.oldest.store(state_.capture.oldest());
+  history_frames.set(static_cast<int32_t>(end - state_.capture.oldest()));
+  return Error::kOk;
+}
+
+Error looper::trigger(size_t track, LoopTrack::Action action,
+                      Quantize quantize, size_t sync_track,
+                      LoopFormat format) {
+  if (!state_.initialized) {
+    return Error::kNotInitialized;
+  } else if (track >= kMaxTracks || sync_track >= kMaxTracks) {
+    return Error::kInvalidArgument;
+  }
+
+  uint64_t now = audio_scheduler::getFrameTime();
+  uint64_t frame = now;
+  switch (quantize) {
+  case Quantize::kNone:
+    break;
+  case Quantize::kLastBeat:
+  case Quantize::kLastBar:
+    if (action == LoopTrack::Action::kRecord) {
+      audio_clock::Position pos = audio_clock::getPosition();
+      uint64_t beats_back =
+          quantize == Quantize::kLastBar ? pos.beat_in_bar + 1 : 1;
+      uint64_t back = beats_back * pos.sub_frames_per_beat;
+      if (pos.next_beat < back) {
+        return Error::kLooperHistoryTooShort;
+      }
+      return recordFrom(track,
+                        (pos.next_beat - back) / audio_clock::kSubFrames);
+    }
+    break;
+  case Quantize::kBeat:
+    frame = audio_clock::nextBeatFrame(audio_clock::getPosition(), now);
+    break;
+  case Quantize::kBar:
+    frame = audio_clock::nextBarFrame(audio_clock::getPosition(), now);
+    break;
+  case Quantize::kLoop: {
+    TrackStatus sync = getTrackStatus(sync_track);
+    bool looping = sync.state == LoopTrack::State::kPlaying ||
+                   sync.state == LoopTrack::State::kOverdubbing;
+    if (looping && sync.length > 0 && sync.loop_start < now) {
+      uint64_t loops = (now - sync.loop_start + sync.length - 1) / sync.length;
+      frame = sync.loop_start + loops * sync.length;
+    }
+  } break;
+  }
+
+  uint32_t arg = static_cast<uint32_t>(format) << 16 |
+                 static_cast<uint32_t>(track) << 8 |
+                 static_cast<uint32_t>(action);
+  return audio_scheduler::postEvent({frame, applyAction, arg});
+}
+
+Error looper::recordFrom(size_t track, uint64_t start) {
+  if (!state_.initialized) {
+    return Error::kNotInitialized;
+  } else if (track >= kMaxTracks) {
+    return Error::kInvalidArgument;
+  } else if (start < state_.oldest.load()) {
+    return Error::kLooperHistoryTooShort;
+  }
+
+  // The audio task rebuilds the start from its low 24 bits, which cover
+  // minutes of history.
+  uint32_t arg = static_cast<uint32_t>(track) << 24 |
+                 static_cast<uint32_t>(start & 0xFFFFFF);
+  return audio_scheduler::postEvent(
+      {audio_scheduler::getFrameTime(), applyRecordFrom, arg});
+}
+
+looper::TrackStatus looper::getTrackStatus(size_t track) {
+  if (track >= kMaxTracks) {
+    return {LoopTrack::State::kIdle, LoopFormat::kPcm16, 0, 0};
+  }
+  return state_.status[track].load();
+}
+
+// Redesigns the input filter when its params change. Filters that are off
+// are left out of the cascade, so by default the input costs nothing.
+static void updateInputFilter(void) {
+  const std::array<float, 3> settings = {
+      input_highpass.value(), input_bass.value(), input_treble.value()};
+  if (settings == input_settings_) {
+    return;
+  }
+  input_settings_ = settings;
+
+  const double rate = audio_scheduler::kSampleRate;
+  BiquadCoeffs sections[3];
+  size_t count = 0;
+  if (settings[0] >= 1.0f) {
+    sections[count++] = biquad::HighPass(settings[0], kFilterQ, rate);
+  }
+  if (settings[1] != 0.0f) {
+    sections[count++] = biquad::LowShelf(kBassHz, kFilterQ, settings[1], rate);
+  }
+  if (settings[2] != 0.0f) {
+    sections[count++] =
+        biquad::HighShelf(kTrebleHz, kFilterQ, settings[2], rate);
+  }
+  input_filter_.configure(sections, count);
+}
+
+static void applyAction(uint32_t arg) {
+  state_.tracks[(arg >> 8) & 0xFF].apply(
+      static_cast<LoopTrack::Action>(arg & 0xFF),
+      static_cast<LoopFormat>(arg >> 16));
+}
+
+static void applyRecordFrom(uint32_t arg) {
+  LoopTrack &track = state_.tracks[arg >> 24];
+  uint64_t now = audio_scheduler::getCallbackFrame();
+  uint64_t start = now - ((now - (arg & 0xFFFFFF)) & 0xFFFFFF);
+
+  // Freeing the track's old loop first could move the pool tail and lose
+  // the history, so it goes once the history is taken. If `start` is no
+  // longer held, the recording starts now rather than somewhere else.
+  LoopHistory history;
+  if (state_.capture.take(start, history)) {
+    track.adopt(history);
+  } else {
+    track.apply(LoopTrack::Action::kRecord, looper::kCaptureFormat);
+  }
+}
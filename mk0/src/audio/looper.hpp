@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "audio/loop_track.hpp"
+#include "errors.hpp"
+
+namespace deloop {
+namespace looper {
+
+// Tracks mixed by the looper, sharing one pool of loop memory (32 KB).
+constexpr size_t kMaxTracks = 4;
+constexpr uint32_t kPoolWords = 8192;
+
+// Words of loop memory compacted per frame processed, bounding the cost of
+// closing gaps left by cleared loops to a small share of each block.
+constexpr uint32_t kCompactionRate = 8;
+
+// Input is captured into free loop memory so recordings can start in the
+// past (see `LoopCapture`). A quarter of the pool holds about 136 ms.
+constexpr LoopFormat kCaptureFormat = LoopFormat::kAdpcm4;
+constexpr uint32_t kCaptureWords = kPoolWords / 4;
+
+// When a triggered action takes effect.
+enum class Quantize : uint8_t {
+  kNone, // At the next block.
+  kBeat, // On the next beat of `audio_clock`.
+  kBar,  // On the next bar of `audio_clock`.
+  kLoop, // When the sync track next wraps to its start.
+  // Recordings only: start retroactively on the beat or bar that started
+  // last. The capture reaches back about 136 ms, less than a beat at any
+  // tempo, so these only work if triggered just after the boundary and fail
+  // otherwise. Other actions apply at the next block.
+  kLastBeat,
+  kLastBar,
+};
+
+struct TrackStatus {
+  LoopTrack::State state;
+  LoopFormat format;
+  uint32_t length;     // Frames, 0 while recording the first pass.
+  // Frame time the loop last started on, while playing. Only exact while the
+  // track plays at speed 1.
+  uint64_t loop_start;
+};
+
+Error init(void);
+
+// Scheduler callback mixing every track into the output. Each track plays at
+// the speed and interpolation quality set by its `looper.trackN.speed` and
+// `looper.trackN.quality` params, and is mixed at the level set by its
+// `looper.trackN.gain` and `looper.trackN.pan` params. The input is mixed in
+// too at `looper.input.gain` and `looper.input.pan`, off by default. First,
+// the input is filtered in place by a high pass at `looper.input.highpass`
+// and shelves at `looper.input.bass` and `looper.input.treble`, all off by
+// default, so callbacks registered after see it filtered too. Register
+// after `audio_clock::process` and after any routine that overwrites the
+// output.
+Error process(uint32_t num_frames, int32_t *tx, int32_t *rx);
+
+// Applies `action` to `track` on the frame chosen by `quantize`, through a
+// scheduler event. A sync track that is not looping falls back to
+// `Quantize::kNone`. A retroactive recording fails as `recordFrom` does. A
+// recording stores the loop in `format`. Must be called from the task that
+// posts scheduler events.
+Error trigger(size_t track, LoopTrack::Action action, Quantize quantize,
+              size_t sync_track = 0, LoopFormat format = LoopFormat::kPcm16);
+
+// Starts recording on `track` from captured input, as if recording had
+// started at frame time `start`. Returns `Error::kLooperHistoryTooShort`,
+// changing nothing, if `start` is older than the capture held as of the last
+// block. Records from the next block instead if `start` falls out of the
+// capture before the audio task gets to it, or if nothing is captured. The
+// loop is stored in `kCaptureFormat`. Must be called from the task that posts
+// scheduler events.
+Error recordFrom(size_t track, uint64_t start);
+
+// Status as of the last block. Safe to call from any task.
+TrackStatus getTrackStatus(size_t track);
+
+} // namespace looper
+} // namespace deloop
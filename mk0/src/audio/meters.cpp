@@ -0,0 +1,88 @@
+#include "audio/meters.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "audio/level_meter.hpp"
+#include "audio/scheduler.hpp"
+#include "errors.hpp"
+#include "metrics.hpp"
+#include "params.hpp"
+#include "util/seqlock.hpp"
+
+using namespace deloop;
+
+// Window levels are reported over, the same as the default telemetry period.
+DELOOP_PARAM(period_ms, "meter.period_ms", 1000.0f, 50.0f, 5000.0f);
+static_assert(5000.0f * audio_scheduler::kSampleRate / 1000.0f <=
+              LevelMeter::kMaxWindowFrames);
+
+DELOOP_METRIC_GAUGE(rx_left_peak, "meter.rx.left.peak_cb");
+DELOOP_METRIC_GAUGE(rx_right_peak, "meter.rx.right.peak_cb");
+DELOOP_METRIC_GAUGE(rx_left_rms, "meter.rx.left.rms_cb");
+DELOOP_METRIC_GAUGE(rx_right_rms, "meter.rx.right.rms_cb");
+DELOOP_METRIC_COUNTER(rx_clips, "meter.rx.clips");
+DELOOP_METRIC_GAUGE(tx_left_peak, "meter.tx.left.peak_cb");
+DELOOP_METRIC_GAUGE(tx_right_peak, "meter.tx.right.peak_cb");
+DELOOP_METRIC_GAUGE(tx_left_rms, "meter.tx.left.rms_cb");
+DELOOP_METRIC_GAUGE(tx_right_rms, "meter.tx.right.rms_cb");
+DELOOP_METRIC_COUNTER(tx_clips, "meter.tx.clips");
+
+// Metrics of each signal, indexed by `meters::Signal`.
+struct SignalMetrics {
+  Gauge *peak[LevelMeter::kChannels];
+  Gauge *rms[LevelMeter::kChannels];
+  Counter *clips;
+};
+static const SignalMetrics metrics_[] = {
+    {{&rx_left_peak, &rx_right_peak}, {&rx_left_rms, &rx_right_rms}, &rx_clips},
+    {{&tx_left_peak, &tx_right_peak}, {&tx_left_rms, &tx_right_rms}, &tx_clips},
+};
+
+const size_t kNumSignals = 2;
+
+static LevelMeter meters_[kNumSignals];
+static SeqLock<LevelMeter::Levels> levels_[kNumSignals];
+
+static void report(size_t signal);
+
+Error meters::processInput(uint32_t num_frames, int32_t *tx, int32_t *rx) {
+  (void)tx;
+  if (num_frames == 0 || rx == nullptr) {
+    return Error::kInvalidArgument;
+  }
+  meters_[static_cast<size_t>(Signal::kInput)].measure(num_frames, rx);
+  return Error::kOk;
+}
+
+Error meters::processOutput(uint32_t num_frames, int32_t *tx, int32_t *rx) {
+  (void)rx;
+  if (num_frames == 0 || tx == nullptr) {
+    return Error::kInvalidArgument;
+  }
+  LevelMeter &output = meters_[static_cast<size_t>(Signal::kOutput)];
+  output.measure(num_frames, tx);
+
+  float window = period_ms.value() * audio_scheduler::kSampleRate / 1000.0f;
+  if (static_cast<float>(output.frames()) >= window) {
+    for (size_t signal = 0; signal < kNumSignals; signal++) {
+      report(signal);
+    }
+  }
+  return Error::kOk;
+}
+
+LevelMeter::Levels meters::getLevels(Signal signal) {
+  return levels_[static_cast<size_t>(signal)].load();
+}
+
+static void report(size_t signal) {
+  LevelMeter::Levels levels = meters_[signal].take();
+  const SignalMetrics &metrics = metrics_[signal];
+  for (size_t c = 0; c < LevelMeter::kChannels; c++) {
+    metrics.peak[c]->set(LevelCb(static_cast<float>(levels.peak[c])));
+    metrics.rms[c]->set(LevelCb(levels.rms[c]));
+  }
+  metrics.clips->increment(levels.clips);
+  levels_[signal].store(levels);
+}
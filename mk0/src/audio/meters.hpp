@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+#include "audio/level_meter.hpp"
+#include "errors.hpp"
+
+namespace deloop {
+namespace meters {
+
+// Meters the input and output of the audio task, block by block, and
+// reports them as metrics once every `meter.period_ms`:
+//
+//   meter.{rx,tx}.{left,right}.peak_cb   Gauges, in centibels of full scale.
+//   meter.{rx,tx}.{left,right}.rms_cb
+//   meter.{rx,tx}.clips                  Counters of samples at full scale.
+//
+// The telemetry task sends changed metrics at its own period, so set the two
+// periods alike to see every window.
+enum class Signal : uint8_t { kInput, kOutput };
+
+// Scheduler callback metering the input as it arrives. Register first, so
+// the input is metered before anything filters it.
+Error processInput(uint32_t num_frames, int32_t *tx, int32_t *rx);
+
+// Scheduler callback metering the output, and reporting when a window ends.
+// Register last, so the output is metered as it leaves.
+Error processOutput(uint32_t num_frames, int32_t *tx, int32_t *rx);
+
+// Levels over the last whole window. Safe to call from any task.
+LevelMeter::Levels getLevels(Signal signal);
+
+} // namespace meters
+} // namespace deloop
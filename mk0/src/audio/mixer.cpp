@@ -0,0 +1,182 @@
+#include "audio/mixer.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include "audio/loop_codec.hpp"
+#include "audio/smoother.hpp"
+
+using namespace deloop;
+
+// Gains are Q14, so up to `Mixer::kMaxGain` fits a 16-bit half word, and
+// 16-bit samples times Q14 gains are 24-bit samples shifted up 6 bits.
+const int kGainBits = 14;
+const int kSumShift = kGainBits - kLoopStorageShift;
+const int32_t kMaxSample = 0x7FFFFF;
+
+// Frames mixed per pass while gains move, bounding the stack used.
+const uint32_t kChunkFrames = 16;
+
+// Adds the products of the low and of the high half words of `a` and `b`.
+static inline int64_t dualMac(uint32_t a, uint32_t b, int64_t sum) {
+#if defined(__ARM_FEATURE_DSP)
+  uint32_t lo = static_cast<uint32_t>(sum);
+  uint32_t hi = static_cast<uint32_t>(static_cast<uint64_t>(sum) >> 32);
+  __asm("smlald %0, %1, %2, %3" : "+r"(lo), "+r"(hi) : "r"(a), "r"(b));
+  return static_cast<int64_t>(static_cast<uint64_t>(hi) << 32 | lo);
+#else
+  return sum +
+         static_cast<int32_t>(static_cast<int16_t>(a)) *
+             static_cast<int16_t>(b) +
+         static_cast<int64_t>(static_cast<int16_t>(a >> 16)) *
+             static_cast<int16_t>(b >> 16);
+#endif
+}
+
+// Frame `i` of `source`, left channel in the low half word.
+static inline uint32_t loadFrame(const int16_t *source, uint32_t i) {
+  uint32_t frame;
+  std::memcpy(&frame, &source[i * Mixer::kChannels], sizeof(frame));
+  return frame;
+}
+
+static inline int32_t gainQ14(float gain) {
+  return std::min(static_cast<int32_t>(gain * (1 << kGainBits) + 0.5f),
+                  INT16_MAX);
+}
+
+static inline int32_t saturate(int32_t out, int64_t sum) {
+  return std::clamp(out + static_cast<int32_t>(sum >> kSumShift),
+                    -kMaxSample, kMaxSample);
+}
+
+template <size_t... I>
+static std::array<Smoother, sizeof...(I)>
+makeGains(float sample_rate, std::index_sequence<I...>) {
+  return {((void)I, Smoother(Smoother::Mode::kLinear, Mixer::kSmoothingMs,
+                             sample_rate, 1.0f))...};
+}
+
+Mixer::Mixer(float sample_rate)
+    : gains_(makeGains(sample_rate,
+                       std::make_index_sequence<kMaxSources * kChannels>())) {
+}
+
+void Mixer::setLevel(size_t source, float gain, float pan) {
+  if (source >= kMaxSources) {
+    return;
+  }
+  gain = std::clamp(gain, 0.0f, kMaxGain);
+  pan = std::clamp(pan, -1.0f, 1.0f);
+  gains_[source * kChannels].setTarget(gain * std::min(1.0f, 1.0f - pan));
+  gains_[source * kChannels + 1].setTarget(gain *
+                                           std::min(1.0f, 1.0f + pan));
+}
+
+bool Mixer::silent(size_t source) const {
+  if (source >= kMaxSources) {
+    return true;
+  }
+  for (size_t c = 0; c < kChannels; c++) {
+    const Smoother &gain = gains_[source * kChannels + c];
+    if (!gain.steady() || gain.value() != 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Mixer::mix(uint32_t num_frames, const int16_t *const *sources,
+                size_t num_sources, int32_t *tx) {
+  num_sources = std::min(num_sources, kMaxSources);
+  for (size_t i = 0; i < num_sources * kChannels; i++) {
+    if (!gains_[i].steady()) {
+      mixMoving(num_frames, sources, num_sources, tx);
+      return;
+    }
+  }
+  mixSteady(num_frames, sources, num_sources, tx);
+}
+
+void Mixer::mixSteady(uint32_t num_frames, const int16_t *const *sources,
+                      size_t num_sources, int32_t *tx) const {
+  // Sources that can be heard, with their gains packed in pairs.
+  const int16_t *active[kMaxSources];
+  int32_t left[kMaxSources];
+  int32_t right[kMaxSources];
+  size_t count = 0;
+  for (size_t s = 0; s < num_sources; s++) {
+    left[count] = gainQ14(gains_[s * kChannels].value());
+    right[count] = gainQ14(gains_[s * kChannels + 1].value());
+    if (sources[s] != nullptr && (left[count] != 0 || right[count] != 0)) {
+      active[count++] = sources[s];
+    }
+  }
+  if (count == 0) {
+    return;
+  }
+
+  uint32_t left_pairs[kMaxSources / 2];
+  uint32_t right_pairs[kMaxSources / 2];
+  size_t pairs = count / 2;
+  for (size_t p = 0; p < pairs; p++) {
+    left_pairs[p] = static_cast<uint32_t>(left[2 * p]) |
+                    static_cast<uint32_t>(left[2 * p + 1]) << 16;
+    right_pairs[p] = static_cast<uint32_t>(right[2 * p]) |
+                     static_cast<uint32_t>(right[2 * p + 1]) << 16;
+  }
+
+  for (uint32_t i = 0; i < num_frames; i++) {
+    int64_t left_sum = 0;
+    int64_t right_sum = 0;
+    for (size_t p = 0; p < pairs; p++) {
+      uint32_t a = loadFrame(active[2 * p], i);
+      uint32_t b = loadFrame(active[2 * p + 1], i);
+      // PKHBT and PKHTB: the left samples of both, then the right.
+      left_sum = dualMac((a & 0xFFFF) | b << 16, left_pairs[p], left_sum);
+      right_sum =
+          dualMac(a >> 16 | (b & 0xFFFF0000), right_pairs[p], right_sum);
+    }
+    if (count % 2 != 0) {
+      uint32_t a = loadFrame(active[count - 1], i);
+      left_sum += static_cast<int16_t>(a) * left[count - 1];
+      right_sum += static_cast<int16_t>(a >> 16) * right[count - 1];
+    }
+    tx[i * kChannels] = saturate(tx[i * kChannels], left_sum);
+    tx[i * kChannels + 1] = saturate(tx[i * kChannels + 1], right_sum);
+  }
+}
+
+void Mixer::mixMoving(uint32_t num_frames, const int16_t *const *sources,
+                      size_t num_sources, int32_t *tx) {
+  for (uint32_t done = 0; done < num_frames;) {
+    uint32_t n = std::min(num_frames - done, kChunkFrames);
+    int64_t sums[kChunkFrames * kChannels] = {};
+    for (size_t s = 0; s < num_sources; s++) {
+      for (size_t c = 0; c < kChannels; c++) {
+        Smoother &gain = gains_[s * kChannels + c];
+        float values[kChunkFrames];
+        if (!gain.next(values, n)) {
+          std::fill(values, values + n, gain.value());
+        }
+        if (sources[s] == nullptr) {
+          continue;
+        }
+        const int16_t *in = &sources[s][done * kChannels + c];
+        for (uint32_t i = 0; i < n; i++) {
+          sums[i * kChannels + c] +=
+              in[i * kChannels] * gainQ14(values[i]);
+        }
+      }
+    }
+
+    int32_t *out = &tx[done * kChannels];
+    for (uint32_t i = 0; i < n * kChannels; i++) {
+      out[i] = saturate(out[i], sums[i]);
+    }
+    done += n;
+  }
+}
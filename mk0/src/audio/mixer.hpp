@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "audio/smoother.hpp"
+
+namespace deloop {
+
+// Sums stereo sources into 24-bit output, each at its own gain and pan.
+//
+// Sources are interleaved 16-bit frames, as loop tracks play them, so one
+// 32-bit load holds a frame. Frames of two sources are repacked channel by
+// channel and multiplied by a pair of Q14 gains in one dual 16-bit
+// multiply-accumulate (SMLALD on the Cortex-M4, plain C on other targets).
+// Sums are 64-bit, so no number of full scale sources at full gain can
+// overflow, and the output saturates to 24 bits once, after adding what is
+// already there.
+//
+// Gain and pan changes are smoothed. While any source's gains are moving,
+// blocks take a slower path with a gain per frame; steady gains are loaded
+// once per block. Pan is a balance: a centred source plays at its gain on
+// both channels, and panning turns the other channel down.
+//
+// Only one task may use a mixer.
+class Mixer {
+public:
+  static constexpr size_t kMaxSources = 8;
+  static constexpr size_t kChannels = 2;
+  static constexpr float kMaxGain = 2.0f; // +6 dB.
+  static constexpr float kSmoothingMs = 20.0f;
+
+  // Every source starts at a gain of 1, centred.
+  explicit Mixer(float sample_rate);
+
+  // Sets the gain (0 to `kMaxGain`) and pan (-1 left to 1 right) of
+  // `source`, reached over `kSmoothingMs`.
+  void setLevel(size_t source, float gain, float pan);
+
+  // True if `source` is steady at a gain of 0, so it need not be rendered.
+  bool silent(size_t source) const;
+
+  // Adds `num_sources` sources of `num_frames` frames to the `num_frames`
+  // interleaved frames of `tx`, saturating. Null sources are silent, but
+  // their gains still move.
+  void mix(uint32_t num_frames, const int16_t *const *sources,
+           size_t num_sources, int32_t *tx);
+
+private:
+  void mixSteady(uint32_t num_frames, const int16_t *const *sources,
+                 size_t num_sources, int32_t *tx) const;
+  void mixMoving(uint32_t num_frames, const int16_t *const *sources,
+                 size_t num_sources, int32_t *tx);
+
+  // Left then right gain of each source.
+  std::array<Smoother, kMaxSources * kChannels> gains_;
+};
+
+} // namespace deloop
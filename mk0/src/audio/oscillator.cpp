@@ -0,0 +1,168 @@
+#include "audio/oscillator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+
+#include "util/const_math.hpp"
+
+using namespace deloop;
+
+// A full cycle in Q15, with the first entry repeated at the end so
+// interpolation never wraps.
+static constexpr auto kTable = [] {
+  std::array<int16_t, OscillatorBank::kTableSize + 1> table = {};
+  for (size_t i = 0; i < table.size(); i++) {
+    double sine = ConstSin(2.0 * std::numbers::pi * static_cast<double>(i) /
+                           OscillatorBank::kTableSize);
+    table[i] = static_cast<int16_t>(sine * INT16_MAX + (sine < 0 ? -0.5 : 0.5));
+  }
+  return table;
+}();
+
+// Phase bits below the table index, of which the top 15 interpolate.
+const int kFracBits = 32 - OscillatorBank::kTableBits;
+const int kInterpBits = 15;
+const int32_t kRound = 1 << (kInterpBits - 1);
+
+// A level of 1 peaks at full scale 24-bit, from a Q15 table.
+const float kFullScale = 256.0f;
+
+// Frames mixed per pass, bounding the stack used.
+const uint32_t kChunkFrames = 32;
+const size_t kChannels = 2;
+
+OscillatorBank::OscillatorBank(float sample_rate)
+    : sample_rate_(sample_rate),
+      glide_frames_(static_cast<uint32_t>(kGlideMs * sample_rate / 1000.0f)) {
+}
+
+void OscillatorBank::play(size_t voice, float frequency, float level) {
+  if (voice >= kMaxVoices) {
+    return;
+  }
+  Voice &v = voices_[voice];
+  v.increment = increment(frequency);
+  float target = std::clamp(level, 0.0f, 1.0f) * kFullScale;
+  if (v.envelope == Envelope::kOff && target == 0.0f) {
+    return;
+  } else if (v.envelope != Envelope::kDecay && v.envelope != Envelope::kOff &&
+             target == v.target) {
+    return;
+  }
+
+  if (v.envelope == Envelope::kOff) {
+    v.amplitude = 0.0f;
+  }
+  v.target = target;
+  if (glide_frames_ == 0) {
+    v.amplitude = target;
+    v.envelope = target > 0.0f ? Envelope::kHold : Envelope::kOff;
+    return;
+  }
+  v.envelope = Envelope::kGlide;
+  v.step = (target - v.amplitude) / static_cast<float>(glide_frames_);
+  v.decay = 1.0f;
+  v.frames = glide_frames_;
+}
+
+void OscillatorBank::strike(size_t voice, float frequency, float level,
+                            uint32_t decay_frames) {
+  if (voice >= kMaxVoices || decay_frames == 0) {
+    return;
+  }
+  Voice &v = voices_[voice];
+  v.envelope = Envelope::kDecay;
+  v.increment = increment(frequency);
+  // One step in, so the first frame is already on its way up.
+  v.phase = v.increment;
+  v.amplitude = std::clamp(level, 0.0f, 1.0f) * kFullScale;
+  v.target = 0.0f;
+  v.step = 0.0f;
+  v.decay = std::exp(std::log(0.001f) / static_cast<float>(decay_frames));
+  v.frames = decay_frames;
+}
+
+bool OscillatorBank::active(size_t voice) const {
+  return voice < kMaxVoices && voices_[voice].envelope != Envelope::kOff;
+}
+
+void OscillatorBank::render(uint32_t num_frames, int32_t *tx) {
+  bool any = std::any_of(voices_.begin(), voices_.end(), [](const Voice &v) {
+    return v.envelope != Envelope::kOff;
+  });
+  if (!any) {
+    return;
+  }
+
+  for (uint32_t done = 0; done < num_frames;) {
+    uint32_t n = std::min(num_frames - done, kChunkFrames);
+    int32_t mix[kChunkFrames] = {};
+    for (Voice &voice : voices_) {
+      if (voice.envelope != Envelope::kOff) {
+        renderVoice(voice, n, mix);
+      }
+    }
+
+    int32_t *out = &tx[done * kChannels];
+    for (uint32_t i = 0; i < n; i++) {
+      for (size_t c = 0; c < kChannels; c++) {
+        out[i * kChannels + c] =
+            std::clamp(out[i * kChannels + c] + mix[i], -0x7FFFFF, 0x7FFFFF);
+      }
+    }
+    done += n;
+  }
+}
+
+uint32_t OscillatorBank::increment(float frequency) const {
+  // Up to just under Nyquist, where the phase steps half a cycle a frame.
+  float cycles = std::clamp(frequency / sample_rate_, 0.0f, 0.49f);
+  return static_cast<uint32_t>(cycles * 4294967296.0f);
+}
+
+void OscillatorBank::renderVoice(Voice &voice, uint32_t num_frames,
+                                 int32_t *mix) {
+  for (uint32_t done = 0; done < num_frames;) {
+    uint32_t n = num_frames - done;
+    if (voice.envelope != Envelope::kHold) {
+      n = std::min(n, voice.frames);
+    }
+
+    // Holding, the envelope is amplitude * 1 + 0.
+    uint32_t phase = voice.phase;
+    float amplitude = voice.amplitude;
+    const float decay = voice.envelope == Envelope::kHold ? 1.0f : voice.decay;
+    const float step = voice.envelope == Envelope::kGlide ? voice.step : 0.0f;
+    for (uint32_t i = done; i < done + n; i++) {
+      uint32_t index = phase >> kFracBits;
+      int32_t frac = static_cast<int32_t>(
+          (phase >> (kFracBits - kInterpBits)) & ((1u << kInterpBits) - 1));
+      int32_t a = kTable[index];
+      int32_t sample =
+          a + (((kTable[index + 1] - a) * frac + kRound) >> kInterpBits);
+      mix[i] += static_cast<int32_t>(static_cast<float>(sample) * amplitude);
+      amplitude = amplitude * decay + step;
+      phase += voice.increment;
+    }
+    voice.phase = phase;
+    voice.amplitude = amplitude;
+    done += n;
+
+    if (voice.envelope == Envelope::kHold) {
+      break;
+    }
+    voice.frames -= n;
+    if (voice.frames > 0) {
+      continue;
+    }
+    // Land exactly on the target, then hold it or stop.
+    voice.amplitude = voice.target;
+    voice.envelope = voice.target > 0.0f ? Envelope::kHold : Envelope::kOff;
+    if (voice.envelope == Envelope::kOff) {
+      break;
+    }
+  }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace deloop {
+
+// Sine voices mixed into the output, for test tones and the metronome.
+//
+// Each voice is a numerically controlled oscillator: a 32-bit phase
+// accumulator whose top bits index a 512-entry Q15 sine table, with the
+// bits below interpolating linearly between entries. The table is a power
+// of two, so the phase wraps for free and any frequency is a step away, and
+// interpolation keeps errors within about a 16-bit step (-88 dB) from 1 KB
+// of flash.
+//
+// A voice either plays, holding its level and gliding to new ones over
+// `kGlideMs`, or is struck, rising from a zero crossing and decaying by
+// 60 dB before it stops. Voices are mono and added to every channel,
+// saturating to 24 bits. Voices that are off cost a branch per block.
+//
+// Only one task may use a bank.
+class OscillatorBank {
+public:
+  static constexpr size_t kMaxVoices = 8;
+  static constexpr float kGlideMs = 20.0f;
+  static constexpr int kTableBits = 9;
+  static constexpr size_t kTableSize = 1u << kTableBits;
+
+  // Every voice starts off.
+  explicit OscillatorBank(float sample_rate);
+
+  // Plays `voice` at `frequency` Hz, gliding to `level` (1 for full scale)
+  // from wherever it was. The phase carries on, so frequency changes do not
+  // click. A level of 0 turns the voice off once it glides there.
+  void play(size_t voice, float frequency, float level);
+
+  // Restarts `voice` at `frequency` Hz and `level`, decaying by 60 dB over
+  // `decay_frames`, after which it stops.
+  void strike(size_t voice, float frequency, float level,
+              uint32_t decay_frames);
+
+  bool active(size_t voice) const;
+
+  // Adds every active voice to both channels of `num_frames` interleaved
+  // frames of `tx`.
+  void render(uint32_t num_frames, int32_t *tx);
+
+private:
+  enum class Envelope : uint8_t {
+    kOff,
+    kHold,  // At a steady level.
+    kGlide, // Towards `target`, by `step` per frame.
+    kDecay, // By `decay` per frame, then off.
+  };
+
+  struct Voice {
+    Envelope envelope;
+    uint32_t phase;
+    uint32_t increment;
+    float amplitude; // Peak output, in 24-bit steps per table step.
+    float target;
+    float step;
+    float decay;
+    uint32_t frames; // Until the glide or decay ends.
+  };
+
+  uint32_t increment(float frequency) const;
+  void renderVoice(Voice &voice, uint32_t num_frames, int32_t *mix);
+
+  float sample_rate_;
+  uint32_t glide_frames_;
+  std::array<Voice, kMaxVoices> voices_ = {};
+};
+
+} // namespace deloop
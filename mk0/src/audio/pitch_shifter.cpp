@@ -0,0 +1,151 @@
+#include "audio/pitch_shifter.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+
+#include "audio/loop_codec.hpp"
+#include "util/const_math.hpp"
+
+using namespace deloop;
+
+// Grain positions and steps are Q16.16 frames.
+const int kPosBits = 16;
+const uint32_t kUnitStep = 1u << kPosBits;
+const uint32_t kPosMask = (PitchShifter::kRingFrames << kPosBits) - 1;
+const uint32_t kFrameMask = PitchShifter::kRingFrames - 1;
+
+// Frames between the newest written and the furthest on a grain reads, so
+// interpolation never reads a frame not yet written.
+const uint32_t kMargin = 2;
+
+// Periodic Hann window in Q14, scaled so that `kGrains` copies staggered by
+// `kHopFrames` sum to 1.
+const int kWindowBits = 14;
+static constexpr auto kWindow = [] {
+  std::array<int16_t, PitchShifter::kWindowSize> window = {};
+  for (size_t n = 0; n < window.size(); n++) {
+    double hann = 0.5 - 0.5 * ConstCos(2.0 * std::numbers::pi *
+                                       static_cast<double>(n) /
+                                       PitchShifter::kWindowSize);
+    double scaled = hann * 2.0 / PitchShifter::kGrains * (1 << kWindowBits);
+    window[n] = static_cast<int16_t>(scaled + 0.5);
+  }
+  return window;
+}();
+
+void PitchShifter::setPitch(float semitones) {
+  semitones = std::clamp(semitones, -kMaxSemitones, kMaxSemitones);
+  if (semitones == semitones_) {
+    return;
+  }
+  semitones_ = semitones;
+  step_ = static_cast<uint32_t>(
+      std::lround(std::exp2(semitones / 12.0f) * kUnitStep));
+}
+
+void PitchShifter::process(uint32_t num_frames, int32_t *io) {
+  bool shift = step_ != kUnitStep;
+  if (shift && !shifting_) {
+    // The ring kept filling while bypassed, so grains can start part way.
+    for (uint32_t g = 0; g < kGrains; g++) {
+      startGrain(grains_[g], g * kHopFrames);
+    }
+  }
+  shifting_ = shift;
+
+  if (!shifting_) {
+    for (uint32_t i = 0; i < num_frames; i++) {
+      for (size_t c = 0; c < kChannels; c++) {
+        ring_[write_ * kChannels + c] =
+            static_cast<int16_t>(io[i * kChannels + c] >> kLoopStorageShift);
+      }
+      write_ = (write_ + 1) & kFrameMask;
+    }
+    return;
+  }
+
+  for (uint32_t i = 0; i < num_frames; i++) {
+    int32_t *frame = &io[i * kChannels];
+    for (size_t c = 0; c < kChannels; c++) {
+      ring_[write_ * kChannels + c] =
+          static_cast<int16_t>(frame[c] >> kLoopStorageShift);
+    }
+    write_ = (write_ + 1) & kFrameMask;
+
+    int32_t sum[kChannels] = {};
+    for (uint32_t g = 0; g < kGrains; g++) {
+      Grain &grain = grains_[g];
+      if (grain.age == kGrainFrames) {
+        startGrain(grain, 0);
+        align(grain, grains_[(g + 1) % kGrains]);
+      }
+      int32_t window = kWindow[grain.age / (kGrainFrames / kWindowSize)];
+      uint32_t pos = grain.read & kPosMask;
+      const int16_t *a = &ring_[(pos >> kPosBits) * kChannels];
+      const int16_t *b =
+          &ring_[(((pos >> kPosBits) + 1) & kFrameMask) * kChannels];
+      int32_t frac = static_cast<int32_t>((pos & (kUnitStep - 1)) >> 1);
+      for (size_t c = 0; c < kChannels; c++) {
+        int32_t sample = a[c] + (((b[c] - a[c]) * frac) >> (kPosBits - 1));
+        sum[c] += sample * window;
+      }
+      grain.read += grain.step;
+      grain.age++;
+    }
+
+    for (size_t c = 0; c < kChannels; c++) {
+      frame[c] = sum[c] >> (kWindowBits - kLoopStorageShift);
+    }
+  }
+}
+
+void PitchShifter::startGrain(Grain &grain, uint32_t age) {
+  // A grain reading faster than the input starts as far back as it will
+  // gain on it, and alignment may move it on by up to `kSearchFrames`.
+  uint32_t behind = kMargin + kSearchFrames;
+  if (step_ > kUnitStep) {
+    behind += ((step_ - kUnitStep) * kGrainFrames + kUnitStep - 1) >> kPosBits;
+  }
+
+  // Positions wrap with the ring, so going back is unsigned arithmetic.
+  grain.step = step_;
+  grain.age = age;
+  grain.read = ((write_ - behind) << kPosBits) + age * (step_ - kUnitStep);
+}
+
+void PitchShifter::align(Grain &grain, const Grain &fading) const {
+  int32_t target[kMatchPoints];
+  for (uint32_t k = 0; k < kMatchPoints; k++) {
+    target[k] = mono(fading.read + k * kMatchStride * fading.step);
+  }
+  auto match = [&](uint32_t start) {
+    int64_t score = 0;
+    for (uint32_t k = 0; k < kMatchPoints; k++) {
+      score += static_cast<int64_t>(target[k]) *
+               mono(start + k * kMatchStride * grain.step);
+    }
+    return score;
+  };
+
+  // Ties, as in silence, keep the nominal start.
+  uint32_t best_start = grain.read;
+  int64_t best = match(best_start);
+  uint32_t first = grain.read - (kSearchFrames << kPosBits);
+  for (uint32_t offset = 0; offset <= 2 * kSearchFrames; offset++) {
+    uint32_t start = first + (offset << kPosBits);
+    int64_t score = match(start);
+    if (score > best) {
+      best = score;
+      best_start = start;
+    }
+  }
+  grain.read = best_start;
+}
+
+int32_t PitchShifter::mono(uint32_t pos) const {
+  const int16_t *frame = &ring_[((pos & kPosMask) >> kPosBits) * kChannels];
+  return frame[0] + frame[1];
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace deloop {
+
+// Transposes interleaved stereo audio without changing its tempo, by
+// overlapping grains read from a delay line at the transposed speed.
+//
+// Input goes into a ring of the last `kRingFrames` frames, stored as the top
+// 16 of the 24 sample bits. Two grains of `kGrainFrames` frames read it with
+// linear interpolation, staggered by half a grain, under Hann windows from a
+// table that sum to exactly 1. A grain picks up the latest pitch when it
+// restarts, so pitch changes glide in over one grain rather than clicking.
+// Grains going faster than the input start far enough back not to overtake
+// it, which delays the output by up to a grain at the highest pitch.
+//
+// As in WSOLA, a restarting grain does not start exactly where the pitch
+// puts it: it searches `kSearchFrames` either way for the start whose next
+// frames best match what the fading grain is about to read, so the two add
+// in phase instead of beating.
+//
+// The cost per block is bounded whatever the audio or pitch: every grain is
+// read on every frame, and a block holds at most one restart, whose search
+// compares a fixed `(2 * kSearchFrames + 1) * kMatchPoints` products.
+// Nothing is allocated. At 0 semitones the input passes through untouched
+// and only the ring is written.
+//
+// All memory is held in the object (about 8 KB). Only one task may use a
+// shifter.
+class PitchShifter {
+public:
+  static constexpr uint32_t kRingFrames = 2048;
+  static constexpr uint32_t kGrainFrames = 1024; // 21 ms.
+  static constexpr uint32_t kGrains = 2;
+  static constexpr uint32_t kHopFrames = kGrainFrames / kGrains;
+  static constexpr uint32_t kWindowSize = 256;
+
+  // Restarts search this far either way of the nominal start, about a
+  // period at 750 Hz, comparing `kMatchPoints` frames `kMatchStride` apart.
+  static constexpr uint32_t kSearchFrames = 64;
+  static constexpr uint32_t kMatchPoints = 16;
+  static constexpr uint32_t kMatchStride = 8;
+
+  static constexpr size_t kChannels = 2;
+
+  // An octave either way, so a grain never reads more than `kGrainFrames`
+  // behind or ahead of where it started.
+  static constexpr float kMaxSemitones = 12.0f;
+
+  static_assert((kRingFrames & (kRingFrames - 1)) == 0);
+  static_assert(kRingFrames >= 2 * kGrainFrames);
+  // At most one restart per scheduler block.
+  static_assert(kHopFrames >= 32);
+
+  // Transposes by `semitones`, clamped to `kMaxSemitones` either way. Grains
+  // started from now on use it.
+  void setPitch(float semitones);
+
+  // Replaces `num_frames` interleaved 24-bit frames of `io` with the
+  // transposed output.
+  void process(uint32_t num_frames, int32_t *io);
+
+private:
+  struct Grain {
+    uint32_t read; // Ring position in Q16.16 frames, wrapping with the ring.
+    uint32_t step; // Q16.16 frames read per frame.
+    uint32_t age;  // Frames since the grain started.
+  };
+
+  // Starts `grain` as if it had started `age` frames ago at the current
+  // pitch.
+  void startGrain(Grain &grain, uint32_t age);
+  // Moves the start of `grain`, which has just started, to line up with
+  // `fading`.
+  void align(Grain &grain, const Grain &fading) const;
+  // Sum of both channels of the frame at or before `pos`.
+  int32_t mono(uint32_t pos) const;
+
+  float semitones_ = 0.0f;
+  uint32_t step_ = 1u << 16;
+  bool shifting_ = false;
+  uint32_t write_ = 0; // Next ring frame written.
+  Grain grains_[kGrains] = {};
+  int16_t ring_[kRingFrames * kChannels] = {};
+};
+
+} // namespace deloop
@@ -0,0 +1,127 @@
+#include "audio/resampler.hpp"
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+
+#include "util/const_math.hpp"
+
+using namespace deloop;
+
+// Input samples are 16-bit, output samples 24-bit.
+const int kOutputShift = 8;
+
+// Fraction bits used by the linear and cubic kernels.
+const int kTBits = 15;
+
+// Polyphase taps are Q14, leaving headroom for the sinc's lobes.
+const int kTapBits = 14;
+
+using PhaseTaps = std::array<int16_t, Resampler::kTaps>;
+
+// Taps of a Blackman windowed sinc spanning the history, one row per phase
+// and a last row for a whole frame on. Each row is scaled to a gain of
+// exactly 1, and the first is exactly the centre frame.
+static constexpr auto kPolyphaseTaps = [] {
+  constexpr double kPi = std::numbers::pi;
+  constexpr double kHalfSpan = Resampler::kTaps / 2;
+  std::array<PhaseTaps, Resampler::kPhases + 1> table = {};
+  for (size_t p = 0; p <= Resampler::kPhases; p++) {
+    double frac = static_cast<double>(p) / Resampler::kPhases;
+    double taps[Resampler::kTaps] = {};
+    double sum = 0.0;
+    for (size_t k = 0; k < Resampler::kTaps; k++) {
+      double x = static_cast<double>(k) - Resampler::kCentre - frac;
+      double sinc = x == 0.0 ? 1.0 : ConstSin(kPi * x) / (kPi * x);
+      double window = 0.42 + 0.5 * ConstCos(kPi * x / kHalfSpan) +
+                      0.08 * ConstCos(2.0 * kPi * x / kHalfSpan);
+      taps[k] = sinc * window;
+      sum += taps[k];
+    }
+
+    // Rounding can leave the gain off by a step, which goes on the largest
+    // tap.
+    int32_t total = 0;
+    size_t largest = 0;
+    for (size_t k = 0; k < Resampler::kTaps; k++) {
+      double scaled = taps[k] / sum * (1 << kTapBits);
+      table[p][k] = static_cast<int16_t>(scaled < 0.0 ? scaled - 0.5
+                                                      : scaled + 0.5);
+      total += table[p][k];
+      largest = table[p][k] > table[p][largest] ? k : largest;
+    }
+    table[p][largest] =
+        static_cast<int16_t>(table[p][largest] + (1 << kTapBits) - total);
+  }
+  return table;
+}();
+
+static_assert(kPolyphaseTaps[0][Resampler::kCentre] == 1 << kTapBits);
+static_assert(kPolyphaseTaps[Resampler::kPhases][Resampler::kCentre + 1] ==
+              1 << kTapBits);
+
+// Kernels over the history from its oldest frame, for one channel.
+
+static inline int32_t linear(const int16_t *h, int32_t t) {
+  const size_t c = Resampler::kCentre * Resampler::kChannels;
+  int32_t p1 = h[c];
+  int32_t p2 = h[c + Resampler::kChannels];
+  return (p1 << kOutputShift) + (((p2 - p1) * t) >> (kTBits - kOutputShift));
+}
+
+static inline int32_t cubic(const int16_t *h, int32_t t) {
+  const size_t c = Resampler::kCentre * Resampler::kChannels;
+  int64_t p0 = h[c - Resampler::kChannels];
+  int64_t p1 = h[c];
+  int64_t p2 = h[c + Resampler::kChannels];
+  int64_t p3 = h[c + 2 * Resampler::kChannels];
+  // Twice the Catmull-Rom coefficients, so they stay whole.
+  int64_t a = 3 * (p1 - p2) + p3 - p0;
+  int64_t b = 2 * p0 - 5 * p1 + 4 * p2 - p3;
+  int64_t d = p2 - p0;
+  int64_t v = ((((a * t) >> kTBits) + b) * t >> kTBits) + d;
+  return static_cast<int32_t>((p1 << kOutputShift) +
+                              ((v * t) >> (kTBits + 1 - kOutputShift)));
+}
+
+static inline int32_t polyphase(const int16_t *h, const PhaseTaps &taps) {
+  int32_t sum = 0;
+  for (size_t k = 0; k < Resampler::kTaps; k++) {
+    sum += h[k * Resampler::kChannels] * taps[k];
+  }
+  return sum >> (kTapBits - kOutputShift);
+}
+
+void Resampler::reset(void) {
+  for (int16_t &sample : history_) {
+    sample = 0;
+  }
+  write_ = 0;
+  frac_ = 0;
+}
+
+void Resampler::interpolate(Interpolation quality, int32_t *out) const {
+  const int16_t *h = &history_[write_ * kChannels];
+  switch (quality) {
+  case Interpolation::kLinear: {
+    int32_t t = static_cast<int32_t>(frac_ >> (kFracBits - kTBits));
+    out[0] = linear(&h[0], t);
+    out[1] = linear(&h[1], t);
+  } break;
+  case Interpolation::kCubic: {
+    int32_t t = static_cast<int32_t>(frac_ >> (kFracBits - kTBits));
+    out[0] = cubic(&h[0], t);
+    out[1] = cubic(&h[1], t);
+  } break;
+  case Interpolation::kPolyphase: {
+    // The nearest phase, which may be the last row.
+    constexpr int kPhaseShift = kFracBits - std::countr_zero(kPhases);
+    const PhaseTaps &taps =
+        kPolyphaseTaps[(frac_ + (1u << (kPhaseShift - 1))) >> kPhaseShift];
+    out[0] = polyphase(&h[0], taps);
+    out[1] = polyphase(&h[1], taps);
+  } break;
+  }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace deloop {
+
+// How a `Resampler` interpolates between input frames, from cheapest to
+// cleanest.
+enum class Interpolation : uint8_t {
+  kLinear,    // 2 taps.
+  kCubic,     // 4 taps, Catmull-Rom.
+  kPolyphase, // 8 taps of a windowed sinc, in `Resampler::kPhases` phases.
+};
+
+// Fixed-point resampler for interleaved stereo 16-bit frames, producing one
+// output frame per call at any speed up to `kMaxStep`.
+//
+// The caller pushes input frames one at a time, straight from wherever they
+// are stored, as `advance` asks for them. The resampler keeps only the
+// last `kTaps` of them. Every interpolation reads around the same frame of
+// that history, `kCentre` frames after the oldest, so the interpolation can
+// change between any two frames without a jump.
+//
+// Speeds above 1 are not filtered beyond the kernel itself, so content over
+// the output Nyquist frequency aliases.
+class Resampler {
+public:
+  static constexpr size_t kChannels = 2;
+  static constexpr size_t kTaps = 8;
+  static constexpr size_t kCentre = kTaps / 2 - 1;
+  static constexpr size_t kPhases = 128;
+
+  // Steps are input frames per output frame in Q8.24.
+  static constexpr int kFracBits = 24;
+  static constexpr uint32_t kUnitStep = 1u << kFracBits;
+  static constexpr uint32_t kMaxStep = 4 * kUnitStep;
+
+  // Clears the history and the position between frames.
+  void reset(void);
+
+  // Adds the frame after the newest in the history.
+  void push(const int16_t *frame) {
+    for (size_t c = 0; c < kChannels; c++) {
+      history_[write_ * kChannels + c] = frame[c];
+      history_[(write_ + kTaps) * kChannels + c] = frame[c];
+    }
+    write_ = (write_ + 1) % kTaps;
+  }
+
+  // Writes the frame `frac()` past the centre of the history to `out`, as
+  // 24-bit samples. Kernels that overshoot can exceed 24 bits.
+  void interpolate(Interpolation quality, int32_t *out) const;
+
+  // Moves on by `step`, at most `kMaxStep`. Returns how many frames to push
+  // before the next call to `interpolate`.
+  uint32_t advance(uint32_t step) {
+    frac_ += step;
+    uint32_t frames = frac_ >> kFracBits;
+    frac_ &= kUnitStep - 1;
+    return frames;
+  }
+
+  uint32_t frac(void) const { return frac_; } // Q0.24 frames.
+
+private:
+  // Every frame is written twice, so the history from the oldest frame is
+  // always contiguous.
+  int16_t history_[2 * kTaps * kChannels] = {};
+  uint32_t write_ = 0; // Oldest frame, overwritten by the next push.
+  uint32_t frac_ = 0;
+};
+
+} // namespace deloop
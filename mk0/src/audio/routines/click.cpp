@@ -0,0 +1,43 @@
+#include "audio/routines/click.hpp"
+
+#include <cstdint>
+
+#include "audio/clock.hpp"
+#include "audio/oscillator.hpp"
+#include "audio/scheduler.hpp"
+#include "errors.hpp"
+#include "params.hpp"
+
+constexpr uint32_t kClickFrames = 1440; // 30 ms, by then at -60 dB.
+constexpr float kBeatHz = 1000.0f;
+constexpr float kDownbeatHz = 2000.0f;
+
+DELOOP_PARAM(level, "click.level", 0.0f, 0.0f, 1.0f);
+
+// Each click strikes a decaying sine on one voice, so a new click cuts off
+// what is left of the last.
+static deloop::OscillatorBank bank_(deloop::audio_scheduler::kSampleRate);
+
+deloop::Error tx_click(uint32_t num_frames, int32_t *tx, int32_t *rx) {
+  if (num_frames == 0 || tx == nullptr || rx == nullptr) {
+    return deloop::Error::kInvalidArgument;
+  }
+
+  const deloop::audio_clock::Position &pos = deloop::audio_clock::position();
+  uint32_t offset = 0;
+  if (!deloop::audio_clock::beatInBlock(pos, num_frames, offset)) {
+    bank_.render(num_frames, tx);
+    return deloop::Error::kOk;
+  }
+
+  // Finish the previous click up to the beat, then start a new one on it.
+  bank_.render(offset, tx);
+  uint32_t beat_in_bar = deloop::audio_clock::beatInBar(pos, offset);
+  if (level.value() > 0.0f) {
+    bank_.strike(0, beat_in_bar == 0 ? kDownbeatHz : kBeatHz, level.value(),
+                 kClickFrames);
+  }
+  bank_.render(num_frames - offset,
+               &tx[offset * deloop::audio_scheduler::kNumChannels]);
+  return deloop::Error::kOk;
+}
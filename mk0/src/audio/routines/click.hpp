@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+
+#include "errors.hpp"
+
+// Mixes a metronome click into the output on every beat of `audio_clock`,
+// starting on the exact frame of the beat. Silent while `click.level` is 0.
+deloop::Error tx_click(uint32_t num_frames, int32_t *tx, int32_t *rx);
@@ -0,0 +1,23 @@
+#include "audio/routines/pitch.hpp"
+
+#include <cstdint>
+
+#include "audio/pitch_shifter.hpp"
+#include "errors.hpp"
+#include "params.hpp"
+
+DELOOP_PARAM(semitones, "pitch.semitones", 0.0f,
+             -deloop::PitchShifter::kMaxSemitones,
+             deloop::PitchShifter::kMaxSemitones);
+
+static deloop::PitchShifter shifter_;
+
+deloop::Error tx_pitch(uint32_t num_frames, int32_t *tx, int32_t *rx) {
+  if (num_frames == 0 || tx == nullptr || rx == nullptr) {
+    return deloop::Error::kInvalidArgument;
+  }
+
+  shifter_.setPitch(semitones.value());
+  shifter_.process(num_frames, tx);
+  return deloop::Error::kOk;
+}
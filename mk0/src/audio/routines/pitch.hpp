@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+#include "errors.hpp"
+
+// Transposes everything mixed into the output so far by `pitch.semitones`,
+// keeping its tempo (see `deloop::PitchShifter`). Passes the output through
+// untouched at 0 semitones.
+deloop::Error tx_pitch(uint32_t num_frames, int32_t *tx, int32_t *rx);
@@ -4,4 +4,7 @@
 
 #include "errors.hpp"
 
+// Overwrites the output with a test tone at `sine.frequency` Hz and
+// `sine.level`, from voice 0 of an `OscillatorBank`. Silent while
+// `sine.level` is 0, as it is by default.
 deloop::Error tx_sine(uint32_t num_frames, int32_t *tx, int32_t *rx);
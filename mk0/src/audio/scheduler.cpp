@@ -1,5 +1,8 @@
+#define DELOOP_LOG_MODULE deloop::LogModule::kAudioScheduler
+
 #include "audio/scheduler.hpp"
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <cstdint>
@@ -7,17 +10,42 @@
 
 #include "errors.hpp"
 #include "logging.hpp"
+#include "metrics.hpp"
+#include "params.hpp"
+#include "util/seqlock.hpp"
+#include "util/spsc_ring.hpp"
 
 using namespace deloop;
 
-const size_t kMaxCallbacks = 4;
+const size_t kMaxCallbacks = 8;
+
+DELOOP_METRIC_COUNTER(blocks_processed, "audio_scheduler.blocks_processed");
+DELOOP_METRIC_COUNTER(busy_blocks, "audio_scheduler.busy_blocks");
+DELOOP_METRIC_COUNTER(callback_errors, "audio_scheduler.callback_errors");
+DELOOP_METRIC_COUNTER(late_events, "audio_scheduler.late_events");
+
 static struct {
   bool initialized;
   std::atomic_flag lock;
   std::size_t num_callbacks;
   std::array<audio_scheduler::ProccessCallback, kMaxCallbacks> callbacks;
+
+  SeqLock<uint64_t> frame_time;
+  // Frame time of the first frame passed to the running callbacks.
+  uint64_t callback_frame;
+  // Events posted but not yet seen by the audio task.
+  SpscRing<audio_scheduler::Event, audio_scheduler::kMaxPendingEvents>
+      posted_events;
+  std::atomic<size_t> num_posted;
+  // Events seen by the audio task, sorted by frame. Only touched by it.
+  std::array<audio_scheduler::Event, audio_scheduler::kMaxPendingEvents>
+      events;
+  size_t num_events;
 } state_ = {0};
 
+static Error runCallbacks(uint32_t num_frames, int32_t *tx, int32_t *rx);
+static void takePostedEvents(void);
+
 Error audio_scheduler::init(void) {
   if (state_.initialized) {
     return Error::kAlreadyInitialized;
@@ -57,18 +85,104 @@ Error audio_scheduler::process(uint32_t num_frames, int32_t *tx, int32_t *rx) {
   }
 
   if (state_.lock.test_and_set(std::memory_order_acquire)) {
+    busy_blocks.increment();
     return Error::kSchedulerBusy;
   }
 
+  // Every callback sees the same parameter values for the whole block.
+  params::acquire();
+  takePostedEvents();
+
+  // Split the block at every frame that has events due, running the events
+  // between the two parts.
+  uint64_t block_start = state_.frame_time.load();
+  uint32_t done = 0;
+  size_t next_event = 0;
   Error err = Error::kOk;
-  for (size_t i = 0; i < state_.num_callbacks; i++) {
-    err = state_.callbacks[i](num_frames, tx, rx);
-    if (err != Error::kOk) {
-      DELOOP_LOG_ERROR("[AUDIO_SCHEDULER] Callback failed: %d", err);
-      break;
+  while (err == Error::kOk && done < num_frames) {
+    uint64_t now = block_start + done;
+    while (next_event < state_.num_events &&
+           state_.events[next_event].frame <= now) {
+      const Event &event = state_.events[next_event++];
+      if (event.frame < now) {
+        late_events.increment();
+      }
+      event.action(event.arg);
+    }
+
+    uint32_t end = num_frames;
+    if (next_event < state_.num_events &&
+        state_.events[next_event].frame < block_start + num_frames) {
+      end = static_cast<uint32_t>(state_.events[next_event].frame -
+                                  block_start);
     }
+
+    state_.callback_frame = now;
+    err = runCallbacks(end - done, &tx[done * kNumChannels],
+                       &rx[done * kNumChannels]);
+    done = end;
   }
 
+  // Drop the events that ran.
+  std::copy(&state_.events[next_event], &state_.events[state_.num_events],
+            &state_.events[0]);
+  state_.num_events -= next_event;
+  state_.num_posted.fetch_sub(next_event, std::memory_order_relaxed);
+
+  state_.frame_time.store(block_start + num_frames);
   state_.lock.clear(std::memory_order_release);
+  blocks_processed.increment();
   return err;
 }
+
+uint64_t audio_scheduler::getFrameTime(void) {
+  return state_.frame_time.load();
+}
+
+uint64_t audio_scheduler::getCallbackFrame(void) {
+  return state_.callback_frame;
+}
+
+Error audio_scheduler::postEvent(const Event &event) {
+  if (!state_.initialized) {
+    return Error::kNotInitialized;
+  } else if (event.action == nullptr) {
+    return Error::kInvalidArgument;
+  }
+
+  // Counting every event not yet run, rather than only the ring, guarantees
+  // the audio task always has room to sort what it takes off the ring.
+  if (state_.num_posted.load(std::memory_order_relaxed) >= kMaxPendingEvents) {
+    return Error::kSchedulerEventsFull;
+  }
+
+  state_.num_posted.fetch_add(1, std::memory_order_relaxed);
+  state_.posted_events.push(event);
+  return Error::kOk;
+}
+
+static Error runCallbacks(uint32_t num_frames, int32_t *tx, int32_t *rx) {
+  for (size_t i = 0; i < state_.num_callbacks; i++) {
+    Error err = state_.callbacks[i](num_frames, tx, rx);
+    if (err != Error::kOk) {
+      callback_errors.increment();
+      DELOOP_LOG_ERROR_FROM_AUDIO("[AUDIO_SCHEDULER] Callback failed: %d",
+                                  err);
+      return err;
+    }
+  }
+  return Error::kOk;
+}
+
+// Moves posted events into the sorted list. Events for the same frame keep
+// the order they were posted in.
+static void takePostedEvents(void) {
+  audio_scheduler::Event event;
+  while (state_.posted_events.pop(event)) {
+    size_t i = state_.num_events++;
+    for (; i > 0 && state_.events[i - 1].frame > event.frame; i--) {
+      state_.events[i] = state_.events[i - 1];
+    }
+    state_.events[i] = event;
+  }
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 
@@ -8,14 +9,47 @@
 namespace deloop {
 namespace audio_scheduler {
 
+// Sample rate of the audio stream (see `SAI_AUDIO_FREQUENCY_48K` in
+// `audio/stream.cpp`).
+constexpr float kSampleRate = 48000.0f;
+
+// Samples per frame. Buffers hold interleaved frames.
+constexpr size_t kNumChannels = 2;
+
+// Events waiting for their frame, including ones not yet seen by `process`.
+constexpr size_t kMaxPendingEvents = 16;
+
 using ProccessCallback =
     std::function<Error(uint32_t num_frames, int32_t *tx, int32_t *rx)>;
 
+// Runs in the audio task, between two frames of a block.
+using EventAction = void (*)(uint32_t arg);
+
+struct Event {
+  uint64_t frame; // Frame time to run at (see `getFrameTime`).
+  EventAction action;
+  uint32_t arg;
+};
+
 // TODO: Make channels configurable
 Error init(void);
 Error registerCallback(ProccessCallback callback);
 // TODO: Register
 Error process(uint32_t num_frames, int32_t *tx, int32_t *rx);
 
+// Number of frames processed since `init`, which is the frame time of the
+// first frame of the next block. Safe to call from any task.
+uint64_t getFrameTime(void);
+
+// Frame time of the first frame passed to the running callback. Only valid
+// in the audio task, from within a callback.
+uint64_t getCallbackFrame(void);
+
+// Queues `event` to run right before frame `event.frame` is processed.
+// `process` splits its block at that frame, so callbacks see the effect from
+// exactly that frame on. Events due before the current block run at its
+// start. Only one task may post events.
+Error postEvent(const Event &event);
+
 } // namespace audio_scheduler
 } // namespace deloop
@@ -0,0 +1,134 @@
+#include "audio/smoother.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+using namespace deloop;
+
+// Frames ramped per pass of `ApplyGain`, bounding its stack use.
+const size_t kGainChunkFrames = 16;
+
+Smoother::Smoother(Mode mode, float time_ms, float sample_rate, float value)
+    : mode_(mode), ramp_samples_(0), pole_{0.0f, 0.0f, 0.0f, 0.0f},
+      current_(value), target_(value) {
+  float samples = time_ms * sample_rate / 1000.0f;
+  if (samples < 1.0f) {
+    return;
+  }
+
+  ramp_samples_ = static_cast<uint32_t>(samples);
+  float pole = std::exp(-1.0f / samples);
+  for (float &p : pole_) {
+    p = pole;
+    pole *= pole_[0];
+  }
+}
+
+void Smoother::setTarget(float target) {
+  if (target == target_) {
+    return;
+  }
+
+  target_ = target;
+  if (ramp_samples_ == 0) {
+    reset(target);
+  } else if (mode_ == Mode::kLinear) {
+    remaining_ = ramp_samples_;
+    step_ = (target_ - current_) / static_cast<float>(ramp_samples_);
+  } else {
+    remaining_ = 1;
+  }
+}
+
+void Smoother::reset(float value) {
+  current_ = value;
+  target_ = value;
+  remaining_ = 0;
+}
+
+bool Smoother::next(float *out, size_t n) {
+  if (steady()) {
+    return false;
+  }
+
+  if (mode_ == Mode::kLinear) {
+    nextLinear(out, n);
+  } else {
+    nextOnePole(out, n);
+  }
+  return true;
+}
+
+void Smoother::nextLinear(float *out, size_t n) {
+  // Each value is computed from the block start rather than accumulated, so
+  // the loop has no carried dependency and rounding does not build up.
+  size_t ramp = std::min<size_t>(n, remaining_);
+  float start = current_;
+  for (size_t i = 0; i < ramp; i++) {
+    out[i] = start + step_ * static_cast<float>(i + 1);
+  }
+  std::fill(out + ramp, out + n, target_);
+
+  remaining_ -= static_cast<uint32_t>(ramp);
+  current_ = (remaining_ == 0)
+                 ? target_
+                 : start + step_ * static_cast<float>(ramp);
+}
+
+void Smoother::nextOnePole(float *out, size_t n) {
+  // The recursion y[n] = t + (y[n-1] - t) * p is unrolled into four
+  // independent products per pass, using p^1 to p^4.
+  float distance = current_ - target_;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    out[i] = target_ + distance * pole_[0];
+    out[i + 1] = target_ + distance * pole_[1];
+    out[i + 2] = target_ + distance * pole_[2];
+    out[i + 3] = target_ + distance * pole_[3];
+    distance *= pole_[3];
+  }
+  for (; i < n; i++) {
+    distance *= pole_[0];
+    out[i] = target_ + distance;
+  }
+
+  if (std::fabs(distance) < kSettleThreshold) {
+    reset(target_);
+  } else {
+    current_ = target_ + distance;
+  }
+}
+
+void deloop::ApplyGain(int32_t *samples, size_t num_frames, size_t channels,
+                       Smoother &gain) {
+  if (gain.steady()) {
+    float value = gain.value();
+    if (value == 1.0f) {
+      return;
+    }
+
+    for (size_t i = 0; i < num_frames * channels; i++) {
+      samples[i] =
+          static_cast<int32_t>(static_cast<float>(samples[i]) * value);
+    }
+    return;
+  }
+
+  float ramp[kGainChunkFrames];
+  for (size_t frame = 0; frame < num_frames; frame += kGainChunkFrames) {
+    size_t n = std::min(kGainChunkFrames, num_frames - frame);
+    if (!gain.next(ramp, n)) {
+      std::fill(ramp, ramp + n, gain.value());
+    }
+
+    int32_t *chunk = &samples[frame * channels];
+    for (size_t i = 0; i < n; i++) {
+      for (size_t c = 0; c < channels; c++) {
+        chunk[i * channels + c] = static_cast<int32_t>(
+            static_cast<float>(chunk[i * channels + c]) * ramp[i]);
+      }
+    }
+  }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace deloop {
+
+// Interpolates a parameter towards its target one sample at a time, so that
+// changes made between blocks do not cause zipper noise. Typically fed from
+// a `Param` once per block:
+//
+//   gain.setTarget(level.value());
+//   ApplyGain(tx, num_frames, 2, gain);
+//
+// Once the target is reached the smoother is steady and costs a single
+// branch per block. Only one task may use a smoother.
+class Smoother {
+public:
+  enum class Mode : uint8_t {
+    kLinear,  // Reaches the target after `time_ms`.
+    kOnePole, // Exponential approach with time constant `time_ms`.
+  };
+
+  // Values within this distance of the target snap to it, which makes a
+  // one-pole smoother steady after about 11.5 time constants for a full
+  // scale step.
+  static constexpr float kSettleThreshold = 1e-5f;
+
+  // A `time_ms` of 0 makes every change immediate.
+  Smoother(Mode mode, float time_ms, float sample_rate, float value = 0.0f);
+
+  // Sets the target, keeping the ramp duration or time constant. Setting
+  // the current target again is free.
+  void setTarget(float target);
+
+  // Jumps to `value` immediately.
+  void reset(float value);
+
+  bool steady() const { return remaining_ == 0; }
+  float value() const { return current_; }
+  float target() const { return target_; }
+
+  // Writes the next `n` values to `out`. Returns false without touching
+  // `out` if the smoother is steady, in which case every value is `value()`.
+  bool next(float *out, size_t n);
+
+private:
+  void nextLinear(float *out, size_t n);
+  void nextOnePole(float *out, size_t n);
+
+  Mode mode_;
+  uint32_t ramp_samples_; // Linear ramp duration, 0 for immediate changes.
+  float pole_[4];         // One-pole decay over 1 to 4 samples.
+  float current_;
+  float target_;
+  float step_ = 0.0f;      // Linear increment per sample.
+  uint32_t remaining_ = 0; // Samples left in a linear ramp, or 1 while a
+                           // one-pole smoother is settling.
+};
+
+// Scales `num_frames` interleaved frames of `channels` samples by `gain`.
+// Every channel of a frame gets the same gain. Samples are left untouched
+// while the gain is steady at unity.
+void ApplyGain(int32_t *samples, size_t num_frames, size_t channels,
+               Smoother &gain);
+
+} // namespace deloop
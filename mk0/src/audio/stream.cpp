@@ -1,3 +1,5 @@
+#define DELOOP_LOG_MODULE deloop::LogModule::kAudioStream
+
 #include "audio/stream.hpp"
 
 #include <stm32f4xx_hal.h>
@@ -12,17 +14,25 @@
 #include "board/stm32f4xx_it.h"
 #include "errors.hpp"
 #include "logging.hpp"
+#include "metrics.hpp"
 #include "portmacro.h"
 #include "stm32f4xx_hal_def.h"
+#include "trace.hpp"
 
 using namespace deloop;
 
 const size_t kTaskStackSize = configMINIMAL_STACK_SIZE * 5;
+// Samples per DMA half buffer, holding interleaved stereo frames.
 const uint16_t kFrameSize = 64;
 
 const UBaseType_t kRxNotifIndex = 0;
 const UBaseType_t kTxNotifIndex = 1;
 
+// Cycles spent processing each block, in buckets of 8192 cycles (~45 us). A
+// 32 frame block at 48 kHz leaves ~120k cycles.
+DELOOP_METRIC_HISTOGRAM(block_cycles, "audio_stream.block_cycles", 13);
+DELOOP_METRIC_COUNTER(notify_errors, "audio_stream.notify_errors");
+
 static struct {
   bool initialized;
   SAI_HandleTypeDef sai_rx_handle;
@@ -250,18 +260,26 @@ static void audioStreamLoop(void *args) {
     uint32_t rx_flag =
         ulTaskNotifyTakeIndexed(kRxNotifIndex, pdTRUE, portMAX_DELAY);
     if (tx_flag != rx_flag) {
-      DELOOP_LOG_ERROR("[AUDIO_STREAM] Tx and Rx notification mismatch: %d",
-                       tx_flag);
+      notify_errors.increment();
+      DELOOP_LOG_ERROR_FROM_AUDIO(
+          "[AUDIO_STREAM] Tx and Rx notification mismatch: %d", tx_flag);
       continue;
     }
 
     uint32_t indx = rx_flag - 1;
     if (indx > 2) {
-      DELOOP_LOG_ERROR("[AUDIO_STREAM] Invalid notification: %d", indx);
+      notify_errors.increment();
+      DELOOP_LOG_ERROR_FROM_AUDIO("[AUDIO_STREAM] Invalid notification: %d",
+                                  indx);
       continue;
     }
-    deloop::audio_scheduler::process(kFrameSize, state_.tx_buf[indx],
-                                     state_.rx_buf[indx]);
+
+    DELOOP_TRACE_SCOPE(TraceTrack::kAudio, "audio_block");
+    uint32_t start = DWT->CYCCNT;
+    deloop::audio_scheduler::process(
+        kFrameSize / deloop::audio_scheduler::kNumChannels,
+        state_.tx_buf[indx], state_.rx_buf[indx]);
+    block_cycles.record(DWT->CYCCNT - start);
   }
 }
 
@@ -271,6 +289,7 @@ static void rxMem0XferComplete(DMA_HandleTypeDef *dma_handle) {
     return;
   }
 
+  DELOOP_TRACE_INSTANT(TraceTrack::kAudioDma, "sai_rx_complete_0");
   BaseType_t xHigherPriorityTaskWoken = pdFALSE;
   xTaskNotifyIndexedFromISR(state_.audio_stream_task, kRxNotifIndex, 1,
                             eSetValueWithOverwrite, &xHigherPriorityTaskWoken);
@@ -283,6 +302,7 @@ static void rxMem1XferComplete(DMA_HandleTypeDef *dma_handle) {
     return;
   }
 
+  DELOOP_TRACE_INSTANT(TraceTrack::kAudioDma, "sai_rx_complete_1");
   BaseType_t xHigherPriorityTaskWoken = pdFALSE;
   xTaskNotifyIndexedFromISR(state_.audio_stream_task, kRxNotifIndex, 2,
                             eSetValueWithOverwrite, &xHigherPriorityTaskWoken);
@@ -295,6 +315,7 @@ static void txMem0XferComplete(DMA_HandleTypeDef *dma_handle) {
     return;
   }
 
+  DELOOP_TRACE_INSTANT(TraceTrack::kAudioDma, "sai_tx_complete_0");
   BaseType_t xHigherPriorityTaskWoken = pdFALSE;
   xTaskNotifyIndexedFromISR(state_.audio_stream_task, kTxNotifIndex, 1,
                             eSetValueWithOverwrite, &xHigherPriorityTaskWoken);
@@ -307,6 +328,7 @@ static void txMem1XferComplete(DMA_HandleTypeDef *dma_handle) {
     return;
   }
 
+  DELOOP_TRACE_INSTANT(TraceTrack::kAudioDma, "sai_tx_complete_1");
   BaseType_t xHigherPriorityTaskWoken = pdFALSE;
   xTaskNotifyIndexedFromISR(state_.audio_stream_task, kTxNotifIndex, 2,
                             eSetValueWithOverwrite, &xHigherPriorityTaskWoken);
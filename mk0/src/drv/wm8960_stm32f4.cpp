@@ -1,3 +1,5 @@
+#define DELOOP_LOG_MODULE deloop::LogModule::kWm8960
+
 #include <cstdlib>
 #include <stm32f4xx_hal.h>
 #include <stm32f4xx_hal_i2c.h>
@@ -11,8 +13,12 @@
 #include "drv/wm8960.hpp"
 #include "errors.hpp"
 #include "logging.hpp"
+#include "metrics.hpp"
 #include "stm32f4xx_hal_def.h"
 
+DELOOP_METRIC_COUNTER(i2c_retries, "wm8960.i2c_retries");
+DELOOP_METRIC_COUNTER(i2c_errors, "wm8960.i2c_errors");
+
 namespace deloop {
 
 Error WM8960::init(I2C_TypeDef *i2c) {
@@ -138,11 +144,14 @@ Error WM8960::writeRegister(uint8_t reg_addr, uint16_t data) {
     if (status == HAL_OK) {
       break;
     } else if (retry_attempts == 0) {
+      i2c_errors.increment();
       // DELOOP_LOG_ERROR("[WM8960] Failed to write to register 0x%02X:
       // 0x%02X",
       //                  reg_addr, data);
       break;
     }
+
+    i2c_retries.increment();
   }
 
   switch (status) {
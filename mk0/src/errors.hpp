@@ -32,6 +32,14 @@ enum class Error : int32_t {
   // Audio Scheduler
   kSchedulerCallbacksFull = -11,
   kSchedulerBusy = -12,
+  kSchedulerEventsFull = -15,
+
+  // Parameters
+  kParamTableFull = -13,
+  kParamNotFound = -14,
+
+  // Looper
+  kLooperHistoryTooShort = -16,
 };
 
 } // namespace deloop
@@ -0,0 +1,95 @@
+#include "log_encoding.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "logging.hpp"
+#include "util/varint.hpp"
+
+using namespace deloop;
+
+void LogBatchEncoder::init(uint8_t *buffer, size_t capacity) {
+  buffer_ = buffer;
+  capacity_ = capacity;
+  reset();
+}
+
+void LogBatchEncoder::reset() {
+  size_ = 0;
+  count_ = 0;
+  last_timestamp_ = 0;
+}
+
+bool LogBatchEncoder::append(const LogEntry &entry) {
+  // Encode into a scratch record first so a record that does not fit leaves
+  // the batch untouched.
+  uint8_t record[5 + kMaxRecordSize];
+  size_t n = 0;
+
+  if (count_ == 0) {
+    n += WriteVarint(&record[n], entry.timestamp);
+    last_timestamp_ = entry.timestamp;
+  }
+
+  uint8_t num_args = 0;
+  uint8_t arg_types = 0;
+  for (const LogArg &arg : entry.args) {
+    if (arg.type == LogArg::Type::kUnset) {
+      break;
+    }
+    arg_types |= static_cast<uint8_t>(static_cast<uint8_t>(arg.type)
+                                      << (2 * num_args));
+    num_args++;
+  }
+
+  uint8_t header = static_cast<uint8_t>(
+      (static_cast<uint8_t>(entry.level) & 0x03) | (num_args << 2) |
+      ((entry.suppressed > 0 ? 1 : 0) << 5));
+  record[n++] = header;
+
+  uint32_t site_id = LogSiteId(entry.hash);
+  for (int i = 0; i < 4; i++) {
+    record[n++] = static_cast<uint8_t>(site_id >> (8 * i));
+  }
+
+  int32_t delta = static_cast<int32_t>(entry.timestamp - last_timestamp_);
+  n += WriteVarint(&record[n], ZigZag(delta));
+
+  if (num_args > 0) {
+    record[n++] = arg_types;
+  }
+
+  for (uint8_t i = 0; i < num_args; i++) {
+    const LogArg &arg = entry.args[i];
+    switch (arg.type) {
+    case LogArg::Type::kU32:
+      n += WriteVarint(&record[n], arg.value.u32);
+      break;
+    case LogArg::Type::kI32:
+      n += WriteVarint(&record[n], ZigZag(arg.value.i32));
+      break;
+    case LogArg::Type::kF32:
+      std::memcpy(&record[n], &arg.value.f32, sizeof(float));
+      n += sizeof(float);
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (entry.suppressed > 0) {
+    n += WriteVarint(&record[n], entry.suppressed);
+  }
+
+  if (size_ + n > capacity_) {
+    return false;
+  }
+
+  std::memcpy(&buffer_[size_], record, n);
+  size_ += n;
+  count_++;
+  last_timestamp_ = entry.timestamp;
+  return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "logging.hpp"
+
+namespace deloop {
+
+// Compact wire encoding for batches of log records, used instead of one
+// protobuf `StreamPacket` per record to save bandwidth on the UART link.
+//
+// NOTE: This must match `python/deloop_mk0/log_encoding.py`.
+//
+// All multi-byte values are little-endian.
+//
+//   Batch:  [base timestamp: varint] [record]...
+//   Record: [header: u8]
+//           [site id: u32]
+//           [timestamp delta from previous record: zigzag varint]
+//           [arg types: u8, only if the record has args]
+//           [args...]
+//           [suppressed count: varint, only if flagged in the header]
+//
+//   Header bits 0-1: Level (`deloop::LogLevel`).
+//   Header bits 2-4: Number of args.
+//   Header bit 5:    Suppressed count present.
+//   Arg types:       2 bits per arg, first arg in bits 0-1 (1: u32, 2: i32,
+//                    3: f32).
+//   Args:            u32 as varint, i32 as zigzag varint, f32 as 4 raw bytes.
+
+// Short identifier of a log call site, folded from its format string hash.
+constexpr uint32_t LogSiteId(uint64_t hash) {
+  return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+class LogBatchEncoder {
+public:
+  // Worst case size of one encoded record.
+  static constexpr size_t kMaxRecordSize = 1 + 4 + 5 + 1 + 4 * 5 + 5;
+
+  void init(uint8_t *buffer, size_t capacity);
+
+  // Returns false, without modifying the batch, if the record does not fit.
+  bool append(const LogEntry &entry);
+  void reset();
+
+  const uint8_t *data() const { return buffer_; }
+  size_t size() const { return size_; }
+  uint32_t count() const { return count_; }
+  bool empty() const { return count_ == 0; }
+
+private:
+  uint8_t *buffer_;
+  size_t capacity_;
+  size_t size_;
+  uint32_t count_;
+  uint32_t last_timestamp_;
+};
+
+} // namespace deloop
@@ -0,0 +1,110 @@
+#include "logging.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "util/irq_lock.hpp"
+#include "util/spsc_ring.hpp"
+
+using namespace deloop;
+
+const size_t kRtLogRingSize = 16;
+
+std::atomic<uint32_t> deloop::internal::log_enabled[kNumLogLevels] = {
+    kAllLogModules, kAllLogModules, kAllLogModules};
+
+static struct {
+  std::array<SpscRing<LogEntry, kRtLogRingSize>, kNumLogContexts> rings;
+  std::atomic<uint32_t> overflows[kNumLogContexts][kNumLogLevels];
+
+  // Filter settings, only modified by the command task.
+  LogLevel min_level;
+  uint32_t module_mask = kAllLogModules;
+  std::atomic<LogClock> clock;
+} state_;
+
+static void updateLogFilter(void) {
+  for (size_t i = 0; i < kNumLogLevels; i++) {
+    bool level_enabled = i >= static_cast<size_t>(state_.min_level);
+    internal::log_enabled[i].store(level_enabled ? state_.module_mask : 0,
+                                   std::memory_order_relaxed);
+  }
+}
+
+void deloop::SetLogLevel(LogLevel level) {
+  state_.min_level = level;
+  updateLogFilter();
+}
+
+void deloop::SetLogModuleMask(uint32_t module_mask) {
+  state_.module_mask = module_mask;
+  updateLogFilter();
+}
+
+void deloop::SetLogClock(LogClock clock) {
+  state_.clock.store(clock, std::memory_order_relaxed);
+}
+
+bool deloop::GetLogTime(uint32_t &now) {
+  LogClock clock = state_.clock.load(std::memory_order_relaxed);
+  if (clock == nullptr) {
+    return false;
+  }
+
+  now = clock();
+  return true;
+}
+
+LogEntry deloop::MakeLogEntry(LogLevel level, const uint64_t hash,
+                              const std::array<LogArg, 4> &args,
+                              uint32_t suppressed) {
+  uint32_t now = 0;
+  GetLogTime(now);
+  return LogEntry{level, hash, args, suppressed, now};
+}
+
+void deloop::SubmitRtLog(LogContext context, LogLevel level,
+                         const uint64_t hash, const std::array<LogArg, 4> &args,
+                         uint32_t suppressed) {
+  size_t ctx = static_cast<size_t>(context);
+  LogEntry entry = MakeLogEntry(level, hash, args, suppressed);
+
+  bool pushed = false;
+  if (context == LogContext::kIsr) {
+    // ISRs of different priorities can preempt each other, so serialize them
+    // to keep the ring single-producer.
+    IrqLock lock;
+    pushed = state_.rings[ctx].push(entry);
+  } else {
+    pushed = state_.rings[ctx].push(entry);
+  }
+
+  if (!pushed) {
+    state_.overflows[ctx][static_cast<size_t>(level)].fetch_add(
+        1, std::memory_order_relaxed);
+  }
+}
+
+void deloop::SubmitAudioLog(LogLevel level, const uint64_t hash,
+                            const std::array<LogArg, 4> &args,
+                            uint32_t suppressed) {
+  SubmitRtLog(LogContext::kAudio, level, hash, args, suppressed);
+}
+
+void deloop::SubmitIsrLog(LogLevel level, const uint64_t hash,
+                          const std::array<LogArg, 4> &args,
+                          uint32_t suppressed) {
+  SubmitRtLog(LogContext::kIsr, level, hash, args, suppressed);
+}
+
+bool deloop::TakeRtLog(LogContext context, LogEntry &entry) {
+  return state_.rings[static_cast<size_t>(context)].pop(entry);
+}
+
+uint32_t deloop::GetRtLogOverflows(LogContext context, LogLevel level) {
+  return state_
+      .overflows[static_cast<size_t>(context)][static_cast<size_t>(level)]
+      .load(std::memory_order_relaxed);
+}
@@ -1,33 +1,105 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <source_location>
 #include <string_view>
+#include <type_traits>
 
 #include "errors.hpp"
 
-#define DELOOP_LOG(fmt, level, blocking, ...)                                  \
+// Logs below this level are compiled out entirely.
+//   - 0: INFO
+//   - 1: WARNING
+//   - 2: ERROR
+//   - 3: None
+#ifndef DELOOP_LOG_MIN_LEVEL
+#define DELOOP_LOG_MIN_LEVEL 0
+#endif
+
+// Translation units tag their logs with a module (for runtime filtering) by
+// defining `DELOOP_LOG_MODULE` before any includes.
+#ifndef DELOOP_LOG_MODULE
+#define DELOOP_LOG_MODULE deloop::LogModule::kCore
+#endif
+
+#define DELOOP_LOG_STRINGIFY_(x) #x
+#define DELOOP_LOG_STRINGIFY(x) DELOOP_LOG_STRINGIFY_(x)
+
+// Every call site gets its own input section. GCC rejects sites in inline
+// functions sharing a section with sites in regular functions (section type
+// conflict), and the linker merges them all into `.deloop_log_sites` anyway.
+#define DELOOP_LOG_SECTION(id) ".deloop_log_sites." DELOOP_LOG_STRINGIFY(id)
+
+// Common body of every logging macro. A call site costs a compile-time level
+// check, a runtime filter lookup and, if enabled, a per-site rate limit before
+// any record is built.
+//
+// Each site that survives `DELOOP_LOG_MIN_LEVEL` also emits a `LogSite`
+// descriptor into a non-loaded ELF section, from which
+// `scripts/create_log_table.py` builds the host log table.
+//
+// NOTE: GCC ignores section attributes on statics in function templates, so
+// logging from templates is not supported.
+#define DELOOP_LOG_SITE(submit, fmt, level, ...)                               \
+  DELOOP_LOG_SITE_(submit, fmt, level, __COUNTER__, ##__VA_ARGS__)
+#define DELOOP_LOG_SITE_(submit, fmt, level, id, ...)                          \
   do {                                                                         \
-    std::array<deloop::LogArg, 4> args = deloop::CreateLogArgs(__VA_ARGS__);   \
-    deloop::SubmitLog(level, FNV1A_64(fmt), args, blocking);                   \
+    if constexpr (static_cast<int>(level) >= DELOOP_LOG_MIN_LEVEL) {           \
+      [[gnu::section(DELOOP_LOG_SECTION(id)), gnu::used]] static constexpr     \
+      auto site = deloop::MakeLogSite(                                         \
+          fmt, __FILE__, __LINE__, level, DELOOP_LOG_MODULE,                   \
+          decltype(deloop::LogArgTypes(__VA_ARGS__)){});                       \
+      if (deloop::LogEnabled(level, DELOOP_LOG_MODULE)) {                      \
+        static deloop::LogRateLimiter limiter;                                 \
+        uint32_t suppressed = 0;                                               \
+        if (limiter.tryAcquire(suppressed)) {                                  \
+          std::array<deloop::LogArg, 4> args =                                 \
+              deloop::CreateLogArgs(__VA_ARGS__);                              \
+          submit(level, site.hash, args, suppressed);                          \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
   } while (0)
 
+// Task context: may wait for room in the outgoing stream, depending on the
+// drop policy of the lane the level maps to.
+#define DELOOP_LOG(fmt, level, ...)                                            \
+  DELOOP_LOG_SITE(deloop::SubmitLog, fmt, level, ##__VA_ARGS__)
+
 #define DELOOP_LOG_INFO(fmt, ...)                                              \
-  DELOOP_LOG(fmt, deloop::LogLevel::INFO, true, ##__VA_ARGS__)
+  DELOOP_LOG(fmt, deloop::LogLevel::INFO, ##__VA_ARGS__)
 #define DELOOP_LOG_WARNING(fmt, ...)                                           \
-  DELOOP_LOG(fmt, deloop::LogLevel::WARNING, true, ##__VA_ARGS__)
+  DELOOP_LOG(fmt, deloop::LogLevel::WARNING, ##__VA_ARGS__)
 #define DELOOP_LOG_ERROR(fmt, ...)                                             \
-  DELOOP_LOG(fmt, deloop::LogLevel::ERROR, true, ##__VA_ARGS__)
+  DELOOP_LOG(fmt, deloop::LogLevel::ERROR, ##__VA_ARGS__)
 
+// Real-time contexts: copies the record into a wait-free ring drained by the
+// UART stream task. Never blocks; records are dropped (and counted) when the
+// ring is full.
 #define DELOOP_LOG_INFO_FROM_ISR(fmt, ...)                                     \
-  DELOOP_LOG(fmt, deloop::LogLevel::INFO, false, ##__VA_ARGS__)
+  DELOOP_LOG_SITE(deloop::SubmitIsrLog, fmt, deloop::LogLevel::INFO,           \
+                  ##__VA_ARGS__)
 #define DELOOP_LOG_WARNING_FROM_ISR(fmt, ...)                                  \
-  DELOOP_LOG(fmt, deloop::LogLevel::WARNING, false, ##__VA_ARGS__)
+  DELOOP_LOG_SITE(deloop::SubmitIsrLog, fmt, deloop::LogLevel::WARNING,        \
+                  ##__VA_ARGS__)
 #define DELOOP_LOG_ERROR_FROM_ISR(fmt, ...)                                    \
-  DELOOP_LOG(fmt, deloop::LogLevel::ERROR, false, ##__VA_ARGS__)
+  DELOOP_LOG_SITE(deloop::SubmitIsrLog, fmt, deloop::LogLevel::ERROR,          \
+                  ##__VA_ARGS__)
+
+#define DELOOP_LOG_INFO_FROM_AUDIO(fmt, ...)                                   \
+  DELOOP_LOG_SITE(deloop::SubmitAudioLog, fmt, deloop::LogLevel::INFO,         \
+                  ##__VA_ARGS__)
+#define DELOOP_LOG_WARNING_FROM_AUDIO(fmt, ...)                                \
+  DELOOP_LOG_SITE(deloop::SubmitAudioLog, fmt, deloop::LogLevel::WARNING,      \
+                  ##__VA_ARGS__)
+#define DELOOP_LOG_ERROR_FROM_AUDIO(fmt, ...)                                  \
+  DELOOP_LOG_SITE(deloop::SubmitAudioLog, fmt, deloop::LogLevel::ERROR,        \
+                  ##__VA_ARGS__)
 
-constexpr uint64_t FNV1A_64(std::string_view str) {
+consteval uint64_t FNV1A_64(std::string_view str) {
   uint64_t hash = 0xcbf29ce484222325;
   for (char c : str) {
     hash = (hash ^ c) * 0x100000001b3;
@@ -39,6 +111,101 @@ constexpr uint64_t FNV1A_64(std::string_view str) {
 namespace deloop {
 
 enum class LogLevel { INFO, WARNING, ERROR };
+constexpr size_t kNumLogLevels = 3;
+
+// NOTE: Bit N of the module mask in `ConfigureLoggingCommand` enables the
+// module with value N.
+enum class LogModule : uint8_t {
+  kCore,
+  kUartStream,
+  kAudioStream,
+  kAudioScheduler,
+  kWm8960,
+};
+constexpr uint32_t kAllLogModules = 0xFFFFFFFF;
+
+namespace internal {
+// Bit N of entry L is set if level L is enabled for module N.
+extern std::atomic<uint32_t> log_enabled[kNumLogLevels];
+} // namespace internal
+
+inline bool LogEnabled(LogLevel level, LogModule module) {
+  uint32_t mask = internal::log_enabled[static_cast<size_t>(level)].load(
+      std::memory_order_relaxed);
+  return (mask & (1u << static_cast<uint32_t>(module))) != 0;
+}
+
+// Runtime filters. Logs below `level`, or from modules not in `module_mask`,
+// are discarded at the call site.
+void SetLogLevel(LogLevel level);
+void SetLogModuleMask(uint32_t module_mask);
+
+// Millisecond clock used for rate limiting. Until a clock is set, logs are
+// never rate limited.
+using LogClock = uint32_t (*)(void);
+void SetLogClock(LogClock clock);
+
+// Returns false if no clock has been set.
+bool GetLogTime(uint32_t &now);
+
+// Per call site token bucket. Allows bursts of `kBurst` records and refills
+// one token every `kRefillPeriodMs`. Records rejected by the bucket are
+// counted and reported with the next record that gets through.
+//
+// NOTE: A call site is expected to run in a single context. Concurrent use
+// is memory-safe but may miscount.
+class LogRateLimiter {
+public:
+  static constexpr uint32_t kBurst = 5;
+  static constexpr uint32_t kRefillPeriodMs = 200;
+
+  constexpr LogRateLimiter() = default;
+
+  bool tryAcquire(uint32_t &suppressed) {
+    uint32_t now = 0;
+    if (!GetLogTime(now)) {
+      return true;
+    }
+
+    uint32_t spent = spent_.load(std::memory_order_relaxed);
+    uint32_t last_refill = last_refill_.load(std::memory_order_relaxed);
+
+    uint32_t refill = (now - last_refill) / kRefillPeriodMs;
+    if (refill >= spent) {
+      spent = 0;
+      last_refill = now;
+    } else if (refill > 0) {
+      spent -= refill;
+      last_refill += refill * kRefillPeriodMs;
+    }
+
+    bool acquired = spent < kBurst;
+    if (acquired) {
+      spent++;
+      suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+    } else {
+      suppressed_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    spent_.store(spent, std::memory_order_relaxed);
+    last_refill_.store(last_refill, std::memory_order_relaxed);
+    return acquired;
+  }
+
+private:
+  // Tokens are tracked as spent rather than available so a zero-initialized
+  // limiter starts with a full bucket.
+  std::atomic<uint32_t> spent_ = 0;
+  std::atomic<uint32_t> last_refill_ = 0;
+  std::atomic<uint32_t> suppressed_ = 0;
+};
+
+// Real-time contexts, each with its own log ring.
+//   - kAudio: The audio stream task (single producer).
+//   - kIsr: Interrupt handlers. Pushes are serialized by masking interrupts
+//     for the duration of the copy.
+enum class LogContext { kAudio, kIsr };
+constexpr size_t kNumLogContexts = 2;
 
 struct LogArg {
   enum class Type { kUnset, kU32, kI32, kF32 };
@@ -67,6 +234,34 @@ constexpr LogArg ToLogArg(deloop::Error value) {
   return LogArg{LogArg::Type::kI32, {.i32 = static_cast<int32_t>(value)}};
 }
 
+// Compile-time view of the `ToLogArg` overloads, for log site descriptors.
+// Overloads must be kept in sync so the recorded type matches the one sent.
+template <LogArg::Type T>
+using LogArgTypeTag = std::integral_constant<LogArg::Type, T>;
+LogArgTypeTag<LogArg::Type::kU32> LogArgTypeOf(uint32_t value);
+LogArgTypeTag<LogArg::Type::kI32> LogArgTypeOf(int value);
+LogArgTypeTag<LogArg::Type::kF32> LogArgTypeOf(float value);
+LogArgTypeTag<LogArg::Type::kI32> LogArgTypeOf(deloop::Error value);
+
+template <typename... Tags> struct LogArgTypeList {
+  static constexpr uint8_t kCount = sizeof...(Tags);
+
+  // 2 bits per arg, first arg in bits 0-1 (as in the compact log encoding).
+  static constexpr uint8_t kMask = [] {
+    uint8_t mask = 0;
+    uint8_t i = 0;
+    ((mask |= static_cast<uint8_t>(static_cast<uint8_t>(Tags::value)
+                                   << (2 * i++))),
+     ...);
+    return mask;
+  }();
+};
+
+// Only used in unevaluated contexts, as `decltype(LogArgTypes(args...))`.
+template <typename... Values>
+LogArgTypeList<decltype(LogArgTypeOf(std::declval<Values>()))...>
+LogArgTypes(Values... values);
+
 template <typename... Values>
 constexpr std::array<LogArg, 4> CreateLogArgs(Values... values) {
   static_assert(sizeof...(values) <= 4, "Only 4 arguments are supported.");
@@ -80,7 +275,75 @@ constexpr std::array<LogArg, 4> CreateLogArgs(Values... values) {
   return args;
 }
 
+// Descriptor of a log call site, emitted into the `.deloop_log_sites` section.
+// The section is not loaded on the device; it only exists in the ELF.
+//
+// NOTE: This layout must match `scripts/create_log_table.py`. Descriptors are
+// packed back to back, with zero padding up to the alignment of the next one.
+template <size_t FmtSize, size_t FileSize> struct LogSite {
+  uint32_t magic;
+  uint32_t line;
+  uint64_t hash;
+  uint8_t level;
+  uint8_t module;
+  uint8_t num_args;
+  uint8_t arg_types;
+  char fmt[FmtSize];   // NUL-terminated.
+  char file[FileSize]; // NUL-terminated.
+};
+
+constexpr uint32_t kLogSiteMagic = 0x5173106D;
+
+template <size_t FmtSize, size_t FileSize, typename... Tags>
+consteval LogSite<FmtSize, FileSize>
+MakeLogSite(const char (&fmt)[FmtSize], const char (&file)[FileSize],
+            uint32_t line, LogLevel level, LogModule module,
+            LogArgTypeList<Tags...> arg_types) {
+  static_assert(sizeof...(Tags) <= 4, "Only 4 arguments are supported.");
+
+  LogSite<FmtSize, FileSize> site = {};
+  site.magic = kLogSiteMagic;
+  site.line = line;
+  site.hash = FNV1A_64(std::string_view(fmt, FmtSize - 1));
+  site.level = static_cast<uint8_t>(level);
+  site.module = static_cast<uint8_t>(module);
+  site.num_args = arg_types.kCount;
+  site.arg_types = arg_types.kMask;
+  for (size_t i = 0; i < FmtSize; i++) {
+    site.fmt[i] = fmt[i];
+  }
+  for (size_t i = 0; i < FileSize; i++) {
+    site.file[i] = file[i];
+  }
+  return site;
+}
+
+struct LogEntry {
+  LogLevel level;
+  uint64_t hash;
+  std::array<LogArg, 4> args;
+  uint32_t suppressed; // Records dropped by the rate limiter before this one.
+  uint32_t timestamp;  // Log clock time (ms) when the record was submitted.
+};
+
+// Fills in an entry stamped with the current log clock time.
+LogEntry MakeLogEntry(LogLevel level, const uint64_t hash,
+                      const std::array<LogArg, 4> &args, uint32_t suppressed);
+
 void SubmitLog(LogLevel level, const uint64_t hash,
-               const std::array<LogArg, 4> &args, bool blocking = true);
+               const std::array<LogArg, 4> &args, uint32_t suppressed = 0);
+void SubmitRtLog(LogContext context, LogLevel level, const uint64_t hash,
+                 const std::array<LogArg, 4> &args, uint32_t suppressed = 0);
+void SubmitAudioLog(LogLevel level, const uint64_t hash,
+                    const std::array<LogArg, 4> &args, uint32_t suppressed);
+void SubmitIsrLog(LogLevel level, const uint64_t hash,
+                  const std::array<LogArg, 4> &args, uint32_t suppressed);
+
+// Consumer side of the real-time log rings. Must only be called from a single
+// task (the UART stream task).
+bool TakeRtLog(LogContext context, LogEntry &entry);
+
+// Total records dropped at `level` because the ring for `context` was full.
+uint32_t GetRtLogOverflows(LogContext context, LogLevel level);
 
 } // namespace deloop
@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <span>
 
 #include <stm32f4xx_hal.h>
 #include <stm32f4xx_hal_gpio.h>
@@ -9,19 +10,39 @@
 #include <FreeRTOS.h> // Must appear before other FreeRTOS includes
 #include <queue.h>
 #include <task.h>
-
+#include <timers.h>
+
+#include "audio/clock.hpp"
+#include "audio/loopback.hpp"
+#include "audio/looper.hpp"
+#include "audio/meters.hpp"
+#include "audio/routines/click.hpp"
+#include "audio/routines/pitch.hpp"
 #include "audio/routines/sine.hpp"
 #include "audio/scheduler.hpp"
 #include "audio/stream.hpp"
 #include "command.pb.h"
 #include "drv/wm8960.hpp"
 #include "logging.hpp"
+#include "params.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
 #include "uart_stream.hpp"
 
 static void ConfigureSystemClock(void);
 static void ConfigureHALPeripherals(void);
+static void EnableCycleCounter(void);
+static uint32_t ReadCycleCounter(void);
 static void ErrorHandler(void);
-static void CommandHandler(const Command &cmd);
+static void CommandHandler(deloop::WM8960 &wm8960, const Command &cmd);
+static CommandStatus ValidateRequest(const Request &request, bool is_last);
+static CommandStatus ExecuteRequest(deloop::WM8960 &wm8960,
+                                    const Request &request,
+                                    CommandResponse &response);
+static void SendResponse(CommandResponse &response);
+static void StartLogFlood(uint32_t count, uint32_t interval_ms);
+static void LogFloodCallback(TimerHandle_t timer);
+static bool ConvertLogLevel(LogLevel level, deloop::LogLevel &out);
 static void CoreLoopTask(void *pvParameters);
 
 const size_t task_stack_size = configMINIMAL_STACK_SIZE * 10;
@@ -31,6 +52,41 @@ static StackType_t task_stack[task_stack_size];
 static bool recording = false;
 static bool playback = false;
 
+// Trace clock times of the command being handled, reported in its response.
+static uint32_t cmd_received_at = 0;
+static uint32_t cmd_dispatched_at = 0;
+
+// Parameter changes of the command being handled, published together once
+// the rest of the batch has run, and the number of parameters it reads.
+const size_t kMaxParamUpdates = pb_arraysize(SetParamsCommand, ids);
+const size_t kMaxParamReads = pb_arraysize(CommandResponse, param_values);
+static deloop::ParamUpdate param_updates[kMaxParamUpdates];
+static size_t num_param_updates = 0;
+static size_t num_param_reads = 0;
+
+// Looper enums are sent as their `deloop` values.
+static_assert(static_cast<int>(deloop::LoopTrack::Action::kRedo) ==
+              LooperAction_LOOPER_REDO);
+static_assert(static_cast<int>(deloop::looper::Quantize::kLastBar) ==
+              LooperQuantize_QUANTIZE_LAST_BAR);
+static_assert(static_cast<int>(deloop::LoopTrack::State::kPaused) ==
+              LooperState_TRACK_PAUSED);
+static_assert(static_cast<int>(deloop::LoopFormat::kAdpcm4) ==
+              LoopFormat_FORMAT_ADPCM4);
+static_assert(pb_arraysize(CommandResponse, tracks) ==
+              deloop::looper::kMaxTracks);
+static_assert(static_cast<int>(deloop::loopback::State::kNoSignal) ==
+              LoopbackState_LOOPBACK_NO_SIGNAL);
+static_assert(pb_arraysize(LoopbackResult, response_db) ==
+                  deloop::loopback::kNumBands &&
+              pb_arraysize(LoopbackResult, band_hz) ==
+                  deloop::loopback::kNumBands);
+
+// Debug log flood (see `FloodLogsCommand`).
+static StaticTimer_t log_flood_timer_buffer;
+static TimerHandle_t log_flood_timer = nullptr;
+static uint32_t log_flood_remaining = 0;
+
 UART_HandleTypeDef uart2_handle = {0};
 
 int main(void) {
@@ -45,12 +101,24 @@ int main(void) {
   HAL_Init();
   ConfigureSystemClock();
   ConfigureHALPeripherals();
+  EnableCycleCounter();
+  deloop::SetTraceClock(ReadCycleCounter, SystemCoreClock);
 
   deloop::Error err = deloop::uart_stream::init(&uart2_handle);
   if (err != deloop::Error::kOk) {
     ErrorHandler();
   }
 
+  err = deloop::telemetry::init();
+  if (err != deloop::Error::kOk) {
+    ErrorHandler();
+  }
+
+  err = deloop::params::init();
+  if (err != deloop::Error::kOk) {
+    ErrorHandler();
+  }
+
   // Initialize LED.
   __HAL_RCC_GPIOA_CLK_ENABLE();
   GPIO_InitTypeDef GPIO_InitStruct;
@@ -147,6 +215,15 @@ static void ConfigureHALPeripherals(void) {
   // TODO: SAI2
 }
 
+// Starts the DWT cycle counter, used to timestamp trace events.
+static void EnableCycleCounter(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static uint32_t ReadCycleCounter(void) { return DWT->CYCCNT; }
+
 static void ErrorHandler(void) {
   // Flash LED to indicate error
   HAL_GPIO_WritePin(GPIOA, GPIO_PIN_5, GPIO_PIN_SET);
@@ -156,49 +233,180 @@ static void ErrorHandler(void) {
 }
 
 static void CommandHandler(deloop::WM8960 &wm8960, const Command &cmd) {
-  // TODO: Breakout larger requests into separate functions.
-  switch (cmd.which_request) {
-  case Command_reset_tag:
+  DELOOP_TRACE_SCOPE(deloop::TraceTrack::kCommand, "command_handler");
+
+  CommandResponse response = CommandResponse_init_zero;
+  response.cmd_id = cmd.cmd_id;
+  num_param_updates = 0;
+  num_param_reads = 0;
+
+  if (cmd.requests_count == 0) {
+    response.status = CommandStatus_ERR_INVALID_PARAMETER;
+    SendResponse(response);
+    return;
+  }
+
+  // Validate the whole batch first, so a rejected batch leaves the device
+  // untouched.
+  for (pb_size_t i = 0; i < cmd.requests_count; i++) {
+    bool is_last = (i + 1 == cmd.requests_count);
+    response.status = ValidateRequest(cmd.requests[i], is_last);
+    if (response.status != CommandStatus_SUCCESS) {
+      response.failed_request = i + 1;
+      SendResponse(response);
+      return;
+    }
+  }
+
+  // Requests that fail here (e.g. codec I/O errors) stop the batch. Requests
+  // before it stay applied.
+  for (pb_size_t i = 0; i < cmd.requests_count; i++) {
+    response.status = ExecuteRequest(wm8960, cmd.requests[i], response);
+    if (response.status != CommandStatus_SUCCESS) {
+      response.failed_request = i + 1;
+      SendResponse(response);
+      return;
+    }
+  }
+
+  // Parameter changes reach the audio task together, at one block boundary.
+  if (num_param_updates > 0 &&
+      deloop::params::set({param_updates, num_param_updates}) !=
+          deloop::Error::kOk) {
+    response.status = CommandStatus_ERR_INTERNAL;
+  }
+
+  SendResponse(response);
+}
+
+// Checks a request without side effects on the device. Parameter changes
+// are collected into `param_updates`.
+static CommandStatus ValidateRequest(const Request &request, bool is_last) {
+  switch (request.which_request) {
+  case Request_reset_tag:
+    // Nothing after a reset would run.
+    return is_last ? CommandStatus_SUCCESS
+                   : CommandStatus_ERR_INVALID_PARAMETER;
+  case Request_configure_logging_tag: {
+    deloop::LogLevel level;
+    const ConfigureLoggingCommand &config_request =
+        request.request.configure_logging;
+    if (config_request.has_min_level &&
+        !ConvertLogLevel(config_request.min_level, level)) {
+      return CommandStatus_ERR_INVALID_PARAMETER;
+    }
+    return CommandStatus_SUCCESS;
+  }
+  case Request_configure_metrics_tag: {
+    const ConfigureMetricsCommand &config_request =
+        request.request.configure_metrics;
+    if (config_request.has_period_ms && config_request.period_ms != 0 &&
+        config_request.period_ms < deloop::telemetry::kMinPeriodMs) {
+      return CommandStatus_ERR_INVALID_PARAMETER;
+    }
+    return CommandStatus_SUCCESS;
+  }
+  case Request_flood_logs_tag:
+    if (request.request.flood_logs.interval_ms == 0) {
+      return CommandStatus_ERR_INVALID_PARAMETER;
+    }
+    return CommandStatus_SUCCESS;
+  case Request_set_params_tag: {
+    const SetParamsCommand &set_request = request.request.set_params;
+    if (set_request.ids_count != set_request.values_count ||
+        num_param_updates + set_request.ids_count > kMaxParamUpdates) {
+      return CommandStatus_ERR_INVALID_PARAMETER;
+    }
+
+    std::span<deloop::ParamUpdate> updates(&param_updates[num_param_updates],
+                                           set_request.ids_count);
+    for (size_t i = 0; i < updates.size(); i++) {
+      updates[i] = {set_request.ids[i], set_request.values[i]};
+    }
+    if (deloop::params::check(updates) != deloop::Error::kOk) {
+      return CommandStatus_ERR_INVALID_PARAMETER;
+    }
+
+    num_param_updates += updates.size();
+    return CommandStatus_SUCCESS;
+  }
+  case Request_get_params_tag: {
+    const GetParamsCommand &get_request = request.request.get_params;
+    if (num_param_reads + get_request.ids_count > kMaxParamReads) {
+      return CommandStatus_ERR_INVALID_PARAMETER;
+    }
+
+    for (pb_size_t i = 0; i < get_request.ids_count; i++) {
+      float value;
+      if (deloop::params::get(get_request.ids[i], value) !=
+          deloop::Error::kOk) {
+        return CommandStatus_ERR_INVALID_PARAMETER;
+      }
+    }
+
+    num_param_reads += get_request.ids_count;
+    return CommandStatus_SUCCESS;
+  }
+  case Request_looper_tag: {
+    const LooperCommand &looper_request = request.request.looper;
+    if (looper_request.track >= deloop::looper::kMaxTracks ||
+        looper_request.sync_track >= deloop::looper::kMaxTracks ||
+        looper_request.action > _LooperAction_MAX ||
+        looper_request.quantize > _LooperQuantize_MAX ||
+        looper_request.format > _LoopFormat_MAX) {
+      return CommandStatus_ERR_INVALID_PARAMETER;
+    }
+    return CommandStatus_SUCCESS;
+  }
+  case Request_configure_recording_tag:
+  case Request_configure_playback_tag:
+  case Request_configure_trace_tag:
+  case Request_ping_tag:
+  case Request_get_looper_status_tag:
+  case Request_measure_loopback_tag:
+  case Request_get_loopback_result_tag:
+    return CommandStatus_SUCCESS;
+  default:
+    DELOOP_LOG_ERROR_FROM_ISR("Unknown command received");
+    return CommandStatus_ERR_UNSUPPORTED_COMMAND;
+  }
+}
+
+// Applies a request that passed `ValidateRequest`. Parameter changes are
+// published by the caller.
+static CommandStatus ExecuteRequest(deloop::WM8960 &wm8960,
+                                    const Request &request,
+                                    CommandResponse &response) {
+  switch (request.which_request) {
+  case Request_reset_tag:
     // Call soft reset function
     NVIC_SystemReset();
     break;
 
-  case Command_configure_recording_tag:
-    if (cmd.request.configure_recording.enable != recording) {
+  case Request_configure_recording_tag:
+    if (request.request.configure_recording.enable != recording) {
       auto error = wm8960.stopRecording();
       if (error != deloop::Error::kOk) {
         DELOOP_LOG_ERROR_FROM_ISR("Failed to stop recording: %d", error);
-        deloop::uart_stream::sendCommandResponse(CommandResponse{
-            .cmd_id = cmd.cmd_id,
-            .status = CommandStatus_ERR_INTERNAL,
-        });
-        break;
+        return CommandStatus_ERR_INTERNAL;
       }
 
-      recording = cmd.request.configure_recording.enable;
+      recording = request.request.configure_recording.enable;
       if (recording) {
         error = wm8960.startRecording();
         if (error != deloop::Error::kOk) {
           DELOOP_LOG_ERROR_FROM_ISR("Failed to start recording: %d", error);
-          deloop::uart_stream::sendCommandResponse(CommandResponse{
-              .cmd_id = cmd.cmd_id,
-              .status = CommandStatus_ERR_INTERNAL,
-          });
           recording = false;
-          break;
+          return CommandStatus_ERR_INTERNAL;
         }
 
         DELOOP_LOG_INFO_FROM_ISR("Successfully started recording");
       }
-
-      deloop::uart_stream::sendCommandResponse(CommandResponse{
-          .cmd_id = cmd.cmd_id,
-          .status = CommandStatus_SUCCESS,
-      });
     }
     break;
-  case Command_configure_playback_tag: {
-    ConfigurePlaybackCommand config_request = cmd.request.configure_playback;
+  case Request_configure_playback_tag: {
+    const ConfigurePlaybackCommand &config_request =
+        request.request.configure_playback;
 
     // Handle volume change if provided
     if (config_request.has_volume) {
@@ -212,11 +420,7 @@ static void CommandHandler(deloop::WM8960 &wm8960, const Command &cmd) {
       auto error = wm8960.setVolume(volume);
       if (error != deloop::Error::kOk) {
         DELOOP_LOG_ERROR_FROM_ISR("Failed to set volume: %d", error);
-        deloop::uart_stream::sendCommandResponse(CommandResponse{
-            .cmd_id = cmd.cmd_id,
-            .status = CommandStatus_ERR_INTERNAL,
-        });
-        break;
+        return CommandStatus_ERR_INTERNAL;
       }
 
       DELOOP_LOG_INFO_FROM_ISR("Volume set to %d%%", (int)(volume * 100));
@@ -227,11 +431,7 @@ static void CommandHandler(deloop::WM8960 &wm8960, const Command &cmd) {
       auto error = wm8960.stopPlayback();
       if (error != deloop::Error::kOk) {
         DELOOP_LOG_ERROR_FROM_ISR("Failed to stop playback: %d", error);
-        deloop::uart_stream::sendCommandResponse(CommandResponse{
-            .cmd_id = cmd.cmd_id,
-            .status = CommandStatus_ERR_INTERNAL,
-        });
-        break;
+        return CommandStatus_ERR_INTERNAL;
       }
 
       playback = config_request.enable;
@@ -242,26 +442,164 @@ static void CommandHandler(deloop::WM8960 &wm8960, const Command &cmd) {
         //     kAudioBufSize);
         if (error != deloop::Error::kOk) {
           DELOOP_LOG_ERROR_FROM_ISR("Failed to start playback: %d", error);
-          deloop::uart_stream::sendCommandResponse(CommandResponse{
-              .cmd_id = cmd.cmd_id,
-              .status = CommandStatus_ERR_INTERNAL,
-          });
           playback = false;
-          break;
+          return CommandStatus_ERR_INTERNAL;
         }
 
         DELOOP_LOG_INFO_FROM_ISR("Successfully started playback");
       }
     }
-
-    deloop::uart_stream::sendCommandResponse(CommandResponse{
-        .cmd_id = cmd.cmd_id,
-        .status = CommandStatus_SUCCESS,
-    });
   } break;
-  default:
-    DELOOP_LOG_ERROR_FROM_ISR("Unknown command received");
+  case Request_configure_logging_tag: {
+    const ConfigureLoggingCommand &config_request =
+        request.request.configure_logging;
+
+    deloop::LogLevel level = deloop::LogLevel::INFO;
+    if (config_request.has_min_level &&
+        ConvertLogLevel(config_request.min_level, level)) {
+      deloop::SetLogLevel(level);
+    }
+    if (config_request.has_module_mask) {
+      deloop::SetLogModuleMask(config_request.module_mask);
+    }
+  } break;
+  case Request_configure_trace_tag:
+    if (request.request.configure_trace.has_enable) {
+      deloop::SetTraceEnabled(request.request.configure_trace.enable);
+    }
+    break;
+  case Request_configure_metrics_tag:
+    if (request.request.configure_metrics.has_period_ms &&
+        deloop::telemetry::setPeriod(
+            request.request.configure_metrics.period_ms) !=
+            deloop::Error::kOk) {
+      return CommandStatus_ERR_INTERNAL;
+    }
+    break;
+  case Request_ping_tag:
     break;
+  case Request_flood_logs_tag:
+    StartLogFlood(request.request.flood_logs.count,
+                  request.request.flood_logs.interval_ms);
+    break;
+  case Request_set_params_tag:
+    break;
+  case Request_get_params_tag:
+    for (pb_size_t i = 0; i < request.request.get_params.ids_count; i++) {
+      float &value = response.param_values[response.param_values_count++];
+      if (deloop::params::get(request.request.get_params.ids[i], value) !=
+          deloop::Error::kOk) {
+        return CommandStatus_ERR_INTERNAL;
+      }
+    }
+    break;
+  case Request_looper_tag: {
+    const LooperCommand &looper_request = request.request.looper;
+    auto error = deloop::looper::trigger(
+        looper_request.track,
+        static_cast<deloop::LoopTrack::Action>(looper_request.action),
+        static_cast<deloop::looper::Quantize>(looper_request.quantize),
+        looper_request.sync_track,
+        static_cast<deloop::LoopFormat>(looper_request.format));
+    if (error == deloop::Error::kLooperHistoryTooShort) {
+      // The boundary is older than the input capture reaches.
+      return CommandStatus_ERR_INVALID_PARAMETER;
+    } else if (error != deloop::Error::kOk) {
+      DELOOP_LOG_ERROR_FROM_ISR("Failed to trigger looper track %u: %d",
+                                looper_request.track, error);
+      return CommandStatus_ERR_INTERNAL;
+    }
+  } break;
+  case Request_get_looper_status_tag:
+    response.tracks_count = deloop::looper::kMaxTracks;
+    for (size_t i = 0; i < deloop::looper::kMaxTracks; i++) {
+      deloop::looper::TrackStatus status = deloop::looper::getTrackStatus(i);
+      response.tracks[i].state = static_cast<LooperState>(status.state);
+      response.tracks[i].length = status.length;
+      response.tracks[i].format = static_cast<LoopFormat>(status.format);
+    }
+    break;
+  case Request_measure_loopback_tag: {
+    auto error = deloop::loopback::start();
+    if (error != deloop::Error::kOk) {
+      DELOOP_LOG_ERROR_FROM_ISR("Failed to start loopback measurement: %d",
+                                error);
+      return CommandStatus_ERR_INTERNAL;
+    }
+  } break;
+  case Request_get_loopback_result_tag: {
+    deloop::loopback::Result result = deloop::loopback::getResult();
+    LoopbackResult &loopback = response.loopback;
+    response.has_loopback = true;
+    loopback.state = static_cast<LoopbackState>(result.state);
+    loopback.block_frames = result.block_frames;
+    loopback.latency_frames = result.latency_frames;
+    loopback.spread_frames = result.spread_frames;
+    loopback.peak_db = result.peak_db;
+    loopback.band_hz_count = deloop::loopback::kNumBands;
+    loopback.response_db_count = deloop::loopback::kNumBands;
+    for (size_t i = 0; i < deloop::loopback::kNumBands; i++) {
+      loopback.band_hz[i] = deloop::loopback::kBandHz[i];
+      loopback.response_db[i] = result.response_db[i];
+    }
+  } break;
+  default:
+    return CommandStatus_ERR_UNSUPPORTED_COMMAND;
+  }
+
+  return CommandStatus_SUCCESS;
+}
+
+// Responses carry the latency stamps of the command being handled.
+static void SendResponse(CommandResponse &response) {
+  response.received_at = cmd_received_at;
+  response.dispatched_at = cmd_dispatched_at;
+  response.completed_at = deloop::GetTraceTime();
+  response.clock_hz = deloop::GetTraceClockFrequency();
+  deloop::uart_stream::sendCommandResponse(response);
+}
+
+// Logs from the timer task, so the flood competes with command handling the
+// way real traffic would. A new flood replaces any running one.
+static void StartLogFlood(uint32_t count, uint32_t interval_ms) {
+  if (log_flood_timer == nullptr) {
+    log_flood_timer =
+        xTimerCreateStatic("Log Flood", 1, pdTRUE, nullptr, LogFloodCallback,
+                           &log_flood_timer_buffer);
+  }
+
+  xTimerStop(log_flood_timer, 0);
+  log_flood_remaining = count;
+  if (count > 0) {
+    xTimerChangePeriod(log_flood_timer, pdMS_TO_TICKS(interval_ms), 0);
+  }
+}
+
+static void LogFloodCallback(TimerHandle_t timer) {
+  if (log_flood_remaining == 0) {
+    xTimerStop(timer, 0);
+    return;
+  }
+
+  log_flood_remaining--;
+  DELOOP_LOG_INFO("Log flood: %u remaining", log_flood_remaining);
+}
+
+static bool ConvertLogLevel(LogLevel level, deloop::LogLevel &out) {
+  switch (level) {
+  case LogLevel_DEBUG:
+  case LogLevel_INFO:
+    out = deloop::LogLevel::INFO;
+    return true;
+  case LogLevel_WARNING:
+    out = deloop::LogLevel::WARNING;
+    return true;
+  case LogLevel_ERROR:
+  case LogLevel_CRITICAL:
+    out = deloop::LogLevel::ERROR;
+    return true;
+  default:
+    return false;
   }
 }
 
@@ -283,13 +621,29 @@ static void CoreLoopTask(void *pvParameters) {
     return;
   }
 
-  err = deloop::audio_scheduler::registerCallback(tx_sine);
+  err = deloop::looper::init();
   if (err != deloop::Error::kOk) {
-    DELOOP_LOG_ERROR("[AUDIO_STREAM] Failed to register audio callback: %d",
-                     err);
+    DELOOP_LOG_ERROR("Failed to initialize looper: %d", err);
     return;
   }
 
+  // The input is metered as it arrives, before the looper filters it. The
+  // clock runs next so every routine sees the block's position. Loops are
+  // mixed over the sine and transposed with it, then the click is mixed in
+  // at its own pitch. A loopback measurement replaces all of it, and the
+  // output is metered as it leaves.
+  for (auto callback :
+       {deloop::meters::processInput, deloop::audio_clock::process, tx_sine,
+        deloop::looper::process, tx_pitch, tx_click,
+        deloop::loopback::process, deloop::meters::processOutput}) {
+    err = deloop::audio_scheduler::registerCallback(callback);
+    if (err != deloop::Error::kOk) {
+      DELOOP_LOG_ERROR("[AUDIO_STREAM] Failed to register audio callback: %d",
+                       err);
+      return;
+    }
+  }
+
   auto error = deloop::audio_stream::init(SAI1_Block_A, SAI1_Block_B);
   if (error != deloop::Error::kOk) {
     DELOOP_LOG_ERROR("Failed to initialize audio stream: %d", error);
@@ -302,12 +656,18 @@ static void CoreLoopTask(void *pvParameters) {
     ErrorHandler();
   }
 
-  Command cmd = Command_init_zero;
+  // Decoded batches are large, so they are kept off the task stack.
+  static deloop::uart_stream::ReceivedCommand received = {};
+  static Command cmd = Command_init_zero;
   QueueHandle_t cmd_queue = deloop::uart_stream::getCmdQueue();
 
   while (1) {
-    if (xQueueReceive(cmd_queue, &cmd, portMAX_DELAY) == pdTRUE) {
-      CommandHandler(wm8960, cmd);
+    if (xQueueReceive(cmd_queue, &received, portMAX_DELAY) == pdTRUE) {
+      cmd_received_at = received.received_at;
+      cmd_dispatched_at = deloop::GetTraceTime();
+      if (deloop::uart_stream::decodeCommand(received, cmd)) {
+        CommandHandler(wm8960, cmd);
+      }
     }
   }
 }
@@ -0,0 +1,22 @@
+#include "metrics.hpp"
+
+#include <span>
+
+using namespace deloop;
+
+// Bounds of the `deloop_metrics` section. The firmware linker script defines
+// them explicitly; elsewhere the linker provides them for any section named
+// like a C identifier. They are weak so a program without metrics still
+// links, with an empty registry.
+extern "C" {
+[[gnu::weak]] extern const MetricEntry __start_deloop_metrics[];
+[[gnu::weak]] extern const MetricEntry __stop_deloop_metrics[];
+}
+
+std::span<const MetricEntry> deloop::GetMetrics() {
+  if (__start_deloop_metrics == nullptr) {
+    return {};
+  }
+
+  return {__start_deloop_metrics, __stop_deloop_metrics};
+}
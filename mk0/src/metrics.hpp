@@ -0,0 +1,205 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "log_encoding.hpp"
+#include "logging.hpp"
+
+// Static registry of counters, gauges and histograms. Metrics are declared at
+// namespace scope in the module that owns them:
+//
+//   DELOOP_METRIC_COUNTER(rx_errors, "uart_stream.rx_errors");
+//   ...
+//   rx_errors.increment();
+//
+// Updates are single relaxed atomic operations, so metrics can be updated
+// from any context, including ISRs and the audio task. Every metric adds an
+// entry to the `deloop_metrics` section, which the telemetry task walks to
+// report changed values (see `telemetry.hpp`).
+//
+// Like log sites, every metric emits a descriptor into the ELF, so names are
+// resolved on the host and only a 32-bit ID is sent.
+
+#define DELOOP_METRIC_CONCAT_(a, b) a##b
+#define DELOOP_METRIC_CONCAT(a, b) DELOOP_METRIC_CONCAT_(a, b)
+
+#define DELOOP_METRIC_ENTRY_(type, var, name, unit_shift, id)                  \
+  [[gnu::section(DELOOP_LOG_SECTION(id)), gnu::used]] static constexpr auto    \
+      DELOOP_METRIC_CONCAT(metric_site_, id) = deloop::MakeMetricSite(         \
+          name, __FILE__, __LINE__, type, DELOOP_LOG_MODULE, unit_shift);      \
+  /* An explicit alignment stops the compiler over-aligning entries, which */  \
+  /* would leave gaps in the registry array. */                                \
+  [[gnu::section("deloop_metrics"), gnu::used]] alignas(                       \
+      deloop::MetricEntry) static const deloop::MetricEntry                    \
+      DELOOP_METRIC_CONCAT(metric_entry_, id) = {                              \
+          deloop::LogSiteId(DELOOP_METRIC_CONCAT(metric_site_, id).hash),      \
+          type,                                                                \
+          &var,                                                                \
+  }
+
+// Monotonic event count.
+#define DELOOP_METRIC_COUNTER(var, name)                                       \
+  static deloop::Counter var;                                                  \
+  DELOOP_METRIC_ENTRY_(deloop::MetricType::kCounter, var, name, 0, __COUNTER__)
+
+// Last observed value of a signed quantity.
+#define DELOOP_METRIC_GAUGE(var, name)                                         \
+  static deloop::Gauge var;                                                    \
+  DELOOP_METRIC_ENTRY_(deloop::MetricType::kGauge, var, name, 0, __COUNTER__)
+
+// Distribution of unsigned samples over exponential buckets. Bucket 0 counts
+// samples below `2^unit_shift`, and each following bucket doubles the range.
+#define DELOOP_METRIC_HISTOGRAM(var, name, unit_shift)                         \
+  static deloop::Histogram var{unit_shift};                                    \
+  DELOOP_METRIC_ENTRY_(deloop::MetricType::kHistogram, var, name, unit_shift,  \
+                       __COUNTER__)
+
+namespace deloop {
+
+enum class MetricType : uint8_t { kCounter, kGauge, kHistogram };
+
+constexpr uint32_t kMetricSiteMagic = 0x3E791C5A;
+
+// Metric sites reuse the log site descriptor layout, with their own magic.
+// The level field holds the `MetricType` and the arg types field holds the
+// histogram unit shift.
+template <size_t NameSize, size_t FileSize>
+consteval LogSite<NameSize, FileSize>
+MakeMetricSite(const char (&name)[NameSize], const char (&file)[FileSize],
+               uint32_t line, MetricType type, LogModule module,
+               uint8_t unit_shift) {
+  auto site = MakeLogSite(name, file, line, LogLevel::INFO, module,
+                          LogArgTypeList<>{});
+  site.magic = kMetricSiteMagic;
+  site.level = static_cast<uint8_t>(type);
+  site.arg_types = unit_shift;
+  return site;
+}
+
+// Value reported to the telemetry task. Gauge values are stored as two's
+// complement.
+struct MetricSample {
+  uint32_t id; // `LogSiteId` of the metric name.
+  MetricType type;
+  uint8_t bucket; // Histogram bucket, 0 for other metrics.
+  uint32_t value;
+};
+
+// The `reported_` fields below hold the last values handed to the telemetry
+// task and are only touched by it.
+
+class Counter {
+public:
+  void increment(uint32_t count = 1) {
+    value_.fetch_add(count, std::memory_order_relaxed);
+  }
+
+  uint32_t value() const { return value_.load(std::memory_order_relaxed); }
+
+  template <typename Callback>
+  void collect(uint32_t id, bool all, Callback &&callback) {
+    uint32_t value = this->value();
+    if (all || value != reported_) {
+      reported_ = value;
+      callback(MetricSample{id, MetricType::kCounter, 0, value});
+    }
+  }
+
+private:
+  std::atomic<uint32_t> value_ = 0;
+  uint32_t reported_ = 0;
+};
+
+class Gauge {
+public:
+  void set(int32_t value) { value_.store(value, std::memory_order_relaxed); }
+
+  int32_t value() const { return value_.load(std::memory_order_relaxed); }
+
+  template <typename Callback>
+  void collect(uint32_t id, bool all, Callback &&callback) {
+    int32_t value = this->value();
+    if (all || value != reported_) {
+      reported_ = value;
+      callback(MetricSample{id, MetricType::kGauge, 0,
+                            static_cast<uint32_t>(value)});
+    }
+  }
+
+private:
+  std::atomic<int32_t> value_ = 0;
+  int32_t reported_ = 0;
+};
+
+class Histogram {
+public:
+  static constexpr size_t kNumBuckets = 8;
+
+  constexpr explicit Histogram(uint8_t unit_shift) : unit_shift_(unit_shift) {}
+
+  void record(uint32_t sample) {
+    size_t bucket = std::bit_width(sample >> unit_shift_);
+    if (bucket >= kNumBuckets) {
+      bucket = kNumBuckets - 1;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint32_t count(size_t bucket) const {
+    return buckets_[bucket].load(std::memory_order_relaxed);
+  }
+
+  // Only changed buckets are reported. Buckets are read one at a time, so a
+  // report may be torn across concurrent `record` calls.
+  template <typename Callback>
+  void collect(uint32_t id, bool all, Callback &&callback) {
+    for (size_t i = 0; i < kNumBuckets; i++) {
+      uint32_t count = this->count(i);
+      if (all || count != reported_[i]) {
+        reported_[i] = count;
+        callback(MetricSample{id, MetricType::kHistogram,
+                              static_cast<uint8_t>(i), count});
+      }
+    }
+  }
+
+private:
+  uint8_t unit_shift_;
+  std::atomic<uint32_t> buckets_[kNumBuckets] = {};
+  uint32_t reported_[kNumBuckets] = {};
+};
+
+// Registry entry, emitted into the `deloop_metrics` section.
+struct MetricEntry {
+  uint32_t id;
+  MetricType type;
+  void *metric; // `Counter`, `Gauge` or `Histogram`, depending on `type`.
+};
+
+// Every metric linked into the program.
+std::span<const MetricEntry> GetMetrics();
+
+// Calls `callback` with every value that changed since the previous call, or
+// with every value if `all` is set. Must only be called from a single task.
+template <typename Callback>
+void CollectMetrics(bool all, Callback &&callback) {
+  for (const MetricEntry &entry : GetMetrics()) {
+    switch (entry.type) {
+    case MetricType::kCounter:
+      static_cast<Counter *>(entry.metric)->collect(entry.id, all, callback);
+      break;
+    case MetricType::kGauge:
+      static_cast<Gauge *>(entry.metric)->collect(entry.id, all, callback);
+      break;
+    case MetricType::kHistogram:
+      static_cast<Histogram *>(entry.metric)->collect(entry.id, all, callback);
+      break;
+    }
+  }
+}
+
+} // namespace deloop
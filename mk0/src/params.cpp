@@ -0,0 +1,136 @@
+#include "params.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "errors.hpp"
+#include "util/irq_lock.hpp"
+#include "util/triple_buffer.hpp"
+
+using namespace deloop;
+
+// Bounds of the `deloop_params` section (see `metrics.cpp`).
+extern "C" {
+[[gnu::weak]] extern const ParamEntry __start_deloop_params[];
+[[gnu::weak]] extern const ParamEntry __stop_deloop_params[];
+}
+
+struct ParamSnapshot {
+  float values[kMaxParams];
+};
+
+static struct {
+  bool initialized;
+  // Latest values from every writer. Guarded by `IrqLock`.
+  ParamSnapshot staged;
+  TripleBuffer<ParamSnapshot> buffer;
+} state_;
+
+const float *deloop::internal::audio_params = nullptr;
+
+std::span<const ParamEntry> deloop::GetParams() {
+  if (__start_deloop_params == nullptr) {
+    return {};
+  }
+
+  return {__start_deloop_params, __stop_deloop_params};
+}
+
+static Param *find(uint32_t id) {
+  for (const ParamEntry &entry : GetParams()) {
+    if (entry.id == id) {
+      return entry.param;
+    }
+  }
+  return nullptr;
+}
+
+Error params::init(void) {
+  if (state_.initialized) {
+    return Error::kAlreadyInitialized;
+  }
+
+  std::span<const ParamEntry> entries = GetParams();
+  if (entries.size() > kMaxParams) {
+    return Error::kParamTableFull;
+  }
+
+  state_.staged = {};
+  for (size_t i = 0; i < entries.size(); i++) {
+    entries[i].param->index_ = static_cast<uint8_t>(i);
+    state_.staged.values[i] = entries[i].param->defaultValue();
+  }
+
+  state_.buffer.reset(state_.staged);
+  internal::audio_params = state_.buffer.front().values;
+  state_.initialized = true;
+  return Error::kOk;
+}
+
+// Looks up every update's param and checks its value, filling `indices` with
+// where each one is staged. Batches are at most `kMaxParams` long, the size
+// of the `indices` buffers callers pass in. A batch may set a param more than
+// once, and the last value wins.
+static Error resolve(std::span<const ParamUpdate> updates, uint8_t *indices) {
+  if (updates.size() > kMaxParams) {
+    return Error::kInvalidArgument;
+  }
+  for (size_t i = 0; i < updates.size(); i++) {
+    const Param *param = find(updates[i].id);
+    if (param == nullptr) {
+      return Error::kParamNotFound;
+    } else if (!param->inRange(updates[i].value)) {
+      return Error::kInvalidArgument;
+    }
+    indices[i] = static_cast<uint8_t>(param->index());
+  }
+  return Error::kOk;
+}
+
+Error params::check(std::span<const ParamUpdate> updates) {
+  uint8_t indices[kMaxParams];
+  return resolve(updates, indices);
+}
+
+Error params::set(std::span<const ParamUpdate> updates) {
+  if (!state_.initialized) {
+    return Error::kNotInitialized;
+  }
+
+  // Params are looked up before masking interrupts, so only the copies are
+  // made with them masked.
+  uint8_t indices[kMaxParams];
+  DELOOP_RETURN_IF_ERROR(resolve(updates, indices));
+
+  // Staging and publishing happen under one lock, so concurrent writers
+  // cannot publish each other's partial updates.
+  IrqLock lock;
+  for (size_t i = 0; i < updates.size(); i++) {
+    state_.staged.values[indices[i]] = updates[i].value;
+  }
+  state_.buffer.back() = state_.staged;
+  state_.buffer.publish();
+  return Error::kOk;
+}
+
+Error params::get(uint32_t id, float &value) {
+  if (!state_.initialized) {
+    return Error::kNotInitialized;
+  }
+
+  const Param *param = find(id);
+  if (param == nullptr) {
+    return Error::kParamNotFound;
+  }
+
+  IrqLock lock;
+  value = state_.staged.values[param->index()];
+  return Error::kOk;
+}
+
+void params::acquire(void) {
+  if (state_.initialized && state_.buffer.acquire()) {
+    internal::audio_params = state_.buffer.front().values;
+  }
+}
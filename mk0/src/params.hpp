@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "errors.hpp"
+#include "log_encoding.hpp"
+#include "logging.hpp"
+
+// Table of runtime parameters shared between the command task and the audio
+// task. Parameters are declared at namespace scope in the module that uses
+// them:
+//
+//   DELOOP_PARAM(level, "sine.level", 1.0f, 0.0f, 1.0f);
+//   ...
+//   float gain = level.value(); // In the audio task.
+//
+// Writers stage changes and publish them through a triple buffer, which the
+// audio scheduler picks up at the start of every block. The audio task
+// therefore sees each published set of changes at once, at a block boundary,
+// and never takes a lock or waits on a writer.
+//
+// Like metrics, every parameter emits a descriptor into the ELF, so names are
+// resolved on the host and only a 32-bit ID is sent.
+
+#define DELOOP_PARAM_CONCAT_(a, b) a##b
+#define DELOOP_PARAM_CONCAT(a, b) DELOOP_PARAM_CONCAT_(a, b)
+
+// Declares `var` with the given default and inclusive range.
+#define DELOOP_PARAM(var, name, default_value, min_value, max_value)           \
+  static deloop::Param var{default_value, min_value, max_value};               \
+  DELOOP_PARAM_ENTRY_(var, name, __COUNTER__)
+
+#define DELOOP_PARAM_ENTRY_(var, name, id)                                     \
+  [[gnu::section(DELOOP_LOG_SECTION(id)), gnu::used]] static constexpr auto    \
+      DELOOP_PARAM_CONCAT(param_site_, id) =                                   \
+          deloop::MakeParamSite(name, __FILE__, __LINE__, DELOOP_LOG_MODULE);  \
+  [[gnu::section("deloop_params"), gnu::used]] alignas(                        \
+      deloop::ParamEntry) static const deloop::ParamEntry                      \
+      DELOOP_PARAM_CONCAT(param_entry_, id) = {                                \
+          deloop::LogSiteId(DELOOP_PARAM_CONCAT(param_site_, id).hash),        \
+          &var,                                                                \
+  }
+
+namespace deloop {
+
+constexpr uint32_t kParamSiteMagic = 0x9A7A3E7E;
+
+// Parameters linked into one program.
+constexpr size_t kMaxParams = 32;
+
+// Parameter sites reuse the log site descriptor layout, with their own magic.
+template <size_t NameSize, size_t FileSize>
+consteval LogSite<NameSize, FileSize>
+MakeParamSite(const char (&name)[NameSize], const char (&file)[FileSize],
+              uint32_t line, LogModule module) {
+  auto site = MakeLogSite(name, file, line, LogLevel::INFO, module,
+                          LogArgTypeList<>{});
+  site.magic = kParamSiteMagic;
+  return site;
+}
+
+namespace params {
+// Assigns snapshot slots and sets every parameter to its default. Must be
+// called before the audio task starts.
+Error init(void);
+} // namespace params
+
+namespace internal {
+// Values of the snapshot the audio task is processing.
+extern const float *audio_params;
+} // namespace internal
+
+class Param {
+public:
+  constexpr Param(float default_value, float min_value, float max_value)
+      : default_(default_value), min_(min_value), max_(max_value) {}
+
+  // Value for the current block. Only valid in the audio task, after
+  // `params::init`.
+  float value() const { return internal::audio_params[index_]; }
+
+  float defaultValue() const { return default_; }
+  bool inRange(float value) const { return value >= min_ && value <= max_; }
+
+  // Slot in the parameter snapshots, assigned by `params::init`.
+  size_t index() const { return index_; }
+
+private:
+  friend Error params::init(void);
+
+  float default_;
+  float min_;
+  float max_;
+  uint8_t index_ = 0;
+};
+
+// Registry entry, emitted into the `deloop_params` section.
+struct ParamEntry {
+  uint32_t id; // `LogSiteId` of the parameter name.
+  Param *param;
+};
+
+struct ParamUpdate {
+  uint32_t id;
+  float value;
+};
+
+// Every parameter linked into the program.
+std::span<const ParamEntry> GetParams();
+
+namespace params {
+
+// Checks updates without applying them. A batch of more than `kMaxParams`
+// updates is invalid.
+Error check(std::span<const ParamUpdate> updates);
+
+// Applies `updates` and publishes them to the audio task as one change, or
+// applies none of them if any is invalid. Safe to call from several tasks;
+// writers are serialized by briefly masking interrupts.
+Error set(std::span<const ParamUpdate> updates);
+
+// Latest value set by a writer, which the audio task may not have picked up
+// yet.
+Error get(uint32_t id, float &value);
+
+// Picks up the most recently published values. Called by the audio scheduler
+// at the start of every block; never blocks.
+void acquire(void);
+
+} // namespace params
+} // namespace deloop
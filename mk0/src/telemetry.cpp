@@ -0,0 +1,140 @@
+#include "telemetry.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <pb.h>
+
+#include <FreeRTOS.h> // Must appear before other FreeRTOS includes
+#include <task.h>
+
+#include "errors.hpp"
+#include "metrics.hpp"
+#include "metrics.pb.h"
+#include "uart_stream.hpp"
+
+using namespace deloop;
+
+const size_t kTaskStackSize = configMINIMAL_STACK_SIZE * 3;
+
+// Every Nth snapshot includes every metric, so the host recovers from dropped
+// packets and picks up values that have not changed since it connected.
+const uint32_t kFullSnapshotInterval = 10;
+
+const size_t kMaxValuesPerPacket = pb_arraysize(MetricsSnapshot, values);
+
+static struct {
+  bool initialized;
+  std::atomic<uint32_t> period_ms;
+  uint32_t snapshots_since_full;
+
+  // Snapshot packet being filled. Only touched by the telemetry task.
+  MetricsSnapshot snapshot;
+
+  StaticTask_t task_info;
+  StackType_t task_stack[kTaskStackSize];
+  TaskHandle_t task_handle;
+} state_;
+
+static void TelemetryTask(void *pvParameters);
+
+Error telemetry::init(void) {
+  if (state_.initialized) {
+    return Error::kAlreadyInitialized;
+  }
+
+  state_.period_ms.store(kDefaultPeriodMs, std::memory_order_relaxed);
+  state_.snapshots_since_full = 0;
+
+  // Runs at idle priority, so snapshots are only taken when every other task
+  // is blocked.
+  state_.task_handle =
+      xTaskCreateStatic(TelemetryTask, "Telemetry", kTaskStackSize, nullptr,
+                        tskIDLE_PRIORITY, state_.task_stack, &state_.task_info);
+
+  state_.initialized = true;
+  return Error::kOk;
+}
+
+Error telemetry::setPeriod(uint32_t period_ms) {
+  if (!state_.initialized) {
+    return Error::kNotInitialized;
+  } else if (period_ms != 0 && period_ms < kMinPeriodMs) {
+    return Error::kInvalidArgument;
+  }
+
+  state_.period_ms.store(period_ms, std::memory_order_relaxed);
+  xTaskNotifyGive(state_.task_handle);
+  return Error::kOk;
+}
+
+static void flushSnapshot(void) {
+  if (state_.snapshot.values_count == 0) {
+    return;
+  }
+
+  uart_stream::sendMetrics(state_.snapshot);
+  state_.snapshot.values_count = 0;
+}
+
+static void addSample(const MetricSample &sample) {
+  MetricValue &value = state_.snapshot.values[state_.snapshot.values_count++];
+  value = MetricValue_init_zero;
+  value.id = sample.id;
+  switch (sample.type) {
+  case MetricType::kCounter:
+    value.which_value = MetricValue_counter_tag;
+    value.value.counter = sample.value;
+    break;
+  case MetricType::kGauge:
+    value.which_value = MetricValue_gauge_tag;
+    value.value.gauge = static_cast<int32_t>(sample.value);
+    break;
+  case MetricType::kHistogram:
+    value.which_value = MetricValue_bucket_count_tag;
+    value.value.bucket_count = sample.value;
+    value.bucket = sample.bucket;
+    break;
+  }
+
+  if (state_.snapshot.values_count == kMaxValuesPerPacket) {
+    flushSnapshot();
+  }
+}
+
+static void sendSnapshot(bool full) {
+  state_.snapshot = MetricsSnapshot_init_zero;
+  state_.snapshot.tick = xTaskGetTickCount();
+  state_.snapshot.full = full;
+
+  CollectMetrics(full, addSample);
+  flushSnapshot();
+}
+
+static void TelemetryTask(void *pvParameters) {
+  (void)pvParameters;
+
+  // Start with a full snapshot.
+  bool full = true;
+  while (true) {
+    uint32_t period_ms = state_.period_ms.load(std::memory_order_relaxed);
+    TickType_t timeout =
+        (period_ms == 0) ? portMAX_DELAY : pdMS_TO_TICKS(period_ms);
+
+    // A notification means the period changed, which forces a full snapshot.
+    if (ulTaskNotifyTake(pdTRUE, timeout) > 0) {
+      full = true;
+    }
+
+    if (state_.period_ms.load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+
+    if (full || ++state_.snapshots_since_full >= kFullSnapshotInterval) {
+      full = true;
+      state_.snapshots_since_full = 0;
+    }
+
+    sendSnapshot(full);
+    full = false;
+  }
+}
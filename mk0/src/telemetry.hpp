@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+#include "errors.hpp"
+
+namespace deloop {
+namespace telemetry {
+
+// Shortest allowed snapshot period, to bound the link bandwidth used by
+// telemetry.
+constexpr uint32_t kMinPeriodMs = 50;
+constexpr uint32_t kDefaultPeriodMs = 1000;
+
+// Starts the task that periodically sends metric snapshots (see
+// `metrics.hpp`) over the UART stream. Only metrics that changed since the
+// previous snapshot are sent, with a full snapshot every few periods.
+Error init(void);
+
+// Sets the snapshot period, or disables snapshots if `period_ms` is 0. The
+// next snapshot is sent immediately and includes every metric.
+Error setPeriod(uint32_t period_ms);
+
+} // namespace telemetry
+} // namespace deloop
@@ -0,0 +1,124 @@
+#include "trace.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "util/irq_lock.hpp"
+#include "util/spsc_ring.hpp"
+#include "util/varint.hpp"
+
+using namespace deloop;
+
+// Holds roughly 20 ms of audio block spans. Sustained tracing of every block
+// exceeds the UART bandwidth, so captures are expected to be short.
+const size_t kTraceRingSize = 128;
+
+std::atomic<bool> deloop::internal::trace_enabled = false;
+
+static struct {
+  SpscRing<TraceEvent, kTraceRingSize> ring;
+  std::atomic<TraceClock> clock;
+  std::atomic<uint32_t> frequency;
+} state_;
+
+void deloop::SetTraceEnabled(bool enabled) {
+  internal::trace_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void deloop::SetTraceClock(TraceClock clock, uint32_t frequency) {
+  state_.frequency.store(frequency, std::memory_order_relaxed);
+  state_.clock.store(clock, std::memory_order_relaxed);
+}
+
+uint32_t deloop::GetTraceClockFrequency() {
+  return state_.frequency.load(std::memory_order_relaxed);
+}
+
+uint32_t deloop::GetTraceTime() {
+  TraceClock clock = state_.clock.load(std::memory_order_relaxed);
+  return clock ? clock() : 0;
+}
+
+void deloop::RecordTraceEvent(TraceEventType type, TraceTrack track,
+                              uint32_t id, int32_t value) {
+  TraceClock clock = state_.clock.load(std::memory_order_relaxed);
+
+  // Every context records into the same ring, so producers are serialized by
+  // masking interrupts for the duration of the copy. The timestamp is taken
+  // inside the lock so events are queued in time order.
+  IrqLock lock;
+  TraceEvent event = {
+      .timestamp = clock ? clock() : 0,
+      .id = id,
+      .value = value,
+      .type = type,
+      .track = track,
+  };
+  state_.ring.push(event);
+}
+
+bool deloop::TakeTraceEvent(TraceEvent &event) {
+  return state_.ring.pop(event);
+}
+
+bool deloop::TraceEventsPending() { return state_.ring.size() > 0; }
+
+uint32_t deloop::GetTraceOverflows() { return state_.ring.overflows(); }
+
+void TraceBatchEncoder::init(uint8_t *buffer, size_t capacity) {
+  buffer_ = buffer;
+  capacity_ = capacity;
+  reset();
+}
+
+void TraceBatchEncoder::reset() {
+  size_ = 0;
+  count_ = 0;
+  last_timestamp_ = 0;
+}
+
+bool TraceBatchEncoder::hasRoom() const {
+  size_t header_size = (count_ == 0) ? 2 * kMaxVarintSize : 0;
+  return capacity_ - size_ >= header_size + kMaxEventSize;
+}
+
+bool TraceBatchEncoder::append(const TraceEvent &event) {
+  // Encode into a scratch event first so an event that does not fit leaves
+  // the batch untouched.
+  uint8_t record[2 * kMaxVarintSize + kMaxEventSize];
+  size_t n = 0;
+
+  uint32_t last_timestamp = last_timestamp_;
+  if (count_ == 0) {
+    n += WriteVarint(&record[n], GetTraceClockFrequency());
+    n += WriteVarint(&record[n], event.timestamp);
+    last_timestamp = event.timestamp;
+  }
+
+  record[n++] = static_cast<uint8_t>(
+      (static_cast<uint8_t>(event.type) & 0x03) |
+      ((static_cast<uint8_t>(event.track) & 0x0F) << 2));
+
+  for (int i = 0; i < 4; i++) {
+    record[n++] = static_cast<uint8_t>(event.id >> (8 * i));
+  }
+
+  int32_t delta = static_cast<int32_t>(event.timestamp - last_timestamp);
+  n += WriteVarint(&record[n], ZigZag(delta));
+
+  if (event.type == TraceEventType::kCounter) {
+    n += WriteVarint(&record[n], ZigZag(event.value));
+  }
+
+  if (size_ + n > capacity_) {
+    return false;
+  }
+
+  std::memcpy(&buffer_[size_], record, n);
+  size_ += n;
+  count_++;
+  last_timestamp_ = event.timestamp;
+  return true;
+}
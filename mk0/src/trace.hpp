@@ -0,0 +1,198 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "log_encoding.hpp"
+#include "logging.hpp"
+
+// Lightweight event tracing. Events are timestamped with a cycle counter,
+// queued in a wait-free ring and streamed in compact batches by the UART
+// stream task. `python/deloop_mk0/trace.py` converts a capture into a Chrome
+// trace (chrome://tracing or ui.perfetto.dev).
+//
+// Tracing is off by default and costs one relaxed load per event while off.
+// Like log sites, every event site emits a descriptor into the ELF, so names
+// are resolved on the host and never sent.
+//
+// Usable from any context, including ISRs and the audio task.
+
+#define DELOOP_TRACE_CONCAT_(a, b) a##b
+#define DELOOP_TRACE_CONCAT(a, b) DELOOP_TRACE_CONCAT_(a, b)
+
+#define DELOOP_TRACE_SITE_(name, id)                                           \
+  [[gnu::section(DELOOP_LOG_SECTION(id)), gnu::used]] static constexpr auto    \
+      DELOOP_TRACE_CONCAT(trace_site_, id) =                                   \
+          deloop::MakeTraceSite(name, __FILE__, __LINE__)
+
+#define DELOOP_TRACE_EVENT_(type, track, name, value, id)                      \
+  do {                                                                         \
+    DELOOP_TRACE_SITE_(name, id);                                              \
+    if (deloop::TraceEnabled()) {                                              \
+      deloop::RecordTraceEvent(                                                \
+          type, track,                                                         \
+          deloop::LogSiteId(DELOOP_TRACE_CONCAT(trace_site_, id).hash),        \
+          value);                                                              \
+    }                                                                          \
+  } while (0)
+
+// Marks the start and end of a span on `track`. Spans on a track must nest.
+#define DELOOP_TRACE_BEGIN(track, name)                                        \
+  DELOOP_TRACE_EVENT_(deloop::TraceEventType::kBegin, track, name, 0,          \
+                      __COUNTER__)
+#define DELOOP_TRACE_END(track, name)                                          \
+  DELOOP_TRACE_EVENT_(deloop::TraceEventType::kEnd, track, name, 0,            \
+                      __COUNTER__)
+
+// Marks a point in time on `track`.
+#define DELOOP_TRACE_INSTANT(track, name)                                      \
+  DELOOP_TRACE_EVENT_(deloop::TraceEventType::kInstant, track, name, 0,        \
+                      __COUNTER__)
+
+// Records the current value of a named counter.
+#define DELOOP_TRACE_COUNTER(track, name, value)                               \
+  DELOOP_TRACE_EVENT_(deloop::TraceEventType::kCounter, track, name,           \
+                      static_cast<int32_t>(value), __COUNTER__)
+
+// Traces a span covering the rest of the enclosing scope.
+#define DELOOP_TRACE_SCOPE(track, name)                                        \
+  DELOOP_TRACE_SCOPE_(track, name, __COUNTER__)
+#define DELOOP_TRACE_SCOPE_(track, name, id)                                   \
+  DELOOP_TRACE_SITE_(name, id);                                                \
+  deloop::TraceScope DELOOP_TRACE_CONCAT(trace_scope_, id)(                    \
+      track, deloop::LogSiteId(DELOOP_TRACE_CONCAT(trace_site_, id).hash))
+
+namespace deloop {
+
+enum class TraceEventType : uint8_t { kBegin, kEnd, kInstant, kCounter };
+
+// Timeline an event is drawn on. Spans only need to nest within a track, so
+// each context that can be preempted mid-span gets its own.
+//
+// NOTE: This must match `TRACKS` in `python/deloop_mk0/trace.py`.
+enum class TraceTrack : uint8_t {
+  kAudioDma, // SAI DMA interrupts.
+  kAudio,    // Audio stream task.
+  kStream,   // UART stream task.
+  kCommand,  // Command handler.
+};
+constexpr size_t kNumTraceTracks = 4;
+
+constexpr uint32_t kTraceSiteMagic = 0x7ACE5173;
+
+// Trace sites reuse the log site descriptor layout, with their own magic.
+template <size_t NameSize, size_t FileSize>
+consteval LogSite<NameSize, FileSize>
+MakeTraceSite(const char (&name)[NameSize], const char (&file)[FileSize],
+              uint32_t line) {
+  auto site = MakeLogSite(name, file, line, LogLevel::INFO, LogModule::kCore,
+                          LogArgTypeList<>{});
+  site.magic = kTraceSiteMagic;
+  return site;
+}
+
+struct TraceEvent {
+  uint32_t timestamp; // Trace clock cycles.
+  uint32_t id;        // `LogSiteId` of the event name.
+  int32_t value;      // Counter value, 0 for other events.
+  TraceEventType type;
+  TraceTrack track;
+};
+
+namespace internal {
+extern std::atomic<bool> trace_enabled;
+} // namespace internal
+
+inline bool TraceEnabled() {
+  return internal::trace_enabled.load(std::memory_order_relaxed);
+}
+
+void SetTraceEnabled(bool enabled);
+
+// Free-running cycle counter (e.g. DWT CYCCNT) and its frequency. Until a
+// clock is set, events are stamped with 0.
+using TraceClock = uint32_t (*)(void);
+void SetTraceClock(TraceClock clock, uint32_t frequency);
+uint32_t GetTraceClockFrequency();
+
+// Current trace clock time, or 0 if no clock has been set.
+uint32_t GetTraceTime();
+
+// Queues an event, dropping (and counting) it if the ring is full.
+void RecordTraceEvent(TraceEventType type, TraceTrack track, uint32_t id,
+                      int32_t value);
+
+// Consumer side of the trace ring. Must only be called from a single task
+// (the UART stream task).
+bool TakeTraceEvent(TraceEvent &event);
+bool TraceEventsPending();
+
+// Total events dropped because the ring was full.
+uint32_t GetTraceOverflows();
+
+class TraceScope {
+public:
+  TraceScope(TraceTrack track, uint32_t id) : track_(track), id_(id) {
+    if (TraceEnabled()) {
+      RecordTraceEvent(TraceEventType::kBegin, track_, id_, 0);
+    }
+  }
+
+  ~TraceScope() {
+    if (TraceEnabled()) {
+      RecordTraceEvent(TraceEventType::kEnd, track_, id_, 0);
+    }
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  TraceTrack track_;
+  uint32_t id_;
+};
+
+// Compact wire encoding for batches of trace events.
+//
+// NOTE: This must match `python/deloop_mk0/trace.py`.
+//
+// All multi-byte values are little-endian.
+//
+//   Batch: [clock frequency (Hz): varint] [base timestamp: varint] [event]...
+//   Event: [header: u8]
+//          [name id: u32]
+//          [timestamp delta from previous event: zigzag varint]
+//          [value: zigzag varint, only for counters]
+//
+//   Header bits 0-1: `TraceEventType`.
+//   Header bits 2-5: `TraceTrack`.
+class TraceBatchEncoder {
+public:
+  // Worst case size of one encoded event.
+  static constexpr size_t kMaxEventSize = 1 + 4 + 5 + 5;
+
+  void init(uint8_t *buffer, size_t capacity);
+
+  // Returns false, without modifying the batch, if the event does not fit.
+  bool append(const TraceEvent &event);
+  void reset();
+
+  const uint8_t *data() const { return buffer_; }
+  size_t size() const { return size_; }
+  uint32_t count() const { return count_; }
+  bool empty() const { return count_ == 0; }
+
+  // True if any event is guaranteed to fit, so events can be taken from the
+  // ring without peeking.
+  bool hasRoom() const;
+
+private:
+  uint8_t *buffer_;
+  size_t capacity_;
+  size_t size_;
+  uint32_t count_;
+  uint32_t last_timestamp_;
+};
+
+} // namespace deloop
@@ -1,5 +1,8 @@
+#define DELOOP_LOG_MODULE deloop::LogModule::kUartStream
+
 #include "uart_stream.hpp"
 
+#include <climits>
 #include <cstring>
 #include <pb_decode.h>
 #include <pb_encode.h>
@@ -11,36 +14,102 @@
 
 #include "command.pb.h"
 #include "errors.hpp"
-#include "log.pb.h"
+#include "log_encoding.hpp"
 #include "logging.hpp"
+#include "metrics.hpp"
 #include "stream.pb.h"
+#include "trace.hpp"
+#include "util/lane.hpp"
+
+using deloop::uart_stream::Priority;
+
+DELOOP_METRIC_COUNTER(tx_bytes, "uart_stream.tx_bytes");
+DELOOP_METRIC_COUNTER(rx_commands, "uart_stream.rx_commands");
+DELOOP_METRIC_COUNTER(rx_decode_errors, "uart_stream.rx_decode_errors");
 
-const size_t kStreamQueueSize = 8;
-const size_t kCmdQueueSize = 8;
+const size_t kCommandLaneSize = 4;
+const size_t kErrorLaneSize = 8;
+const size_t kTelemetryLaneSize = 4;
+const size_t kInfoLaneSize = 8;
+// Queued commands are whole frames, so the queue is kept short.
+const size_t kCmdQueueSize = 4;
 const size_t kTaskStackSize = configMINIMAL_STACK_SIZE * 2;
 
+// Frame start bytes. Log records are batched into their own frame type so
+// they do not pay for a `StreamPacket` each.
+const uint8_t kPacketStartByte = 0xEB;
+const uint8_t kLogBatchStartByte = 0xEC;
+const uint8_t kTraceBatchStartByte = 0xED;
+
+// Largest batch payloads. Must fit in the one byte frame length.
+const size_t kLogBatchSize = 128;
+const size_t kTraceBatchSize = 128;
+
+// Maximum time a blocking producer waits for room in a `kBlock` lane.
+const TickType_t kBlockTimeout = 1000;
+
+// Drops are aggregated and reported at most once per interval per lane, so a
+// flood of drops cannot itself saturate the link.
+const TickType_t kDropReportInterval = 100;
+
+// Real-time contexts do not notify the stream task, so their log rings are
+// polled at this interval.
+const TickType_t kPollInterval = 10;
+
+// Item queued in a lane. Log records are kept unencoded until the stream task
+// batches them. Trace events are not queued in lanes; a `kTraceBatch` message
+// only tells the stream task to send a batch from the trace ring.
+enum class MessageType : uint8_t { kPacket, kLog, kTraceBatch };
+
+struct OutgoingMessage {
+  MessageType type;
+  union {
+    deloop::LogEntry log;
+    StreamPacket packet;
+  };
+};
+
 static struct {
   bool initialized;
   UART_HandleTypeDef *uart_handle;
 
-  StaticQueue_t stream_queue_info;
-  uint8_t stream_queue_buffer[kStreamQueueSize * StreamPacket_size];
-  QueueHandle_t stream_queue_handle;
+  // Outgoing messages, indexed by `Priority`. Guarded by critical sections.
+  deloop::Lane<OutgoingMessage> lanes[deloop::uart_stream::kNumPriorities];
+  OutgoingMessage command_lane_buffer[kCommandLaneSize];
+  OutgoingMessage error_lane_buffer[kErrorLaneSize];
+  OutgoingMessage telemetry_lane_buffer[kTelemetryLaneSize];
+  OutgoingMessage info_lane_buffer[kInfoLaneSize];
+  uint32_t pending_drops[deloop::uart_stream::kNumPriorities];
+  TickType_t last_drop_report[deloop::uart_stream::kNumPriorities];
+  uint32_t rt_overflows_seen[deloop::kNumLogContexts][deloop::kNumLogLevels];
+  uint32_t trace_overflows_seen;
 
   StaticQueue_t cmd_queue_info;
-  uint8_t cmd_queue_buffer[kCmdQueueSize * StreamPacket_size];
+  uint8_t cmd_queue_buffer[kCmdQueueSize *
+                           sizeof(deloop::uart_stream::ReceivedCommand)];
   QueueHandle_t cmd_queue_handle;
 
+  // Log records waiting to be sent as one frame. Only touched by the stream
+  // task.
+  deloop::LogBatchEncoder log_batch;
+  uint8_t log_batch_buffer[kLogBatchSize];
+  deloop::TraceBatchEncoder trace_batch;
+  uint8_t trace_batch_buffer[kTraceBatchSize];
+
   StaticTask_t task_info;
   StackType_t task_stack[kTaskStackSize];
+  TaskHandle_t task_handle;
 
-  // UART RX state
-  uint8_t rx_buffer[StreamPacket_size + 2];
+  // UART RX state. The frame length is a single byte, so any frame fits.
+  uint8_t rx_buffer[UINT8_MAX];
+  deloop::uart_stream::ReceivedCommand rx_command;
   bool rx_start_byte_received;
   uint8_t rx_packet_size;
 } _state;
 
 static void StreamTask(void *pvParameters);
+static bool enqueue(Priority priority, const OutgoingMessage &message,
+                    bool blocking);
 
 void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
   if (huart != _state.uart_handle || !_state.initialized) {
@@ -49,7 +118,7 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
 
   // Process received byte
   if (!_state.rx_start_byte_received) {
-    if (_state.rx_buffer[0] == 0xEB) { // Start byte
+    if (_state.rx_buffer[0] == kPacketStartByte) {
       _state.rx_start_byte_received = true;
       _state.rx_packet_size = 0;
     }
@@ -62,15 +131,13 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
     HAL_UART_Receive_IT(_state.uart_handle, &_state.rx_buffer[0],
                         _state.rx_packet_size);
   } else {
-
-    Command cmd = Command_init_zero;
-    pb_istream_t stream =
-        pb_istream_from_buffer(&_state.rx_buffer[0], _state.rx_packet_size);
-    if (pb_decode(&stream, Command_fields, &cmd)) {
-      xQueueSendToBackFromISR(_state.cmd_queue_handle, (void *)&cmd, NULL);
-    } else {
-      DELOOP_LOG_ERROR_FROM_ISR("Failed to decode command");
-    }
+    // Batched commands decode into large structs, so decoding is left to
+    // the handler task (see `decodeCommand`).
+    _state.rx_command.received_at = deloop::GetTraceTime();
+    _state.rx_command.size = _state.rx_packet_size;
+    memcpy(_state.rx_command.data, _state.rx_buffer, _state.rx_packet_size);
+    xQueueSendToBackFromISR(_state.cmd_queue_handle,
+                            (void *)&_state.rx_command, NULL);
 
     // Reset for next packet
     _state.rx_start_byte_received = false;
@@ -89,17 +156,33 @@ deloop::Error deloop::uart_stream::init(UART_HandleTypeDef *uart_handle) {
   memset(&_state, 0, sizeof(_state));
 
   _state.uart_handle = uart_handle;
+  deloop::SetLogClock(HAL_GetTick);
+
+  // Initialize lanes. Command responses wait for room, errors keep the
+  // earliest (usually root-cause) messages and everything else keeps the
+  // latest.
+  _state.lanes[static_cast<size_t>(Priority::kCommand)].init(
+      _state.command_lane_buffer, kCommandLaneSize, deloop::DropPolicy::kBlock);
+  _state.lanes[static_cast<size_t>(Priority::kError)].init(
+      _state.error_lane_buffer, kErrorLaneSize,
+      deloop::DropPolicy::kDropNewest);
+  _state.lanes[static_cast<size_t>(Priority::kTelemetry)].init(
+      _state.telemetry_lane_buffer, kTelemetryLaneSize,
+      deloop::DropPolicy::kDropOldest);
+  _state.lanes[static_cast<size_t>(Priority::kInfo)].init(
+      _state.info_lane_buffer, kInfoLaneSize, deloop::DropPolicy::kDropOldest);
+  _state.log_batch.init(_state.log_batch_buffer, kLogBatchSize);
+  _state.trace_batch.init(_state.trace_batch_buffer, kTraceBatchSize);
 
   // Initialize queues
-  _state.stream_queue_handle =
-      xQueueCreateStatic(kStreamQueueSize, sizeof(StreamPacket),
-                         _state.stream_queue_buffer, &_state.stream_queue_info);
   _state.cmd_queue_handle =
-      xQueueCreateStatic(kCmdQueueSize, sizeof(Command),
+      xQueueCreateStatic(kCmdQueueSize,
+                         sizeof(deloop::uart_stream::ReceivedCommand),
                          _state.cmd_queue_buffer, &_state.cmd_queue_info);
 
-  xTaskCreateStatic(StreamTask, "UART Stream", kTaskStackSize, NULL, 1,
-                    _state.task_stack, &_state.task_info);
+  _state.task_handle =
+      xTaskCreateStatic(StreamTask, "UART Stream", kTaskStackSize, NULL, 1,
+                        _state.task_stack, &_state.task_info);
 
   // Initialize RX state
   _state.rx_start_byte_received = false;
@@ -112,81 +195,260 @@ deloop::Error deloop::uart_stream::init(UART_HandleTypeDef *uart_handle) {
   return deloop::Error::kOk;
 }
 
+static Priority priorityForLevel(deloop::LogLevel level) {
+  return (level == deloop::LogLevel::INFO) ? Priority::kInfo
+                                           : Priority::kError;
+}
+
 void deloop::SubmitLog(deloop::LogLevel level, const uint64_t hash,
-                       const std::array<LogArg, 4> &args, bool blocking) {
-  LogRecord record = LogRecord_init_zero;
-  record.hash = hash;
-
-  switch (level) {
-  case deloop::LogLevel::INFO:
-    record.level = LogLevel_INFO;
-    break;
-  case deloop::LogLevel::WARNING:
-    record.level = LogLevel_WARNING;
-    break;
-  case deloop::LogLevel::ERROR:
-    record.level = LogLevel_ERROR;
-    break;
-  default:
-    record.level = LogLevel_INFO;
-    break;
+                       const std::array<LogArg, 4> &args,
+                       uint32_t suppressed) {
+  OutgoingMessage message;
+  message.type = MessageType::kLog;
+  message.log = deloop::MakeLogEntry(level, hash, args, suppressed);
+  enqueue(priorityForLevel(level), message, true);
+}
+
+void deloop::uart_stream::sendCommandResponse(const CommandResponse &resp) {
+  OutgoingMessage message;
+  message.type = MessageType::kPacket;
+  message.packet = StreamPacket_init_zero;
+  message.packet.which_payload = StreamPacket_cmd_response_tag;
+  message.packet.payload.cmd_response = resp;
+
+  enqueue(Priority::kCommand, message, true);
+}
+
+// Snapshots are sent at telemetry priority, whose lane keeps the latest.
+void deloop::uart_stream::sendMetrics(const MetricsSnapshot &snapshot) {
+  OutgoingMessage message;
+  message.type = MessageType::kPacket;
+  message.packet = StreamPacket_init_zero;
+  message.packet.which_payload = StreamPacket_metrics_tag;
+  message.packet.payload.metrics = snapshot;
+
+  enqueue(Priority::kTelemetry, message, false);
+}
+
+void deloop::uart_stream::setDropPolicy(Priority priority,
+                                        DropPolicy policy) {
+  taskENTER_CRITICAL();
+  _state.lanes[static_cast<size_t>(priority)].setPolicy(policy);
+  taskEXIT_CRITICAL();
+}
+
+uint32_t deloop::uart_stream::getDroppedCount(Priority priority) {
+  taskENTER_CRITICAL();
+  uint32_t dropped = _state.lanes[static_cast<size_t>(priority)].totalDropped();
+  taskEXIT_CRITICAL();
+  return dropped;
+}
+
+// Pushes a message into its lane and wakes the stream task. Blocking producers
+// wait for room in `kBlock` lanes. Must be called from a task; real-time
+// contexts go through the wait-free log rings instead.
+static bool enqueue(Priority priority, const OutgoingMessage &message,
+                    bool blocking) {
+  if (!_state.initialized) {
+    return false;
   }
 
-  for (size_t i = 0; i < args.size(); i++) {
-    LogRecord_Arg arg = LogRecord_Arg_init_zero;
-    if (args[i].type == deloop::LogArg::Type::kUnset) {
-      break;
+  deloop::Lane<OutgoingMessage> &lane =
+      _state.lanes[static_cast<size_t>(priority)];
+
+  TickType_t start = xTaskGetTickCount();
+  while (true) {
+    taskENTER_CRITICAL();
+    bool pushed = lane.push(message);
+    bool wait = !pushed && lane.policy() == deloop::DropPolicy::kBlock;
+    if (wait &&
+        (!blocking || (xTaskGetTickCount() - start) >= kBlockTimeout)) {
+      lane.countDrop();
+      wait = false;
     }
+    taskEXIT_CRITICAL();
 
-    switch (args[i].type) {
-    case deloop::LogArg::Type::kU32:
-      arg.which_value = LogRecord_Arg_u32_tag;
-      arg.value.u32 = args[i].value.u32;
-      break;
-    case deloop::LogArg::Type::kI32:
-      arg.which_value = LogRecord_Arg_i32_tag;
-      arg.value.i32 = args[i].value.i32;
-      break;
-    case deloop::LogArg::Type::kF32:
-      arg.which_value = LogRecord_Arg_f32_tag;
-      arg.value.f32 = args[i].value.f32;
-      break;
-    default:
-      break;
+    if (pushed) {
+      xTaskNotifyGive(_state.task_handle);
+      return true;
+    } else if (!wait) {
+      return false;
     }
 
-    record.args[i] = arg;
-    record.args_count++;
+    vTaskDelay(1);
+  }
+}
+
+QueueHandle_t deloop::uart_stream::getCmdQueue() {
+  return _state.cmd_queue_handle;
+}
+
+bool deloop::uart_stream::decodeCommand(const ReceivedCommand &received,
+                                        Command &cmd) {
+  cmd = Command_init_zero;
+  pb_istream_t stream = pb_istream_from_buffer(received.data, received.size);
+  if (!pb_decode(&stream, Command_fields, &cmd)) {
+    rx_decode_errors.increment();
+    DELOOP_LOG_ERROR("Failed to decode command");
+    return false;
   }
 
-  StreamPacket packet = StreamPacket_init_zero;
-  packet.which_payload = StreamPacket_log_tag;
-  packet.payload.log = record;
+  rx_commands.increment();
+  return true;
+}
 
-  if (blocking) {
-    xQueueSendToBack(_state.stream_queue_handle, (void *)&packet, 1000);
-  } else {
-    xQueueSendToBackFromISR(_state.stream_queue_handle, (void *)&packet, NULL);
+// Moves records from the real-time log rings into their lanes.
+static void drainRtLogs(void) {
+  OutgoingMessage message;
+  message.type = MessageType::kLog;
+  for (size_t i = 0; i < deloop::kNumLogContexts; i++) {
+    auto context = static_cast<deloop::LogContext>(i);
+    while (deloop::TakeRtLog(context, message.log)) {
+      enqueue(priorityForLevel(message.log.level), message, false);
+    }
   }
 }
 
-void deloop::uart_stream::sendCommandResponse(const CommandResponse &resp) {
-  StreamPacket packet = StreamPacket_init_zero;
-  packet.which_payload = StreamPacket_cmd_response_tag;
-  packet.payload.cmd_response = resp;
+// Folds records dropped by the real-time log rings into the pending drop
+// counts of the lanes they would have gone to.
+static void collectRtLogOverflows(void) {
+  for (size_t i = 0; i < deloop::kNumLogContexts; i++) {
+    for (size_t j = 0; j < deloop::kNumLogLevels; j++) {
+      auto context = static_cast<deloop::LogContext>(i);
+      auto level = static_cast<deloop::LogLevel>(j);
+      uint32_t overflows = deloop::GetRtLogOverflows(context, level);
+      uint32_t lane = static_cast<uint32_t>(priorityForLevel(level));
+      _state.pending_drops[lane] += overflows - _state.rt_overflows_seen[i][j];
+      _state.rt_overflows_seen[i][j] = overflows;
+    }
+  }
 
-  xQueueSendToBack(_state.stream_queue_handle, (void *)&packet, 1000);
+  uint32_t trace_overflows = deloop::GetTraceOverflows();
+  _state.pending_drops[static_cast<size_t>(Priority::kTelemetry)] +=
+      trace_overflows - _state.trace_overflows_seen;
+  _state.trace_overflows_seen = trace_overflows;
 }
 
-QueueHandle_t deloop::uart_stream::getCmdQueue() {
-  return _state.cmd_queue_handle;
+// Builds a drop report for the highest priority lane with unreported drops,
+// if its report interval has elapsed.
+static bool takeDropReport(OutgoingMessage &message) {
+  TickType_t now = xTaskGetTickCount();
+  collectRtLogOverflows();
+  for (size_t i = 0; i < deloop::uart_stream::kNumPriorities; i++) {
+    taskENTER_CRITICAL();
+    _state.pending_drops[i] += _state.lanes[i].takeDropped();
+    taskEXIT_CRITICAL();
+
+    if (_state.pending_drops[i] == 0 ||
+        (now - _state.last_drop_report[i]) < kDropReportInterval) {
+      continue;
+    }
+
+    message.type = MessageType::kPacket;
+    message.packet = StreamPacket_init_zero;
+    message.packet.which_payload = StreamPacket_dropped_tag;
+    message.packet.payload.dropped.priority = static_cast<StreamPriority>(i);
+    message.packet.payload.dropped.count = _state.pending_drops[i];
+    _state.pending_drops[i] = 0;
+    _state.last_drop_report[i] = now;
+    return true;
+  }
+
+  return false;
+}
+
+// Trace batches are sent at telemetry priority, ahead of the telemetry lane.
+static bool takeNextMessage(OutgoingMessage &message) {
+  const size_t kTelemetry = static_cast<size_t>(Priority::kTelemetry);
+  const size_t kNumLower = deloop::uart_stream::kNumPriorities - kTelemetry;
+
+  drainRtLogs();
+  if (takeDropReport(message)) {
+    return true;
+  }
+
+  taskENTER_CRITICAL();
+  size_t lane = deloop::popHighestPriority(_state.lanes, kTelemetry, message);
+  taskEXIT_CRITICAL();
+  if (lane < kTelemetry) {
+    return true;
+  }
+
+  if (deloop::TraceEventsPending()) {
+    message.type = MessageType::kTraceBatch;
+    return true;
+  }
+
+  taskENTER_CRITICAL();
+  lane = deloop::popHighestPriority(&_state.lanes[kTelemetry], kNumLower,
+                                    message);
+  taskEXIT_CRITICAL();
+
+  return lane < kNumLower;
+}
+
+static void transmitPacket(const StreamPacket &packet) {
+  uint8_t tx_buffer[StreamPacket_size + 2];
+
+  tx_buffer[0] = kPacketStartByte;
+  // TODO: Add checksum and escape sequence for start byte
+  pb_ostream_t stream =
+      pb_ostream_from_buffer(tx_buffer + 2, sizeof(tx_buffer) - 2);
+  pb_encode(&stream, StreamPacket_fields, &packet);
+  tx_buffer[1] = (uint8_t)stream.bytes_written;
+
+  // Transmit the packet
+  HAL_UART_Transmit(_state.uart_handle, tx_buffer,
+                    (uint16_t)stream.bytes_written + 2, 1000);
+  tx_bytes.increment(static_cast<uint32_t>(stream.bytes_written) + 2);
+}
+
+// Sends a batch payload (at most 255 bytes) in its own frame type.
+static void transmitBatch(uint8_t start_byte, const uint8_t *data,
+                          size_t size) {
+  uint8_t tx_buffer[UINT8_MAX + 2];
+
+  tx_buffer[0] = start_byte;
+  tx_buffer[1] = (uint8_t)size;
+  memcpy(&tx_buffer[2], data, size);
+
+  HAL_UART_Transmit(_state.uart_handle, tx_buffer, (uint16_t)size + 2, 1000);
+  tx_bytes.increment(static_cast<uint32_t>(size) + 2);
+}
+
+static void transmitLogBatch(void) {
+  transmitBatch(kLogBatchStartByte, _state.log_batch.data(),
+                _state.log_batch.size());
+  _state.log_batch.reset();
+}
+
+// Sends one batch of whatever is in the trace ring.
+static void transmitTraceBatch(void) {
+  deloop::TraceEvent event;
+  while (_state.trace_batch.hasRoom() && deloop::TakeTraceEvent(event)) {
+    _state.trace_batch.append(event);
+  }
+
+  transmitBatch(kTraceBatchStartByte, _state.trace_batch.data(),
+                _state.trace_batch.size());
+  _state.trace_batch.reset();
+}
+
+// Adds a log record to the pending batch, sending the batch first if the
+// record does not fit.
+static void batchLog(const deloop::LogEntry &entry) {
+  if (_state.log_batch.append(entry)) {
+    return;
+  }
+
+  transmitLogBatch();
+  _state.log_batch.append(entry);
 }
 
 static void StreamTask(void *pvParameters) {
   (void)pvParameters;
 
-  StreamPacket packet = StreamPacket_init_zero;
-  uint8_t tx_buffer[StreamPacket_size + 2];
+  OutgoingMessage message;
 
   while (true) {
     if (_state.initialized == false) {
@@ -194,18 +456,31 @@ static void StreamTask(void *pvParameters) {
       continue;
     }
 
-    if (xQueueReceive(_state.stream_queue_handle, &packet, portMAX_DELAY) ==
-        pdTRUE) {
-      tx_buffer[0] = 0xEB; // Start byte
-      // TODO: Add checksum and escape sequence for start byte
-      pb_ostream_t stream =
-          pb_ostream_from_buffer(tx_buffer + 2, sizeof(tx_buffer) - 2);
-      pb_encode(&stream, StreamPacket_fields, &packet);
-      tx_buffer[1] = (uint8_t)stream.bytes_written;
-
-      // Transmit the packet
-      HAL_UART_Transmit(_state.uart_handle, tx_buffer,
-                        (uint16_t)stream.bytes_written + 2, 1000);
+    // Wake on new messages, or periodically to drain the real-time log rings
+    // and flush pending drop reports.
+    ulTaskNotifyTake(pdTRUE, kPollInterval);
+    DELOOP_TRACE_SCOPE(deloop::TraceTrack::kStream, "uart_stream_drain");
+    while (takeNextMessage(message)) {
+      switch (message.type) {
+      case MessageType::kLog:
+        batchLog(message.log);
+        break;
+      case MessageType::kTraceBatch:
+        transmitTraceBatch();
+        break;
+      default:
+        if (message.packet.which_payload == StreamPacket_cmd_response_tag) {
+          message.packet.payload.cmd_response.sent_at = deloop::GetTraceTime();
+        }
+        transmitPacket(message.packet);
+        break;
+      }
+    }
+
+    // Logs are batched only with whatever is already queued, so a lone
+    // record is not held back.
+    if (!_state.log_batch.empty()) {
+      transmitLogBatch();
     }
   }
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <climits>
 #include <cstdint>
 #include <functional>
 #include <stm32f4xx_hal.h>
@@ -10,13 +11,35 @@
 
 #include "command.pb.h"
 #include "errors.hpp"
+#include "metrics.pb.h"
+#include "util/lane.hpp"
 
 namespace deloop {
 namespace uart_stream {
 
+// Outgoing traffic classes, highest priority first. Each class has its own
+// lane so a flood of low priority messages cannot delay higher ones.
+//
+// NOTE: This must match `StreamPriority` in `proto/stream.proto`.
+enum class Priority : uint8_t { kCommand, kError, kTelemetry, kInfo };
+constexpr size_t kNumPriorities = 4;
+
+// Item of the command queue: an encoded `Command` frame.
+struct ReceivedCommand {
+  uint32_t received_at; // Trace clock time the command was received.
+  uint8_t size;
+  uint8_t data[UINT8_MAX];
+};
+
 Error init(UART_HandleTypeDef *uart_handle);
+// Queue of `ReceivedCommand`s.
 QueueHandle_t getCmdQueue();
+// Decodes a queued command. Returns false (and logs) if it is malformed.
+bool decodeCommand(const ReceivedCommand &received, Command &cmd);
 void sendCommandResponse(const CommandResponse &resp);
+void sendMetrics(const MetricsSnapshot &snapshot);
+void setDropPolicy(Priority priority, DropPolicy policy);
+uint32_t getDroppedCount(Priority priority);
 
 } // namespace uart_stream
 } // namespace deloop
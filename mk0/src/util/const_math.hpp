@@ -0,0 +1,66 @@
+#pragma once
+
+#include <numbers>
+
+namespace deloop {
+
+// Sine of `x` radians, for building tables at compile time so they stay in
+// flash. Accurate to double precision over a period.
+constexpr double ConstSin(double x) {
+  constexpr double kPi = std::numbers::pi;
+  while (x > kPi) {
+    x -= 2.0 * kPi;
+  }
+  while (x < -kPi) {
+    x += 2.0 * kPi;
+  }
+  double term = x;
+  double sum = x;
+  for (int n = 1; n < 12; n++) {
+    term *= -x * x / ((2 * n) * (2 * n + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double ConstCos(double x) {
+  return ConstSin(x + std::numbers::pi / 2);
+}
+
+// Square root of `x`, 0 for anything not positive.
+constexpr double ConstSqrt(double x) {
+  if (!(x > 0.0)) {
+    return 0.0;
+  }
+  double root = x > 1.0 ? x : 1.0;
+  for (int n = 0; n < 100; n++) {
+    double next = 0.5 * (root + x / root);
+    if (next >= root) {
+      break;
+    }
+    root = next;
+  }
+  return root;
+}
+
+// e to the power `x`, halving `x` until the series converges quickly and
+// squaring back.
+constexpr double ConstExp(double x) {
+  int halvings = 0;
+  while (x > 0.5 || x < -0.5) {
+    x /= 2.0;
+    halvings++;
+  }
+  double term = 1.0;
+  double sum = 1.0;
+  for (int n = 1; n < 16; n++) {
+    term *= x / n;
+    sum += term;
+  }
+  for (int n = 0; n < halvings; n++) {
+    sum *= sum;
+  }
+  return sum;
+}
+
+} // namespace deloop
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace deloop {
+
+// Masks all interrupts for the lifetime of the lock. Usable from both tasks
+// and ISRs, and never waits on target, so it is suitable for guarding a few
+// instructions on real-time paths. Keep the guarded section short.
+//
+// Host builds have no interrupts to mask, so a spinlock provides the same
+// mutual exclusion between test threads.
+class IrqLock {
+public:
+  IrqLock() {
+#if defined(__arm__)
+    __asm volatile("mrs %0, primask" : "=r"(primask_));
+    __asm volatile("cpsid i" ::: "memory");
+#else
+    while (host_lock_.test_and_set(std::memory_order_acquire)) {
+    }
+#endif
+  }
+
+  ~IrqLock() {
+#if defined(__arm__)
+    __asm volatile("msr primask, %0" ::"r"(primask_) : "memory");
+#else
+    host_lock_.clear(std::memory_order_release);
+#endif
+  }
+
+  IrqLock(const IrqLock &) = delete;
+  IrqLock &operator=(const IrqLock &) = delete;
+
+private:
+#if defined(__arm__)
+  uint32_t primask_;
+#else
+  static inline std::atomic_flag host_lock_;
+#endif
+};
+
+} // namespace deloop
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace deloop {
+
+// Behaviour of a lane when an item is pushed while it is full.
+enum class DropPolicy : uint8_t {
+  kDropNewest, // Reject the incoming item.
+  kDropOldest, // Evict the oldest queued item to make room.
+  kBlock,      // Reject the incoming item; the producer waits and retries.
+};
+
+// Fixed-capacity FIFO with an overflow policy and a drop counter.
+//
+// Storage is provided by the owner so lanes of different depths can share a
+// type. Lanes are not thread-safe; callers must serialize access (e.g. with a
+// critical section).
+template <typename T> class Lane {
+public:
+  void init(T *storage, size_t capacity, DropPolicy policy) {
+    storage_ = storage;
+    capacity_ = capacity;
+    policy_ = policy;
+    head_ = 0;
+    count_ = 0;
+    dropped_ = 0;
+    total_dropped_ = 0;
+  }
+
+  // Returns false if the item was rejected. Under `kDropOldest` the push
+  // always succeeds, but evicting an item still counts as a drop.
+  bool push(const T &item) {
+    if (capacity_ == 0) {
+      countDrop();
+      return false;
+    }
+
+    if (count_ == capacity_) {
+      if (policy_ != DropPolicy::kDropOldest) {
+        if (policy_ == DropPolicy::kDropNewest) {
+          countDrop();
+        }
+        return false;
+      }
+
+      head_ = (head_ + 1) % capacity_;
+      count_--;
+      countDrop();
+    }
+
+    storage_[(head_ + count_) % capacity_] = item;
+    count_++;
+    return true;
+  }
+
+  bool pop(T &item) {
+    if (count_ == 0) {
+      return false;
+    }
+
+    item = storage_[head_];
+    head_ = (head_ + 1) % capacity_;
+    count_--;
+    return true;
+  }
+
+  // Records an item the producer gave up on (e.g. a `kBlock` push that timed
+  // out).
+  void countDrop() {
+    dropped_++;
+    total_dropped_++;
+  }
+
+  // Returns the number of items dropped since the previous call.
+  uint32_t takeDropped() {
+    uint32_t dropped = dropped_;
+    dropped_ = 0;
+    return dropped;
+  }
+
+  bool empty() const { return count_ == 0; }
+  bool full() const { return count_ == capacity_; }
+  size_t size() const { return count_; }
+  size_t capacity() const { return capacity_; }
+  uint32_t totalDropped() const { return total_dropped_; }
+  DropPolicy policy() const { return policy_; }
+  void setPolicy(DropPolicy policy) { policy_ = policy; }
+
+private:
+  T *storage_;
+  size_t capacity_;
+  size_t head_;
+  size_t count_;
+  DropPolicy policy_;
+  uint32_t dropped_;
+  uint32_t total_dropped_;
+};
+
+// Pops from the first non-empty lane, where lower indices have higher
+// priority. Returns the index of the lane popped from, or `num_lanes` if all
+// lanes are empty.
+template <typename T>
+size_t popHighestPriority(Lane<T> *lanes, size_t num_lanes, T &item) {
+  for (size_t i = 0; i < num_lanes; i++) {
+    if (lanes[i].pop(item)) {
+      return i;
+    }
+  }
+
+  return num_lanes;
+}
+
+} // namespace deloop
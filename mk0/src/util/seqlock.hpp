@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace deloop {
+
+// Value with a single writer and any number of readers.
+//
+// Cortex-M4 has no atomic loads or stores wider than 32 bits, so the value is
+// kept as words guarded by a sequence count. The writer never waits; readers
+// retry if they overlap a store, which only happens if the writer preempts
+// them mid-read.
+template <typename T> class SeqLock {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "T must be trivially copyable.");
+
+public:
+  void store(const T &value) {
+    std::array<uint32_t, kNumWords> words = {};
+    std::memcpy(words.data(), &value, sizeof(T));
+
+    uint32_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kNumWords; i++) {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+    seq_.store(seq + 2, std::memory_order_release);
+  }
+
+  T load() const {
+    std::array<uint32_t, kNumWords> words;
+    while (true) {
+      uint32_t seq = seq_.load(std::memory_order_acquire);
+      for (size_t i = 0; i < kNumWords; i++) {
+        words[i] = words_[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if ((seq & 1) == 0 && seq == seq_.load(std::memory_order_relaxed)) {
+        break;
+      }
+    }
+
+    T value;
+    std::memcpy(&value, words.data(), sizeof(T));
+    return value;
+  }
+
+private:
+  static constexpr size_t kNumWords = (sizeof(T) + 3) / 4;
+
+  std::atomic<uint32_t> seq_ = 0; // Odd while a store is in progress.
+  std::array<std::atomic<uint32_t>, kNumWords> words_ = {};
+};
+
+} // namespace deloop
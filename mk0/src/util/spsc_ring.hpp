@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace deloop {
+
+// Wait-free single-producer/single-consumer ring buffer.
+//
+// `push` and `pop` never block or retry, so the ring is safe to use from the
+// audio task and from ISRs. Exactly one context may push and exactly one may
+// pop at a time.
+template <typename T, size_t Capacity> class SpscRing {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two.");
+
+public:
+  // Returns false (and counts an overflow) if the ring is full.
+  bool push(const T &item) {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    uint32_t head = head_.load(std::memory_order_acquire);
+    if (tail - head == Capacity) {
+      overflows_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    items_[tail & kMask] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &item) {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    uint32_t tail = tail_.load(std::memory_order_acquire);
+    if (head == tail) {
+      return false;
+    }
+
+    item = items_[head & kMask];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+
+  // Total number of rejected pushes.
+  uint32_t overflows() const {
+    return overflows_.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr uint32_t kMask = Capacity - 1;
+
+  std::array<T, Capacity> items_;
+  std::atomic<uint32_t> head_;
+  std::atomic<uint32_t> tail_;
+  std::atomic<uint32_t> overflows_;
+};
+
+} // namespace deloop
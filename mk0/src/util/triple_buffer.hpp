@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace deloop {
+
+// Wait-free single-writer/single-reader triple buffer.
+//
+// The writer fills `back()` and publishes it; the reader picks up the most
+// recently published value with `acquire()` and reads it through `front()`.
+// Neither side ever waits for the other, and the reader always sees a
+// complete value, so it is safe for handing state to the audio task. Values
+// published between two `acquire` calls replace each other; only the latest
+// is seen.
+template <typename T> class TripleBuffer {
+public:
+  // Writer side. The back buffer holds stale contents after `publish`.
+  T &back() { return buffers_[back_]; }
+
+  void publish() {
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) &
+            kIndexMask;
+  }
+
+  // Reader side. Returns true if a newer value was published since the last
+  // call.
+  bool acquire() {
+    if ((middle_.load(std::memory_order_relaxed) & kFresh) == 0) {
+      return false;
+    }
+
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+    return true;
+  }
+
+  const T &front() const { return buffers_[front_]; }
+
+  // Sets every buffer to `value`. Not safe while either side is active.
+  void reset(const T &value) {
+    buffers_.fill(value);
+    front_ = 0;
+    middle_.store(1, std::memory_order_relaxed);
+    back_ = 2;
+  }
+
+private:
+  static constexpr uint8_t kIndexMask = 0x03;
+  static constexpr uint8_t kFresh = 0x04; // Middle was published, not read.
+
+  std::array<T, 3> buffers_ = {};
+  uint8_t front_ = 0;
+  std::atomic<uint8_t> middle_ = 1;
+  uint8_t back_ = 2;
+};
+
+} // namespace deloop
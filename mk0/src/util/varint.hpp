@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace deloop {
+
+// Worst case size of a varint encoded `uint32_t`.
+constexpr size_t kMaxVarintSize = 5;
+
+// Writes `value` as a LEB128 varint (as in protobuf). Returns the number of
+// bytes written.
+inline size_t WriteVarint(uint8_t *dst, uint32_t value) {
+  size_t i = 0;
+  while (value >= 0x80) {
+    dst[i++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  dst[i++] = static_cast<uint8_t>(value);
+  return i;
+}
+
+// Maps signed values to unsigned so small magnitudes encode to short varints.
+constexpr uint32_t ZigZag(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^
+         static_cast<uint32_t>(value >> 31);
+}
+
+} // namespace deloop
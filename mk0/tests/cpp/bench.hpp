@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Minimal helpers for host benchmarks. Results are printed rather than
+// asserted, since host timings vary between machines and build types.
+namespace bench {
+
+// Cycle counter where the host has one (x86 TSC), nanoseconds otherwise.
+inline uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+#endif
+}
+
+inline const char *unit() {
+#if defined(__x86_64__) || defined(__i386__)
+  return "cycles";
+#else
+  return "ns";
+#endif
+}
+
+// Returns the mean cost of one call to `fn` over `iterations` calls.
+template <typename F> double measure(uint64_t iterations, F &&fn) {
+  fn(); // Warm up caches and branch predictors.
+
+  uint64_t start = now();
+  for (uint64_t i = 0; i < iterations; i++) {
+    fn();
+  }
+  return static_cast<double>(now() - start) / static_cast<double>(iterations);
+}
+
+inline void report(const char *name, double value, const char *per) {
+  std::printf("[ BENCH    ] %-48s %10.2f %s/%s\n", name, value, unit(), per);
+}
+
+} // namespace bench
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <numbers>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "audio/biquad.hpp"
+#include "bench.hpp"
+
+using deloop::BiquadCascade;
+using deloop::BiquadCoeffs;
+namespace biquad = deloop::biquad;
+
+namespace {
+
+constexpr double kSampleRate = 48000.0;
+constexpr uint32_t kBlockFrames = 32;
+constexpr double kFullScale = 0x7FFFFF;
+constexpr double kButterworthQ = std::numbers::sqrt2 / 2.0;
+
+using Block = std::array<int32_t, kBlockFrames * BiquadCascade::kChannels>;
+
+// Gain of the quantized `section` at `hz`, in dB.
+double responseDb(const BiquadCoeffs &section, double hz) {
+  auto term = [&](int32_t coeff) {
+    return std::ldexp(static_cast<double>(coeff), -section.bits);
+  };
+  std::complex<double> z1 =
+      std::polar(1.0, -2.0 * std::numbers::pi * hz / kSampleRate);
+  std::complex<double> z2 = z1 * z1;
+  std::complex<double> num =
+      term(section.b0) + term(section.b1) * z1 + term(section.b2) * z2;
+  std::complex<double> den =
+      1.0 - term(section.a1) * z1 - term(section.a2) * z2;
+  return 20.0 * std::log10(std::abs(num / den));
+}
+
+// Gain of `cascade` for a sine at `hz`, in dB, from the RMS of a second of
+// it after `settle_s` seconds. The right channel is checked to match.
+double measureDb(BiquadCascade &cascade, double hz, double level = 0.25,
+                 double settle_s = 1.0) {
+  double w = 2.0 * std::numbers::pi * hz / kSampleRate;
+  uint32_t settle = static_cast<uint32_t>(settle_s * kSampleRate);
+  uint32_t frames = settle + static_cast<uint32_t>(kSampleRate);
+  double in_power = 0.0;
+  double out_power = 0.0;
+  for (uint32_t done = 0; done < frames; done += kBlockFrames) {
+    Block block;
+    for (uint32_t i = 0; i < kBlockFrames; i++) {
+      double x = level * kFullScale * std::sin(w * (done + i));
+      block[2 * i] = block[2 * i + 1] = static_cast<int32_t>(std::lround(x));
+    }
+    Block in = block;
+    cascade.process(kBlockFrames, block.data());
+    for (uint32_t i = 0; i < kBlockFrames; i++) {
+      EXPECT_EQ(block[2 * i], block[2 * i + 1]);
+      if (done >= settle) {
+        in_power += static_cast<double>(in[2 * i]) * in[2 * i];
+        out_power += static_cast<double>(block[2 * i]) * block[2 * i];
+      }
+    }
+  }
+  return 10.0 * std::log10(out_power / in_power);
+}
+
+// Runs `cascade` over `frames` frames of `input` on both channels, returning
+// the left output.
+std::vector<int32_t> run(BiquadCascade &cascade, uint32_t frames,
+                         int32_t input) {
+  std::vector<int32_t> out;
+  for (uint32_t done = 0; done < frames; done += kBlockFrames) {
+    Block block;
+    block.fill(input);
+    cascade.process(kBlockFrames, block.data());
+    for (uint32_t i = 0; i < kBlockFrames; i++) {
+      out.push_back(block[2 * i]);
+    }
+  }
+  return out;
+}
+
+} // namespace
+
+TEST(BiquadTests, designs_follow_the_cookbook) {
+  // Designed at compile time.
+  constexpr BiquadCoeffs kHighPass =
+      biquad::HighPass(80.0, kButterworthQ, kSampleRate);
+  static_assert(kHighPass.bits == biquad::kMaxBits);
+
+  EXPECT_NEAR(responseDb(kHighPass, 80.0), -3.01, 0.01);
+  EXPECT_NEAR(responseDb(kHighPass, 20000.0), 0.0, 0.01);
+  BiquadCoeffs low_pass = biquad::LowPass(5000.0, kButterworthQ, kSampleRate);
+  EXPECT_NEAR(responseDb(low_pass, 5000.0), -3.01, 0.01);
+  EXPECT_NEAR(responseDb(low_pass, 10.0), 0.0, 0.01);
+
+  for (double db : {-12.0, -3.0, 6.0, 12.0}) {
+    SCOPED_TRACE(db);
+    BiquadCoeffs peak = biquad::Peak(1000.0, 2.0, db, kSampleRate);
+    EXPECT_NEAR(responseDb(peak, 1000.0), db, 0.01);
+    EXPECT_NEAR(responseDb(peak, 20.0), 0.0, 0.01);
+
+    BiquadCoeffs low = biquad::LowShelf(200.0, kButterworthQ, db, kSampleRate);
+    EXPECT_NEAR(responseDb(low, 200.0), db / 2.0, 0.01);
+    EXPECT_NEAR(responseDb(low, 10.0), db, 0.01);
+    EXPECT_NEAR(responseDb(low, 20000.0), 0.0, 0.01);
+
+    BiquadCoeffs high =
+        biquad::HighShelf(4000.0, kButterworthQ, db, kSampleRate);
+    EXPECT_NEAR(responseDb(high, 4000.0), db / 2.0, 0.01);
+    EXPECT_NEAR(responseDb(high, 24000.0), db, 0.01);
+    EXPECT_NEAR(responseDb(high, 20.0), 0.0, 0.01);
+  }
+
+  // Boosts give up coefficient bits for range.
+  EXPECT_LT(biquad::HighShelf(4000.0, kButterworthQ, 12.0, kSampleRate).bits,
+            biquad::kMaxBits);
+}
+
+TEST(BiquadTests, cascade_filters_as_designed) {
+  const BiquadCoeffs sections[] = {
+      biquad::HighPass(100.0, kButterworthQ, kSampleRate),
+      biquad::Peak(1000.0, 1.0, 6.0, kSampleRate),
+      biquad::HighShelf(8000.0, kButterworthQ, -6.0, kSampleRate),
+  };
+  BiquadCascade cascade;
+  cascade.configure(sections, std::size(sections));
+  for (double hz : {50.0, 100.0, 440.0, 1000.0, 3000.0, 12000.0}) {
+    double expected = 0.0;
+    for (const BiquadCoeffs &section : sections) {
+      expected += responseDb(section, hz);
+    }
+    double measured = measureDb(cascade, hz);
+    std::printf("[ BENCH    ] %7.0f Hz: %6.2f dB (designed %6.2f dB)\n", hz,
+                measured, expected);
+    EXPECT_NEAR(measured, expected, 0.02) << hz << " Hz";
+  }
+}
+
+TEST(BiquadTests, no_sections_pass_frames_through) {
+  BiquadCascade cascade;
+  Block block;
+  for (size_t i = 0; i < block.size(); i++) {
+    block[i] = static_cast<int32_t>(i) * 1000 - 0x7FFF;
+  }
+  Block in = block;
+  cascade.process(kBlockFrames, block.data());
+  EXPECT_EQ(block, in);
+}
+
+TEST(BiquadTests, low_cutoffs_stay_stable) {
+  // Poles within a few parts in a thousand of 1.
+  const BiquadCoeffs high_pass =
+      biquad::HighPass(5.0, kButterworthQ, kSampleRate);
+  const BiquadCoeffs low_pass =
+      biquad::LowPass(10.0, kButterworthQ, kSampleRate);
+  const int32_t step = static_cast<int32_t>(0.5 * kFullScale);
+
+  // A high pass takes DC out entirely, rather than leaving an offset.
+  BiquadCascade cascade;
+  cascade.configure(&high_pass, 1);
+  std::vector<int32_t> out = run(cascade, 5 * 48000, step);
+  for (size_t i = out.size() - 48000; i < out.size(); i++) {
+    ASSERT_EQ(out[i], 0) << i;
+  }
+
+  // A low pass settles on DC at exactly unity, without wandering.
+  cascade.reset();
+  cascade.configure(&low_pass, 1);
+  out = run(cascade, 5 * 48000, step);
+  double dc_gain = (low_pass.b0 + low_pass.b1 + low_pass.b2) /
+                   (std::ldexp(1.0, low_pass.bits) - low_pass.a1 - low_pass.a2);
+  EXPECT_EQ(dc_gain, 1.0);
+  for (size_t i = out.size() - 48000; i < out.size(); i++) {
+    ASSERT_EQ(out[i], step) << i;
+  }
+
+  // Both come back to silence, without limit cycles.
+  for (const BiquadCoeffs *section : {&high_pass, &low_pass}) {
+    cascade.configure(section, 1);
+    run(cascade, 48000, step);
+    out = run(cascade, 5 * 48000, 0);
+    for (size_t i = out.size() - 48000; i < out.size(); i++) {
+      ASSERT_EQ(out[i], 0) << i;
+    }
+  }
+
+  // And their response is the one designed, down to the cutoff.
+  for (double hz : {5.0, 20.0, 100.0}) {
+    cascade.reset();
+    cascade.configure(&high_pass, 1);
+    EXPECT_NEAR(measureDb(cascade, hz, 0.25, 2.0), responseDb(high_pass, hz),
+                0.02)
+        << hz << " Hz";
+  }
+  for (double hz : {10.0, 40.0}) {
+    cascade.reset();
+    cascade.configure(&low_pass, 1);
+    EXPECT_NEAR(measureDb(cascade, hz, 0.25, 2.0), responseDb(low_pass, hz),
+                0.02)
+        << hz << " Hz";
+  }
+}
+
+TEST(BiquadTests, sections_saturate) {
+  // +12 dB at 1 kHz on a full scale 1 kHz sine clips, rather than wraps.
+  const BiquadCoeffs peak = biquad::Peak(1000.0, 1.0, 12.0, kSampleRate);
+  BiquadCascade cascade;
+  cascade.configure(&peak, 1);
+  double w = 2.0 * std::numbers::pi * 1000.0 / kSampleRate;
+  int32_t top = 0;
+  int32_t bottom = 0;
+  for (uint32_t done = 0; done < 48000; done += kBlockFrames) {
+    Block block;
+    for (uint32_t i = 0; i < kBlockFrames; i++) {
+      block[2 * i] = block[2 * i + 1] = static_cast<int32_t>(
+          kFullScale * std::sin(w * (done + i)));
+    }
+    cascade.process(kBlockFrames, block.data());
+    for (int32_t sample : block) {
+      ASSERT_LE(std::abs(sample), 0x7FFFFF);
+      top = std::max(top, sample);
+      bottom = std::min(bottom, sample);
+    }
+  }
+  EXPECT_EQ(top, 0x7FFFFF);
+  EXPECT_EQ(bottom, -0x7FFFFF);
+}
+
+TEST(BiquadTests, new_coefficients_keep_the_history) {
+  // Changing a section's gain mid-stream moves the output by about the
+  // change in gain, without a jump to silence.
+  const int32_t step = static_cast<int32_t>(0.25 * kFullScale);
+  BiquadCoeffs shelf = biquad::LowShelf(200.0, kButterworthQ, 0.0,
+                                        kSampleRate);
+  BiquadCascade cascade;
+  cascade.configure(&shelf, 1);
+  std::vector<int32_t> out = run(cascade, 48000, step);
+  EXPECT_NEAR(out.back(), step, 1);
+
+  shelf = biquad::LowShelf(200.0, kButterworthQ, -6.0, kSampleRate);
+  cascade.configure(&shelf, 1);
+  out = run(cascade, kBlockFrames, step);
+  EXPECT_GT(out.front(), step / 2);
+  out = run(cascade, 48000, step);
+  EXPECT_NEAR(out.back(), step * std::pow(10.0, -6.0 / 20.0), 2.0);
+}
+
+// Cost per section per stereo frame of a cascade over a block.
+TEST(BiquadBenchmark, cycles_per_section_per_frame) {
+  constexpr uint64_t kBlocks = 200000;
+  std::mt19937 rng(1);
+  Block block;
+  for (int32_t &sample : block) {
+    sample = static_cast<int32_t>(rng() % 0xFFFFFF) - 0x7FFFFF;
+  }
+
+  std::array<BiquadCoeffs, BiquadCascade::kMaxSections> sections;
+  for (size_t s = 0; s < sections.size(); s++) {
+    sections[s] = biquad::Peak(100.0 * static_cast<double>(s + 1), 1.0, -3.0,
+                               kSampleRate);
+  }
+  for (size_t count : {1, 4, 8}) {
+    BiquadCascade cascade;
+    cascade.configure(sections.data(), count);
+    Block work = block;
+    double cycles = bench::measure(kBlocks, [&]() {
+      work = block;
+      cascade.process(kBlockFrames, work.data());
+    });
+    std::string label =
+        "BiquadCascade (" + std::to_string(count) + " sections)";
+    bench::report(label.c_str(),
+                  cycles / static_cast<double>(count * kBlockFrames),
+                  "section frame");
+  }
+}
@@ -0,0 +1,264 @@
+#include <array>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "audio/clock.hpp"
+#include "audio/routines/click.hpp"
+#include "audio/scheduler.hpp"
+#include "errors.hpp"
+#include "log_encoding.hpp"
+#include "params.hpp"
+
+using deloop::audio_clock::kSubFrames;
+using deloop::audio_clock::Position;
+using deloop::audio_scheduler::kNumChannels;
+
+namespace {
+
+constexpr uint32_t kBlockFrames = 32;
+
+const uint32_t kBpmId = deloop::LogSiteId(FNV1A_64("clock.bpm"));
+const uint32_t kBeatsPerBarId =
+    deloop::LogSiteId(FNV1A_64("clock.beats_per_bar"));
+const uint32_t kClickLevelId = deloop::LogSiteId(FNV1A_64("click.level"));
+
+struct Beat {
+  uint64_t frame;
+  uint32_t beat_in_bar;
+};
+
+std::vector<Beat> beats;
+bool event_ran = false;
+uint64_t event_seen_at = 0;
+
+deloop::Error clearOutput(uint32_t num_frames, int32_t *tx, int32_t *rx) {
+  (void)rx;
+  std::fill(tx, tx + num_frames * kNumChannels, 0);
+  return deloop::Error::kOk;
+}
+
+// Records every beat the clock reports, the way a processor would see it.
+deloop::Error recordBeats(uint32_t num_frames, int32_t *tx, int32_t *rx) {
+  (void)tx;
+  (void)rx;
+  const Position &pos = deloop::audio_clock::position();
+  EXPECT_EQ(pos.frame, deloop::audio_scheduler::getCallbackFrame());
+
+  uint32_t offset = 0;
+  if (deloop::audio_clock::beatInBlock(pos, num_frames, offset)) {
+    beats.push_back(
+        {pos.frame + offset, deloop::audio_clock::beatInBar(pos, offset)});
+  }
+
+  if (event_ran && event_seen_at == 0) {
+    event_seen_at = pos.frame;
+  }
+  return deloop::Error::kOk;
+}
+
+void markEvent(uint32_t arg) {
+  (void)arg;
+  event_ran = true;
+}
+
+class ClockTests : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    ASSERT_EQ(deloop::params::init(), deloop::Error::kOk);
+    ASSERT_EQ(deloop::audio_scheduler::init(), deloop::Error::kOk);
+    for (auto callback : {deloop::audio_clock::process, clearOutput,
+                          recordBeats, tx_click}) {
+      ASSERT_EQ(deloop::audio_scheduler::registerCallback(callback),
+                deloop::Error::kOk);
+    }
+  }
+
+  void SetUp() override {
+    set(kClickLevelId, 0.0f);
+    beats.clear();
+    event_ran = false;
+    event_seen_at = 0;
+    run(1);
+  }
+
+  static void set(uint32_t id, float value) {
+    deloop::ParamUpdate update[] = {{id, value}};
+    ASSERT_EQ(deloop::params::set(update), deloop::Error::kOk);
+  }
+
+  // Processes `num_blocks` blocks, returning the left channel of the last.
+  static std::array<int32_t, kBlockFrames> run(int num_blocks) {
+    std::array<int32_t, kBlockFrames * kNumChannels> tx;
+    std::array<int32_t, kBlockFrames * kNumChannels> rx = {};
+    std::array<int32_t, kBlockFrames> left = {};
+    for (int block = 0; block < num_blocks; block++) {
+      EXPECT_EQ(deloop::audio_scheduler::process(kBlockFrames, tx.data(),
+                                                 rx.data()),
+                deloop::Error::kOk);
+    }
+    for (uint32_t i = 0; i < kBlockFrames; i++) {
+      EXPECT_EQ(tx[i * kNumChannels], tx[i * kNumChannels + 1]);
+      left[i] = tx[i * kNumChannels];
+    }
+    return left;
+  }
+
+  // Processes blocks until the next beat lands in one.
+  static std::array<int32_t, kBlockFrames> runToBeat() {
+    size_t seen = beats.size();
+    std::array<int32_t, kBlockFrames> left;
+    while (beats.size() == seen) {
+      left = run(1);
+    }
+    return left;
+  }
+};
+
+} // namespace
+
+TEST_F(ClockTests, beats_land_on_exact_frames_without_drift) {
+  // 137 BPM is not a whole number of frames per beat.
+  set(kBpmId, 137.0f);
+  run(1);
+  beats.clear();
+
+  Position pos = deloop::audio_clock::getPosition();
+  EXPECT_EQ(pos.sub_frames_per_beat,
+            static_cast<uint32_t>(48000.0f * 60.0f * 256.0f / 137.0f));
+  for (int i = 0; i < 50; i++) {
+    runToBeat();
+  }
+
+  for (uint64_t k = 0; k < beats.size(); k++) {
+    ASSERT_EQ(beats[k].frame,
+              (pos.next_beat + k * pos.sub_frames_per_beat) / kSubFrames)
+        << "beat " << k;
+  }
+}
+
+TEST_F(ClockTests, bars_follow_meter_and_quantize) {
+  set(kBpmId, 300.0f);
+  set(kBeatsPerBarId, 3.0f);
+  runToBeat();
+  runToBeat();
+
+  Position pos = deloop::audio_clock::getPosition();
+  uint64_t bar = deloop::audio_clock::nextBarFrame(pos, pos.frame + 1);
+  uint64_t beat = deloop::audio_clock::nextBeatFrame(pos, pos.frame + 1);
+  EXPECT_LE(beat, bar);
+  EXPECT_EQ(beat, pos.next_beat / kSubFrames);
+
+  beats.clear();
+  for (int i = 0; i < 7; i++) {
+    runToBeat();
+  }
+  for (size_t i = 1; i < beats.size(); i++) {
+    EXPECT_EQ(beats[i].beat_in_bar, (beats[i - 1].beat_in_bar + 1) % 3);
+  }
+
+  bool found = false;
+  for (const Beat &b : beats) {
+    if (b.beat_in_bar == 0) {
+      EXPECT_EQ(b.frame, bar);
+      found = true;
+      break;
+    }
+  }
+  EXPECT_TRUE(found);
+
+  // A bar boundary is its own quantized frame.
+  EXPECT_EQ(deloop::audio_clock::nextBarFrame(pos, bar), bar);
+  EXPECT_EQ(deloop::audio_clock::nextBarFrame(pos, bar + 1),
+            bar + 3 * pos.sub_frames_per_beat / kSubFrames);
+  set(kBeatsPerBarId, 4.0f);
+}
+
+TEST_F(ClockTests, lowering_the_meter_past_the_beat_starts_a_bar) {
+  set(kBpmId, 300.0f);
+  set(kBeatsPerBarId, 6.0f);
+  do {
+    runToBeat();
+    run(1);
+  } while (deloop::audio_clock::getPosition().beat_in_bar != 4);
+
+  // On the fifth beat of six, the meter drops to four, so the next beat is
+  // a downbeat, to processors and to the clock alike.
+  set(kBeatsPerBarId, 4.0f);
+  uint64_t bar = deloop::audio_clock::getPosition().bar;
+  runToBeat();
+  EXPECT_EQ(beats.back().beat_in_bar, 0);
+  run(1);
+  Position pos = deloop::audio_clock::getPosition();
+  EXPECT_EQ(pos.beat_in_bar, 0);
+  EXPECT_EQ(pos.bar, bar + 1);
+}
+
+TEST_F(ClockTests, tempo_change_keeps_beat_phase) {
+  set(kBpmId, 120.0f);
+  runToBeat();
+
+  // A quarter of the way into the beat, halve the tempo.
+  run(24000 / 4 / kBlockFrames);
+  Position pos = deloop::audio_clock::getPosition();
+  uint64_t now = deloop::audio_scheduler::getFrameTime();
+  uint64_t remaining = pos.next_beat - now * kSubFrames;
+  ASSERT_NEAR(static_cast<double>(remaining / kSubFrames), 18000.0,
+              kBlockFrames);
+
+  set(kBpmId, 60.0f);
+  beats.clear();
+  runToBeat();
+  EXPECT_EQ(beats[0].frame, now + 2 * remaining / kSubFrames);
+}
+
+TEST_F(ClockTests, event_on_bar_boundary_runs_on_the_downbeat) {
+  set(kBpmId, 240.0f);
+  run(1);
+  Position pos = deloop::audio_clock::getPosition();
+  uint64_t bar = deloop::audio_clock::nextBarFrame(
+      pos, deloop::audio_scheduler::getFrameTime());
+  ASSERT_EQ(deloop::audio_scheduler::postEvent({bar, markEvent, 0}),
+            deloop::Error::kOk);
+
+  beats.clear();
+  while (event_seen_at == 0) {
+    run(1);
+  }
+  EXPECT_EQ(event_seen_at, bar);
+  ASSERT_FALSE(beats.empty());
+  EXPECT_EQ(beats.back().frame, bar);
+  EXPECT_EQ(beats.back().beat_in_bar, 0);
+}
+
+TEST_F(ClockTests, click_starts_on_the_beat_frame) {
+  set(kBpmId, 120.0f);
+  runToBeat();
+  set(kClickLevelId, 1.0f);
+  run(1);
+
+  std::array<int32_t, kBlockFrames> left = runToBeat();
+  uint64_t block_start = deloop::audio_scheduler::getFrameTime() -
+                         kBlockFrames;
+  uint32_t offset = static_cast<uint32_t>(beats.back().frame - block_start);
+  for (uint32_t i = 0; i < offset; i++) {
+    EXPECT_EQ(left[i], 0) << "frame " << i;
+  }
+  EXPECT_GT(left[offset], 0);
+
+  // The click has died away long before the next beat.
+  run(24000 / kBlockFrames / 2);
+  std::array<int32_t, kBlockFrames> tail = run(1);
+  for (int32_t sample : tail) {
+    EXPECT_EQ(sample, 0);
+  }
+}
+
+TEST_F(ClockTests, silent_click_leaves_output_untouched) {
+  set(kBpmId, 300.0f);
+  for (int i = 0; i < 3; i++) {
+    for (int32_t sample : runToBeat()) {
+      ASSERT_EQ(sample, 0);
+    }
+  }
+}
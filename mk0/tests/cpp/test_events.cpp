@@ -0,0 +1,136 @@
+#include <array>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "audio/scheduler.hpp"
+#include "errors.hpp"
+
+using deloop::audio_scheduler::Event;
+using deloop::audio_scheduler::kNumChannels;
+
+namespace {
+
+constexpr uint32_t kBlockFrames = 32;
+
+// State changed by events and written into every frame by the callback, so
+// the output shows the exact frame each event took effect on.
+int32_t level = 0;
+std::vector<uint32_t> sub_blocks;
+
+void setLevel(uint32_t arg) { level = static_cast<int32_t>(arg); }
+
+deloop::Error writeLevel(uint32_t num_frames, int32_t *tx, int32_t *rx) {
+  (void)rx;
+  sub_blocks.push_back(num_frames);
+  for (uint32_t i = 0; i < num_frames * kNumChannels; i++) {
+    tx[i] = level;
+  }
+  return deloop::Error::kOk;
+}
+
+class EventTests : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    ASSERT_EQ(deloop::audio_scheduler::init(), deloop::Error::kOk);
+    ASSERT_EQ(deloop::audio_scheduler::registerCallback(writeLevel),
+              deloop::Error::kOk);
+  }
+
+  void SetUp() override {
+    level = 0;
+    sub_blocks.clear();
+  }
+
+  // Processes `num_blocks` blocks and returns the left channel of each
+  // frame.
+  std::vector<int32_t> run(int num_blocks) {
+    std::vector<int32_t> output;
+    std::array<int32_t, kBlockFrames * kNumChannels> tx;
+    std::array<int32_t, kBlockFrames * kNumChannels> rx = {};
+    for (int block = 0; block < num_blocks; block++) {
+      EXPECT_EQ(deloop::audio_scheduler::process(kBlockFrames, tx.data(),
+                                                 rx.data()),
+                deloop::Error::kOk);
+      for (uint32_t i = 0; i < kBlockFrames; i++) {
+        EXPECT_EQ(tx[i * kNumChannels], tx[i * kNumChannels + 1]);
+        output.push_back(tx[i * kNumChannels]);
+      }
+    }
+    return output;
+  }
+};
+
+} // namespace
+
+TEST_F(EventTests, frame_time_counts_processed_frames) {
+  uint64_t start = deloop::audio_scheduler::getFrameTime();
+  run(3);
+  EXPECT_EQ(deloop::audio_scheduler::getFrameTime(), start + 3 * kBlockFrames);
+}
+
+TEST_F(EventTests, events_apply_on_their_exact_frame) {
+  uint64_t start = deloop::audio_scheduler::getFrameTime();
+  // Out of order, mid-block, on a block boundary and on the last frame.
+  ASSERT_EQ(deloop::audio_scheduler::postEvent({start + 45, setLevel, 2}),
+            deloop::Error::kOk);
+  ASSERT_EQ(deloop::audio_scheduler::postEvent({start + 10, setLevel, 1}),
+            deloop::Error::kOk);
+  ASSERT_EQ(deloop::audio_scheduler::postEvent({start + 64, setLevel, 3}),
+            deloop::Error::kOk);
+  ASSERT_EQ(deloop::audio_scheduler::postEvent({start + 95, setLevel, 4}),
+            deloop::Error::kOk);
+
+  std::vector<int32_t> output = run(3);
+  for (uint32_t frame = 0; frame < output.size(); frame++) {
+    int32_t expected = frame < 10 ? 0 : frame < 45 ? 1 : frame < 64 ? 2
+                                   : frame < 95    ? 3
+                                                   : 4;
+    ASSERT_EQ(output[frame], expected) << "frame " << frame;
+  }
+
+  // Blocks are split only where events fall.
+  EXPECT_EQ(sub_blocks,
+            (std::vector<uint32_t>{10, 22, 13, 19, 31, 1}));
+}
+
+TEST_F(EventTests, late_events_apply_at_block_start) {
+  run(1);
+  uint64_t now = deloop::audio_scheduler::getFrameTime();
+  ASSERT_EQ(deloop::audio_scheduler::postEvent({now - 5, setLevel, 7}),
+            deloop::Error::kOk);
+
+  std::vector<int32_t> output = run(1);
+  EXPECT_EQ(output.front(), 7);
+  EXPECT_EQ(sub_blocks.back(), kBlockFrames);
+}
+
+TEST_F(EventTests, same_frame_events_keep_post_order) {
+  uint64_t at = deloop::audio_scheduler::getFrameTime() + 3;
+  ASSERT_EQ(deloop::audio_scheduler::postEvent({at, setLevel, 1}),
+            deloop::Error::kOk);
+  ASSERT_EQ(deloop::audio_scheduler::postEvent({at, setLevel, 2}),
+            deloop::Error::kOk);
+
+  std::vector<int32_t> output = run(1);
+  EXPECT_EQ(output[2], 0);
+  EXPECT_EQ(output[3], 2);
+}
+
+TEST_F(EventTests, full_queue_rejects_events) {
+  uint64_t far = deloop::audio_scheduler::getFrameTime() + 1000000;
+  for (size_t i = 0; i < deloop::audio_scheduler::kMaxPendingEvents; i++) {
+    ASSERT_EQ(deloop::audio_scheduler::postEvent({far, setLevel, 0}),
+              deloop::Error::kOk);
+  }
+  EXPECT_EQ(deloop::audio_scheduler::postEvent({far, setLevel, 0}),
+            deloop::Error::kSchedulerEventsFull);
+
+  // Events still wait in the sorted list after the audio task takes them.
+  run(1);
+  EXPECT_EQ(deloop::audio_scheduler::postEvent({far, setLevel, 0}),
+            deloop::Error::kSchedulerEventsFull);
+
+  EXPECT_EQ(deloop::audio_scheduler::postEvent({far, nullptr, 0}),
+            deloop::Error::kInvalidArgument);
+}
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <gtest/gtest.h>
+
+#include "util/lane.hpp"
+
+namespace {
+
+struct Packet {
+  uint32_t id;
+  uint32_t enqueued_at;
+};
+
+enum LaneIndex : size_t { kCommand, kError, kTelemetry, kInfo, kNumLanes };
+
+} // namespace
+
+TEST(LaneTests, fifo_order) {
+  std::array<int, 4> storage;
+  deloop::Lane<int> lane;
+  lane.init(storage.data(), storage.size(), deloop::DropPolicy::kDropNewest);
+
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(lane.push(i));
+  }
+
+  int item = -1;
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(lane.pop(item));
+    EXPECT_EQ(item, i);
+  }
+  EXPECT_FALSE(lane.pop(item));
+  EXPECT_TRUE(lane.empty());
+}
+
+TEST(LaneTests, drop_newest_rejects_when_full) {
+  std::array<int, 2> storage;
+  deloop::Lane<int> lane;
+  lane.init(storage.data(), storage.size(), deloop::DropPolicy::kDropNewest);
+
+  EXPECT_TRUE(lane.push(1));
+  EXPECT_TRUE(lane.push(2));
+  EXPECT_FALSE(lane.push(3));
+  EXPECT_EQ(lane.takeDropped(), 1u);
+  EXPECT_EQ(lane.takeDropped(), 0u);
+  EXPECT_EQ(lane.totalDropped(), 1u);
+
+  int item = 0;
+  ASSERT_TRUE(lane.pop(item));
+  EXPECT_EQ(item, 1);
+}
+
+TEST(LaneTests, drop_oldest_evicts_head) {
+  std::array<int, 2> storage;
+  deloop::Lane<int> lane;
+  lane.init(storage.data(), storage.size(), deloop::DropPolicy::kDropOldest);
+
+  EXPECT_TRUE(lane.push(1));
+  EXPECT_TRUE(lane.push(2));
+  EXPECT_TRUE(lane.push(3));
+  EXPECT_EQ(lane.takeDropped(), 1u);
+
+  int item = 0;
+  ASSERT_TRUE(lane.pop(item));
+  EXPECT_EQ(item, 2);
+  ASSERT_TRUE(lane.pop(item));
+  EXPECT_EQ(item, 3);
+}
+
+TEST(LaneTests, block_rejects_without_counting) {
+  std::array<int, 1> storage;
+  deloop::Lane<int> lane;
+  lane.init(storage.data(), storage.size(), deloop::DropPolicy::kBlock);
+
+  EXPECT_TRUE(lane.push(1));
+  EXPECT_FALSE(lane.push(2));
+  EXPECT_EQ(lane.totalDropped(), 0u);
+
+  // The producer decides when it has given up.
+  lane.countDrop();
+  EXPECT_EQ(lane.takeDropped(), 1u);
+}
+
+TEST(LaneTests, pop_highest_priority_first) {
+  std::array<int, 2> storage_a;
+  std::array<int, 2> storage_b;
+  deloop::Lane<int> lanes[2];
+  lanes[0].init(storage_a.data(), storage_a.size(),
+                deloop::DropPolicy::kDropNewest);
+  lanes[1].init(storage_b.data(), storage_b.size(),
+                deloop::DropPolicy::kDropNewest);
+
+  lanes[1].push(10);
+  lanes[0].push(20);
+
+  int item = 0;
+  EXPECT_EQ(deloop::popHighestPriority(lanes, 2, item), 0u);
+  EXPECT_EQ(item, 20);
+  EXPECT_EQ(deloop::popHighestPriority(lanes, 2, item), 1u);
+  EXPECT_EQ(item, 10);
+  EXPECT_EQ(deloop::popHighestPriority(lanes, 2, item), 2u);
+}
+
+// Models the UART stream task: the link drains one packet per tick while
+// producers flood info logs at several times the link rate. Command responses
+// must still go out within a bounded number of ticks, and every flooded log
+// must be either sent or counted as dropped.
+TEST(LaneTests, command_latency_bounded_under_log_flood) {
+  constexpr uint32_t kTicks = 10000;
+  constexpr uint32_t kLogsPerTick = 4;
+  constexpr uint32_t kCommandPeriod = 37;
+
+  std::array<Packet, 4> command_storage;
+  std::array<Packet, 8> error_storage;
+  std::array<Packet, 4> telemetry_storage;
+  std::array<Packet, 8> info_storage;
+  deloop::Lane<Packet> lanes[kNumLanes];
+  lanes[kCommand].init(command_storage.data(), command_storage.size(),
+                       deloop::DropPolicy::kBlock);
+  lanes[kError].init(error_storage.data(), error_storage.size(),
+                     deloop::DropPolicy::kDropNewest);
+  lanes[kTelemetry].init(telemetry_storage.data(), telemetry_storage.size(),
+                         deloop::DropPolicy::kDropOldest);
+  lanes[kInfo].init(info_storage.data(), info_storage.size(),
+                    deloop::DropPolicy::kDropOldest);
+
+  uint32_t logs_pushed = 0;
+  uint32_t logs_sent = 0;
+  uint32_t commands_sent = 0;
+  uint32_t max_command_latency = 0;
+
+  for (uint32_t tick = 0; tick < kTicks; tick++) {
+    for (uint32_t i = 0; i < kLogsPerTick; i++) {
+      lanes[kInfo].push(Packet{logs_pushed++, tick});
+    }
+
+    if (tick % kCommandPeriod == 0) {
+      ASSERT_TRUE(lanes[kCommand].push(Packet{tick, tick}));
+    }
+
+    Packet packet = {};
+    size_t lane = deloop::popHighestPriority(lanes, kNumLanes, packet);
+    if (lane == kCommand) {
+      commands_sent++;
+      max_command_latency =
+          std::max(max_command_latency, tick - packet.enqueued_at);
+    } else if (lane == kInfo) {
+      logs_sent++;
+    }
+  }
+
+  EXPECT_EQ(commands_sent, (kTicks + kCommandPeriod - 1) / kCommandPeriod);
+  EXPECT_LE(max_command_latency, 1u);
+
+  uint32_t logs_queued = static_cast<uint32_t>(lanes[kInfo].size());
+  EXPECT_EQ(logs_pushed,
+            logs_sent + lanes[kInfo].totalDropped() + logs_queued);
+  EXPECT_GT(lanes[kInfo].totalDropped(), 0u);
+}
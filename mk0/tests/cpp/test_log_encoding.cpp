@@ -0,0 +1,184 @@
+#include <array>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <pb_encode.h>
+#include <vector>
+
+#include "bench.hpp"
+#include "log_encoding.hpp"
+#include "logging.hpp"
+#include "stream.pb.h"
+
+namespace {
+
+// Folds to site ID 0x00000003.
+constexpr uint64_t kHash = 0x0000000100000002;
+
+deloop::LogEntry makeEntry(deloop::LogLevel level, uint32_t timestamp,
+                           const std::array<deloop::LogArg, 4> &args,
+                           uint32_t suppressed = 0) {
+  return deloop::LogEntry{level, kHash, args, suppressed, timestamp};
+}
+
+// Must match `tests/python/test_log_encoding.py`.
+const std::vector<uint8_t> kGoldenBatch = {
+    0xE8, 0x07,                   // Base timestamp: 1000
+    0x04,                         // INFO, 1 arg
+    0x03, 0x00, 0x00, 0x00,       // Site ID
+    0x00,                         // Delta: 0
+    0x01,                         // Arg types: u32
+    0x05,                         // 5
+    0x2A,                         // ERROR, 2 args, suppressed
+    0x03, 0x00, 0x00, 0x00,       // Site ID
+    0x14,                         // Delta: +10
+    0x0E,                         // Arg types: i32, f32
+    0x03,                         // -2
+    0x00, 0x00, 0x80, 0x3F,       // 1.0f
+    0x03,                         // Suppressed: 3
+};
+
+std::vector<deloop::LogEntry> goldenEntries() {
+  return {
+      makeEntry(deloop::LogLevel::INFO, 1000,
+                deloop::CreateLogArgs(static_cast<uint32_t>(5))),
+      makeEntry(deloop::LogLevel::ERROR, 1010,
+                deloop::CreateLogArgs(static_cast<int32_t>(-2), 1.0f), 3),
+  };
+}
+
+// Encodes an entry the way the stream used to: one `StreamPacket` per record.
+size_t encodeAsStreamPacket(const deloop::LogEntry &entry, uint8_t *buffer,
+                            size_t capacity) {
+  StreamPacket packet = StreamPacket_init_zero;
+  packet.which_payload = StreamPacket_log_tag;
+  LogRecord &record = packet.payload.log;
+  record.level = LogLevel_INFO;
+  record.tick = entry.timestamp;
+  record.hash = entry.hash;
+  record.suppressed = entry.suppressed;
+  for (const deloop::LogArg &arg : entry.args) {
+    if (arg.type == deloop::LogArg::Type::kUnset) {
+      break;
+    }
+    LogRecord_Arg &out = record.args[record.args_count++];
+    out.which_value = LogRecord_Arg_u32_tag;
+    out.value.u32 = arg.value.u32;
+  }
+
+  pb_ostream_t stream = pb_ostream_from_buffer(buffer, capacity);
+  pb_encode(&stream, StreamPacket_fields, &packet);
+  return stream.bytes_written + 2; // Start and length bytes.
+}
+
+} // namespace
+
+TEST(LogEncodingTests, golden_batch) {
+  std::array<uint8_t, 64> buffer;
+  deloop::LogBatchEncoder encoder;
+  encoder.init(buffer.data(), buffer.size());
+
+  for (const deloop::LogEntry &entry : goldenEntries()) {
+    ASSERT_TRUE(encoder.append(entry));
+  }
+
+  EXPECT_EQ(encoder.count(), 2u);
+  std::vector<uint8_t> encoded(encoder.data(),
+                               encoder.data() + encoder.size());
+  EXPECT_EQ(encoded, kGoldenBatch);
+}
+
+TEST(LogEncodingTests, negative_timestamp_delta) {
+  std::array<uint8_t, 32> buffer;
+  deloop::LogBatchEncoder encoder;
+  encoder.init(buffer.data(), buffer.size());
+
+  // Records from different lanes can be sent out of submission order.
+  ASSERT_TRUE(encoder.append(makeEntry(deloop::LogLevel::INFO, 5, {})));
+  ASSERT_TRUE(encoder.append(makeEntry(deloop::LogLevel::INFO, 4, {})));
+
+  const std::vector<uint8_t> expected = {
+      0x05, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x03, 0x00, 0x00, 0x00, 0x01,
+  };
+  std::vector<uint8_t> encoded(encoder.data(),
+                               encoder.data() + encoder.size());
+  EXPECT_EQ(encoded, expected);
+}
+
+TEST(LogEncodingTests, full_batch_rejects_record_unchanged) {
+  std::array<uint8_t, 12> buffer;
+  deloop::LogBatchEncoder encoder;
+  encoder.init(buffer.data(), buffer.size());
+
+  auto entry = makeEntry(deloop::LogLevel::INFO, 1000, {});
+  ASSERT_TRUE(encoder.append(entry)); // 8 bytes with the base timestamp.
+  size_t size = encoder.size();
+  EXPECT_FALSE(encoder.append(entry));
+  EXPECT_EQ(encoder.size(), size);
+  EXPECT_EQ(encoder.count(), 1u);
+
+  // A fresh batch starts over with a base timestamp.
+  encoder.reset();
+  EXPECT_TRUE(encoder.empty());
+  ASSERT_TRUE(encoder.append(entry));
+  EXPECT_EQ(encoder.size(), size);
+}
+
+TEST(LogEncodingTests, worst_case_record_fits_max_size) {
+  std::array<uint8_t, 5 + deloop::LogBatchEncoder::kMaxRecordSize> buffer;
+  deloop::LogBatchEncoder encoder;
+  encoder.init(buffer.data(), buffer.size());
+
+  auto entry = makeEntry(
+      deloop::LogLevel::ERROR, 0xFFFFFFFF,
+      deloop::CreateLogArgs(0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu,
+                            0xFFFFFFFFu),
+      0xFFFFFFFF);
+  EXPECT_TRUE(encoder.append(entry));
+}
+
+TEST(LogEncodingTests, benchmark_against_stream_packet) {
+  constexpr size_t kRecords = 1000;
+  auto entry = makeEntry(
+      deloop::LogLevel::INFO, 0,
+      deloop::CreateLogArgs(static_cast<uint32_t>(48000),
+                            static_cast<uint32_t>(64)));
+
+  std::array<uint8_t, StreamPacket_size + 2> packet_buffer;
+  size_t packet_bytes = 0;
+  double packet_cost = bench::measure(kRecords, [&]() {
+    entry.timestamp += 3;
+    packet_bytes = encodeAsStreamPacket(entry, packet_buffer.data(),
+                                        packet_buffer.size());
+  });
+
+  // Batches sized as in the stream task, including their frame header.
+  std::array<uint8_t, 128> batch_buffer;
+  deloop::LogBatchEncoder encoder;
+  encoder.init(batch_buffer.data(), batch_buffer.size());
+  size_t batch_bytes = 0;
+  size_t batch_records = 0;
+  entry.timestamp = 0;
+  double batch_cost = bench::measure(kRecords, [&]() {
+    entry.timestamp += 3;
+    if (!encoder.append(entry)) {
+      batch_bytes += encoder.size() + 2;
+      batch_records += encoder.count();
+      encoder.reset();
+      encoder.append(entry);
+    }
+  });
+  batch_bytes += encoder.size() + 2;
+  batch_records += encoder.count();
+
+  bench::report("StreamPacket per record", packet_cost, "log");
+  bench::report("LogBatchEncoder::append", batch_cost, "log");
+  std::printf("[ BENCH    ] %-48s %10zu bytes/log\n", "StreamPacket per record",
+              packet_bytes);
+  std::printf("[ BENCH    ] %-48s %10.2f bytes/log\n",
+              "LogBatchEncoder (128 byte batches)",
+              static_cast<double>(batch_bytes) /
+                  static_cast<double>(batch_records));
+
+  EXPECT_LT(batch_bytes, packet_bytes * batch_records);
+}
@@ -0,0 +1,140 @@
+#include <array>
+#include <cstdint>
+#include <gtest/gtest.h>
+
+#include "bench.hpp"
+#include "logging.hpp"
+
+namespace {
+
+uint32_t submitted = 0;
+uint32_t last_suppressed = 0;
+uint32_t fake_time_ms = 0;
+
+uint32_t fakeClock(void) { return fake_time_ms; }
+
+class LoggingTests : public ::testing::Test {
+protected:
+  void SetUp() override {
+    submitted = 0;
+    last_suppressed = 0;
+    fake_time_ms = 0;
+    deloop::SetLogLevel(deloop::LogLevel::INFO);
+    deloop::SetLogModuleMask(deloop::kAllLogModules);
+    deloop::SetLogClock(nullptr);
+  }
+};
+
+} // namespace
+
+void deloop::SubmitLog(deloop::LogLevel level, const uint64_t hash,
+                       const std::array<LogArg, 4> &args,
+                       uint32_t suppressed) {
+  (void)level;
+  (void)hash;
+  (void)args;
+  submitted++;
+  last_suppressed = suppressed;
+}
+
+TEST_F(LoggingTests, level_filter) {
+  deloop::SetLogLevel(deloop::LogLevel::WARNING);
+
+  DELOOP_LOG_INFO("filtered");
+  EXPECT_EQ(submitted, 0u);
+
+  DELOOP_LOG_WARNING("not filtered");
+  DELOOP_LOG_ERROR("not filtered either");
+  EXPECT_EQ(submitted, 2u);
+}
+
+TEST_F(LoggingTests, module_filter) {
+  uint32_t core = 1u << static_cast<uint32_t>(deloop::LogModule::kCore);
+
+  deloop::SetLogModuleMask(deloop::kAllLogModules & ~core);
+  DELOOP_LOG_ERROR("filtered");
+  EXPECT_EQ(submitted, 0u);
+
+  deloop::SetLogModuleMask(core);
+  DELOOP_LOG_ERROR("not filtered");
+  EXPECT_EQ(submitted, 1u);
+}
+
+TEST_F(LoggingTests, filtered_args_not_evaluated) {
+  int evaluated = 0;
+  auto arg = [&evaluated]() { return ++evaluated; };
+
+  deloop::SetLogLevel(deloop::LogLevel::ERROR);
+  DELOOP_LOG_INFO("value: %d", arg());
+  EXPECT_EQ(evaluated, 0);
+}
+
+TEST_F(LoggingTests, rate_limit_reports_suppressed) {
+  deloop::SetLogClock(fakeClock);
+  fake_time_ms = 1000;
+
+  auto log = []() { DELOOP_LOG_INFO("repeated"); };
+  for (uint32_t i = 0; i < deloop::LogRateLimiter::kBurst + 3; i++) {
+    log();
+  }
+  EXPECT_EQ(submitted, deloop::LogRateLimiter::kBurst);
+
+  // One refill period restores one token, and the record that uses it
+  // carries the suppressed count.
+  fake_time_ms += deloop::LogRateLimiter::kRefillPeriodMs;
+  log();
+  log();
+  EXPECT_EQ(submitted, deloop::LogRateLimiter::kBurst + 1);
+  EXPECT_EQ(last_suppressed, 3u);
+
+  // A long pause refills the whole bucket.
+  fake_time_ms += 60000;
+  log();
+  EXPECT_EQ(last_suppressed, 1u);
+  for (uint32_t i = 1; i < deloop::LogRateLimiter::kBurst; i++) {
+    log();
+  }
+  EXPECT_EQ(submitted, 2 * deloop::LogRateLimiter::kBurst + 1);
+  EXPECT_EQ(last_suppressed, 0u);
+}
+
+TEST_F(LoggingTests, rate_limit_is_per_site) {
+  deloop::SetLogClock(fakeClock);
+
+  for (uint32_t i = 0; i < 2 * deloop::LogRateLimiter::kBurst; i++) {
+    DELOOP_LOG_INFO("site A");
+    DELOOP_LOG_INFO("site B");
+  }
+  EXPECT_EQ(submitted, 2 * deloop::LogRateLimiter::kBurst);
+}
+
+TEST_F(LoggingTests, benchmark_call_cost) {
+  constexpr uint64_t kIterations = 10000000;
+  int value = 0;
+
+  deloop::SetLogLevel(deloop::LogLevel::ERROR);
+  bench::report("DELOOP_LOG_INFO (level filtered)",
+                bench::measure(kIterations,
+                               [&]() { DELOOP_LOG_INFO("bench %d", value); }),
+                "call");
+
+  deloop::SetLogLevel(deloop::LogLevel::INFO);
+  deloop::SetLogModuleMask(0);
+  bench::report("DELOOP_LOG_INFO (module filtered)",
+                bench::measure(kIterations,
+                               [&]() { DELOOP_LOG_INFO("bench %d", value); }),
+                "call");
+
+  deloop::SetLogModuleMask(deloop::kAllLogModules);
+  deloop::SetLogClock(fakeClock);
+  bench::report("DELOOP_LOG_INFO (rate limited)",
+                bench::measure(kIterations,
+                               [&]() { DELOOP_LOG_INFO("bench %d", value); }),
+                "call");
+
+  deloop::SetLogClock(nullptr);
+  bench::report("DELOOP_LOG_INFO (submitted)",
+                bench::measure(kIterations,
+                               [&]() { DELOOP_LOG_INFO("bench %d", value); }),
+                "call");
+}
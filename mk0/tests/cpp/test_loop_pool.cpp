@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+#include "audio/loop_pool.hpp"
+#include "bench.hpp"
+
+using deloop::LoopPool;
+using Region = LoopPool::Region;
+
+namespace {
+
+constexpr uint32_t kCapacity = 1024;
+
+// Word `index` of a region filled with `tag`.
+uint32_t pattern(uint32_t tag, uint32_t index) {
+  return tag * 7919 + index;
+}
+
+// Writes the pattern to `count` words of `region`, starting at `first`.
+void fill(LoopPool &pool, Region region, uint32_t tag, uint32_t first,
+          uint32_t count) {
+  for (uint32_t index = first; index < first + count;) {
+    uint32_t contiguous = 0;
+    uint32_t *words = pool.words(region, index, contiguous);
+    uint32_t n = std::min(contiguous, first + count - index);
+    for (uint32_t i = 0; i < n; i++, index++) {
+      words[i] = pattern(tag, index);
+    }
+  }
+}
+
+// Returns the first word of `region` not holding the pattern, or its size.
+uint32_t verify(LoopPool &pool, Region region, uint32_t tag) {
+  for (uint32_t index = 0; index < pool.size(region);) {
+    uint32_t contiguous = 0;
+    const uint32_t *words = pool.words(region, index, contiguous);
+    for (uint32_t i = 0; i < contiguous; i++, index++) {
+      if (words[i] != pattern(tag, index)) {
+        return index;
+      }
+    }
+  }
+  return pool.size(region);
+}
+
+class LoopPoolTests : public ::testing::Test {
+protected:
+  LoopPoolTests() : pool(memory) {}
+
+  Region allocate(uint32_t words, uint32_t tag) {
+    Region region = pool.allocate();
+    EXPECT_NE(region, LoopPool::kNoRegion);
+    EXPECT_TRUE(pool.grow(region, words));
+    fill(pool, region, tag, 0, words);
+    return region;
+  }
+
+  std::array<uint32_t, kCapacity> memory = {};
+  LoopPool pool;
+};
+
+} // namespace
+
+TEST_F(LoopPoolTests, only_the_last_region_grows) {
+  Region a = allocate(100, 1);
+  Region b = allocate(200, 2);
+  EXPECT_FALSE(pool.grow(a, 10));
+  EXPECT_FALSE(pool.grow(b, kCapacity - 299));
+  EXPECT_TRUE(pool.grow(b, kCapacity - 300));
+  EXPECT_EQ(pool.freeWords(), 0);
+  EXPECT_EQ(verify(pool, a, 1), 100);
+}
+
+TEST_F(LoopPoolTests, open_tail_until_sealed_or_freed) {
+  EXPECT_FALSE(pool.tailOpen());
+  Region a = pool.allocate(true);
+  EXPECT_TRUE(pool.tailOpen());
+  pool.seal(a);
+  EXPECT_FALSE(pool.tailOpen());
+
+  Region b = pool.allocate(true);
+  Region c = pool.allocate();
+  EXPECT_FALSE(pool.tailOpen());
+  pool.free(c);
+  EXPECT_TRUE(pool.tailOpen());
+  pool.free(b);
+  EXPECT_FALSE(pool.tailOpen());
+}
+
+TEST_F(LoopPoolTests, runs_out_of_regions) {
+  for (size_t i = 0; i < LoopPool::kMaxRegions; i++) {
+    EXPECT_NE(pool.allocate(), LoopPool::kNoRegion);
+  }
+  EXPECT_EQ(pool.allocate(), LoopPool::kNoRegion);
+}
+
+TEST_F(LoopPoolTests, compaction_keeps_regions_readable_while_moving) {
+  Region a = allocate(300, 1);
+  Region b = allocate(250, 2);
+  Region c = allocate(150, 3);
+  pool.free(a);
+  EXPECT_EQ(pool.freeWords(), kCapacity - 400);
+  EXPECT_EQ(pool.tailWords(), kCapacity - 700);
+
+  // Small steps leave regions part way through a move between calls.
+  uint32_t moved = 0;
+  while (uint32_t n = pool.compact(7)) {
+    EXPECT_LE(n, 7);
+    moved += n;
+    ASSERT_EQ(verify(pool, b, 2), 250);
+    ASSERT_EQ(verify(pool, c, 3), 150);
+  }
+  EXPECT_EQ(moved, 400);
+  EXPECT_EQ(pool.tailWords(), pool.freeWords());
+}
+
+TEST_F(LoopPoolTests, moving_region_keeps_writes_and_growth) {
+  Region a = allocate(300, 1);
+  Region b = allocate(200, 2);
+  pool.free(a);
+  ASSERT_EQ(pool.compact(50), 50);
+
+  // Rewrite across the split and grow at the old end mid-move.
+  fill(pool, b, 4, 0, 200);
+  ASSERT_TRUE(pool.grow(b, 100));
+  fill(pool, b, 4, 200, 100);
+  ASSERT_EQ(verify(pool, b, 4), 300);
+
+  while (pool.compact(64) > 0) {
+  }
+  EXPECT_EQ(verify(pool, b, 4), 300);
+  EXPECT_EQ(pool.tailWords(), kCapacity - 300);
+}
+
+TEST_F(LoopPoolTests, freeing_during_a_move_restarts_cleanly) {
+  Region a = allocate(100, 1);
+  Region b = allocate(100, 2);
+  Region c = allocate(100, 3);
+  pool.free(b);
+  ASSERT_EQ(pool.compact(30), 30);
+  pool.free(a);
+
+  while (pool.compact(16) > 0) {
+    ASSERT_EQ(verify(pool, c, 3), 100);
+  }
+  EXPECT_EQ(pool.tailWords(), kCapacity - 100);
+}
+
+// Replays random looper sessions: tracks record loops of random length a
+// codec block at a time, loops are cleared at random and the pool compacts a
+// fixed budget per scheduler block. Checks every loop stays intact and
+// reports how much memory gaps hold back and what a block of compaction
+// costs.
+TEST(LoopPoolFuzz, random_sessions_stay_intact) {
+  constexpr uint32_t kPoolWords = 8192;
+  constexpr uint32_t kBlockFrames = 32;
+  constexpr uint32_t kBlockWords = 32; // A block of 16-bit stereo frames.
+  constexpr uint32_t kCompactPerBlock = kBlockFrames * 8;
+  constexpr size_t kTracks = 4;
+  constexpr int kBlocks = 200000;
+
+  static std::array<uint32_t, kPoolWords> memory;
+  LoopPool pool(memory);
+  std::mt19937 rng(1234);
+
+  struct Track {
+    Region region = LoopPool::kNoRegion;
+    uint32_t tag = 0;
+    uint32_t target = 0; // Blocks left to record, 0 once closed.
+  };
+  std::array<Track, kTracks> tracks;
+  uint32_t next_tag = 1;
+
+  uint64_t recordings = 0;
+  uint64_t blocked = 0; // Recordings cut short while gaps held free memory.
+  double gap_sum = 0.0;
+  uint32_t gap_max = 0;
+  std::vector<uint64_t> compact_costs; // Of blocks that moved words.
+
+  for (int block = 0; block < kBlocks; block++) {
+    Track &track = tracks[rng() % kTracks];
+    uint32_t action = rng() % 256;
+    if (track.region == LoopPool::kNoRegion && action < 4) {
+      track.region = pool.allocate();
+      track.tag = next_tag++;
+      track.target = 2 + rng() % (kPoolWords / kBlockWords / 2);
+      recordings++;
+    } else if (track.region != LoopPool::kNoRegion && track.target == 0 &&
+               action < 2) {
+      ASSERT_EQ(verify(pool, track.region, track.tag),
+                pool.size(track.region));
+      pool.free(track.region);
+      track.region = LoopPool::kNoRegion;
+    }
+
+    for (Track &t : tracks) {
+      if (t.region == LoopPool::kNoRegion || t.target == 0) {
+        continue;
+      }
+      uint32_t size = pool.size(t.region);
+      if (pool.grow(t.region, kBlockWords)) {
+        fill(pool, t.region, t.tag, size, kBlockWords);
+        t.target--;
+      } else {
+        t.target = 0;
+        if (pool.freeWords() >= kBlockWords) {
+          blocked++;
+        }
+      }
+    }
+
+    uint64_t start = bench::now();
+    if (pool.compact(kCompactPerBlock) > 0) {
+      compact_costs.push_back(bench::now() - start);
+    }
+
+    uint32_t gaps = pool.freeWords() - pool.tailWords();
+    gap_sum += gaps;
+    gap_max = std::max(gap_max, gaps);
+  }
+
+  for (const Track &track : tracks) {
+    if (track.region != LoopPool::kNoRegion) {
+      EXPECT_EQ(verify(pool, track.region, track.tag),
+                pool.size(track.region));
+    }
+  }
+
+  EXPECT_GT(recordings, 100);
+  std::printf("[ BENCH    ] %llu recordings, %llu cut short by gaps\n",
+              static_cast<unsigned long long>(recordings),
+              static_cast<unsigned long long>(blocked));
+  std::printf("[ BENCH    ] Gap words: mean %.1f, max %u of %u\n",
+              gap_sum / kBlocks, gap_max, kPoolWords);
+
+  // The host's worst single call is scheduler noise, so report a high
+  // percentile; the budget bounds the work done on target.
+  ASSERT_FALSE(compact_costs.empty());
+  std::sort(compact_costs.begin(), compact_costs.end());
+  auto percentile = [&](double p) {
+    size_t i = static_cast<size_t>(p * static_cast<double>(
+                                           compact_costs.size() - 1));
+    return static_cast<double>(compact_costs[i]);
+  };
+  std::printf("[ BENCH    ] %zu of %d blocks compacted\n",
+              compact_costs.size(), kBlocks);
+  bench::report("LoopPool::compact (p50)", percentile(0.5), "block");
+  bench::report("LoopPool::compact (p99.9)", percentile(0.999), "block");
+}
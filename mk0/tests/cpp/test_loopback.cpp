@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <gtest/gtest.h>
+#include <numbers>
+#include <vector>
+
+#include "audio/loopback.hpp"
+#include "audio/scheduler.hpp"
+#include "errors.hpp"
+
+namespace loopback = deloop::loopback;
+
+namespace {
+
+// Feeds the output back to the input `delay` frames later, through `filter`,
+// a block of `block_frames` at a time.
+class LoopbackTests : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    ASSERT_EQ(deloop::audio_scheduler::init(), deloop::Error::kOk);
+    ASSERT_EQ(deloop::audio_scheduler::registerCallback(loopback::process),
+              deloop::Error::kOk);
+  }
+
+  // Runs a whole measurement, failing if it never ends.
+  template <typename Filter>
+  loopback::Result measure(uint32_t block_frames, uint32_t delay,
+                           Filter filter) {
+    EXPECT_EQ(loopback::start(), deloop::Error::kOk);
+    std::deque<int32_t> line(delay * 2, 0);
+    std::vector<int32_t> tx(block_frames * 2);
+    std::vector<int32_t> rx(block_frames * 2);
+    for (int block = 0; block < 1000000; block++) {
+      for (int32_t &sample : rx) {
+        sample = line.front();
+        line.pop_front();
+      }
+      std::fill(tx.begin(), tx.end(), 0);
+      EXPECT_EQ(deloop::audio_scheduler::process(block_frames, tx.data(),
+                                                 rx.data()),
+                deloop::Error::kOk);
+      for (size_t i = 0; i < tx.size(); i++) {
+        line.push_back(filter(i % 2, tx[i]));
+      }
+
+      loopback::Result result = loopback::getResult();
+      if (block > 0 && result.state != loopback::State::kRunning) {
+        return result;
+      }
+    }
+    ADD_FAILURE() << "The measurement never ended";
+    return {};
+  }
+};
+
+int32_t wire(size_t channel, int32_t sample) {
+  (void)channel;
+  return sample;
+}
+
+} // namespace
+
+TEST_F(LoopbackTests, idle_leaves_the_output_untouched) {
+  EXPECT_EQ(loopback::getResult().state, loopback::State::kIdle);
+  std::vector<int32_t> tx(64, 1234);
+  std::vector<int32_t> rx(64, 0);
+  ASSERT_EQ(deloop::audio_scheduler::process(32, tx.data(), rx.data()),
+            deloop::Error::kOk);
+  EXPECT_EQ(tx, std::vector<int32_t>(64, 1234));
+}
+
+TEST_F(LoopbackTests, measures_the_delay_for_any_block_size) {
+  for (auto [block_frames, delay] :
+       {std::pair{32u, 100u}, std::pair{16u, 37u}, std::pair{128u, 700u}}) {
+    SCOPED_TRACE(block_frames);
+    loopback::Result result = measure(block_frames, delay, wire);
+    ASSERT_EQ(result.state, loopback::State::kDone);
+    EXPECT_EQ(result.block_frames, block_frames);
+    EXPECT_EQ(result.latency_frames, delay);
+    EXPECT_EQ(result.spread_frames, 0);
+    EXPECT_NEAR(result.peak_db, 20.0f * std::log10(loopback::kImpulseLevel),
+                0.01f);
+    for (size_t band = 0; band < loopback::kNumBands; band++) {
+      EXPECT_NEAR(result.response_db[band], 0.0f, 0.05f)
+          << loopback::kBandHz[band] << " Hz";
+    }
+  }
+}
+
+TEST_F(LoopbackTests, response_follows_the_loop) {
+  // A one-pole low pass at 1 kHz on the left channel only; the right is
+  // not connected.
+  const float a = 1.0f - std::exp(-2.0f * std::numbers::pi_v<float> *
+                                  1000.0f / 48000.0f);
+  float y = 0.0f;
+  auto lowpass = [&](size_t channel, int32_t sample) {
+    if (channel != 0) {
+      return 0;
+    }
+    y += a * (static_cast<float>(sample) - y);
+    return static_cast<int32_t>(y);
+  };
+  loopback::Result result = measure(32, 200, lowpass);
+  ASSERT_EQ(result.state, loopback::State::kDone);
+
+  // The filter's impulse response peaks on its first frame.
+  EXPECT_EQ(result.latency_frames, 200);
+  for (size_t band = 0; band < loopback::kNumBands; band++) {
+    // Exact gain of the one-pole filter.
+    float w = 2.0f * std::numbers::pi_v<float> * loopback::kBandHz[band] /
+              48000.0f;
+    float gain = a / std::sqrt(1.0f - 2.0f * (1.0f - a) * std::cos(w) +
+                               (1.0f - a) * (1.0f - a));
+    std::printf("[ BENCH    ] %7.0f Hz: %6.2f dB (filter %6.2f dB)\n",
+                static_cast<double>(loopback::kBandHz[band]),
+                static_cast<double>(result.response_db[band]),
+                static_cast<double>(20.0f * std::log10(gain)));
+    EXPECT_NEAR(result.response_db[band], 20.0f * std::log10(gain), 0.1f)
+        << loopback::kBandHz[band] << " Hz";
+  }
+}
+
+TEST_F(LoopbackTests, no_loopback_is_reported) {
+  auto open = [](size_t, int32_t) { return 0; };
+  loopback::Result result = measure(32, 100, open);
+  EXPECT_EQ(result.state, loopback::State::kNoSignal);
+}
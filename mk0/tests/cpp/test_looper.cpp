@@ -0,0 +1,867 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <numbers>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "audio/clock.hpp"
+#include "audio/loop_capture.hpp"
+#include "audio/loop_track.hpp"
+#include "audio/looper.hpp"
+#include "audio/resampler.hpp"
+#include "audio/scheduler.hpp"
+#include "bench.hpp"
+#include "errors.hpp"
+#include "log_encoding.hpp"
+#include "params.hpp"
+
+using Action = deloop::LoopTrack::Action;
+using State = deloop::LoopTrack::State;
+using deloop::LoopFormat;
+using deloop::LoopTrack;
+using deloop::looper::Quantize;
+
+namespace {
+
+constexpr uint32_t kBlockFrames = 32;
+constexpr size_t kBlockSamples = kBlockFrames * LoopTrack::kNumChannels;
+constexpr int32_t kFullFeedback = LoopTrack::kUnityFeedback;
+
+using Block = std::array<int32_t, kBlockSamples>;
+using Frames = std::array<int16_t, kBlockSamples>;
+
+// Input whose every sample encodes its frame, exactly representable in the
+// 16-bit loop storage.
+Block ramp(int32_t first) {
+  Block block;
+  for (size_t i = 0; i < kBlockSamples; i++) {
+    block[i] = (first + static_cast<int32_t>(i / 2)) << 8;
+  }
+  return block;
+}
+
+// Runs `track` over `num_frames` of `rx`, returning what it played in 24-bit
+// samples.
+Block render(LoopTrack &track, uint32_t num_frames, const Block &rx,
+             int32_t feedback) {
+  Frames out;
+  Block tx = {};
+  if (track.process(num_frames, out.data(), rx.data(), feedback)) {
+    for (size_t i = 0; i < num_frames * LoopTrack::kNumChannels; i++) {
+      tx[i] = out[i] << 8;
+    }
+  }
+  return tx;
+}
+
+class LoopTrackTests : public ::testing::Test {
+protected:
+  LoopTrackTests() : pool(storage), track(pool) {}
+
+  Block play(const Block &rx = {}) {
+    return render(track, kBlockFrames, rx, kFullFeedback);
+  }
+
+  // Three blocks of 16-bit frames.
+  std::array<uint32_t, 3 * kBlockSamples / 2> storage = {};
+  deloop::LoopPool pool;
+  LoopTrack track;
+};
+
+} // namespace
+
+TEST_F(LoopTrackTests, records_then_plays_in_a_loop) {
+  track.apply(Action::kRecord);
+  EXPECT_EQ(play(ramp(0)), Block{}); // Recording is not played.
+  play(ramp(kBlockFrames));
+  track.apply(Action::kPlay);
+  EXPECT_EQ(track.state(), State::kPlaying);
+  EXPECT_EQ(track.length(), 2 * kBlockFrames);
+
+  EXPECT_EQ(play(), ramp(0));
+  EXPECT_EQ(play(), ramp(kBlockFrames));
+  EXPECT_EQ(play(), ramp(0));
+}
+
+TEST_F(LoopTrackTests, loop_wraps_mid_block) {
+  track.apply(Action::kRecord);
+  render(track, 5, ramp(0), kFullFeedback);
+  track.apply(Action::kPlay);
+
+  Block out = play();
+  for (size_t frame = 0; frame < kBlockFrames; frame++) {
+    ASSERT_EQ(out[2 * frame], static_cast<int32_t>(frame % 5) << 8);
+  }
+  EXPECT_EQ(track.head(), kBlockFrames % 5);
+}
+
+TEST_F(LoopTrackTests, overdub_applies_feedback_in_one_pass) {
+  track.apply(Action::kRecord);
+  play(ramp(100));
+  track.apply(Action::kOverdub);
+  EXPECT_EQ(track.state(), State::kOverdubbing);
+
+  // Half feedback: the pass plays the old loop and stores old / 2 + input.
+  EXPECT_EQ(render(track, kBlockFrames, ramp(1), kFullFeedback / 2),
+            ramp(100));
+
+  track.apply(Action::kPlay);
+  Block out = play();
+  for (size_t frame = 0; frame < kBlockFrames; frame++) {
+    int32_t old = 100 + static_cast<int32_t>(frame);
+    ASSERT_EQ(out[2 * frame], (old / 2 + 1 + static_cast<int32_t>(frame))
+                                  << 8);
+  }
+}
+
+TEST_F(LoopTrackTests, overdubbed_loop_saturates) {
+  track.apply(Action::kRecord);
+  Block loud;
+  loud.fill(0x7FFF00);
+  play(loud);
+  track.apply(Action::kOverdub);
+
+  // The pass plays the old loop; what it stores saturates.
+  EXPECT_EQ(play(loud)[0], INT16_MAX << 8);
+  track.apply(Action::kPlay);
+  EXPECT_EQ(play()[0], INT16_MAX << 8);
+}
+
+TEST_F(LoopTrackTests, recording_closes_when_the_pool_is_full) {
+  track.apply(Action::kRecord);
+  for (int block = 0; block < 3; block++) {
+    play(ramp(block * kBlockFrames));
+  }
+  EXPECT_EQ(pool.freeWords(), 0);
+
+  // The first frame that does not fit closes the loop and plays it.
+  EXPECT_EQ(play(ramp(0)), ramp(0));
+  EXPECT_EQ(track.state(), State::kPlaying);
+  EXPECT_EQ(track.length(), 3 * kBlockFrames);
+}
+
+TEST_F(LoopTrackTests, compressed_loops_overdub_across_blocks) {
+  // Multiples of 16 survive 12-bit storage exactly.
+  Block input;
+  for (size_t i = 0; i < kBlockSamples; i++) {
+    input[i] = static_cast<int32_t>(i / 2) << 12;
+  }
+
+  // A 42 frame loop: a full coded block, then a partial one.
+  track.apply(Action::kRecord, LoopFormat::kPcm12);
+  EXPECT_EQ(track.format(), LoopFormat::kPcm12);
+  play(input);
+  render(track, 10, input, kFullFeedback);
+  track.apply(Action::kPlay);
+  play();
+
+  // Overdub from frame 32 round to frame 21, crossing from the partial
+  // block back into the first.
+  track.apply(Action::kOverdub);
+  play(input);
+  track.apply(Action::kPlay);
+  EXPECT_EQ(track.head(), 22);
+
+  auto expected = [](uint32_t frame) {
+    uint32_t recorded = frame % kBlockFrames;
+    uint32_t overdubbed = frame >= kBlockFrames ? frame - kBlockFrames
+                          : frame < 22          ? frame + 10
+                                                : 0;
+    return static_cast<int32_t>(recorded + overdubbed) << 12;
+  };
+  for (uint32_t done = 0; done < 2 * kBlockFrames; done += kBlockFrames) {
+    Block out = play();
+    for (uint32_t frame = 0; frame < kBlockFrames; frame++) {
+      uint32_t loop_frame = (22 + done + frame) % 42;
+      ASSERT_EQ(out[2 * frame], expected(loop_frame)) << loop_frame;
+    }
+  }
+}
+
+TEST_F(LoopTrackTests, pause_resumes_from_loop_start) {
+  track.apply(Action::kRecord);
+  play(ramp(0));
+  play(ramp(kBlockFrames));
+  track.apply(Action::kPlay);
+  play();
+  track.apply(Action::kPause);
+  EXPECT_EQ(play(), Block{});
+
+  track.apply(Action::kPlay);
+  EXPECT_EQ(play(), ramp(0));
+}
+
+TEST_F(LoopTrackTests, double_speed_skips_frames_across_the_wrap) {
+  track.apply(Action::kRecord);
+  play(ramp(0));
+  play(ramp(kBlockFrames));
+  track.apply(Action::kPlay);
+  track.setSpeed(2 * deloop::Resampler::kUnitStep,
+                 deloop::Interpolation::kPolyphase);
+
+  for (int pass = 0; pass < 2; pass++) {
+    Block out = play();
+    for (size_t frame = 0; frame < kBlockFrames; frame++) {
+      ASSERT_EQ(out[2 * frame], static_cast<int32_t>(2 * frame) << 8);
+    }
+  }
+  EXPECT_EQ(track.head(), 0);
+}
+
+TEST_F(LoopTrackTests, speed_changes_continue_from_the_head) {
+  track.apply(Action::kRecord);
+  play(ramp(0));
+  play(ramp(kBlockFrames));
+  track.apply(Action::kPlay);
+  EXPECT_EQ(play(), ramp(0));
+
+  // Half speed interpolates from where normal speed left off, truncated to
+  // 16-bit frames.
+  track.setSpeed(deloop::Resampler::kUnitStep / 2,
+                 deloop::Interpolation::kLinear);
+  Block out = play();
+  for (size_t frame = 0; frame < kBlockFrames; frame++) {
+    ASSERT_EQ(out[2 * frame],
+              (static_cast<int32_t>(2 * kBlockFrames + frame) >> 1) << 8);
+  }
+  EXPECT_EQ(track.head(), kBlockFrames + kBlockFrames / 2);
+
+  track.setSpeed(deloop::Resampler::kUnitStep,
+                 deloop::Interpolation::kLinear);
+  out = play();
+  EXPECT_EQ(out[0], static_cast<int32_t>(kBlockFrames * 3 / 2) << 8);
+  EXPECT_EQ(track.head(), kBlockFrames / 2);
+}
+
+TEST_F(LoopTrackTests, empty_loops_stay_idle) {
+  track.apply(Action::kPlay);
+  EXPECT_EQ(track.state(), State::kIdle);
+
+  // Closing a recording before any frame discards it.
+  track.apply(Action::kRecord);
+  track.apply(Action::kOverdub);
+  EXPECT_EQ(track.state(), State::kIdle);
+
+  track.apply(Action::kRecord);
+  play(ramp(0));
+  track.apply(Action::kClear);
+  EXPECT_EQ(track.state(), State::kIdle);
+  EXPECT_EQ(track.length(), 0);
+  EXPECT_EQ(pool.freeWords(), pool.capacity());
+
+  LoopTrack no_storage;
+  no_storage.apply(Action::kRecord);
+  EXPECT_EQ(no_storage.state(), State::kIdle);
+}
+
+TEST(LoopCaptureTests, adopted_loop_starts_on_the_requested_frame) {
+  // Room for the ring and the blocks recorded past it.
+  std::array<uint32_t, 64 * kBlockSamples / 2> storage = {};
+  deloop::LoopPool pool(storage);
+  deloop::LoopCapture capture(pool, LoopFormat::kPcm16, 8 * kBlockSamples / 2);
+  LoopTrack track(pool);
+
+  // 10 blocks and 5 frames, so capture is part way through a block.
+  uint64_t frame = 0;
+  for (; frame < 10 * kBlockFrames; frame += kBlockFrames) {
+    Block rx = ramp(static_cast<int32_t>(frame));
+    capture.process(frame, kBlockFrames, rx.data());
+  }
+  Block rx = ramp(static_cast<int32_t>(frame));
+  capture.process(frame, 5, rx.data());
+  frame += 5;
+
+  // 8 ring blocks keep the last 7 complete ones.
+  EXPECT_EQ(capture.oldest(), 3 * kBlockFrames);
+  deloop::LoopHistory history;
+  EXPECT_FALSE(capture.take(capture.oldest() - 1, history));
+  ASSERT_TRUE(capture.take(250, history));
+  track.adopt(history);
+  EXPECT_EQ(track.state(), State::kRecording);
+  EXPECT_EQ(track.head(), frame - 250);
+
+  // Record on, past the end of the ring, then play the loop back.
+  for (; frame < 700; frame += kBlockFrames) {
+    rx = ramp(static_cast<int32_t>(frame));
+    render(track, kBlockFrames, rx, kFullFeedback);
+    capture.process(frame, kBlockFrames, rx.data());
+  }
+  track.apply(Action::kPlay);
+  uint32_t length = static_cast<uint32_t>(frame - 250);
+  ASSERT_EQ(track.length(), length);
+
+  for (uint32_t done = 0; done < 2 * length; done += kBlockFrames) {
+    Block silence = {};
+    Block tx = render(track, kBlockFrames, silence, kFullFeedback);
+    for (uint32_t i = 0; i < kBlockFrames; i++) {
+      int32_t expected = static_cast<int32_t>(250 + (done + i) % length);
+      ASSERT_EQ(tx[2 * i], expected << 8) << done + i;
+    }
+  }
+}
+
+namespace {
+
+// Tracks with room for an undo journal.
+class LoopUndoTests : public ::testing::Test {
+protected:
+  LoopUndoTests() : pool(storage), track(pool) {}
+
+  // Records `num_blocks` blocks of ramp and starts playing.
+  void record(uint32_t num_blocks, LoopFormat format = LoopFormat::kPcm16) {
+    track.apply(Action::kRecord, format);
+    for (uint32_t block = 0; block < num_blocks; block++) {
+      Block rx = ramp(static_cast<int32_t>(block * kBlockFrames));
+      render(track, kBlockFrames, rx, kFullFeedback);
+    }
+    track.apply(Action::kPlay);
+  }
+
+  // Overdubs one pass of a constant input and plays on.
+  void overdub(int32_t input) {
+    track.apply(Action::kOverdub);
+    Block rx;
+    rx.fill(input << 8);
+    for (uint32_t done = 0; done < track.length(); done += kBlockFrames) {
+      render(track, kBlockFrames, rx, kFullFeedback);
+    }
+    track.apply(Action::kPlay);
+  }
+
+  // Plays a pass from the loop start, returning how far it is from the
+  // recorded ramp plus `offset`, or -1 if it is not a constant offset.
+  int32_t pass() {
+    EXPECT_EQ(track.head(), 0);
+    int32_t offset = 0;
+    for (uint32_t done = 0; done < track.length(); done += kBlockFrames) {
+      Block rx = {};
+      Block tx = render(track, kBlockFrames, rx, kFullFeedback);
+      for (uint32_t i = 0; i < kBlockFrames; i++) {
+        int32_t diff = (tx[2 * i] >> 8) - static_cast<int32_t>(done + i);
+        if (done + i == 0) {
+          offset = diff;
+        } else if (diff != offset) {
+          return -1;
+        }
+      }
+    }
+    return offset;
+  }
+
+  std::array<uint32_t, 64 * kBlockSamples / 2> storage = {};
+  deloop::LoopPool pool;
+  LoopTrack track;
+};
+
+} // namespace
+
+TEST_F(LoopUndoTests, undo_and_redo_step_through_passes) {
+  record(2);
+  overdub(1);
+  overdub(2);
+  EXPECT_EQ(pass(), 3);
+  // Two blocks saved per pass, each with a header word.
+  EXPECT_EQ(track.journalWords(), 2 * 2 * 33);
+
+  track.apply(Action::kUndo);
+  EXPECT_EQ(pass(), 1);
+  track.apply(Action::kUndo);
+  EXPECT_EQ(pass(), 0);
+  track.apply(Action::kUndo);
+  EXPECT_FALSE(track.swapping());
+  EXPECT_EQ(pass(), 0);
+
+  track.apply(Action::kRedo);
+  EXPECT_EQ(pass(), 1);
+  track.apply(Action::kRedo);
+  EXPECT_EQ(pass(), 3);
+  track.apply(Action::kRedo);
+  EXPECT_EQ(pass(), 3);
+}
+
+TEST_F(LoopUndoTests, overdub_after_undo_replaces_redo) {
+  record(2);
+  overdub(1);
+  overdub(2);
+  track.apply(Action::kUndo);
+  overdub(4);
+  EXPECT_EQ(pass(), 5);
+
+  track.apply(Action::kRedo);
+  EXPECT_EQ(pass(), 5);
+  track.apply(Action::kUndo);
+  EXPECT_EQ(pass(), 1);
+}
+
+TEST_F(LoopUndoTests, undo_is_spread_over_blocks) {
+  record(20);
+  overdub(1);
+  track.apply(Action::kUndo);
+  track.apply(Action::kOverdub);
+
+  // The loop plays on, and overdubbing waits for the undo.
+  Block rx;
+  rx.fill(1 << 8);
+  for (uint32_t swapped = 0; swapped < 20;
+       swapped += LoopTrack::kSwapsPerProcess) {
+    EXPECT_TRUE(track.swapping());
+    EXPECT_EQ(track.state(), State::kPlaying);
+    render(track, kBlockFrames, rx, kFullFeedback);
+  }
+  EXPECT_FALSE(track.swapping());
+  EXPECT_EQ(track.state(), State::kOverdubbing);
+}
+
+TEST_F(LoopUndoTests, silent_overdub_saves_nothing) {
+  record(4);
+  overdub(0);
+  EXPECT_EQ(track.journalWords(), 0);
+  track.apply(Action::kUndo);
+  EXPECT_FALSE(track.swapping());
+}
+
+TEST_F(LoopUndoTests, overdub_never_cuts_another_recording_short) {
+  record(2);
+  LoopTrack other(pool);
+  other.apply(Action::kRecord);
+  render(other, kBlockFrames, ramp(0), kFullFeedback);
+
+  // A journal would be allocated after the recording and stop it growing,
+  // so this pass cannot be undone.
+  overdub(1);
+  EXPECT_EQ(track.journalWords(), 0);
+  for (int32_t block = 1; block < 10; block++) {
+    render(other, kBlockFrames, ramp(block * kBlockFrames), kFullFeedback);
+  }
+  EXPECT_EQ(other.state(), State::kRecording);
+  other.apply(Action::kPlay);
+  EXPECT_EQ(other.length(), 10 * kBlockFrames);
+
+  // Once it closes, passes are journaled again.
+  overdub(2);
+  EXPECT_EQ(track.journalWords(), 2 * 33);
+  track.apply(Action::kUndo);
+  EXPECT_EQ(pass(), 1);
+}
+
+TEST_F(LoopUndoTests, adpcm_undo_is_exact) {
+  record(8, LoopFormat::kAdpcm4);
+  std::vector<int32_t> before;
+  for (uint32_t done = 0; done < track.length(); done += kBlockFrames) {
+    Block rx = {};
+    Block tx = render(track, kBlockFrames, rx, kFullFeedback);
+    before.insert(before.end(), tx.begin(), tx.end());
+  }
+
+  overdub(100);
+  EXPECT_EQ(track.journalWords(), 8 * 11);
+  track.apply(Action::kUndo);
+  for (uint32_t done = 0; done < track.length(); done += kBlockFrames) {
+    Block rx = {};
+    Block tx = render(track, kBlockFrames, rx, kFullFeedback);
+    ASSERT_TRUE(std::equal(tx.begin(), tx.end(),
+                           &before[done * LoopTrack::kNumChannels]));
+  }
+}
+
+namespace {
+
+class LooperTests : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    ASSERT_EQ(deloop::params::init(), deloop::Error::kOk);
+    ASSERT_EQ(deloop::looper::init(), deloop::Error::kOk);
+    ASSERT_EQ(deloop::audio_scheduler::init(), deloop::Error::kOk);
+    for (auto callback :
+         {deloop::audio_clock::process, deloop::looper::process}) {
+      ASSERT_EQ(deloop::audio_scheduler::registerCallback(callback),
+                deloop::Error::kOk);
+    }
+
+    // 240 BPM in 3/4, a 36000 frame bar.
+    const uint32_t bpm = deloop::LogSiteId(FNV1A_64("clock.bpm"));
+    const uint32_t meter = deloop::LogSiteId(FNV1A_64("clock.beats_per_bar"));
+    deloop::ParamUpdate updates[] = {{bpm, 240.0f}, {meter, 3.0f}};
+    ASSERT_EQ(deloop::params::set(updates), deloop::Error::kOk);
+  }
+
+  void TearDown() override {
+    for (size_t i = 0; i < deloop::looper::kMaxTracks; i++) {
+      ASSERT_EQ(deloop::looper::trigger(i, Action::kClear, Quantize::kNone),
+                deloop::Error::kOk);
+    }
+    run(1);
+  }
+
+  // Processes blocks of silence with a constant input.
+  static void run(int num_blocks, int32_t input = 0) {
+    Block tx;
+    Block rx;
+    for (int block = 0; block < num_blocks; block++) {
+      rx.fill(input);
+      ASSERT_EQ(deloop::audio_scheduler::process(kBlockFrames, tx.data(),
+                                                 rx.data()),
+                deloop::Error::kOk);
+    }
+  }
+
+  // Runs blocks until `track` enters `state`, returning the frame it did,
+  // from its published status.
+  static uint64_t runUntil(size_t track, State state) {
+    for (int block = 0; block < 100000; block++) {
+      run(1);
+      deloop::looper::TrackStatus status =
+          deloop::looper::getTrackStatus(track);
+      if (status.state == state) {
+        return status.loop_start;
+      }
+    }
+    ADD_FAILURE() << "Track never reached the state";
+    return 0;
+  }
+};
+
+} // namespace
+
+TEST_F(LooperTests, bar_quantized_recording_starts_on_the_bar) {
+  run(1);
+  deloop::audio_clock::Position pos = deloop::audio_clock::getPosition();
+  uint64_t bar = deloop::audio_clock::nextBarFrame(
+      pos, deloop::audio_scheduler::getFrameTime());
+  ASSERT_EQ(deloop::looper::trigger(0, Action::kRecord, Quantize::kBar),
+            deloop::Error::kOk);
+
+  // A bar is longer than the pool, so the recording closes when full.
+  constexpr uint32_t kPoolFrames =
+      deloop::looper::kPoolWords /
+      deloop::LoopBlockWords(LoopFormat::kPcm16) * deloop::kLoopBlockFrames;
+  uint64_t loop_start = runUntil(0, State::kPlaying);
+  EXPECT_EQ(deloop::looper::getTrackStatus(0).length, kPoolFrames);
+  EXPECT_EQ(loop_start, bar + kPoolFrames);
+}
+
+TEST_F(LooperTests, synced_track_starts_on_the_loop_boundary) {
+  ASSERT_EQ(deloop::looper::trigger(0, Action::kRecord, Quantize::kNone),
+            deloop::Error::kOk);
+  run(10, 1 << 8);
+  ASSERT_EQ(deloop::looper::trigger(0, Action::kPlay, Quantize::kNone),
+            deloop::Error::kOk);
+  run(3);
+
+  deloop::looper::TrackStatus leader = deloop::looper::getTrackStatus(0);
+  ASSERT_EQ(leader.length, 10 * kBlockFrames);
+  ASSERT_EQ(deloop::looper::trigger(1, Action::kRecord, Quantize::kLoop, 0),
+            deloop::Error::kOk);
+  run(10);
+  ASSERT_EQ(deloop::looper::trigger(1, Action::kPlay, Quantize::kLoop, 0),
+            deloop::Error::kOk);
+
+  uint64_t loop_start = runUntil(1, State::kPlaying);
+  EXPECT_EQ(deloop::looper::getTrackStatus(1).length, leader.length);
+  EXPECT_EQ((loop_start - leader.loop_start) % leader.length, 0u);
+}
+
+TEST_F(LooperTests, retroactive_recording_is_sample_aligned) {
+  // A sine on the frame time, so a loop a frame off its start shows up as a
+  // large error despite the lossy capture format.
+  constexpr double kPeriod = 48.0;
+  constexpr double kAmplitude = 0x400000;
+  auto sine = [&](uint64_t frame) {
+    double phase = 2.0 * std::numbers::pi * static_cast<double>(frame) /
+                   kPeriod;
+    return static_cast<int32_t>(kAmplitude * std::sin(phase));
+  };
+  auto capture = [&](int num_blocks) {
+    for (int block = 0; block < num_blocks; block++) {
+      uint64_t frame = deloop::audio_scheduler::getFrameTime();
+      Block tx = {};
+      Block rx;
+      for (uint32_t i = 0; i < kBlockFrames; i++) {
+        rx[2 * i] = rx[2 * i + 1] = sine(frame + i);
+      }
+      ASSERT_EQ(deloop::audio_scheduler::process(kBlockFrames, tx.data(),
+                                                 rx.data()),
+                deloop::Error::kOk);
+    }
+  };
+
+  // Start 2000 frames back and record past the end of the capture ring.
+  capture(300);
+  uint64_t start = deloop::audio_scheduler::getFrameTime() - 2000;
+  ASSERT_EQ(deloop::looper::recordFrom(1, start), deloop::Error::kOk);
+  capture(200);
+  uint64_t stop = deloop::audio_scheduler::getFrameTime();
+  ASSERT_EQ(deloop::looper::trigger(1, Action::kPlay, Quantize::kNone),
+            deloop::Error::kOk);
+  run(1);
+
+  deloop::looper::TrackStatus status = deloop::looper::getTrackStatus(1);
+  ASSERT_EQ(status.state, State::kPlaying);
+  EXPECT_EQ(status.format, deloop::looper::kCaptureFormat);
+  ASSERT_EQ(status.length, stop - start);
+
+  // Loop frame n should play input frame `start + n`.
+  double error = 0.0;
+  double signal = 0.0;
+  for (int block = 0; block < 300; block++) {
+    uint64_t frame = deloop::audio_scheduler::getFrameTime();
+    Block tx = {};
+    Block rx = {};
+    ASSERT_EQ(deloop::audio_scheduler::process(kBlockFrames, tx.data(),
+                                               rx.data()),
+              deloop::Error::kOk);
+    uint64_t loop_start = deloop::looper::getTrackStatus(1).loop_start;
+    for (uint32_t i = 0; i < kBlockFrames; i++) {
+      uint64_t n = (frame + i + status.length - loop_start) % status.length;
+      double e = tx[2 * i] - sine(start + n);
+      error += e * e;
+      signal += kAmplitude * kAmplitude / 2.0;
+    }
+  }
+  EXPECT_LT(error / signal, 0.002);
+}
+
+TEST_F(LooperTests, retroactive_quantize_needs_the_boundary_captured) {
+  // Fill the capture, then trigger in the block after a beat.
+  run(250);
+  uint64_t beat = deloop::audio_clock::getPosition().beat;
+  deloop::audio_clock::Position pos;
+  do {
+    run(1);
+    pos = deloop::audio_clock::getPosition();
+  } while (pos.beat == beat);
+  ASSERT_EQ(deloop::looper::trigger(0, Action::kRecord, Quantize::kLastBeat),
+            deloop::Error::kOk);
+  run(10);
+  uint64_t stop = deloop::audio_scheduler::getFrameTime();
+  ASSERT_EQ(deloop::looper::trigger(0, Action::kPlay, Quantize::kNone),
+            deloop::Error::kOk);
+  runUntil(0, State::kPlaying);
+  EXPECT_EQ(deloop::looper::getTrackStatus(0).length, stop - pos.beat_frame);
+
+  // Further into the beat, it is no longer held, and neither is the bar.
+  do {
+    run(1);
+    pos = deloop::audio_clock::getPosition();
+  } while (pos.frame < pos.beat_frame + 8000);
+  EXPECT_EQ(deloop::looper::trigger(1, Action::kRecord, Quantize::kLastBeat),
+            deloop::Error::kLooperHistoryTooShort);
+  EXPECT_EQ(deloop::looper::trigger(1, Action::kRecord, Quantize::kLastBar),
+            deloop::Error::kLooperHistoryTooShort);
+  EXPECT_EQ(deloop::looper::recordFrom(1, pos.beat_frame),
+            deloop::Error::kLooperHistoryTooShort);
+  run(1);
+  EXPECT_EQ(deloop::looper::getTrackStatus(1).state, State::kIdle);
+}
+
+TEST_F(LooperTests, invalid_triggers_are_rejected) {
+  EXPECT_EQ(deloop::looper::trigger(deloop::looper::kMaxTracks,
+                                    Action::kRecord, Quantize::kNone),
+            deloop::Error::kInvalidArgument);
+  EXPECT_EQ(deloop::looper::trigger(0, Action::kRecord, Quantize::kLoop,
+                                    deloop::looper::kMaxTracks),
+            deloop::Error::kInvalidArgument);
+}
+
+TEST_F(LooperTests, input_is_monitored_at_its_level) {
+  const uint32_t gain = deloop::LogSiteId(FNV1A_64("looper.input.gain"));
+  const uint32_t pan = deloop::LogSiteId(FNV1A_64("looper.input.pan"));
+  deloop::ParamUpdate on[] = {{gain, 1.0f}, {pan, -0.5f}};
+  ASSERT_EQ(deloop::params::set(on), deloop::Error::kOk);
+
+  // Past the gain ramp, the left plays as is and the right at half.
+  run(100, 1000 << 8);
+  Block tx = {};
+  Block rx;
+  rx.fill(1000 << 8);
+  ASSERT_EQ(deloop::audio_scheduler::process(kBlockFrames, tx.data(),
+                                             rx.data()),
+            deloop::Error::kOk);
+  EXPECT_EQ(tx[0], 1000 << 8);
+  EXPECT_EQ(tx[1], 500 << 8);
+
+  deloop::ParamUpdate off[] = {{gain, 0.0f}, {pan, 0.0f}};
+  ASSERT_EQ(deloop::params::set(off), deloop::Error::kOk);
+  run(100);
+}
+
+TEST_F(LooperTests, input_is_filtered_before_the_mix) {
+  const uint32_t gain = deloop::LogSiteId(FNV1A_64("looper.input.gain"));
+  const uint32_t highpass =
+      deloop::LogSiteId(FNV1A_64("looper.input.highpass"));
+  deloop::ParamUpdate on[] = {{gain, 1.0f}, {highpass, 20.0f}};
+  ASSERT_EQ(deloop::params::set(on), deloop::Error::kOk);
+
+  // The high pass takes the DC out of what is monitored, and of the input
+  // callbacks after the looper see.
+  run(3000, 1000 << 8);
+  Block tx = {};
+  Block rx;
+  rx.fill(1000 << 8);
+  ASSERT_EQ(deloop::audio_scheduler::process(kBlockFrames, tx.data(),
+                                             rx.data()),
+            deloop::Error::kOk);
+  EXPECT_EQ(tx[0], 0);
+  EXPECT_EQ(rx[0], 0);
+
+  deloop::ParamUpdate off[] = {{gain, 0.0f}, {highpass, 0.0f}};
+  ASSERT_EQ(deloop::params::set(off), deloop::Error::kOk);
+  run(100);
+}
+
+// One track per state and format, over a block, to size how many tracks
+// fit in the audio task's budget.
+TEST(LoopTrackBenchmark, cycles_per_track_per_block) {
+  constexpr uint64_t kBlocks = 200000;
+  static std::array<uint32_t, deloop::looper::kPoolWords> storage;
+  Frames out = {};
+  Block rx = ramp(0);
+
+  for (auto [format, name] : {std::pair{LoopFormat::kPcm16, "pcm16"},
+                              std::pair{LoopFormat::kPcm12, "pcm12"},
+                              std::pair{LoopFormat::kAdpcm4, "adpcm4"}}) {
+    deloop::LoopPool pool(storage);
+    LoopTrack track(pool);
+    auto process = [&](int32_t feedback) {
+      return bench::measure(kBlocks, [&]() {
+        track.process(kBlockFrames, out.data(), rx.data(), feedback);
+      });
+    };
+    std::string prefix = std::string("LoopTrack::process (") + name + ", ";
+
+    track.apply(Action::kRecord, format);
+    bench::report((prefix + "recording)").c_str(),
+                  bench::measure(kBlocks,
+                                 [&]() {
+                                   if (track.state() != State::kRecording) {
+                                     track.apply(Action::kRecord, format);
+                                   }
+                                   track.process(kBlockFrames, out.data(),
+                                                 rx.data(), kFullFeedback);
+                                 }),
+                  "block");
+
+    track.apply(Action::kRecord, format);
+    while (track.state() == State::kRecording) {
+      track.process(kBlockFrames, out.data(), rx.data(), kFullFeedback);
+    }
+    ASSERT_EQ(track.state(), State::kPlaying);
+    bench::report((prefix + "playing)").c_str(), process(kFullFeedback),
+                  "block");
+
+    track.apply(Action::kOverdub);
+    bench::report((prefix + "overdubbing)").c_str(),
+                  process(kFullFeedback / 2), "block");
+
+    track.apply(Action::kPause);
+    bench::report((prefix + "paused)").c_str(), process(kFullFeedback),
+                  "block");
+  }
+}
+
+// Varispeed playback at double speed, the most frames read per block.
+TEST(LoopTrackBenchmark, varispeed_cycles_per_block) {
+  constexpr uint64_t kBlocks = 200000;
+  static std::array<uint32_t, deloop::looper::kPoolWords> storage;
+  Frames out = {};
+  Block rx = ramp(0);
+
+  for (auto [format, format_name] : {std::pair{LoopFormat::kPcm16, "pcm16"},
+                                     std::pair{LoopFormat::kAdpcm4,
+                                               "adpcm4"}}) {
+    deloop::LoopPool pool(storage);
+    LoopTrack track(pool);
+    track.apply(Action::kRecord, format);
+    for (int i = 0; i < 64; i++) {
+      track.process(kBlockFrames, out.data(), rx.data(), kFullFeedback);
+    }
+    track.apply(Action::kPlay);
+
+    for (auto [quality, name] :
+         {std::pair{deloop::Interpolation::kLinear, "linear"},
+          std::pair{deloop::Interpolation::kCubic, "cubic"},
+          std::pair{deloop::Interpolation::kPolyphase, "polyphase"}}) {
+      track.setSpeed(2 * deloop::Resampler::kUnitStep, quality);
+      std::string label = std::string("LoopTrack::process (") + format_name +
+                          ", " + name + " x2)";
+      bench::report(label.c_str(), bench::measure(kBlocks, [&]() {
+                      track.process(kBlockFrames, out.data(), rx.data(),
+                                    kFullFeedback);
+                    }),
+                    "block");
+    }
+  }
+}
+
+// Capture runs on every block whether or not anything records.
+TEST(LoopCaptureBenchmark, cycles_per_block) {
+  constexpr uint64_t kBlocks = 200000;
+  static std::array<uint32_t, deloop::looper::kPoolWords> storage;
+  deloop::LoopPool pool(storage);
+  deloop::LoopCapture capture(pool, deloop::looper::kCaptureFormat,
+                              deloop::looper::kCaptureWords);
+  Block rx = ramp(0);
+  uint64_t frame = 0;
+  bench::report("LoopCapture::process (adpcm4)",
+                bench::measure(kBlocks,
+                               [&]() {
+                                 capture.process(frame, kBlockFrames,
+                                                 rx.data());
+                                 frame += kBlockFrames;
+                               }),
+                "block");
+}
+
+// Journal memory per overdubbed block and the cost of restoring one, for
+// each format. Timed on a paused track, which only applies the undo.
+TEST(LoopUndoBenchmark, memory_and_cycles_per_block) {
+  constexpr uint32_t kLoopBlocks = 64;
+  constexpr int kRepeats = 2000;
+  static std::array<uint32_t, deloop::looper::kPoolWords> storage;
+  Frames out = {};
+  Block rx;
+  rx.fill(1 << 8);
+
+  for (auto [format, name] : {std::pair{LoopFormat::kPcm16, "pcm16"},
+                              std::pair{LoopFormat::kPcm12, "pcm12"},
+                              std::pair{LoopFormat::kAdpcm4, "adpcm4"}}) {
+    deloop::LoopPool pool(storage);
+    LoopTrack track(pool);
+    track.apply(Action::kRecord, format);
+    for (uint32_t i = 0; i < kLoopBlocks; i++) {
+      track.process(kBlockFrames, out.data(), rx.data(), kFullFeedback);
+    }
+    track.apply(Action::kOverdub);
+    for (uint32_t i = 0; i < kLoopBlocks; i++) {
+      track.process(kBlockFrames, out.data(), rx.data(), kFullFeedback);
+    }
+    track.apply(Action::kPause);
+    ASSERT_FALSE(track.swapping());
+
+    std::printf("[ BENCH    ] %-6s journal: %u words per block of %zu\n",
+                name, track.journalWords() / kLoopBlocks,
+                deloop::LoopBlockWords(format));
+
+    // Undo and redo alternately, so every call restores blocks.
+    uint64_t cycles = 0;
+    uint64_t swaps = 0;
+    for (int i = 0; i < kRepeats; i++) {
+      track.apply(i % 2 == 0 ? Action::kUndo : Action::kRedo);
+      while (track.swapping()) {
+        uint64_t start = bench::now();
+        track.process(kBlockFrames, out.data(), rx.data(), kFullFeedback);
+        cycles += bench::now() - start;
+      }
+      swaps += kLoopBlocks;
+    }
+    std::string label = std::string("LoopTrack undo (") + name + ")";
+    bench::report(label.c_str(),
+                  static_cast<double>(cycles) / static_cast<double>(swaps),
+                  "block restored");
+  }
+}
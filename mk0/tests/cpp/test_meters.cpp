@@ -0,0 +1,186 @@
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <numbers>
+
+#include "audio/level_meter.hpp"
+#include "audio/meters.hpp"
+#include "audio/scheduler.hpp"
+#include "bench.hpp"
+#include "errors.hpp"
+#include "log_encoding.hpp"
+#include "metrics.hpp"
+#include "params.hpp"
+
+using deloop::LevelMeter;
+namespace meters = deloop::meters;
+
+namespace {
+
+constexpr uint32_t kBlockFrames = 32;
+constexpr float kFullScale = LevelMeter::kFullScale;
+
+using Block = std::array<int32_t, kBlockFrames * LevelMeter::kChannels>;
+
+// A block of a 1500 Hz sine (a whole cycle per block) at `left` on the
+// left channel and `right` on the right, as fractions of full scale.
+Block sine(float left, float right) {
+  Block block;
+  for (uint32_t i = 0; i < kBlockFrames; i++) {
+    float s = std::sin(2.0f * std::numbers::pi_v<float> *
+                       static_cast<float>(i) / kBlockFrames);
+    block[2 * i] = static_cast<int32_t>(std::lround(left * kFullScale * s));
+    block[2 * i + 1] =
+        static_cast<int32_t>(std::lround(right * kFullScale * s));
+  }
+  return block;
+}
+
+int32_t metricValue(const char *name, uint32_t id) {
+  for (const deloop::MetricEntry &entry : deloop::GetMetrics()) {
+    if (entry.id == id) {
+      return entry.type == deloop::MetricType::kGauge
+                 ? static_cast<deloop::Gauge *>(entry.metric)->value()
+                 : static_cast<int32_t>(
+                       static_cast<deloop::Counter *>(entry.metric)->value());
+    }
+  }
+  ADD_FAILURE() << "No metric " << name;
+  return 0;
+}
+
+#define METRIC(name) metricValue(name, deloop::LogSiteId(FNV1A_64(name)))
+
+} // namespace
+
+TEST(LevelMeterTests, measures_peak_rms_and_clips) {
+  LevelMeter meter;
+  Block block = sine(0.5f, 0.25f);
+  for (int i = 0; i < 10; i++) {
+    meter.measure(kBlockFrames, block.data());
+  }
+  EXPECT_EQ(meter.frames(), 10 * kBlockFrames);
+
+  LevelMeter::Levels levels = meter.take();
+  EXPECT_EQ(levels.frames, 10 * kBlockFrames);
+  EXPECT_EQ(levels.peak[0], std::lround(0.5f * kFullScale));
+  EXPECT_EQ(levels.peak[1], std::lround(0.25f * kFullScale));
+  EXPECT_NEAR(levels.rms[0], 0.5f * kFullScale / std::numbers::sqrt2_v<float>,
+              2.0f);
+  EXPECT_NEAR(levels.rms[1],
+              0.25f * kFullScale / std::numbers::sqrt2_v<float>, 2.0f);
+  EXPECT_EQ(levels.clips, 0);
+
+  // Every sample at or past full scale clips, on either channel.
+  block.fill(0);
+  block[0] = LevelMeter::kFullScale;
+  block[3] = -LevelMeter::kFullScale - 1;
+  block[4] = LevelMeter::kFullScale - 1;
+  meter.measure(kBlockFrames, block.data());
+  levels = meter.take();
+  EXPECT_EQ(levels.clips, 2);
+  EXPECT_EQ(levels.peak[1], LevelMeter::kFullScale + 1);
+
+  // Taking the levels starts a new window.
+  levels = meter.take();
+  EXPECT_EQ(levels.frames, 0);
+  EXPECT_EQ(levels.peak[0], 0);
+  EXPECT_EQ(levels.rms[0], 0.0f);
+}
+
+TEST(LevelMeterTests, windows_do_not_overflow) {
+  LevelMeter meter;
+  Block block;
+  block.fill(-LevelMeter::kFullScale - 1);
+  for (uint32_t done = 0; done < LevelMeter::kMaxWindowFrames;
+       done += kBlockFrames) {
+    meter.measure(kBlockFrames, block.data());
+  }
+  LevelMeter::Levels levels = meter.take();
+  EXPECT_NEAR(levels.rms[0], kFullScale, kFullScale * 1e-5f);
+}
+
+TEST(LevelMeterTests, levels_in_centibels) {
+  EXPECT_EQ(deloop::LevelCb(kFullScale), 0);
+  EXPECT_EQ(deloop::LevelCb(kFullScale / 2.0f), -60);
+  EXPECT_EQ(deloop::LevelCb(kFullScale / 1000.0f), -600);
+  EXPECT_EQ(deloop::LevelCb(0.0f), -1440);
+}
+
+TEST(MetersTests, reports_once_per_period) {
+  ASSERT_EQ(deloop::params::init(), deloop::Error::kOk);
+  ASSERT_EQ(deloop::audio_scheduler::init(), deloop::Error::kOk);
+  ASSERT_EQ(deloop::audio_scheduler::registerCallback(meters::processInput),
+            deloop::Error::kOk);
+  // Stands in for everything between, here a straight copy at half level.
+  ASSERT_EQ(deloop::audio_scheduler::registerCallback(
+                [](uint32_t num_frames, int32_t *tx, int32_t *rx) {
+                  for (uint32_t i = 0; i < num_frames * 2; i++) {
+                    tx[i] = rx[i] / 2;
+                  }
+                  return deloop::Error::kOk;
+                }),
+            deloop::Error::kOk);
+  ASSERT_EQ(deloop::audio_scheduler::registerCallback(meters::processOutput),
+            deloop::Error::kOk);
+
+  // 100 ms windows of 150 blocks.
+  const uint32_t period = deloop::LogSiteId(FNV1A_64("meter.period_ms"));
+  deloop::ParamUpdate updates[] = {{period, 100.0f}};
+  ASSERT_EQ(deloop::params::set(updates), deloop::Error::kOk);
+
+  auto run = [](int num_blocks, const Block &input) {
+    for (int block = 0; block < num_blocks; block++) {
+      Block tx = {};
+      Block rx = input;
+      ASSERT_EQ(deloop::audio_scheduler::process(kBlockFrames, tx.data(),
+                                                 rx.data()),
+                deloop::Error::kOk);
+    }
+  };
+
+  Block clipped = sine(1.0f, 0.1f);
+  run(149, clipped);
+  EXPECT_EQ(meters::getLevels(meters::Signal::kInput).frames, 0);
+  run(1, clipped);
+  LevelMeter::Levels input = meters::getLevels(meters::Signal::kInput);
+  LevelMeter::Levels output = meters::getLevels(meters::Signal::kOutput);
+  EXPECT_EQ(input.frames, 4800);
+  EXPECT_EQ(output.frames, 4800);
+  EXPECT_EQ(input.peak[0], LevelMeter::kFullScale);
+  EXPECT_EQ(output.peak[0], LevelMeter::kFullScale / 2);
+
+  // A full scale sine peaks at 0 dB, and has an RMS 3 dB below.
+  EXPECT_EQ(METRIC("meter.rx.left.peak_cb"), 0);
+  EXPECT_EQ(METRIC("meter.rx.left.rms_cb"), -30);
+  EXPECT_EQ(METRIC("meter.rx.right.peak_cb"), -200);
+  EXPECT_EQ(METRIC("meter.tx.left.peak_cb"), -60);
+  EXPECT_EQ(METRIC("meter.tx.right.rms_cb"), -290);
+  // The sine touches full scale twice a cycle on the input only.
+  EXPECT_EQ(METRIC("meter.rx.clips"), 150 * 2);
+  EXPECT_EQ(METRIC("meter.tx.clips"), 0);
+
+  // Windows do not overlap.
+  run(150, sine(0.0f, 0.0f));
+  EXPECT_EQ(METRIC("meter.rx.left.peak_cb"), -1440);
+  EXPECT_EQ(METRIC("meter.rx.clips"), 150 * 2);
+}
+
+// Cost of metering the input and output of a block, which the audio task
+// pays on every block.
+TEST(MetersBenchmark, cycles_per_block) {
+  constexpr uint64_t kBlocks = 200000;
+  Block tx = sine(0.5f, 0.5f);
+  Block rx = sine(0.25f, 0.25f);
+  double cycles = bench::measure(kBlocks, [&]() {
+    meters::processInput(kBlockFrames, tx.data(), rx.data());
+    meters::processOutput(kBlockFrames, tx.data(), rx.data());
+  });
+  bench::report("meters (input and output)", cycles, "block");
+
+  LevelMeter meter;
+  cycles = bench::measure(kBlocks,
+                          [&]() { meter.measure(kBlockFrames, tx.data()); });
+  bench::report("LevelMeter::measure", cycles, "block");
+}
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "log_encoding.hpp"
+#include "metrics.hpp"
+
+namespace {
+
+DELOOP_METRIC_COUNTER(test_counter, "test.counter");
+DELOOP_METRIC_GAUGE(test_gauge, "test.gauge");
+DELOOP_METRIC_HISTOGRAM(test_histogram, "test.histogram", 4);
+
+std::vector<deloop::MetricSample> collect(bool all) {
+  std::vector<deloop::MetricSample> samples;
+  deloop::CollectMetrics(all, [&](const deloop::MetricSample &sample) {
+    samples.push_back(sample);
+  });
+  return samples;
+}
+
+class MetricsTests : public ::testing::Test {
+protected:
+  // Start every test with nothing left to report.
+  void SetUp() override { collect(true); }
+};
+
+} // namespace
+
+TEST_F(MetricsTests, RegistryHoldsEveryMetric) {
+  ASSERT_EQ(deloop::GetMetrics().size(), 3);
+
+  std::vector<uint32_t> ids;
+  for (const deloop::MetricEntry &entry : deloop::GetMetrics()) {
+    ids.push_back(entry.id);
+  }
+  EXPECT_NE(std::find(ids.begin(), ids.end(),
+                      deloop::LogSiteId(FNV1A_64("test.counter"))),
+            ids.end());
+  EXPECT_NE(std::find(ids.begin(), ids.end(),
+                      deloop::LogSiteId(FNV1A_64("test.gauge"))),
+            ids.end());
+  EXPECT_NE(std::find(ids.begin(), ids.end(),
+                      deloop::LogSiteId(FNV1A_64("test.histogram"))),
+            ids.end());
+}
+
+TEST_F(MetricsTests, OnlyChangedValuesAreCollected) {
+  EXPECT_TRUE(collect(false).empty());
+
+  test_counter.increment(3);
+  std::vector<deloop::MetricSample> samples = collect(false);
+  ASSERT_EQ(samples.size(), 1);
+  EXPECT_EQ(samples[0].id, deloop::LogSiteId(FNV1A_64("test.counter")));
+  EXPECT_EQ(samples[0].type, deloop::MetricType::kCounter);
+  EXPECT_EQ(samples[0].value, test_counter.value());
+
+  EXPECT_TRUE(collect(false).empty());
+}
+
+TEST_F(MetricsTests, GaugeHoldsSignedValues) {
+  test_gauge.set(-5);
+  std::vector<deloop::MetricSample> samples = collect(false);
+  ASSERT_EQ(samples.size(), 1);
+  EXPECT_EQ(samples[0].type, deloop::MetricType::kGauge);
+  EXPECT_EQ(static_cast<int32_t>(samples[0].value), -5);
+}
+
+TEST_F(MetricsTests, HistogramBuckets) {
+  uint32_t before[deloop::Histogram::kNumBuckets];
+  for (size_t i = 0; i < deloop::Histogram::kNumBuckets; i++) {
+    before[i] = test_histogram.count(i);
+  }
+
+  // Unit of 16: [0, 16), [16, 32), [32, 64), ... and a final open bucket.
+  test_histogram.record(0);
+  test_histogram.record(15);
+  test_histogram.record(16);
+  test_histogram.record(63);
+  test_histogram.record(0xFFFFFFFF);
+
+  EXPECT_EQ(test_histogram.count(0) - before[0], 2);
+  EXPECT_EQ(test_histogram.count(1) - before[1], 1);
+  EXPECT_EQ(test_histogram.count(2) - before[2], 1);
+  EXPECT_EQ(test_histogram.count(7) - before[7], 1);
+
+  std::vector<deloop::MetricSample> samples = collect(false);
+  ASSERT_EQ(samples.size(), 4);
+  EXPECT_EQ(samples[0].bucket, 0);
+  EXPECT_EQ(samples[3].bucket, 7);
+  EXPECT_EQ(samples[3].type, deloop::MetricType::kHistogram);
+}
+
+TEST_F(MetricsTests, CollectAllReportsUnchangedValues) {
+  EXPECT_EQ(collect(true).size(), 2 + deloop::Histogram::kNumBuckets);
+}
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "audio/mixer.hpp"
+#include "bench.hpp"
+
+using deloop::Mixer;
+
+namespace {
+
+constexpr float kSampleRate = 48000.0f;
+constexpr uint32_t kBlockFrames = 32;
+constexpr size_t kBlockSamples = kBlockFrames * Mixer::kChannels;
+
+using Source = std::array<int16_t, kBlockSamples>;
+using Block = std::array<int32_t, kBlockSamples>;
+
+Source random(std::mt19937 &rng) {
+  Source source;
+  for (int16_t &sample : source) {
+    sample = static_cast<int16_t>(rng());
+  }
+  return source;
+}
+
+// Mixes `sources` into a silent block.
+Block mix(Mixer &mixer, const std::vector<const int16_t *> &sources) {
+  Block tx = {};
+  mixer.mix(kBlockFrames, sources.data(), sources.size(), tx.data());
+  return tx;
+}
+
+// Runs `mixer` until its gains settle.
+void settle(Mixer &mixer) {
+  constexpr uint32_t kFrames = static_cast<uint32_t>(
+      Mixer::kSmoothingMs * kSampleRate / 1000.0f);
+  std::vector<const int16_t *> none(Mixer::kMaxSources, nullptr);
+  for (uint32_t done = 0; done <= kFrames; done += kBlockFrames) {
+    mix(mixer, none);
+  }
+}
+
+} // namespace
+
+TEST(MixerTests, unity_gains_sum_exactly) {
+  Mixer mixer(kSampleRate);
+  std::mt19937 rng(1);
+  Source a = random(rng);
+  Source b = random(rng);
+  Source c = random(rng);
+
+  Block tx = mix(mixer, {a.data(), nullptr, b.data(), c.data()});
+  for (size_t i = 0; i < kBlockSamples; i++) {
+    int32_t sum = (a[i] + b[i] + c[i]) << 8;
+    ASSERT_EQ(tx[i], std::clamp(sum, -0x7FFFFF, 0x7FFFFF));
+  }
+}
+
+TEST(MixerTests, matches_a_reference_for_any_count_and_gains) {
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> gain(0.0f, Mixer::kMaxGain);
+  std::uniform_real_distribution<float> pan(-1.0f, 1.0f);
+
+  for (size_t count = 1; count <= Mixer::kMaxSources; count++) {
+    Mixer mixer(kSampleRate);
+    std::vector<Source> sources(count);
+    std::vector<const int16_t *> pointers;
+    std::vector<int32_t> left(count);
+    std::vector<int32_t> right(count);
+    for (size_t s = 0; s < count; s++) {
+      // Quiet enough not to saturate, so the sum is checked exactly.
+      for (int16_t &sample : sources[s]) {
+        sample = static_cast<int16_t>(static_cast<int16_t>(rng()) / 16);
+      }
+      pointers.push_back(sources[s].data());
+      float g = gain(rng);
+      float p = pan(rng);
+      mixer.setLevel(s, g, p);
+      left[s] = static_cast<int32_t>(g * std::min(1.0f, 1.0f - p) * 16384 +
+                                     0.5f);
+      right[s] = static_cast<int32_t>(g * std::min(1.0f, 1.0f + p) * 16384 +
+                                      0.5f);
+    }
+    settle(mixer);
+
+    Block tx = mix(mixer, pointers);
+    for (size_t i = 0; i < kBlockFrames; i++) {
+      int64_t l = 0;
+      int64_t r = 0;
+      for (size_t s = 0; s < count; s++) {
+        l += sources[s][2 * i] * std::min(left[s], INT16_MAX);
+        r += sources[s][2 * i + 1] * std::min(right[s], INT16_MAX);
+      }
+      ASSERT_EQ(tx[2 * i], l >> 6) << count;
+      ASSERT_EQ(tx[2 * i + 1], r >> 6) << count;
+    }
+  }
+}
+
+TEST(MixerTests, full_scale_sources_saturate_without_wrapping) {
+  Mixer mixer(kSampleRate);
+  for (size_t s = 0; s < Mixer::kMaxSources; s++) {
+    mixer.setLevel(s, Mixer::kMaxGain, 0.0f);
+  }
+  settle(mixer);
+
+  Source high;
+  high.fill(INT16_MAX);
+  Source low;
+  low.fill(INT16_MIN);
+  std::vector<const int16_t *> highs(Mixer::kMaxSources, high.data());
+  std::vector<const int16_t *> lows(Mixer::kMaxSources, low.data());
+  EXPECT_EQ(mix(mixer, highs)[0], 0x7FFFFF);
+  EXPECT_EQ(mix(mixer, lows)[1], -0x7FFFFF);
+
+  // What is already in the output counts towards saturation.
+  Block tx;
+  tx.fill(0x7FFF00);
+  Source quiet;
+  quiet.fill(100);
+  const int16_t *one[] = {quiet.data()};
+  mixer.mix(kBlockFrames, one, 1, tx.data());
+  EXPECT_EQ(tx[0], 0x7FFFFF);
+}
+
+TEST(MixerTests, pan_turns_the_other_side_down) {
+  Mixer mixer(kSampleRate);
+  mixer.setLevel(0, 1.0f, -1.0f);
+  mixer.setLevel(1, 1.0f, 0.5f);
+  settle(mixer);
+
+  Source source;
+  source.fill(1000);
+  EXPECT_EQ(mix(mixer, {source.data()})[0], 1000 << 8);
+  EXPECT_EQ(mix(mixer, {source.data()})[1], 0);
+  EXPECT_EQ(mix(mixer, {nullptr, source.data()})[0], 500 << 8);
+  EXPECT_EQ(mix(mixer, {nullptr, source.data()})[1], 1000 << 8);
+}
+
+TEST(MixerTests, gain_changes_ramp_without_steps) {
+  Mixer mixer(kSampleRate);
+  Source source;
+  source.fill(10000);
+  EXPECT_FALSE(mixer.silent(0));
+
+  mixer.setLevel(0, 0.0f, 0.0f);
+  int32_t previous = 10000 << 8;
+  size_t frames = 0;
+  while (!mixer.silent(0)) {
+    Block tx = mix(mixer, {source.data()});
+    for (size_t i = 0; i < kBlockFrames; i++) {
+      ASSERT_LE(tx[2 * i], previous);
+      ASSERT_GE(tx[2 * i], previous - (10000 << 8) / 900);
+      previous = tx[2 * i];
+    }
+    frames += kBlockFrames;
+  }
+  EXPECT_EQ(previous, 0);
+  EXPECT_NEAR(static_cast<double>(frames), 960.0, kBlockFrames);
+  EXPECT_EQ(mix(mixer, {source.data()}), Block{});
+}
+
+// Cost of mixing steady sources, the common case, and while every gain
+// moves.
+TEST(MixerBenchmark, cycles_per_frame) {
+  constexpr uint64_t kBlocks = 200000;
+  std::mt19937 rng(3);
+  std::vector<Source> sources(Mixer::kMaxSources);
+  std::vector<const int16_t *> pointers;
+  for (Source &source : sources) {
+    source = random(rng);
+    pointers.push_back(source.data());
+  }
+  Block tx = {};
+
+  for (size_t count : {2, 4, 8}) {
+    Mixer mixer(kSampleRate);
+    double steady = bench::measure(kBlocks, [&]() {
+      mixer.mix(kBlockFrames, pointers.data(), count, tx.data());
+    });
+    float level = 0.5f;
+    double moving = bench::measure(kBlocks, [&]() {
+      level = 1.5f - level;
+      for (size_t s = 0; s < count; s++) {
+        mixer.setLevel(s, level, 0.0f);
+      }
+      mixer.mix(kBlockFrames, pointers.data(), count, tx.data());
+    });
+
+    std::string label = "Mixer (" + std::to_string(count) + " sources, ";
+    bench::report((label + "steady)").c_str(), steady / kBlockFrames,
+                  "frame");
+    bench::report((label + "moving)").c_str(), moving / kBlockFrames,
+                  "frame");
+  }
+}
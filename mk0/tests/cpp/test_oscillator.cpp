@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <numbers>
+#include <string>
+#include <vector>
+
+#include "audio/oscillator.hpp"
+#include "bench.hpp"
+
+using deloop::OscillatorBank;
+
+namespace {
+
+constexpr float kSampleRate = 48000.0f;
+constexpr uint32_t kBlockFrames = 32;
+constexpr double kFullScale = 0x7FFFFF;
+
+using Block = std::array<int32_t, kBlockFrames * 2>;
+
+// The left channel of `num_blocks` blocks rendered by `bank`.
+std::vector<int32_t> render(OscillatorBank &bank, uint32_t num_blocks) {
+  std::vector<int32_t> left;
+  for (uint32_t block = 0; block < num_blocks; block++) {
+    Block tx = {};
+    bank.render(kBlockFrames, tx.data());
+    for (uint32_t i = 0; i < kBlockFrames; i++) {
+      EXPECT_EQ(tx[2 * i], tx[2 * i + 1]);
+      left.push_back(tx[2 * i]);
+    }
+  }
+  return left;
+}
+
+// Runs `bank` past any glide.
+void settle(OscillatorBank &bank) {
+  render(bank, static_cast<uint32_t>(OscillatorBank::kGlideMs * kSampleRate /
+                                     1000.0f / kBlockFrames) +
+                   1);
+}
+
+} // namespace
+
+TEST(OscillatorTests, plays_a_clean_sine_at_any_frequency) {
+  for (float hz : {27.5f, 440.0f, 1000.0f, 5123.4f, 19000.0f}) {
+    OscillatorBank bank(kSampleRate);
+    bank.play(0, hz, 1.0f);
+    settle(bank);
+
+    // Least squares fit of an exact sine at the frequency asked for.
+    std::vector<int32_t> out = render(bank, 200);
+    double w = 2.0 * std::numbers::pi * static_cast<double>(hz / kSampleRate);
+    double ss = 0.0;
+    double cc = 0.0;
+    double sc = 0.0;
+    double ys = 0.0;
+    double yc = 0.0;
+    for (size_t i = 0; i < out.size(); i++) {
+      double s = std::sin(w * static_cast<double>(i));
+      double c = std::cos(w * static_cast<double>(i));
+      ss += s * s;
+      cc += c * c;
+      sc += s * c;
+      ys += out[i] * s;
+      yc += out[i] * c;
+    }
+    double det = ss * cc - sc * sc;
+    double a = (ys * cc - yc * sc) / det;
+    double b = (yc * ss - ys * sc) / det;
+    EXPECT_NEAR(std::hypot(a, b), kFullScale, kFullScale * 1e-4);
+
+    double peak_error = 0.0;
+    for (size_t i = 0; i < out.size(); i++) {
+      double exact = a * std::sin(w * static_cast<double>(i)) +
+                     b * std::cos(w * static_cast<double>(i));
+      peak_error = std::max(peak_error, std::abs(out[i] - exact));
+    }
+    double db = 20.0 * std::log10(peak_error / kFullScale);
+    std::printf("[ BENCH    ] %7.1f Hz: peak error %.1f dB\n",
+                static_cast<double>(hz), db);
+    EXPECT_LT(db, -80.0) << hz;
+  }
+}
+
+TEST(OscillatorTests, level_glides_without_steps) {
+  OscillatorBank bank(kSampleRate);
+  EXPECT_FALSE(bank.active(0));
+  bank.play(0, 100.0f, 1.0f);
+  EXPECT_TRUE(bank.active(0));
+
+  // The peak slope of a full scale 100 Hz sine, with room for the glide.
+  double max_slope = kFullScale * 2.0 * std::numbers::pi * 100.0 /
+                     static_cast<double>(kSampleRate) * 1.1;
+  std::vector<int32_t> out = render(bank, 100);
+  for (size_t i = 1; i < out.size(); i++) {
+    ASSERT_LT(std::abs(out[i] - out[i - 1]), max_slope) << i;
+  }
+  EXPECT_GT(*std::max_element(out.begin(), out.end()), 0.99 * kFullScale);
+
+  // Gliding to 0 turns the voice off, and it stays silent.
+  bank.play(0, 100.0f, 0.0f);
+  settle(bank);
+  EXPECT_FALSE(bank.active(0));
+  for (int32_t sample : render(bank, 10)) {
+    ASSERT_EQ(sample, 0);
+  }
+}
+
+TEST(OscillatorTests, struck_voice_decays_then_stops) {
+  constexpr uint32_t kDecayFrames = 1440;
+  OscillatorBank bank(kSampleRate);
+  bank.strike(0, 1000.0f, 1.0f, kDecayFrames);
+
+  std::vector<int32_t> out = render(bank, kDecayFrames / kBlockFrames + 2);
+  EXPECT_GT(out[0], 0);
+  double w = 2.0 * std::numbers::pi * 1000.0 /
+             static_cast<double>(kSampleRate);
+  EXPECT_NEAR(out[0], kFullScale * std::sin(w), kFullScale * 1e-4);
+
+  // Close to 60 dB down over the last cycle, then silent.
+  int32_t tail = 0;
+  for (uint32_t i = kDecayFrames - 48; i < kDecayFrames; i++) {
+    tail = std::max(tail, std::abs(out[i]));
+  }
+  EXPECT_NEAR(20.0 * std::log10(tail / kFullScale), -59.0, 1.0);
+  for (size_t i = kDecayFrames; i < out.size(); i++) {
+    ASSERT_EQ(out[i], 0);
+  }
+  EXPECT_FALSE(bank.active(0));
+}
+
+TEST(OscillatorTests, voices_add_and_saturate) {
+  OscillatorBank bank(kSampleRate);
+  bank.play(0, 440.0f, 0.5f);
+  bank.play(1, 660.0f, 0.25f);
+  settle(bank);
+  std::vector<int32_t> both = render(bank, 4);
+
+  OscillatorBank first(kSampleRate);
+  first.play(0, 440.0f, 0.5f);
+  settle(first);
+  OscillatorBank second(kSampleRate);
+  second.play(1, 660.0f, 0.25f);
+  settle(second);
+  std::vector<int32_t> a = render(first, 4);
+  std::vector<int32_t> b = render(second, 4);
+  for (size_t i = 0; i < both.size(); i++) {
+    ASSERT_EQ(both[i], a[i] + b[i]);
+  }
+
+  // Voices add to what is already there, and clip rather than wrap.
+  Block tx;
+  tx.fill(0x7FFF00);
+  for (size_t v = 0; v < OscillatorBank::kMaxVoices; v++) {
+    bank.strike(v, 12000.0f, 1.0f, 1000);
+  }
+  bank.render(kBlockFrames, tx.data());
+  EXPECT_EQ(tx[0], 0x7FFFFF);
+}
+
+// Cost per voice per frame with every voice holding a tone, the usual case,
+// and with every voice struck.
+TEST(OscillatorBenchmark, cycles_per_voice_per_frame) {
+  constexpr uint64_t kBlocks = 200000;
+  Block tx = {};
+  for (size_t count : {1, 4, 8}) {
+    OscillatorBank bank(kSampleRate);
+    for (size_t v = 0; v < count; v++) {
+      bank.play(v, 100.0f * static_cast<float>(v + 1), 0.1f);
+    }
+    settle(bank);
+    double holding = bench::measure(
+        kBlocks, [&]() { bank.render(kBlockFrames, tx.data()); });
+
+    double struck = bench::measure(kBlocks, [&]() {
+      for (size_t v = 0; v < count; v++) {
+        if (!bank.active(v)) {
+          bank.strike(v, 1000.0f, 0.1f, 1440);
+        }
+      }
+      bank.render(kBlockFrames, tx.data());
+    });
+
+    double frames = static_cast<double>(count * kBlockFrames);
+    std::string label = "OscillatorBank (" + std::to_string(count);
+    bench::report((label + " holding)").c_str(), holding / frames,
+                  "voice frame");
+    bench::report((label + " struck)").c_str(), struck / frames,
+                  "voice frame");
+  }
+}
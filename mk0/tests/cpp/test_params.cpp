@@ -0,0 +1,147 @@
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+#include "log_encoding.hpp"
+#include "params.hpp"
+#include "util/triple_buffer.hpp"
+
+namespace {
+
+DELOOP_PARAM(test_gain, "test.gain", 0.5f, 0.0f, 1.0f);
+DELOOP_PARAM(test_mix, "test.mix", 0.0f, -1.0f, 1.0f);
+
+const uint32_t kGainId = deloop::LogSiteId(FNV1A_64("test.gain"));
+const uint32_t kMixId = deloop::LogSiteId(FNV1A_64("test.mix"));
+
+class ParamsTests : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    ASSERT_EQ(deloop::params::init(), deloop::Error::kOk);
+  }
+
+  // Start every test from the defaults, as seen by the audio side.
+  void SetUp() override {
+    deloop::ParamUpdate defaults[] = {{kGainId, 0.5f}, {kMixId, 0.0f}};
+    ASSERT_EQ(deloop::params::set(defaults), deloop::Error::kOk);
+    deloop::params::acquire();
+  }
+};
+
+} // namespace
+
+TEST(TripleBufferTests, ReaderSeesLatestPublishedValue) {
+  deloop::TripleBuffer<int> buffer;
+  buffer.reset(0);
+  EXPECT_FALSE(buffer.acquire());
+
+  buffer.back() = 1;
+  buffer.publish();
+  buffer.back() = 2;
+  buffer.publish();
+  EXPECT_EQ(buffer.front(), 0);
+
+  EXPECT_TRUE(buffer.acquire());
+  EXPECT_EQ(buffer.front(), 2);
+  EXPECT_FALSE(buffer.acquire());
+  EXPECT_EQ(buffer.front(), 2);
+}
+
+TEST(TripleBufferTests, WriterNeverTouchesFront) {
+  deloop::TripleBuffer<int> buffer;
+  buffer.reset(0);
+  buffer.back() = 1;
+  buffer.publish();
+  ASSERT_TRUE(buffer.acquire());
+
+  for (int i = 2; i < 10; i++) {
+    buffer.back() = i;
+    buffer.publish();
+    EXPECT_EQ(buffer.front(), 1);
+  }
+}
+
+TEST_F(ParamsTests, RegistryHoldsEveryParam) {
+  ASSERT_EQ(deloop::GetParams().size(), 2);
+  EXPECT_EQ(test_gain.value(), 0.5f);
+  EXPECT_EQ(test_mix.value(), 0.0f);
+}
+
+TEST_F(ParamsTests, ChangesAppearAtNextAcquire) {
+  deloop::ParamUpdate updates[] = {{kGainId, 0.25f}, {kMixId, -0.5f}};
+  ASSERT_EQ(deloop::params::set(updates), deloop::Error::kOk);
+
+  float value = 0.0f;
+  ASSERT_EQ(deloop::params::get(kGainId, value), deloop::Error::kOk);
+  EXPECT_EQ(value, 0.25f);
+  EXPECT_EQ(test_gain.value(), 0.5f);
+
+  deloop::params::acquire();
+  EXPECT_EQ(test_gain.value(), 0.25f);
+  EXPECT_EQ(test_mix.value(), -0.5f);
+}
+
+TEST_F(ParamsTests, InvalidUpdatesApplyNothing) {
+  deloop::ParamUpdate out_of_range[] = {{kGainId, 0.25f}, {kMixId, 2.0f}};
+  EXPECT_EQ(deloop::params::set(out_of_range),
+            deloop::Error::kInvalidArgument);
+
+  deloop::ParamUpdate unknown[] = {{kGainId, 0.25f}, {1234, 0.0f}};
+  EXPECT_EQ(deloop::params::set(unknown), deloop::Error::kParamNotFound);
+
+  std::vector<deloop::ParamUpdate> too_many(deloop::kMaxParams + 1,
+                                            {kGainId, 0.25f});
+  EXPECT_EQ(deloop::params::set(too_many), deloop::Error::kInvalidArgument);
+
+  float value = 0.0f;
+  ASSERT_EQ(deloop::params::get(kGainId, value), deloop::Error::kOk);
+  EXPECT_EQ(value, 0.5f);
+  deloop::params::acquire();
+  EXPECT_EQ(test_gain.value(), 0.5f);
+}
+
+// Each writer publishes both parameters with the same generation value, so a
+// reader that ever sees them differ has read a torn snapshot.
+TEST_F(ParamsTests, ConcurrentWritersNeverTearReads) {
+  const int kNumWriters = 3;
+  const int kUpdatesPerWriter = 20000;
+
+  // The defaults differ, so start the reader from a matching pair.
+  deloop::ParamUpdate start[] = {{kGainId, 0.0f}, {kMixId, 0.0f}};
+  ASSERT_EQ(deloop::params::set(start), deloop::Error::kOk);
+  deloop::params::acquire();
+
+  std::atomic<int> writers_done = 0;
+  std::vector<std::thread> writers;
+  for (int w = 0; w < kNumWriters; w++) {
+    writers.emplace_back([w, &writers_done] {
+      for (int i = 0; i < kUpdatesPerWriter; i++) {
+        float value = static_cast<float>(w * kUpdatesPerWriter + i) /
+                      (kNumWriters * kUpdatesPerWriter);
+        deloop::ParamUpdate updates[] = {{kGainId, value}, {kMixId, value}};
+        EXPECT_EQ(deloop::params::set(updates), deloop::Error::kOk);
+      }
+      writers_done.fetch_add(1);
+    });
+  }
+
+  uint64_t reads = 0;
+  uint64_t torn = 0;
+  while (writers_done.load() < kNumWriters) {
+    deloop::params::acquire();
+    if (test_gain.value() != test_mix.value()) {
+      torn++;
+    }
+    reads++;
+  }
+
+  for (std::thread &writer : writers) {
+    writer.join();
+  }
+
+  EXPECT_GT(reads, 0);
+  EXPECT_EQ(torn, 0);
+}
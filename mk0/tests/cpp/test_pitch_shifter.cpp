@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <numbers>
+#include <utility>
+#include <vector>
+
+#include "audio/pitch_shifter.hpp"
+#include "bench.hpp"
+
+using deloop::PitchShifter;
+
+namespace {
+
+constexpr uint32_t kBlockFrames = 32;
+constexpr double kSampleRate = 48000.0;
+constexpr double kAmplitude = 0x400000; // Half of 24-bit full scale.
+
+// `num_frames` interleaved frames of a sine, the same on both channels.
+std::vector<int32_t> sine(double hz, size_t num_frames) {
+  std::vector<int32_t> samples(num_frames * 2);
+  for (size_t i = 0; i < num_frames; i++) {
+    double phase = 2.0 * std::numbers::pi * hz * static_cast<double>(i) /
+                   kSampleRate;
+    samples[2 * i] = static_cast<int32_t>(kAmplitude * std::sin(phase));
+    samples[2 * i + 1] = samples[2 * i];
+  }
+  return samples;
+}
+
+// Runs `samples` through `shifter` a block at a time, in place.
+void shift(PitchShifter &shifter, std::vector<int32_t> &samples) {
+  for (size_t i = 0; i < samples.size(); i += 2 * kBlockFrames) {
+    shifter.process(kBlockFrames, &samples[i]);
+  }
+}
+
+// Power of the left channel at `hz` (Goertzel), from frame `first` on.
+double power(const std::vector<int32_t> &samples, double hz, size_t first) {
+  double coeff = 2.0 * std::cos(2.0 * std::numbers::pi * hz / kSampleRate);
+  double s1 = 0.0;
+  double s2 = 0.0;
+  for (size_t i = first; i < samples.size() / 2; i++) {
+    double s = samples[2 * i] + coeff * s1 - s2;
+    s2 = s1;
+    s1 = s;
+  }
+  return s1 * s1 + s2 * s2 - coeff * s1 * s2;
+}
+
+double rms(const std::vector<int32_t> &samples, size_t first) {
+  double sum = 0.0;
+  for (size_t i = first; i < samples.size() / 2; i++) {
+    sum += static_cast<double>(samples[2 * i]) * samples[2 * i];
+  }
+  return std::sqrt(sum / static_cast<double>(samples.size() / 2 - first));
+}
+
+} // namespace
+
+TEST(PitchShifterTests, zero_semitones_passes_through) {
+  static PitchShifter shifter;
+  std::vector<int32_t> in = sine(440.0, 4096);
+  std::vector<int32_t> out = in;
+  shift(shifter, out);
+  EXPECT_EQ(out, in);
+}
+
+TEST(PitchShifterTests, transposes_a_sine) {
+  constexpr double kHz = 440.0;
+  constexpr size_t kFrames = 48000;
+  constexpr size_t kSettled = kFrames / 2;
+  for (float semitones : {12.0f, 7.0f, -5.0f, -12.0f}) {
+    SCOPED_TRACE(semitones);
+    static PitchShifter shifter;
+    shifter.setPitch(semitones);
+    std::vector<int32_t> out = sine(kHz, kFrames);
+    shift(shifter, out);
+
+    double target = kHz * std::exp2(static_cast<double>(semitones) / 12.0);
+    double db = 10.0 * std::log10(power(out, target, kSettled) /
+                                  power(out, kHz, kSettled));
+    std::printf("[ BENCH    ] %+5.1f semitones: %.1f dB over the input "
+                "pitch\n",
+                static_cast<double>(semitones), db);
+    EXPECT_GT(db, 30.0);
+
+    // The windows sum to 1, so the level is kept up to the beating of
+    // overlapping grains.
+    double gain = 20.0 * std::log10(rms(out, kSettled) / (kAmplitude / 2));
+    EXPECT_NEAR(gain, 20.0 * std::log10(std::sqrt(2.0)), 3.0);
+  }
+}
+
+TEST(PitchShifterTests, pitch_changes_do_not_click) {
+  static PitchShifter shifter;
+  shifter.setPitch(3.0f);
+  std::vector<int32_t> out = sine(200.0, 48000);
+  for (size_t i = 0; i < out.size(); i += 2 * kBlockFrames) {
+    if (i == out.size() / 2) {
+      shifter.setPitch(-3.0f);
+    }
+    shifter.process(kBlockFrames, &out[i]);
+  }
+
+  // A step would show as a jump far beyond the slope of the transposed
+  // sines.
+  double max_slope = kAmplitude * 2.0 * std::numbers::pi * 200.0 *
+                     std::exp2(3.0 / 12.0) / kSampleRate;
+  int32_t max_jump = 0;
+  for (size_t i = 2; i < out.size(); i += 2) {
+    max_jump = std::max(max_jump, std::abs(out[i] - out[i - 2]));
+  }
+  EXPECT_LT(max_jump, 2.0 * max_slope);
+}
+
+// Cost per block, and what share of the device's block budget that would
+// be at the host's cycle count (180 MHz core, 32 frames at 48 kHz).
+TEST(PitchShifterBenchmark, cycles_per_block) {
+  constexpr uint64_t kBlocks = 100000;
+  constexpr double kBudget = 180e6 * kBlockFrames / kSampleRate;
+  static PitchShifter shifter;
+  std::vector<int32_t> block = sine(440.0, kBlockFrames);
+
+  for (float semitones : {0.0f, -12.0f, 7.0f, 12.0f}) {
+    shifter.setPitch(semitones);
+    std::vector<uint64_t> costs(kBlocks);
+    for (uint64_t &cost : costs) {
+      uint64_t start = bench::now();
+      shifter.process(kBlockFrames, block.data());
+      cost = bench::now() - start;
+    }
+
+    // Most blocks only read grains; one in `kHopFrames / kBlockFrames` also
+    // restarts one. The host's worst single call is scheduler noise, so
+    // report a high percentile for the restarts.
+    std::sort(costs.begin(), costs.end());
+    for (auto [percentile, index] :
+         {std::pair{"p50", kBlocks / 2},
+          std::pair{"p99.9", kBlocks * 999 / 1000}}) {
+      double cycles = static_cast<double>(costs[index]);
+      char label[64];
+      std::snprintf(label, sizeof(label), "PitchShifter (%+.0f, %s)",
+                    static_cast<double>(semitones), percentile);
+      bench::report(label, cycles, "block");
+      std::printf("[ BENCH    ] %.1f%% of a %.0f cycle block\n",
+                  100.0 * cycles / kBudget, kBudget);
+    }
+  }
+}
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <gtest/gtest.h>
+#include <numbers>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "audio/resampler.hpp"
+#include "bench.hpp"
+
+using deloop::Interpolation;
+using deloop::Resampler;
+
+namespace {
+
+constexpr std::pair<Interpolation, const char *> kQualities[] = {
+    {Interpolation::kLinear, "linear"},
+    {Interpolation::kCubic, "cubic"},
+    {Interpolation::kPolyphase, "polyphase"},
+};
+
+// Input frame `i`, the same on both channels.
+using Source = std::function<int16_t(int64_t)>;
+
+// Resamples `source` from frame 0 at `step`, returning `n` output samples of
+// the left channel.
+std::vector<int32_t> resample(Interpolation quality, uint32_t step,
+                              const Source &source, size_t n) {
+  Resampler resampler;
+  int64_t next = -static_cast<int64_t>(Resampler::kCentre);
+  auto push = [&]() {
+    int16_t frame[2] = {source(next), source(next)};
+    resampler.push(frame);
+    next++;
+  };
+  for (size_t i = 0; i < Resampler::kTaps; i++) {
+    push();
+  }
+
+  std::vector<int32_t> out(n);
+  for (size_t i = 0; i < n; i++) {
+    int32_t frame[2];
+    resampler.interpolate(quality, frame);
+    EXPECT_EQ(frame[0], frame[1]);
+    out[i] = frame[0];
+    for (uint32_t k = resampler.advance(step); k > 0; k--) {
+      push();
+    }
+  }
+  return out;
+}
+
+uint32_t stepFor(double speed) {
+  return static_cast<uint32_t>(speed * Resampler::kUnitStep);
+}
+
+} // namespace
+
+TEST(ResamplerTests, whole_frame_steps_are_exact) {
+  Source ramp = [](int64_t i) { return static_cast<int16_t>(i * 100); };
+  for (auto [quality, name] : kQualities) {
+    SCOPED_TRACE(name);
+    std::vector<int32_t> out = resample(quality, stepFor(2.0), ramp, 64);
+    for (size_t i = 0; i < out.size(); i++) {
+      ASSERT_EQ(out[i], static_cast<int32_t>(i * 2 * 100) << 8);
+    }
+  }
+}
+
+TEST(ResamplerTests, linear_and_cubic_follow_a_ramp_between_frames) {
+  Source ramp = [](int64_t i) { return static_cast<int16_t>(i * 64); };
+  for (Interpolation quality :
+       {Interpolation::kLinear, Interpolation::kCubic}) {
+    std::vector<int32_t> out = resample(quality, stepFor(0.25), ramp, 256);
+    for (size_t i = 0; i < out.size(); i++) {
+      ASSERT_EQ(out[i], static_cast<int32_t>(i * 16) << 8);
+    }
+  }
+}
+
+TEST(ResamplerTests, fine_speeds_hold_their_rate) {
+  // A drift correction of 50 ppm is a frame every 20000.
+  Source ramp = [](int64_t i) { return static_cast<int16_t>(i % 30000); };
+  std::vector<int32_t> out =
+      resample(Interpolation::kLinear, stepFor(1.00005), ramp, 20001);
+  EXPECT_NEAR(out.back() >> 8, 20001, 1);
+}
+
+TEST(ResamplerTests, better_kernels_track_a_sine_more_closely) {
+  constexpr double kHz = 6000.0;
+  constexpr double kSpeed = 0.73;
+  constexpr double kAmplitude = 20000.0;
+  auto ideal = [](double frame) {
+    return kAmplitude *
+           std::sin(2.0 * std::numbers::pi * kHz * frame / 48000.0);
+  };
+  Source sine = [&](int64_t i) {
+    return static_cast<int16_t>(std::lround(ideal(static_cast<double>(i))));
+  };
+
+  double previous = 0.0;
+  for (auto [quality, name] : kQualities) {
+    std::vector<int32_t> out = resample(quality, stepFor(kSpeed), sine, 4096);
+    double signal = 0.0;
+    double noise = 0.0;
+    for (size_t i = 0; i < out.size(); i++) {
+      double s = ideal(static_cast<double>(i) * kSpeed);
+      double e = out[i] / 256.0 - s;
+      signal += s * s;
+      noise += e * e;
+    }
+    double db = 10.0 * std::log10(signal / noise);
+    std::printf("[ BENCH    ] %-9s SNR on a 6 kHz sine: %.1f dB\n", name,
+                db);
+    EXPECT_GT(db, previous + 6.0) << name;
+    previous = db;
+  }
+  EXPECT_GT(previous, 50.0);
+}
+
+// Cost per output frame at half and double speed, where double speed also
+// pushes two frames per output.
+TEST(ResamplerBenchmark, cycles_per_frame) {
+  constexpr uint64_t kFrames = 1000000;
+  int16_t frame[2] = {1000, -1000};
+  for (auto [quality, name] : kQualities) {
+    for (double speed : {0.5, 2.0}) {
+      Resampler resampler;
+      uint32_t step = stepFor(speed);
+      int32_t sum = 0;
+      double cycles = bench::measure(kFrames, [&]() {
+        int32_t out[2];
+        resampler.interpolate(quality, out);
+        sum += out[0] + out[1];
+        for (uint32_t k = resampler.advance(step); k > 0; k--) {
+          frame[0]++;
+          resampler.push(frame);
+        }
+      });
+      char label[64];
+      std::snprintf(label, sizeof(label), "Resampler (%s, speed %.1f)", name,
+                    speed);
+      bench::report(label, cycles, "frame");
+      EXPECT_NE(sum, 1); // Keeps the loop from being optimized out.
+    }
+  }
+}
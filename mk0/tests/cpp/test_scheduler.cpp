@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <gtest/gtest.h>
+
+#include "audio/scheduler.hpp"
+#include "errors.hpp"
+#include "logging.hpp"
+
+// NOTE: This test links only the audio and logging libraries. Any call from
+// `audio_scheduler::process` into the blocking `SubmitLog` path would fail to
+// link, since that lives with the UART stream.
+
+static deloop::Error failingCallback(uint32_t num_frames, int32_t *tx,
+                                     int32_t *rx) {
+  (void)num_frames;
+  (void)tx;
+  (void)rx;
+  return deloop::Error::kInvalidArgument;
+}
+
+TEST(SchedulerTests, process_never_blocks_on_full_log_ring) {
+  constexpr int kIterations = 10000;
+  constexpr auto kMaxCallDuration = std::chrono::milliseconds(5);
+
+  deloop::Error err = deloop::audio_scheduler::init();
+  ASSERT_TRUE(err == deloop::Error::kOk ||
+              err == deloop::Error::kAlreadyInitialized);
+  ASSERT_EQ(deloop::audio_scheduler::registerCallback(failingCallback),
+            deloop::Error::kOk);
+
+  std::array<int32_t, 64> tx = {};
+  std::array<int32_t, 64> rx = {};
+  uint32_t overflows_before = deloop::GetRtLogOverflows(
+      deloop::LogContext::kAudio, deloop::LogLevel::ERROR);
+
+  // Nothing drains the ring, so it fills after a handful of blocks and every
+  // later error must be dropped rather than waited on.
+  auto worst = std::chrono::steady_clock::duration::zero();
+  for (int i = 0; i < kIterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    err = deloop::audio_scheduler::process(
+        tx.size() / deloop::audio_scheduler::kNumChannels, tx.data(),
+        rx.data());
+    worst = std::max(worst, std::chrono::steady_clock::now() - start);
+    ASSERT_EQ(err, deloop::Error::kInvalidArgument);
+  }
+
+  EXPECT_LT(worst, kMaxCallDuration);
+
+  size_t queued = 0;
+  deloop::LogEntry entry;
+  while (deloop::TakeRtLog(deloop::LogContext::kAudio, entry)) {
+    EXPECT_EQ(entry.level, deloop::LogLevel::ERROR);
+    EXPECT_EQ(entry.hash, FNV1A_64("[AUDIO_SCHEDULER] Callback failed: %d"));
+    queued++;
+  }
+
+  uint32_t overflows = deloop::GetRtLogOverflows(deloop::LogContext::kAudio,
+                                                 deloop::LogLevel::ERROR) -
+                       overflows_before;
+  EXPECT_GT(queued, 0u);
+  EXPECT_EQ(queued + overflows, static_cast<size_t>(kIterations));
+}
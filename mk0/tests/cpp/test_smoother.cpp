@@ -0,0 +1,143 @@
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <gtest/gtest.h>
+
+#include "audio/smoother.hpp"
+#include "bench.hpp"
+
+using Mode = deloop::Smoother::Mode;
+
+constexpr float kSampleRate = 48000.0f;
+
+TEST(SmootherTests, steady_smoother_writes_nothing) {
+  deloop::Smoother smoother(Mode::kLinear, 10.0f, kSampleRate, 0.5f);
+  std::array<float, 4> out = {-1.0f, -1.0f, -1.0f, -1.0f};
+
+  EXPECT_TRUE(smoother.steady());
+  EXPECT_FALSE(smoother.next(out.data(), out.size()));
+  EXPECT_EQ(out[0], -1.0f);
+
+  // Setting the same target again does not start a ramp.
+  smoother.setTarget(0.5f);
+  EXPECT_TRUE(smoother.steady());
+}
+
+TEST(SmootherTests, linear_ramp_reaches_target_exactly) {
+  // 1 ms at 48 kHz is 48 samples.
+  deloop::Smoother smoother(Mode::kLinear, 1.0f, kSampleRate, 0.0f);
+  smoother.setTarget(1.0f);
+
+  std::array<float, 32> out;
+  ASSERT_TRUE(smoother.next(out.data(), out.size()));
+  EXPECT_FLOAT_EQ(out[0], 1.0f / 48);
+  EXPECT_FLOAT_EQ(out[31], 32.0f / 48);
+  EXPECT_FALSE(smoother.steady());
+
+  ASSERT_TRUE(smoother.next(out.data(), out.size()));
+  EXPECT_FLOAT_EQ(out[15], 1.0f);
+  EXPECT_EQ(out[16], 1.0f);
+  EXPECT_EQ(out[31], 1.0f);
+  EXPECT_TRUE(smoother.steady());
+  EXPECT_EQ(smoother.value(), 1.0f);
+}
+
+TEST(SmootherTests, linear_retarget_ramps_from_current_value) {
+  deloop::Smoother smoother(Mode::kLinear, 1.0f, kSampleRate, 0.0f);
+  smoother.setTarget(1.0f);
+
+  std::array<float, 24> out;
+  smoother.next(out.data(), out.size());
+  smoother.setTarget(0.0f);
+  smoother.next(out.data(), 1);
+
+  // Half way up, then a full 48 sample ramp back down.
+  EXPECT_FLOAT_EQ(out[0], 0.5f - 0.5f / 48);
+}
+
+TEST(SmootherTests, one_pole_matches_recursion_and_settles) {
+  const float time_ms = 0.5f;
+  deloop::Smoother smoother(Mode::kOnePole, time_ms, kSampleRate, 0.0f);
+  smoother.setTarget(1.0f);
+
+  const float pole = std::exp(-1000.0f / (time_ms * kSampleRate));
+  float expected = 0.0f;
+  std::array<float, 7> out; // Not a multiple of the unrolled width.
+  for (int block = 0; block < 3; block++) {
+    ASSERT_TRUE(smoother.next(out.data(), out.size()));
+    for (float value : out) {
+      expected = 1.0f + (expected - 1.0f) * pole;
+      EXPECT_NEAR(value, expected, 1e-6f);
+    }
+  }
+
+  // 24 samples per time constant, so 12 time constants is plenty.
+  std::array<float, 24 * 12> settle;
+  smoother.next(settle.data(), settle.size());
+  EXPECT_TRUE(smoother.steady());
+  EXPECT_EQ(smoother.value(), 1.0f);
+}
+
+TEST(SmootherTests, zero_time_changes_immediately) {
+  deloop::Smoother smoother(Mode::kOnePole, 0.0f, kSampleRate, 0.0f);
+  smoother.setTarget(0.25f);
+  EXPECT_TRUE(smoother.steady());
+  EXPECT_EQ(smoother.value(), 0.25f);
+}
+
+TEST(SmootherTests, apply_gain_ramps_every_channel) {
+  deloop::Smoother gain(Mode::kLinear, 0.0625f, kSampleRate, 1.0f);
+  gain.setTarget(0.0f); // 3 sample ramp.
+
+  std::array<int32_t, 8> samples = {1000, -1000, 1000, -1000,
+                                    1000, -1000, 1000, -1000};
+  deloop::ApplyGain(samples.data(), 4, 2, gain);
+  EXPECT_EQ(samples[0], 666);
+  EXPECT_EQ(samples[1], -666);
+  EXPECT_EQ(samples[2], 333);
+  EXPECT_EQ(samples[3], -333);
+  EXPECT_EQ(samples[4], 0);
+  EXPECT_EQ(samples[7], 0);
+  EXPECT_TRUE(gain.steady());
+}
+
+TEST(SmootherTests, benchmark_gain_stage) {
+  constexpr uint64_t kBlocks = 200000;
+  constexpr size_t kFrames = 32;
+  std::array<int32_t, kFrames * 2> block;
+  block.fill(0x100000);
+
+  deloop::Smoother unity(Mode::kLinear, 20.0f, kSampleRate, 1.0f);
+  bench::report("ApplyGain (steady, unity)",
+                bench::measure(kBlocks,
+                               [&]() {
+                                 deloop::ApplyGain(block.data(), kFrames, 2,
+                                                   unity);
+                               }),
+                "block");
+
+  deloop::Smoother steady(Mode::kLinear, 20.0f, kSampleRate, 0.5f);
+  bench::report("ApplyGain (steady)",
+                bench::measure(kBlocks,
+                               [&]() {
+                                 block.fill(0x100000);
+                                 deloop::ApplyGain(block.data(), kFrames, 2,
+                                                   steady);
+                               }),
+                "block");
+
+  // Retargeting every block keeps both smoothers ramping.
+  for (Mode mode : {Mode::kLinear, Mode::kOnePole}) {
+    deloop::Smoother ramping(mode, 20.0f, kSampleRate, 0.0f);
+    float target = 1.0f;
+    double cost = bench::measure(kBlocks, [&]() {
+      block.fill(0x100000);
+      target = 1.0f - target;
+      ramping.setTarget(target);
+      deloop::ApplyGain(block.data(), kFrames, 2, ramping);
+    });
+    bench::report(mode == Mode::kLinear ? "ApplyGain (linear ramp)"
+                                        : "ApplyGain (one-pole ramp)",
+                  cost, "block");
+  }
+}
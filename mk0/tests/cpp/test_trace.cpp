@@ -0,0 +1,157 @@
+#include <array>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "trace.hpp"
+
+namespace {
+
+uint32_t fake_cycles = 0;
+
+uint32_t fakeClock(void) { return fake_cycles; }
+
+void drainTraceEvents() {
+  deloop::TraceEvent event;
+  while (deloop::TakeTraceEvent(event)) {
+  }
+}
+
+class TraceTests : public ::testing::Test {
+protected:
+  void SetUp() override {
+    fake_cycles = 0;
+    deloop::SetTraceClock(fakeClock, 1000);
+    deloop::SetTraceEnabled(true);
+    drainTraceEvents();
+  }
+
+  void TearDown() override { deloop::SetTraceEnabled(false); }
+};
+
+// Must match `tests/python/test_trace.py`.
+const std::vector<uint8_t> kGoldenBatch = {
+    0xE8, 0x07,             // Clock frequency: 1000
+    0x64,                   // Base timestamp: 100
+    0x04,                   // Begin, audio track
+    0x03, 0x00, 0x00, 0x00, // Name ID
+    0x00,                   // Delta: 0
+    0x0B,                   // Counter, stream track
+    0x03, 0x00, 0x00, 0x00, // Name ID
+    0x13,                   // Delta: -10
+    0x03,                   // Value: -2
+    0x05,                   // End, audio track
+    0x03, 0x00, 0x00, 0x00, // Name ID
+    0x28,                   // Delta: +20
+};
+
+} // namespace
+
+TEST_F(TraceTests, DisabledRecordsNothing) {
+  deloop::SetTraceEnabled(false);
+  DELOOP_TRACE_INSTANT(deloop::TraceTrack::kAudio, "disabled_instant");
+  { DELOOP_TRACE_SCOPE(deloop::TraceTrack::kAudio, "disabled_scope"); }
+
+  EXPECT_FALSE(deloop::TraceEventsPending());
+}
+
+TEST_F(TraceTests, EventsAreStampedByTraceClock) {
+  fake_cycles = 1234;
+  DELOOP_TRACE_COUNTER(deloop::TraceTrack::kStream, "queue_depth", -7);
+
+  deloop::TraceEvent event;
+  ASSERT_TRUE(deloop::TakeTraceEvent(event));
+  EXPECT_EQ(event.timestamp, 1234);
+  EXPECT_EQ(event.type, deloop::TraceEventType::kCounter);
+  EXPECT_EQ(event.track, deloop::TraceTrack::kStream);
+  EXPECT_EQ(event.id, deloop::LogSiteId(FNV1A_64("queue_depth")));
+  EXPECT_EQ(event.value, -7);
+  EXPECT_FALSE(deloop::TakeTraceEvent(event));
+}
+
+TEST_F(TraceTests, ScopeRecordsBeginAndEnd) {
+  {
+    fake_cycles = 10;
+    DELOOP_TRACE_SCOPE(deloop::TraceTrack::kCommand, "scope");
+    fake_cycles = 25;
+  }
+
+  deloop::TraceEvent begin;
+  deloop::TraceEvent end;
+  ASSERT_TRUE(deloop::TakeTraceEvent(begin));
+  ASSERT_TRUE(deloop::TakeTraceEvent(end));
+  EXPECT_EQ(begin.type, deloop::TraceEventType::kBegin);
+  EXPECT_EQ(begin.timestamp, 10);
+  EXPECT_EQ(end.type, deloop::TraceEventType::kEnd);
+  EXPECT_EQ(end.timestamp, 25);
+  EXPECT_EQ(begin.id, end.id);
+  EXPECT_EQ(begin.track, deloop::TraceTrack::kCommand);
+}
+
+TEST_F(TraceTests, FullRingCountsOverflows) {
+  uint32_t overflows = deloop::GetTraceOverflows();
+  for (int i = 0; i < 200; i++) {
+    DELOOP_TRACE_INSTANT(deloop::TraceTrack::kAudioDma, "flood");
+  }
+
+  EXPECT_GT(deloop::GetTraceOverflows(), overflows);
+  drainTraceEvents();
+}
+
+TEST_F(TraceTests, EncodeGoldenBatch) {
+  std::array<uint8_t, 64> buffer;
+  deloop::TraceBatchEncoder encoder;
+  encoder.init(buffer.data(), buffer.size());
+
+  const deloop::TraceEvent events[] = {
+      {100, 3, 0, deloop::TraceEventType::kBegin, deloop::TraceTrack::kAudio},
+      {90, 3, -2, deloop::TraceEventType::kCounter,
+       deloop::TraceTrack::kStream},
+      {110, 3, 0, deloop::TraceEventType::kEnd, deloop::TraceTrack::kAudio},
+  };
+  for (const deloop::TraceEvent &event : events) {
+    ASSERT_TRUE(encoder.append(event));
+  }
+
+  EXPECT_EQ(encoder.count(), 3);
+  EXPECT_EQ(std::vector<uint8_t>(encoder.data(),
+                                 encoder.data() + encoder.size()),
+            kGoldenBatch);
+}
+
+TEST_F(TraceTests, HasRoomGuaranteesAppend) {
+  std::array<uint8_t, 48> buffer;
+  deloop::TraceBatchEncoder encoder;
+  encoder.init(buffer.data(), buffer.size());
+
+  // Worst case: large timestamps and counter values.
+  deloop::TraceEvent event = {0xFFFFFFFF, 0xFFFFFFFF, INT32_MIN,
+                              deloop::TraceEventType::kCounter,
+                              deloop::TraceTrack::kCommand};
+  uint32_t appended = 0;
+  while (encoder.hasRoom()) {
+    ASSERT_TRUE(encoder.append(event));
+    event.timestamp ^= 0x80000000;
+    appended++;
+  }
+
+  EXPECT_EQ(appended, encoder.count());
+  EXPECT_GT(appended, 0);
+  EXPECT_LE(encoder.size(), buffer.size());
+}
+
+TEST_F(TraceTests, ResetStartsNewBatch) {
+  std::array<uint8_t, 64> buffer;
+  deloop::TraceBatchEncoder encoder;
+  encoder.init(buffer.data(), buffer.size());
+
+  deloop::TraceEvent event = {500, 1, 0, deloop::TraceEventType::kInstant,
+                              deloop::TraceTrack::kAudioDma};
+  ASSERT_TRUE(encoder.append(event));
+  size_t first_size = encoder.size();
+
+  encoder.reset();
+  EXPECT_TRUE(encoder.empty());
+  ASSERT_TRUE(encoder.append(event));
+  EXPECT_EQ(encoder.size(), first_size);
+}
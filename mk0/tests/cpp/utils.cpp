@@ -3,6 +3,7 @@
 #include "logging.hpp"
 
 void deloop::SubmitLog(deloop::LogLevel level, const uint64_t hash,
-                       const std::array<LogArg, 4> &args, bool blocking) {
+                       const std::array<LogArg, 4> &args,
+                       uint32_t suppressed) {
   std::cout << "RECEIVED" << std::endl;
 }
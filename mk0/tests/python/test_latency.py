@@ -0,0 +1,75 @@
+import sys
+import unittest
+from pathlib import Path
+
+sys.path.append(str(Path(__file__).parent.parent.parent / "python"))
+from deloop_mk0 import latency  # noqa: E402
+
+
+class TestLatency(unittest.TestCase):
+
+    def test_stages(self):
+        # 1 MHz device clock, so stamps are in microseconds.
+        sample = latency.from_response(
+            end_to_end=0.010,
+            received_at=1000,
+            dispatched_at=1500,
+            completed_at=3500,
+            sent_at=4000,
+            clock_hz=1_000_000,
+        )
+        self.assertAlmostEqual(sample.queue, 0.0005)
+        self.assertAlmostEqual(sample.handler, 0.002)
+        self.assertAlmostEqual(sample.response, 0.0005)
+        self.assertAlmostEqual(sample.link, 0.007)
+        self.assertAlmostEqual(sample.end_to_end, 0.010)
+
+    def test_clock_wraparound(self):
+        sample = latency.from_response(
+            end_to_end=0.001,
+            received_at=0xFFFFFF00,
+            dispatched_at=0x00000100,
+            completed_at=0x00000100,
+            sent_at=0x00000100,
+            clock_hz=1_000_000,
+        )
+        self.assertAlmostEqual(sample.queue, 512e-6)
+
+    def test_no_device_clock(self):
+        self.assertIsNone(latency.from_response(0.001, 0, 0, 0, 0, 0))
+
+    def test_percentile(self):
+        values = list(range(1, 101))
+        self.assertEqual(latency.percentile(values, 50), 50)
+        self.assertEqual(latency.percentile(values, 99), 99)
+        self.assertEqual(latency.percentile(values, 100), 100)
+        self.assertEqual(latency.percentile([7], 90), 7)
+
+        with self.assertRaises(ValueError):
+            latency.percentile([], 50)
+
+    def test_summary(self):
+        stats = latency.LatencyStats(max_samples=10)
+        self.assertEqual(stats.summary(), [])
+
+        for i in range(1, 21):
+            stats.add(latency.CommandLatency(
+                end_to_end=i * 1e-3,
+                link=0.0,
+                queue=0.0,
+                handler=i * 1e-3,
+                response=0.0,
+            ))
+
+        # Only the latest 10 samples (11..20 ms) are kept.
+        rows = {row[0]: row[1:] for row in stats.summary()}
+        self.assertEqual(list(rows), list(latency.STAGES))
+        p50, p90, p99, max_ = rows["handler"]
+        self.assertAlmostEqual(p50, 15.0)
+        self.assertAlmostEqual(p90, 19.0)
+        self.assertAlmostEqual(p99, 20.0)
+        self.assertAlmostEqual(max_, 20.0)
+
+
+if __name__ == '__main__':
+    unittest.main()
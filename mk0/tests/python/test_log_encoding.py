@@ -0,0 +1,65 @@
+import struct
+import sys
+import unittest
+from pathlib import Path
+
+sys.path.append(str(Path(__file__).parent.parent.parent / "python"))
+from deloop_mk0 import log_encoding  # noqa: E402
+
+# Must match `tests/cpp/test_log_encoding.cpp`.
+GOLDEN_BATCH = bytes([
+    0xE8, 0x07,
+    0x04, 0x03, 0x00, 0x00, 0x00, 0x00, 0x01, 0x05,
+    0x2A, 0x03, 0x00, 0x00, 0x00, 0x14, 0x0E, 0x03,
+    0x00, 0x00, 0x80, 0x3F, 0x03,
+])
+
+
+class TestLogEncoding(unittest.TestCase):
+
+    def test_site_id(self):
+        self.assertEqual(log_encoding.site_id(0x0000000100000002), 3)
+        self.assertEqual(
+            log_encoding.site_id(0xFFFFFFFFFFFFFFFF), 0x00000000)
+
+    def test_decode_golden_batch(self):
+        records = log_encoding.decode_log_batch(GOLDEN_BATCH)
+        self.assertEqual(len(records), 2)
+
+        self.assertEqual(records[0].level, "INFO")
+        self.assertEqual(records[0].site_id, 3)
+        self.assertEqual(records[0].timestamp, 1000)
+        self.assertEqual(records[0].args, [5])
+        self.assertEqual(records[0].suppressed, 0)
+
+        self.assertEqual(records[1].level, "ERROR")
+        self.assertEqual(records[1].site_id, 3)
+        self.assertEqual(records[1].timestamp, 1010)
+        self.assertEqual(records[1].args, [-2, 1.0])
+        self.assertEqual(records[1].suppressed, 3)
+
+    def test_decode_negative_delta(self):
+        batch = bytes([
+            0x05,
+            0x00, 0x03, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x03, 0x00, 0x00, 0x00, 0x01,
+        ])
+        records = log_encoding.decode_log_batch(batch)
+        self.assertEqual([r.timestamp for r in records], [5, 4])
+
+    def test_decode_float_arg(self):
+        batch = bytes([0x00, 0x04, 0x03, 0x00, 0x00, 0x00, 0x00, 0x03])
+        batch += struct.pack("<f", 0.5)
+        records = log_encoding.decode_log_batch(batch)
+        self.assertEqual(records[0].args, [0.5])
+
+    def test_decode_empty_batch(self):
+        self.assertEqual(log_encoding.decode_log_batch(b""), [])
+
+    def test_decode_truncated_batch(self):
+        with self.assertRaises(ValueError):
+            log_encoding.decode_log_batch(GOLDEN_BATCH[:-1])
+
+
+if __name__ == "__main__":
+    unittest.main()
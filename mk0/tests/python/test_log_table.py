@@ -1,111 +1,241 @@
 import json
+import struct
 import sys
 import tempfile
 import unittest
 from pathlib import Path
 from unittest import mock
-from unittest.mock import mock_open, patch
+from unittest.mock import patch
 
 sys.path.append(str(Path(__file__).parent.parent.parent / "scripts"))
 import create_log_table  # noqa: E402
 
 
+def make_log_site(
+    msg: str,
+    level: int = 0,
+    module: int = 0,
+    arg_types: list[int] | None = None,
+    file: str = "src/main.cpp",
+    line: int = 1,
+    hash: int | None = None,
+    magic: int = create_log_table.LOG_SITE_MAGIC,
+) -> bytes:
+    """Packs a descriptor laid out like `deloop::LogSite`."""
+    arg_types = arg_types or []
+    mask = 0
+    for i, arg_type in enumerate(arg_types):
+        mask |= arg_type << (2 * i)
+
+    if hash is None:
+        hash = create_log_table.fnv1a_64(msg)
+
+    site = struct.pack(
+        "<IIQBBBB",
+        magic,
+        line,
+        hash,
+        level,
+        module,
+        len(arg_types),
+        mask,
+    )
+    site += msg.encode("utf-8") + b"\0" + file.encode("utf-8") + b"\0"
+
+    # Pad to the alignment of the next descriptor.
+    return site + b"\0" * (-len(site) % 8)
+
+
+def make_elf(sections: dict[str, bytes], is_64: bool = False) -> bytes:
+    """Builds a minimal little-endian ELF holding only `sections`."""
+    names = [""] + list(sections) + [".shstrtab"]
+    contents = [b""] + list(sections.values())
+
+    shstrtab = b""
+    name_offsets = []
+    for name in names:
+        name_offsets.append(len(shstrtab))
+        shstrtab += name.encode("utf-8") + b"\0"
+    contents.append(shstrtab)
+
+    header_size = 0x40 if is_64 else 0x34
+    data = b""
+    data_offsets = []
+    for content in contents:
+        data_offsets.append(header_size + len(data))
+        data += content
+    shoff = header_size + len(data)
+
+    if is_64:
+        shentsize = 0x40
+        header = b"\x7fELF" + bytes([2, 1, 1]) + b"\0" * 9
+        header += struct.pack("<HHIQQQIHHHHHH", 2, 62, 1, 0, 0, shoff, 0,
+                              header_size, 0, 0, shentsize, len(names),
+                              len(names) - 1)
+        section_fmt = "<IIQQQQIIQQ"
+    else:
+        shentsize = 0x28
+        header = b"\x7fELF" + bytes([1, 1, 1]) + b"\0" * 9
+        header += struct.pack("<HHIIIIIHHHHHH", 2, 40, 1, 0, 0, shoff, 0,
+                              header_size, 0, 0, shentsize, len(names),
+                              len(names) - 1)
+        section_fmt = "<IIIIIIIIII"
+
+    section_headers = b""
+    for i, content in enumerate(contents):
+        type_ = 0 if i == 0 else (3 if i == len(contents) - 1 else 1)
+        section_headers += struct.pack(section_fmt, name_offsets[i], type_,
+                                       0, 0, data_offsets[i], len(content),
+                                       0, 0, 1, 0)
+
+    return header + data + section_headers
+
+
 class TestCreateLogTable(unittest.TestCase):
 
-    @patch("builtins.open", new_callable=mock_open, read_data="")
-    def test_no_macros_provided(self, mock_file):
-        args = mock.Mock()
-        args.macro = []
-        args.source_files = ["dummy.c"]
-        args.output = "output.json"
-
-        with patch("builtins.print") as mock_print:
-            create_log_table.main(args)
-            mock_print.assert_called_with("No macros provided.")
-
-    @patch("builtins.open", new_callable=mock_open, read_data="")
-    def test_no_source_files_provided(self, mock_file):
-        args = mock.Mock()
-        args.macro = ["DELOOP_LOG"]
-        args.source_files = []
-        args.output = "output.json"
-
-        with patch("builtins.print") as mock_print:
-            create_log_table.main(args)
-            mock_print.assert_called_with("No source files provided.")
-
-    def test_basic(self):
-        self._test_log_parsing_and_output(
-            content="""
-            #include <stdio.h>
-            #define DELOOP_LOG(MSG, ...) printf(MSG, __VA_ARGS__)
-            DELOOP_LOG("Log message here");
-            """,
-            macros=["DELOOP_LOG"],
-            expected_logs=["Log message here"],
+    def test_single_site(self):
+        elf = make_elf({
+            ".deloop_log_sites": make_log_site(
+                "Failed to start recording: %d",
+                level=2,
+                module=4,
+                arg_types=[2],
+                file="src/drv/wm8960_stm32f4.cpp",
+                line=42,
+            ),
+        })
+
+        sites = create_log_table.extract_log_sites(elf)
+        self.assertEqual(len(sites), 1)
+        self.assertEqual(sites[0].msg, "Failed to start recording: %d")
+        self.assertEqual(
+            sites[0].hash,
+            create_log_table.fnv1a_64("Failed to start recording: %d"),
         )
+        self.assertEqual(sites[0].level, "ERROR")
+        self.assertEqual(sites[0].module, 4)
+        self.assertEqual(sites[0].arg_types, ["i32"])
+        self.assertEqual(sites[0].file, "src/drv/wm8960_stm32f4.cpp")
+        self.assertEqual(sites[0].line, 42)
 
     def test_many_args(self):
-        self._test_log_parsing_and_output(
-            content="""
-            DELOOP_LOG(
-                "Log message %d with %s!",
-                42,  12 + 6,
-                10233213 + 9);
-            """,
-            macros=["DELOOP_LOG"],
-            expected_logs=["Log message %d with %s!"],
+        elf = make_elf({
+            ".deloop_log_sites": make_log_site(
+                "Log message %d with %u and %f!",
+                arg_types=[2, 1, 3],
+            ),
+        })
+
+        sites = create_log_table.extract_log_sites(elf)
+        self.assertEqual(sites[0].arg_types, ["i32", "u32", "f32"])
+
+    def test_packed_sites_with_padding(self):
+        # Host toolchains over-align descriptors; padding must be skipped.
+        section = make_log_site("First") + b"\0" * 16
+        section += make_log_site("Second", level=1)
+        elf = make_elf({".deloop_log_sites": section}, is_64=True)
+
+        sites = create_log_table.extract_log_sites(elf)
+        self.assertEqual([s.msg for s in sites], ["First", "Second"])
+        self.assertEqual(sites[1].level, "WARNING")
+
+    def test_unlinked_input_sections(self):
+        # Without the firmware linker script, each site keeps its own section.
+        elf = make_elf({
+            ".deloop_log_sites.0": make_log_site("Log message here"),
+            ".text": b"\x01\x02\x03\x04",
+            ".deloop_log_sites.1": make_log_site("Another log message"),
+        })
+
+        sites = create_log_table.extract_log_sites(elf)
+        self.assertEqual(
+            [s.msg for s in sites],
+            ["Log message here", "Another log message"],
         )
 
-    def test_multiple_macros(self):
-        self._test_log_parsing_and_output(
-            content="""
-            #define DELOOP_LOG(MSG, ...) printf(MSG, __VA_ARGS__)
-            #define OTHER_LOG(MSG, ...) printf(MSG, __VA_ARGS__)
-            DELOOP_LOG("Log message here");
-            OTHER_LOG("Another log message here");
-            """,
-            macros=["DELOOP_LOG", "OTHER_LOG"],
-            expected_logs=["Log message here", "Another log message here"],
-        )
+    def test_trace_sites(self):
+        elf = make_elf({
+            ".deloop_log_sites.0": make_log_site("Log message"),
+            ".deloop_log_sites.1": make_log_site(
+                "audio_block", magic=create_log_table.TRACE_SITE_MAGIC),
+        })
+
+        sites = create_log_table.extract_log_sites(elf)
+        self.assertEqual([s.kind for s in sites], ["log", "trace"])
+        self.assertEqual(sites[1].msg, "audio_block")
+
+    def test_metric_sites(self):
+        elf = make_elf({
+            ".deloop_log_sites.0": make_log_site(
+                "audio_stream.block_cycles",
+                level=2,
+                module=2,
+                arg_types=[1, 1],  # Unit shift of 5.
+                magic=create_log_table.METRIC_SITE_MAGIC,
+            ),
+        })
+
+        sites = create_log_table.extract_log_sites(elf)
+        self.assertEqual(sites[0].kind, "metric")
+        self.assertEqual(sites[0].msg, "audio_stream.block_cycles")
+        self.assertEqual(sites[0].metric_type, "histogram")
+        self.assertEqual(sites[0].unit_shift, 5)
+        self.assertEqual(sites[0].module, 2)
+
+    def test_param_sites(self):
+        elf = make_elf({
+            ".deloop_log_sites.0": make_log_site(
+                "sine.level", magic=create_log_table.PARAM_SITE_MAGIC),
+        })
+
+        sites = create_log_table.extract_log_sites(elf)
+        self.assertEqual(sites[0].kind, "param")
+        self.assertEqual(sites[0].msg, "sine.level")
+
+    def test_hash_mismatch(self):
+        elf = make_elf({
+            ".deloop_log_sites": make_log_site("Log message", hash=1),
+        })
+
+        with self.assertRaises(ValueError):
+            create_log_table.extract_log_sites(elf)
+
+    def test_not_an_elf(self):
+        with self.assertRaises(ValueError):
+            create_log_table.extract_log_sites(b"not an elf")
+
+    def test_table_merges_latest(self):
+        elf = make_elf({
+            ".deloop_log_sites": make_log_site("Log message here"),
+        })
+        old_hash = str(create_log_table.fnv1a_64("Removed message"))
+        latest = {old_hash: {"msg": "Removed message",
+                             "latest_version": "0.1.0"}}
+
+        with tempfile.TemporaryDirectory() as tmp:
+            tmp = Path(tmp)
+            (tmp / "fw.elf").write_bytes(elf)
+            (tmp / "latest.json").write_text(json.dumps(latest))
 
-    def _test_log_parsing_and_output(
-        self,
-        content: str,
-        macros: list[str],
-        expected_logs: list[str],
-    ) -> None:
-        with tempfile.NamedTemporaryFile(
-            mode="w",
-            suffix=".c",
-            delete=False,
-        ) as tmp:
-            tmp.write(content)
-            tmp_path = tmp.name
-
-        with tempfile.NamedTemporaryFile(
-            mode="r+",
-            suffix=".json",
-            delete=False,
-        ) as output_tmp:
             args = mock.Mock()
-            args.macro = macros
-            args.source_files = [tmp_path]
+            args.elf = str(tmp / "fw.elf")
+            args.latest = str(tmp / "latest.json")
+            args.output = str(tmp / "table.json")
             args.source_version = "1.0.0"
-            args.output = output_tmp.name
-            args.latest = None
 
             with patch("builtins.print") as mock_print:
                 create_log_table.main(args)
                 mock_print.assert_any_call(
-                    f"Wrote {len(expected_logs)} log "
-                    f"calls to {output_tmp.name}"
+                    f"Wrote 2 log calls to {args.output}"
                 )
 
-            result = json.load(output_tmp)
-            for k, v in result.items():
-                self.assertIn(v["msg"], expected_logs)
-                self.assertEqual(int(k), create_log_table.fnv1a_64(v["msg"]))
+            result = json.loads((tmp / "table.json").read_text())
+
+        self.assertEqual(result[old_hash]["latest_version"], "0.1.0")
+        new_hash = str(create_log_table.fnv1a_64("Log message here"))
+        self.assertEqual(result[new_hash]["msg"], "Log message here")
+        self.assertEqual(result[new_hash]["latest_version"], "1.0.0")
+        self.assertEqual(result[new_hash]["location"], "src/main.cpp:1")
 
 
 if __name__ == '__main__':
@@ -0,0 +1,67 @@
+import sys
+import unittest
+from pathlib import Path
+
+sys.path.append(str(Path(__file__).parent.parent.parent / "python"))
+from deloop_mk0 import metrics  # noqa: E402
+
+# Hashes 3, 5 and 9 fold to site IDs 3, 5 and 9.
+LOG_TABLE = {
+    "3": {"msg": "uart_stream.tx_bytes", "kind": "metric",
+          "type": "counter", "unit_shift": 0},
+    "5": {"msg": "audio_stream.block_cycles", "kind": "metric",
+          "type": "histogram", "unit_shift": 4},
+    "7": {"msg": "Log message", "level": "INFO", "args": []},
+    "9": {"msg": "meter.rx.left.peak_cb", "kind": "metric",
+          "type": "gauge", "unit_shift": 0},
+}
+
+
+class TestMetrics(unittest.TestCase):
+
+    def test_bucket_labels(self):
+        self.assertEqual(
+            metrics.bucket_labels(4),
+            ["[0, 16)", "[16, 32)", "[32, 64)", "[64, 128)", "[128, 256)",
+             "[256, 512)", "[512, 1024)", "[1024, inf)"],
+        )
+
+    def test_names_from_log_table(self):
+        store = metrics.MetricStore(LOG_TABLE)
+        metric = store.update(3, metrics.COUNTER, 42, tick=100)
+        self.assertEqual(metric.name, "uart_stream.tx_bytes")
+        self.assertEqual(metric.value, 42)
+        self.assertEqual(metric.tick, 100)
+
+        self.assertEqual(
+            store.update(7, metrics.GAUGE, -1).name, "unknown_00000007")
+
+    def test_updates_replace_values(self):
+        store = metrics.MetricStore(LOG_TABLE)
+        store.update(3, metrics.COUNTER, 1)
+        store.update(3, metrics.COUNTER, 5)
+        self.assertEqual(store.rows(),
+                         [("uart_stream.tx_bytes", "counter", "5")])
+
+    def test_histogram_buckets(self):
+        store = metrics.MetricStore(LOG_TABLE)
+        store.update(5, metrics.HISTOGRAM, 10, bucket=0)
+        store.update(5, metrics.HISTOGRAM, 2, bucket=7)
+        metric = store.update(5, metrics.HISTOGRAM, 3, bucket=0)
+
+        self.assertEqual(metric.buckets, [3, 0, 0, 0, 0, 0, 0, 2])
+        self.assertEqual(metric.format(), "[0, 16): 3, [1024, inf): 2")
+
+        with self.assertRaises(ValueError):
+            store.update(5, metrics.HISTOGRAM, 1, bucket=8)
+
+    def test_centibel_gauges_in_db(self):
+        store = metrics.MetricStore(LOG_TABLE)
+        self.assertEqual(store.update(9, metrics.GAUGE, -125).format(),
+                         "-12.5 dB")
+        self.assertEqual(store.update(9, metrics.GAUGE, 0).format(),
+                         "0.0 dB")
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,91 @@
+import io
+import struct
+import sys
+import unittest
+from pathlib import Path
+
+sys.path.append(str(Path(__file__).parent.parent.parent / "python"))
+from deloop_mk0 import trace  # noqa: E402
+
+# Must match `tests/cpp/test_trace.cpp`.
+GOLDEN_BATCH = bytes([
+    0xE8, 0x07, 0x64,
+    0x04, 0x03, 0x00, 0x00, 0x00, 0x00,
+    0x0B, 0x03, 0x00, 0x00, 0x00, 0x13, 0x03,
+    0x05, 0x03, 0x00, 0x00, 0x00, 0x28,
+])
+
+
+def make_event(event_type: int, track: int, id: int, delta: int) -> bytes:
+    return bytes([event_type | (track << 2)]) + struct.pack(
+        "<I", id) + bytes([delta])
+
+
+class TestTrace(unittest.TestCase):
+
+    def test_decode_golden_batch(self):
+        batch = trace.decode_trace_batch(GOLDEN_BATCH)
+        self.assertEqual(batch.frequency, 1000)
+        self.assertEqual(
+            [(e.type, e.track, e.id, e.timestamp, e.value)
+             for e in batch.events],
+            [
+                (trace.BEGIN, 1, 3, 100, 0),
+                (trace.COUNTER, 2, 3, 90, -2),
+                (trace.END, 1, 3, 110, 0),
+            ],
+        )
+
+    def test_truncated_batch(self):
+        with self.assertRaises(ValueError):
+            trace.decode_trace_batch(GOLDEN_BATCH[:-3])
+
+    def test_read_capture(self):
+        capture = io.BytesIO(bytes([len(GOLDEN_BATCH)]) + GOLDEN_BATCH
+                             + bytes([len(GOLDEN_BATCH)]) + GOLDEN_BATCH)
+        batches = trace.read_capture(capture)
+        self.assertEqual(len(batches), 2)
+        self.assertEqual(len(batches[1].events), 3)
+
+        with self.assertRaises(ValueError):
+            trace.read_capture(io.BytesIO(bytes([10, 0x01])))
+
+    def test_chrome_trace(self):
+        # Hash 3 folds to site ID 3.
+        log_table = {"3": {"msg": "audio_block", "kind": "trace"}}
+        result = trace.to_chrome_trace(
+            [trace.decode_trace_batch(GOLDEN_BATCH)], log_table)
+
+        events = [e for e in result["traceEvents"] if e["ph"] != "M"]
+        self.assertEqual([e["ph"] for e in events], ["B", "C", "E"])
+        self.assertEqual(
+            [e["name"] for e in events], ["audio_block"] * 3)
+        self.assertEqual([e["tid"] for e in events], [1, 2, 1])
+        # 1000 Hz clock, relative to the first event.
+        self.assertEqual([e["ts"] for e in events], [0, -10000, 10000])
+        self.assertEqual(events[1]["args"], {"audio_block": -2})
+
+        names = [e["args"]["name"] for e in result["traceEvents"]
+                 if e["ph"] == "M"]
+        self.assertEqual(names, list(trace.TRACKS))
+
+    def test_unknown_name(self):
+        result = trace.to_chrome_trace(
+            [trace.decode_trace_batch(GOLDEN_BATCH)], {})
+        self.assertEqual(result["traceEvents"][-1]["name"], "unknown_00000003")
+
+    def test_timestamp_wraparound(self):
+        # Base timestamp 0xFFFFFFF0, then +0x20 across the wrap.
+        batch = bytes([0x01, 0xF0, 0xFF, 0xFF, 0xFF, 0x0F])
+        batch += make_event(trace.INSTANT, 0, 3, 0x00)
+        batch += make_event(trace.INSTANT, 0, 3, 0x40)
+        result = trace.to_chrome_trace(
+            [trace.decode_trace_batch(batch)], {})
+
+        events = [e for e in result["traceEvents"] if e["ph"] != "M"]
+        self.assertEqual(events[0]["ts"], 0)
+        self.assertEqual(events[1]["ts"], 32 * 1e6)
+
+
+if __name__ == '__main__':
+    unittest.main()